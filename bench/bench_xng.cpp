@@ -0,0 +1,187 @@
+#include "xng/xng.h"
+#include "xng/common/xng_inflate.h"
+#include "xng/common/xng_pool.h"
+#include "xng/png/xng_png.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//! reads a PNG file, without its signature. empty on error
+std::vector<uint8_t> read_file(const char* path)
+{
+	std::shared_ptr<FILE> file(fopen(path, "rb"), fclose);
+	if (!file || fseek(file.get(), 0, SEEK_END) != 0)
+	{
+		return {};
+	}
+
+	const long size = ftell(file.get());
+	if (size <= 8 || fseek(file.get(), 8, SEEK_SET) != 0)
+	{
+		return {};
+	}
+	std::vector<uint8_t> filedata(size_t(size) - 8);
+	if (fread(filedata.data(), 1, filedata.size(), file.get()) != filedata.size())
+	{
+		return {};
+	}
+	return filedata;
+}
+
+//! seconds for running f repeatedly, at least minSeconds in total. runs receives the number of runs
+template <typename Function>
+double measure(Function f, double minSeconds, uint32_t* runs)
+{
+	using clock		 = std::chrono::steady_clock;
+	const auto start = clock::now();
+	double	   seconds;
+	*runs = 0;
+	do
+	{
+		f();
+		++*runs;
+		seconds = std::chrono::duration<double>(clock::now() - start).count();
+	} while (seconds < minSeconds);
+	return seconds;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! batch decoding: files/s of png::decode_many against the thread count of the pool
+
+void bench_batch(const std::vector<std::vector<uint8_t>>& files)
+{
+	std::vector<xng::common::ByteSpan> spans;
+	for (auto& file : files)
+	{
+		spans.push_back({file.data(), file.size()});
+	}
+
+	// powers of two up to one thread per hardware thread
+	const uint32_t		  maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<uint32_t> threadCounts;
+	for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	printf("batch decoding, %zu files\n", spans.size());
+	printf("\tthreads\tfiles/s\tspeedup\n");
+
+	xng::png::ScratchCache scratchCache;	// reused by the runs, they measure the decoding of warm buffers
+	xng::png::BatchOptions options;
+	double				   baseline = 0.0;
+	options.scratchCache			= &scratchCache;
+	for (uint32_t threads : threadCounts)
+	{
+		xng::common::ThreadPool				 pool(threads);
+		std::vector<xng::png::BatchResult> results;
+		bool								 isValid = true;
+
+		uint32_t	 runs;
+		const double seconds = measure([&] { isValid &= xng::png::decode_many(spans, options, &pool, &results) == 0; }, 1.0, &runs);
+		const double filesPerSecond = double(spans.size()) * runs / seconds;
+		baseline					= threads == 1 ? filesPerSecond : baseline;
+		printf("\t%u\t%.0f\t%.2f%s\n", threads, filesPerSecond, filesPerSecond / baseline, isValid ? "" : "\t(errors)");
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! inflate: MB/s of image data (IDAT) inflated by the built-in one-shot inflate, which fills the
+//! exact-size buffer in place, and by the streaming backends
+
+void bench_inflate(const std::vector<std::vector<uint8_t>>& files)
+{
+	std::vector<std::vector<uint8_t>> streams;
+	std::vector<std::vector<uint8_t>> outputs;
+	size_t							  outputSize = 0;
+	for (auto& file : files)
+	{
+		std::vector<uint8_t> stream;
+		for (auto& chunk : xng::read_chunks(file.data(), file.size()))
+		{
+			if (memcmp(chunk.id.type, "IDAT", sizeof(chunk.id.type)) == 0)
+			{
+				stream.insert(stream.end(), chunk.data.begin(), chunk.data.end());
+			}
+		}
+
+		std::vector<uint8_t> output = xng::common::inflate(stream, nullptr, nullptr);
+		if (!output.empty())
+		{
+			outputSize += output.size();
+			streams.push_back(std::move(stream));
+			outputs.push_back(std::move(output));
+		}
+	}
+
+	printf("inflate, %zu streams, %.1f MB\n", streams.size(), outputSize / 1e6);
+	printf("\tbackend\tMB/s\n");
+
+	auto report = [outputSize](const char* name, double seconds, uint32_t runs, bool isValid) {
+		printf("\t%s\t%.1f%s\n", name, outputSize * runs / seconds / 1e6, isValid ? "" : "\t(errors)");
+	};
+
+	uint32_t runs;
+	bool	 isValid = true;
+	double	 seconds = measure(
+		  [&] {
+			  for (size_t i = 0; i < streams.size(); ++i)
+			  {
+				  isValid &= xng::common::inflate(streams[i], xng::common::builtin_inflate, nullptr, &outputs[i]) == 0;
+			  }
+		  },
+		  1.0, &runs);
+	report("built-in, one-shot", seconds, runs, isValid);
+
+	auto bench_stream = [&](const char* name, const xng::common::inflatestream_t* backend) {
+		xng::common::InflateStream stream;
+		isValid = true;
+		seconds = measure(
+		  [&] {
+			  for (size_t i = 0; i < streams.size(); ++i)
+			  {
+				  isValid &= stream.reset(backend, nullptr) == 0 && stream.feed(streams[i].data(), streams[i].size()) == 0
+							 && stream.read(outputs[i].data(), outputs[i].size());
+			  }
+		  },
+		  1.0, &runs);
+		report(name, seconds, runs, isValid);
+	};
+	bench_stream("built-in, stream", &xng::common::builtin_inflatestream);
+#ifdef XNG_ZLIB
+	bench_stream("zlib, stream", &xng::common::zlib_inflatestream);
+#endif	// XNG_ZLIB
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: %s file.png...\n", argv[0]);
+		return -1;
+	}
+
+	std::vector<std::vector<uint8_t>> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		files.push_back(read_file(argv[i]));
+		if (files.back().empty())
+		{
+			printf("can't read %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	bench_batch(files);
+	bench_inflate(files);
+	return 0;
+}
@@ -1,16 +1,3706 @@
 #include "xng/xng.h"
+#include "xng/common/xng_color.h"
+#include "xng/common/xng_common.h"
+#include "xng/common/xng_inflate.h"
+#include "xng/common/xng_jpeg.h"
+#include "xng/common/xng_lz.h"
+#include "xng/common/xng_pool.h"
+#include "xng/common/xng_stats.h"
+#include "xng/jng/xng_jng.h"
+#include "xng/mng/xng_mng.h"
+#include "xng/optimizer/xng_optimizer.h"
+#include "xng/player/xng_player.h"
+#include "xng/png/xng_png.h"
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
 #include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//-- without arguments, the checks below run on data built in memory and the exit code is the number of
+//-- failed checks. with a file as argument, its chunks are listed instead
+
+int failures = 0;
+
+#define CHECK(condition)                                                        \
+	do                                                                          \
+	{                                                                           \
+		if (!(condition))                                                       \
+		{                                                                       \
+			printf("%s:%i: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++failures;                                                         \
+		}                                                                       \
+	} while (0)
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! test data
+
+void append_uint16(std::vector<uint8_t>* out, uint16_t value)
+{
+	out->push_back(uint8_t(value >> 8));
+	out->push_back(uint8_t(value));
+}
+
+void append_uint32(std::vector<uint8_t>* out, uint32_t value)
+{
+	append_uint16(out, uint16_t(value >> 16));
+	append_uint16(out, uint16_t(value));
+}
+
+uint32_t adler32(const std::vector<uint8_t>& data)
+{
+	uint32_t a = 1, b = 0;
+	for (uint8_t value : data)
+	{
+		a = (a + value) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+//! zlib stream of stored blocks of up to blockSize bytes
+std::vector<uint8_t> zlib_stored(const std::vector<uint8_t>& data, size_t blockSize = 65535)
+{
+	std::vector<uint8_t> out = {0x78, 0x01};
+	size_t				 pos = 0;
+	do
+	{
+		const size_t size = std::min(blockSize, data.size() - pos);
+		out.push_back(pos + size == data.size() ? 1 : 0);
+		out.push_back(uint8_t(size));
+		out.push_back(uint8_t(size >> 8));
+		out.push_back(uint8_t(~size));
+		out.push_back(uint8_t(~size >> 8));
+		out.insert(out.end(), data.begin() + pos, data.begin() + pos + size);
+		pos += size;
+	} while (pos < data.size());
+	append_uint32(&out, adler32(data));
+	return out;
+}
+
+//! LSB first bit writer of deflate streams
+struct BitWriter
+{
+	std::vector<uint8_t>* out;
+	uint32_t			  bits  = 0;
+	uint32_t			  count = 0;
+
+	void write(uint32_t value, uint32_t n)
+	{
+		bits |= value << count;
+		count += n;
+		while (count >= 8)
+		{
+			out->push_back(uint8_t(bits));
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+
+	//! Huffman codes are stored MSB first
+	void write_code(uint32_t code, uint32_t n)
+	{
+		for (uint32_t i = n; i-- > 0;)
+		{
+			write((code >> i) & 1, 1);
+		}
+	}
+
+	void flush()
+	{
+		if (count > 0)
+		{
+			write(0, 8 - count);
+		}
+	}
+};
+
+void write_fixed_literal(BitWriter* writer, uint32_t symbol)
+{
+	if (symbol < 144)
+	{
+		writer->write_code(0x30 + symbol, 8);
+	}
+	else if (symbol < 256)
+	{
+		writer->write_code(0x190 + symbol - 144, 9);
+	}
+	else if (symbol < 280)
+	{
+		writer->write_code(symbol - 256, 7);
+	}
+	else
+	{
+		writer->write_code(0xC0 + symbol - 280, 8);
+	}
+}
+
+//! zlib stream of one block with the fixed Huffman codes, greedy matches of up to 258 bytes within
+//! window bytes back, so lengths and distances of all code ranges occur in long enough data
+std::vector<uint8_t> zlib_fixed(const std::vector<uint8_t>& data, size_t window = 32768)
+{
+	static const uint16_t lengthBase[29]	= {3,  4,  5,  6,  7,  8,  9,  10, 11,	13,	 15,  17,  19,  23, 27,
+											   31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+	static const uint8_t  lengthExtra[29]	= {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	static const uint16_t distanceBase[30]	= {1,	2,	 3,	  4,   5,	7,	  9,	13,	  17,	25,	  33,	49,	  65,	 97,	129,
+											   193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+	static const uint8_t  distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+	std::vector<uint8_t> out = {0x78, 0x01};
+	BitWriter			 writer{&out};
+	writer.write(1, 1);
+	writer.write(1, 2);
+	for (size_t pos = 0; pos < data.size();)
+	{
+		size_t bestLength = 0, bestDistance = 0;
+		for (size_t distance = 1; distance <= std::min(pos, window); ++distance)
+		{
+			size_t length = 0;
+			while (length < 258 && pos + length < data.size() && data[pos + length] == data[pos + length - distance])
+			{
+				++length;
+			}
+			if (length > bestLength)
+			{
+				bestLength	 = length;
+				bestDistance = distance;
+			}
+		}
+		if (bestLength < 3)
+		{
+			write_fixed_literal(&writer, data[pos++]);
+			continue;
+		}
+
+		uint32_t code = 28;
+		while (lengthBase[code] > bestLength)
+		{
+			--code;
+		}
+		write_fixed_literal(&writer, 257 + code);
+		writer.write(uint32_t(bestLength - lengthBase[code]), lengthExtra[code]);
+		code = 29;
+		while (distanceBase[code] > bestDistance)
+		{
+			--code;
+		}
+		writer.write_code(code, 5);
+		writer.write(uint32_t(bestDistance - distanceBase[code]), distanceExtra[code]);
+		pos += bestLength;
+	}
+	write_fixed_literal(&writer, 256);
+	writer.flush();
+	append_uint32(&out, adler32(data));
+	return out;
+}
+
+//! text and its zlib stream with dynamic Huffman codes (zlib level 9)
+std::vector<uint8_t> dynamic_text()
+{
+	std::string text;
+	for (int i = 99; i > 0; i -= 7)
+	{
+		text += std::to_string(i) + " bottles of beer on the wall, " + std::to_string(i) + " bottles of beer. ";
+	}
+	return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+const uint8_t dynamic_text_zlib[] = {
+  0x78, 0xda, 0x85, 0xd2, 0x4b, 0x0a, 0xc4, 0x30, 0x0c, 0x04, 0xd1, 0xab, 0xf4, 0x01, 0x06, 0x11, 0x2b, 0x5f, 0x1f, 0x27,
+  0x01, 0x87, 0x2c, 0x4c, 0x0c, 0x33, 0x86, 0xb9, 0x7e, 0xb2, 0x6f, 0x21, 0xad, 0x8b, 0xb7, 0xab, 0x9c, 0x71, 0xb4, 0xde,
+  0x6b, 0xf9, 0xa1, 0x9d, 0x38, 0x4a, 0xf9, 0xa2, 0xdd, 0xe8, 0x57, 0xc1, 0x7f, 0xaf, 0xf5, 0x83, 0x4c, 0x5d, 0x90, 0x35,
+  0x30, 0xca, 0x66, 0x9b, 0x7d, 0xc3, 0x5d, 0xb0, 0x6e, 0xbe, 0xe1, 0xfe, 0x9a, 0x14, 0x98, 0xc4, 0x66, 0x99, 0x7c, 0xc3,
+  0x5d, 0x30, 0xaf, 0xbe, 0xe1, 0xfe, 0x9a, 0x21, 0x30, 0x03, 0x9b, 0x69, 0xf4, 0x0d, 0x77, 0xc1, 0xb8, 0xf8, 0x86, 0xbb,
+  0x40, 0x83, 0x0f, 0xd4, 0xf8, 0x40, 0x83, 0x0f, 0xd4, 0xf8, 0x20, 0x05, 0x1f, 0x24, 0xe3, 0x83, 0x60, 0x03, 0xe3, 0x82,
+  0x60, 0x02, 0xe3, 0x81, 0x07, 0xf4, 0x65, 0x01, 0xbc};
+
+//! size of the test JPEGs
+const uint32_t jpeg_width  = 24;
+const uint32_t jpeg_height = 16;
+
+//! JPEG by libjpeg of the pixels r = 40 + 7x, g = 30 + 10y, b = 200 - 3x - 4y: quality 95, 4:2:0, a
+//! restart marker after every MCU
+const uint8_t color_jpeg[] = {
+  0xff, 0xd8, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x02, 0x02, 0x02,
+  0x02, 0x02, 0x04, 0x03, 0x02, 0x02, 0x02, 0x02, 0x05, 0x04, 0x04, 0x03, 0x04, 0x06, 0x05, 0x06, 0x06, 0x06, 0x05, 0x06,
+  0x06, 0x06, 0x07, 0x09, 0x08, 0x06, 0x07, 0x09, 0x07, 0x06, 0x06, 0x08, 0x0b, 0x08, 0x09, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+  0x06, 0x08, 0x0b, 0x0c, 0x0b, 0x0a, 0x0c, 0x09, 0x0a, 0x0a, 0x0a, 0xff, 0xdb, 0x00, 0x43, 0x01, 0x02, 0x02, 0x02, 0x02,
+  0x02, 0x02, 0x05, 0x03, 0x03, 0x05, 0x0a, 0x07, 0x06, 0x07, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+  0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+  0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+  0xff, 0xc0, 0x00, 0x11, 0x08, 0x00, 0x10, 0x00, 0x18, 0x03, 0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01, 0xff,
+  0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01,
+  0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05,
+  0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1,
+  0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27,
+  0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54,
+  0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+  0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2,
+  0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+  0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5,
+  0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xc4, 0x00, 0x1f, 0x01,
+  0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03,
+  0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x11, 0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03,
+  0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12,
+  0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52,
+  0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29,
+  0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57,
+  0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82,
+  0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4,
+  0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
+  0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+  0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xdd, 0x00, 0x04, 0x00, 0x01, 0xff, 0xda, 0x00,
+  0x0c, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3f, 0x00, 0xf8, 0xd7, 0xc3, 0xff, 0x00, 0x07, 0x3e, 0xef, 0xfa,
+  0x2f, 0xfe, 0x3b, 0x5d, 0xc7, 0x87, 0xfe, 0x0e, 0x7d, 0xdf, 0xf4, 0x5f, 0xfc, 0x76, 0xbd, 0xd7, 0xc3, 0xff, 0x00, 0x07,
+  0x3e, 0xef, 0xfa, 0x2f, 0xfe, 0x3b, 0x5d, 0xc7, 0x87, 0xfe, 0x0e, 0x7d, 0xdf, 0xf4, 0x5f, 0xfc, 0x76, 0xbf, 0x5d, 0xe3,
+  0x1f, 0x18, 0x7e, 0x2f, 0xde, 0x7e, 0x27, 0xcc, 0x78, 0x77, 0xe2, 0x37, 0xc1, 0xef, 0x9f, 0xff, 0xd0, 0xf2, 0x5f, 0x0f,
+  0xfc, 0x1c, 0xfb, 0xbf, 0xe8, 0xbf, 0xf8, 0xed, 0x15, 0xf5, 0x6f, 0x87, 0xfe, 0x0e, 0x7d, 0xdf, 0xf4, 0x5f, 0xfc, 0x76,
+  0x8a, 0xf8, 0x9c, 0xdb, 0xc6, 0x1f, 0xf6, 0xc7, 0xfb, 0xcf, 0xc4, 0xfe, 0xa7, 0xc8, 0x3c, 0x46, 0xff, 0x00, 0x84, 0xe8,
+  0xfb, 0xe7, 0xff, 0xd9};
+
+//! greyscale JPEG by libjpeg of the pixels 16 + 5x + 3y: quality 95, optimized Huffman codes
+const uint8_t grey_jpeg[] = {
+  0xff, 0xd8, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x02, 0x02, 0x02,
+  0x02, 0x02, 0x04, 0x03, 0x02, 0x02, 0x02, 0x02, 0x05, 0x04, 0x04, 0x03, 0x04, 0x06, 0x05, 0x06, 0x06, 0x06, 0x05, 0x06,
+  0x06, 0x06, 0x07, 0x09, 0x08, 0x06, 0x07, 0x09, 0x07, 0x06, 0x06, 0x08, 0x0b, 0x08, 0x09, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+  0x06, 0x08, 0x0b, 0x0c, 0x0b, 0x0a, 0x0c, 0x09, 0x0a, 0x0a, 0x0a, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x00, 0x10, 0x00, 0x18,
+  0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x15, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x09, 0xff, 0xc4, 0x00, 0x1a, 0x10, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x07, 0x23, 0x33, 0x41, 0x51, 0xff, 0xda, 0x00, 0x08, 0x01,
+  0x01, 0x00, 0x00, 0x3f, 0x00, 0x95, 0xe9, 0x21, 0x22, 0x26, 0x72, 0x82, 0x81, 0x24, 0x24, 0x44, 0xce, 0x50, 0x50, 0x24,
+  0x84, 0x88, 0x99, 0xca, 0x01, 0xf4, 0x90, 0x91, 0x13, 0x39, 0x41, 0x40, 0x92, 0x12, 0x22, 0x67, 0x28, 0x28, 0x12, 0x42,
+  0x44, 0x4c, 0xe5, 0x0f, 0xff, 0xd9};
+
+//! pseudo-random data: noise, runs, or noise with repeats
+std::vector<uint8_t> make_data(std::mt19937* rng, size_t size, int kind)
+{
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		switch (kind)
+		{
+			case 0:
+				data[i] = uint8_t((*rng)());
+				break;
+			case 1:
+				data[i] = uint8_t(i / 7 % 5 + ((*rng)() % 50 == 0));
+				break;
+			default:
+				data[i] = i > 300 && (*rng)() % 4 != 0 ? data[i - 1 - (*rng)() % 300] : uint8_t((*rng)() % 16);
+				break;
+		}
+	}
+	return data;
+}
+
+//! zlib streams of all block types, streams[i] is the compressed inputs[i]
+void make_streams(std::mt19937* rng, std::vector<std::vector<uint8_t>>* inputs, std::vector<std::vector<uint8_t>>* streams)
+{
+	inputs->push_back(dynamic_text());
+	streams->push_back(std::vector<uint8_t>(std::begin(dynamic_text_zlib), std::end(dynamic_text_zlib)));
+	inputs->push_back({});
+	streams->push_back(zlib_stored(inputs->back()));
+	for (int kind = 0; kind < 3; ++kind)
+	{
+		inputs->push_back(make_data(rng, 70000, kind));
+		streams->push_back(zlib_stored(inputs->back(), 1 + (*rng)() % 20000));
+		inputs->push_back(make_data(rng, 1 + (*rng)() % 3000, kind));
+		streams->push_back(zlib_fixed(inputs->back()));
+	}
+}
+
+//! chunk with its CRC
+xng::chunk_t make_chunk(const char* type, const std::vector<uint8_t>& data)
+{
+	xng::chunk_t chunk;
+	memcpy(chunk.id.type, type, sizeof(chunk.id.type));
+	chunk.length = uint32_t(data.size());
+	chunk.data.assign(data.begin(), data.end());
+
+	std::vector<uint8_t> crcdata(type, type + sizeof(chunk.id.type));
+	crcdata.insert(crcdata.end(), data.begin(), data.end());
+	chunk.crc = xng::compute_crc32(crcdata.data(), crcdata.size());
+	return chunk;
+}
+
+//! file data of the chunks, without signature
+std::vector<uint8_t> write_chunks(const std::vector<xng::chunk_t>& chunks)
+{
+	size_t size = 0;
+	for (const xng::chunk_t& chunk : chunks)
+	{
+		size += xng::chunkheader_size + chunk.length + sizeof(uint32_t);
+	}
+
+	std::vector<uint8_t> filedata(size);
+	uint8_t*			 next = filedata.data();
+	for (const xng::chunk_t& chunk : chunks)
+	{
+		xng::write_chunk(chunk, next, &next);
+	}
+	return filedata;
+}
+
+//! rgba8 pixels and the PNG chunks encoding them
+struct TestImage
+{
+	uint32_t				  width;
+	uint32_t				  height;
+	std::vector<uint8_t>	  rgba;
+	std::vector<xng::chunk_t> chunks;	// IHDR, PLTE, tRNS, IDAT (one or more), IEND
+};
+
+//! image data of a random image: pixels repeating their left neighbour now and then, random filter
+//! types, compressed by stored blocks or fixed Huffman codes
+//! param[in] paletteBits: 0 for rgba8, 1, 2, 4 or 8 for palette images
+//! param[out] palette: colors of a palette image, rgba
+//! param[out] image: receives the size, pixels and the IHDR, PLTE, tRNS and IDAT chunks
+void make_image_data(std::mt19937* rng, uint32_t width, uint32_t height, uint8_t paletteBits, bool fixedHuffman, std::vector<uint32_t>* palette, TestImage* image)
+{
+	image->width  = width;
+	image->height = height;
+	image->rgba.resize(size_t(width) * height * 4);
+	image->chunks.clear();
+
+	std::vector<uint8_t> header;
+	append_uint32(&header, width);
+	append_uint32(&header, height);
+	header.insert(header.end(), {uint8_t(paletteBits ? paletteBits : 8), uint8_t(paletteBits ? 3 : 6), 0, 0, 0});
+	image->chunks.push_back(make_chunk("IHDR", header));
+
+	if (paletteBits)
+	{
+		palette->resize(size_t(1) << paletteBits);
+		std::vector<uint8_t> colors, alphas;
+		for (uint32_t& color : *palette)
+		{
+			color = (*rng)();
+			append_uint32(&colors, color);
+			colors.pop_back();
+			alphas.push_back(uint8_t(color));
+		}
+		image->chunks.push_back(make_chunk("PLTE", colors));
+		image->chunks.push_back(make_chunk("tRNS", alphas));
+	}
+
+	const size_t		 bytewidth = paletteBits ? 1 : 4;
+	const size_t		 rowSize   = paletteBits ? (size_t(width) * paletteBits + 7) / 8 : size_t(width) * 4;
+	std::vector<uint8_t> raw, row(rowSize), previous(rowSize);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		std::fill(row.begin(), row.end(), 0);
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			uint8_t* pixel = &image->rgba[(size_t(y) * width + x) * 4];
+			if (x > 0 && (*rng)() % 2 == 0)
+			{
+				memcpy(pixel, pixel - 4, 4);
+			}
+			else if (!paletteBits)
+			{
+				append_uint32(&header, (*rng)());
+				memcpy(pixel, header.data() + header.size() - 4, 4);
+			}
+			else
+			{
+				const uint32_t index = (*rng)() % palette->size();
+				const uint32_t color = (*palette)[index];
+				pixel[0]			 = uint8_t(color >> 24);
+				pixel[1]			 = uint8_t(color >> 16);
+				pixel[2]			 = uint8_t(color >> 8);
+				pixel[3]			 = uint8_t(color);
+			}
+
+			if (!paletteBits)
+			{
+				memcpy(&row[size_t(x) * 4], pixel, 4);
+				continue;
+			}
+			uint32_t index = 0;
+			while ((*palette)[index] != (uint32_t(pixel[0]) << 24 | uint32_t(pixel[1]) << 16 | uint32_t(pixel[2]) << 8 | pixel[3]))
+			{
+				++index;
+			}
+			const size_t bit = size_t(x) * paletteBits;
+			row[bit / 8] |= uint8_t(index << (8 - paletteBits - bit % 8));
+		}
+
+		const uint8_t filterType = uint8_t((*rng)() % 5);
+		raw.push_back(filterType);
+		raw.resize(raw.size() + rowSize);
+		xng::common::filter_scanline(&raw[raw.size() - rowSize], row.data(), previous.data(), bytewidth, filterType, rowSize);
+		previous = row;
+	}
+
+	// split into several chunks, empty ones included
+	const std::vector<uint8_t> compressed = fixedHuffman ? zlib_fixed(raw, 1024) : zlib_stored(raw, 1 + (*rng)() % 4096);
+	size_t					   pos		  = 0;
+	for (uint32_t pieces = 1 + (*rng)() % 3; pieces > 0; --pieces)
+	{
+		const size_t size = pieces == 1 ? compressed.size() - pos : (*rng)() % (compressed.size() - pos + 1);
+		image->chunks.push_back(make_chunk("IDAT", std::vector<uint8_t>(compressed.begin() + pos, compressed.begin() + pos + size)));
+		pos += size;
+	}
+}
+
+//! random still PNG, see make_image_data
+TestImage make_png(std::mt19937* rng, uint32_t width, uint32_t height, uint8_t paletteBits, bool fixedHuffman)
+{
+	TestImage			  image;
+	std::vector<uint32_t> palette;
+	make_image_data(rng, width, height, paletteBits, fixedHuffman, &palette, &image);
+	image.chunks.push_back(make_chunk("IEND", {}));
+	return image;
+}
+
+//! random Adam7 interlaced PNG: the pixels of make_image_data, reordered into the seven passes
+TestImage make_adam7_png(std::mt19937* rng, uint32_t width, uint32_t height, uint8_t paletteBits)
+{
+	TestImage			  image;
+	std::vector<uint32_t> palette;
+	make_image_data(rng, width, height, paletteBits, false, &palette, &image);
+	while (memcmp(image.chunks.back().id.type, "IDAT", 4) == 0)
+	{
+		image.chunks.pop_back();
+	}
+	std::vector<uint8_t> header(image.chunks[0].data.begin(), image.chunks[0].data.end());
+	header[12]		= 1;
+	image.chunks[0] = make_chunk("IHDR", header);
+
+	// x, y, xstep, ystep of the passes
+	static const uint32_t passes[7][4] = {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}};
+	const size_t		  bytewidth	   = paletteBits ? 1 : 4;
+	std::vector<uint8_t>  raw;
+	for (const uint32_t* pass : passes)
+	{
+		const uint32_t passWidth  = width > pass[0] ? (width - pass[0] + pass[2] - 1) / pass[2] : 0;
+		const uint32_t passHeight = height > pass[1] ? (height - pass[1] + pass[3] - 1) / pass[3] : 0;
+		if (passWidth == 0 || passHeight == 0)
+		{
+			continue;
+		}
+
+		const size_t		 rowSize = paletteBits ? (size_t(passWidth) * paletteBits + 7) / 8 : size_t(passWidth) * 4;
+		std::vector<uint8_t> row(rowSize), previous(rowSize);
+		for (uint32_t r = 0; r < passHeight; ++r)
+		{
+			std::fill(row.begin(), row.end(), 0);
+			for (uint32_t i = 0; i < passWidth; ++i)
+			{
+				const uint8_t* pixel = &image.rgba[(size_t(pass[1] + r * pass[3]) * width + pass[0] + i * pass[2]) * 4];
+				if (!paletteBits)
+				{
+					memcpy(&row[size_t(i) * 4], pixel, 4);
+					continue;
+				}
+				uint32_t index = 0;
+				while (palette[index] != (uint32_t(pixel[0]) << 24 | uint32_t(pixel[1]) << 16 | uint32_t(pixel[2]) << 8 | pixel[3]))
+				{
+					++index;
+				}
+				const size_t bit = size_t(i) * paletteBits;
+				row[bit / 8] |= uint8_t(index << (8 - paletteBits - bit % 8));
+			}
+
+			const uint8_t filterType = uint8_t((*rng)() % 5);
+			raw.push_back(filterType);
+			raw.resize(raw.size() + rowSize);
+			xng::common::filter_scanline(&raw[raw.size() - rowSize], row.data(), previous.data(), bytewidth, filterType, rowSize);
+			previous = row;
+		}
+	}
+
+	image.chunks.push_back(make_chunk("IDAT", zlib_fixed(raw, 1024)));
+	image.chunks.push_back(make_chunk("IEND", {}));
+	return image;
+}
+
+//! decodes the default image of PNG file data (without signature), returns 0 on success
+int decode_png(const std::vector<uint8_t>& filedata, const xng::png::DecodeOptions& options, xng::png::Document* document)
+{
+	const std::vector<xng::chunk_t> chunks = xng::read_chunks(filedata.data(), filedata.size());
+	xng::png::DecoderInfo			info;
+	if (xng::png::read_decoderinfo(chunks, &info) != 0)
+	{
+		return -1;
+	}
+	return xng::png::decode(info, options, document);
+}
+
+//! truncates and flips bits of the file data, decode must fail or succeed without reading or writing
+//! out of bounds (caught by the sanitizers)
+template <typename Decode>
+void corrupt_file(std::mt19937* rng, const std::vector<uint8_t>& filedata, int flips, Decode decode)
+{
+	for (int i = 0; i < flips; ++i)
+	{
+		std::vector<uint8_t> corrupt(filedata.begin(), filedata.begin() + (*rng)() % filedata.size());
+		decode(corrupt);
+		corrupt = filedata;
+		for (uint32_t count = 1 + (*rng)() % 4; count > 0; --count)
+		{
+			corrupt[(*rng)() % corrupt.size()] ^= uint8_t(1 << (*rng)() % 8);
+		}
+		decode(corrupt);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! streaming inflate
+
+//! inflates a stream fed in pieces of up to feedSize bytes and drained into windows of up to drainSize
+//! bytes with a backend. returns the status the stream ended with
+xng::common::InflateStatus inflate_pieces(const xng::common::inflatestream_t* backend,
+										  const std::vector<uint8_t>&		  data,
+										  std::mt19937*						  rng,
+										  size_t							  feedSize,
+										  size_t							  drainSize,
+										  std::vector<uint8_t>*				  out)
+{
+	using xng::common::InflateStatus;
+
+	xng::common::InflateStream stream;
+	if (stream.reset(backend, nullptr) != 0)
+	{
+		return InflateStatus::Error;
+	}
+
+	// every piece is a copy of its own, released once the stream asks for more, so a backend keeping
+	// pointers into consumed input is caught by the address sanitizer
+	std::unique_ptr<uint8_t[]> piece;
+	std::vector<uint8_t>	   window(drainSize);
+	size_t					   fed = 0;
+	out->clear();
+	for (;;)
+	{
+		size_t				written = 0;
+		const size_t		size	= 1 + (*rng)() % drainSize;
+		const InflateStatus status	= stream.drain(window.data(), size, &written);
+		if (written > size)
+		{
+			return InflateStatus::Error;
+		}
+		out->insert(out->end(), window.begin(), window.begin() + written);
+		if (status != InflateStatus::NeedsInput && status != InflateStatus::Ok)
+		{
+			return status;
+		}
+		if (status == InflateStatus::NeedsInput)
+		{
+			if (fed == data.size())
+			{
+				return InflateStatus::NeedsInput;
+			}
+			const size_t count = std::min(data.size() - fed, size_t(1 + (*rng)() % feedSize));
+			piece.reset(new uint8_t[count]);
+			memcpy(piece.get(), data.data() + fed, count);
+			fed += count;
+			if (stream.feed(piece.get(), count) != 0)
+			{
+				return InflateStatus::Error;
+			}
+		}
+	}
+}
+
+void test_inflatestream()
+{
+	using xng::common::InflateStatus;
+
+	std::vector<const xng::common::inflatestream_t*> backends = {&xng::common::builtin_inflatestream};
+#ifdef XNG_ZLIB
+	backends.push_back(&xng::common::zlib_inflatestream);
+#endif	// XNG_ZLIB
+
+	std::mt19937					  rng(30);
+	std::vector<std::vector<uint8_t>> inputs, streams;
+	make_streams(&rng, &inputs, &streams);
+
+	for (const xng::common::inflatestream_t* backend : backends)
+	{
+		for (size_t i = 0; i < streams.size(); ++i)
+		{
+			const std::vector<uint8_t>& stream = streams[i];
+			std::vector<uint8_t>		out;
+
+			// whole input, large windows; single bytes; ragged pieces
+			CHECK(inflate_pieces(backend, stream, &rng, stream.size(), 1 << 16, &out) == InflateStatus::Done && out == inputs[i]);
+			CHECK(inflate_pieces(backend, stream, &rng, 1, 1, &out) == InflateStatus::Done && out == inputs[i]);
+			CHECK(inflate_pieces(backend, stream, &rng, 300, 5000, &out) == InflateStatus::Done && out == inputs[i]);
+
+			// a truncated stream never ends, the output is a prefix of the data
+			const size_t size = rng() % stream.size();
+			const std::vector<uint8_t> truncated(stream.begin(), stream.begin() + size);
+			CHECK(inflate_pieces(backend, truncated, &rng, 1000, 1000, &out) != InflateStatus::Done);
+			CHECK(out.size() <= inputs[i].size() && std::equal(out.begin(), out.end(), inputs[i].begin()));
+
+			// flipped bits fail or end the stream without running past the output windows (checked by
+			// inflate_pieces and the sanitizers)
+			for (int flip = 0; flip < 20; ++flip)
+			{
+				std::vector<uint8_t> corrupt = stream;
+				corrupt[rng() % corrupt.size()] ^= uint8_t(1 << rng() % 8);
+				inflate_pieces(backend, corrupt, &rng, 1000, 1000, &out);
+			}
+		}
+
+		// the zlib header and the adler32 checksum are verified
+		std::vector<uint8_t> stream = streams[0], out;
+		stream[0]					= 0x79;
+		CHECK(inflate_pieces(backend, stream, &rng, 1000, 1000, &out) == InflateStatus::Error);
+		stream = streams[0];
+		stream.back() ^= 1;
+		CHECK(inflate_pieces(backend, stream, &rng, 1000, 1000, &out) == InflateStatus::Error);
+	}
+
+	// the reused state of a stream starts over after reset
+	xng::common::InflateStream stream;
+	std::vector<uint8_t>	   out(inputs[0].size());
+	for (int i = 0; i < 2; ++i)
+	{
+		CHECK(stream.reset(&xng::common::builtin_inflatestream, nullptr) == 0);
+		CHECK(stream.feed(streams[0].data(), streams[0].size() / 2) == 0);
+		CHECK(i == 1 || !stream.read(out.data(), out.size()));
+	}
+	CHECK(stream.feed(streams[0].data() + streams[0].size() / 2, streams[0].size() - streams[0].size() / 2) == 0);
+	CHECK(stream.read(out.data(), out.size()) && out == inputs[0]);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! one-shot built-in inflate
+
+void test_builtin_inflate()
+{
+	std::mt19937					  rng(31);
+	std::vector<std::vector<uint8_t>> inputs, streams;
+	make_streams(&rng, &inputs, &streams);
+
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		const std::vector<uint8_t>& stream = streams[i];
+		const std::vector<uint8_t>& input  = inputs[i];
+
+		// allocated by the inflate
+		unsigned char* out	   = nullptr;
+		size_t		   outsize = 0;
+		CHECK(xng::common::builtin_inflate(&out, &outsize, stream.data(), stream.size(), nullptr) == 0);
+		CHECK(outsize == input.size() && std::equal(input.begin(), input.end(), out));
+		free(out);
+
+		// filled in place: the exact size or more, not less
+		std::vector<uint8_t> buffer(input.size() + 1);
+		out		= buffer.data();
+		outsize = buffer.size();
+		CHECK(xng::common::builtin_inflate(&out, &outsize, stream.data(), stream.size(), nullptr) == 0);
+		CHECK(out == buffer.data() && outsize == input.size() && std::equal(input.begin(), input.end(), buffer.begin()));
+		if (!input.empty())
+		{
+			std::unique_ptr<uint8_t[]> small(new uint8_t[input.size() - 1]);
+			out		= small.get();
+			outsize = input.size() - 1;
+			CHECK(xng::common::builtin_inflate(&out, &outsize, stream.data(), stream.size(), nullptr) != 0);
+		}
+
+		std::vector<uint8_t> inflated(input.size());
+		CHECK(xng::common::inflate(stream, nullptr, nullptr, &inflated) == 0 && inflated == input);
+
+		// a truncated stream fails, as does a flipped adler32; flipped bits elsewhere must not overrun
+		const size_t truncated = rng() % stream.size();
+		out					   = buffer.data();
+		outsize				   = buffer.size();
+		CHECK(xng::common::builtin_inflate(&out, &outsize, stream.data(), truncated, nullptr) != 0);
+		std::vector<uint8_t> corrupt = stream;
+		corrupt[corrupt.size() - 1 - rng() % 4] ^= 0x10;
+		out		= buffer.data();
+		outsize = buffer.size();
+		CHECK(xng::common::builtin_inflate(&out, &outsize, corrupt.data(), corrupt.size(), nullptr) != 0);
+		for (int flip = 0; flip < 20; ++flip)
+		{
+			corrupt = stream;
+			corrupt[rng() % corrupt.size()] ^= uint8_t(1 << rng() % 8);
+			out		= buffer.data();
+			outsize = buffer.size();
+			xng::common::builtin_inflate(&out, &outsize, corrupt.data(), corrupt.size(), nullptr);
+			CHECK(outsize <= buffer.size());
+			out = nullptr;
+			if (xng::common::builtin_inflate(&out, &outsize, corrupt.data(), corrupt.size(), nullptr) == 0)
+			{
+				free(out);
+			}
+		}
+	}
+
+	// PNG image data inflated straight into the image buffer, by a stream or a one-shot function
+	std::vector<xng::png::DecodeOptions> decodeOptions(3);
+	decodeOptions[1].inflatestream = &xng::common::builtin_inflatestream;
+	decodeOptions[2].inflatefunc   = xng::common::builtin_inflate;
+	for (int i = 0; i < 20; ++i)
+	{
+		const uint8_t		 paletteBits[] = {0, 1, 2, 4, 8};
+		const TestImage		 image		   = make_png(&rng, 1 + rng() % 40, 1 + rng() % 40, paletteBits[i % 5], i % 2 != 0);
+		std::vector<uint8_t> filedata	   = write_chunks(image.chunks);
+		for (const xng::png::DecodeOptions& options : decodeOptions)
+		{
+			xng::png::Document document;
+			CHECK(decode_png(filedata, options, &document) == 0);
+			CHECK(document.width == image.width && document.height == image.height);
+			CHECK(document.frames.size() == 1 && document.frames[0].imagedata == image.rgba);
+		}
+
+		corrupt_file(&rng, filedata, 10, [&](const std::vector<uint8_t>& corrupt) {
+			xng::png::Document document;
+			if (decode_png(corrupt, decodeOptions[i % 3], &document) == 0)
+			{
+				CHECK(document.frames.size() == 1 && document.frames[0].imagedata.size() == size_t(document.width) * document.height * 4);
+			}
+		});
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! region and downscaled decoding
+
+//! reference of the downscaled region: the box filter of the decoder, alpha-premultiplied sums rounded
+//! to nearest, over the pixels on a grid of step gridStep in image coordinates
+//! param[in] gridStep: 1 for all pixels, 2, 4 or 8 for the pixels of Adam7 passes 1-5, 1-3 or 1
+std::vector<uint8_t> box_reference(const TestImage& image, const xng::png::Region& region, uint32_t targetWidth, uint32_t targetHeight, uint32_t gridStep)
+{
+	std::vector<uint64_t> sums(size_t(targetWidth) * targetHeight * 5, 0);
+	for (uint32_t y = region.y; y < region.y + region.height; ++y)
+	{
+		for (uint32_t x = region.x; x < region.x + region.width; ++x)
+		{
+			if (x % gridStep != 0 || y % gridStep != 0)
+			{
+				continue;
+			}
+			const uint8_t* pixel = &image.rgba[(size_t(y) * image.width + x) * 4];
+			const size_t   tx	 = size_t(x - region.x) * targetWidth / region.width;
+			const size_t   ty	 = size_t(y - region.y) * targetHeight / region.height;
+			uint64_t*	   sum	 = &sums[(ty * targetWidth + tx) * 5];
+			for (int c = 0; c < 3; ++c)
+			{
+				sum[c] += uint64_t(pixel[c]) * pixel[3];
+			}
+			sum[3] += pixel[3];
+			sum[4] += 1;
+		}
+	}
+
+	std::vector<uint8_t> rgba(size_t(targetWidth) * targetHeight * 4, 0);
+	for (size_t i = 0; i < size_t(targetWidth) * targetHeight; ++i)
+	{
+		const uint64_t* sum = &sums[i * 5];
+		if (sum[3] == 0)
+		{
+			continue;
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			rgba[i * 4 + c] = uint8_t((sum[c] + sum[3] / 2) / sum[3]);
+		}
+		rgba[i * 4 + 3] = uint8_t((sum[3] + sum[4] / 2) / sum[4]);
+	}
+	return rgba;
+}
+
+//! the region of the image, unscaled
+std::vector<uint8_t> crop(const TestImage& image, const xng::png::Region& region)
+{
+	std::vector<uint8_t> rgba;
+	for (uint32_t y = region.y; y < region.y + region.height; ++y)
+	{
+		const uint8_t* row = &image.rgba[(size_t(y) * image.width + region.x) * 4];
+		rgba.insert(rgba.end(), row, row + size_t(region.width) * 4);
+	}
+	return rgba;
+}
+
+void test_region_scaling()
+{
+	std::mt19937 rng(26);
+
+	// odd sizes, Adam7 images with passes left empty included, by a one-shot inflate and a stream
+	const uint32_t		sizes[][2]	  = {{1, 1}, {2, 3}, {5, 1}, {7, 13}, {9, 9}, {33, 21}, {17, 64}, {65, 47}, {80, 80}};
+	const uint8_t		paletteBits[] = {0, 1, 2, 4, 8};
+	xng::png::DecodeOptions streaming;
+	streaming.inflatestream = &xng::common::builtin_inflatestream;
+	int count				= 0;
+	for (const uint32_t* size : sizes)
+	{
+		for (bool interlaced : {false, true})
+		{
+			const uint8_t		 bits  = paletteBits[count++ % 5];
+			const TestImage		 image = interlaced ? make_adam7_png(&rng, size[0], size[1], bits) : make_png(&rng, size[0], size[1], bits, true);
+			const std::vector<uint8_t> filedata = write_chunks(image.chunks);
+			const uint32_t		 width = image.width, height = image.height;
+
+			xng::png::Document document;
+			CHECK(decode_png(filedata, {}, &document) == 0 && document.frames.size() == 1 && document.frames[0].imagedata == image.rgba);
+			CHECK(decode_png(filedata, streaming, &document) == 0 && document.frames.size() == 1 && document.frames[0].imagedata == image.rgba);
+
+			// regions on the borders and random ones, whole and at 1/2, 1/4 and 1/8 scale
+			std::vector<xng::png::Region> regions = {
+			  {0, 0, width, height},
+			  {width - 1, 0, 1, height},
+			  {0, height - 1, width, 1},
+			  {width - 1, height - 1, 1, 1},
+			  {width / 2, height / 2, width - width / 2, height - height / 2},
+			};
+			for (int i = 0; i < 4; ++i)
+			{
+				const uint32_t x = rng() % width, y = rng() % height;
+				regions.push_back({x, y, 1 + uint32_t(rng() % (width - x)), 1 + uint32_t(rng() % (height - y))});
+			}
+			for (const xng::png::Region& region : regions)
+			{
+				xng::png::DecodeOptions options = rng() % 2 ? streaming : xng::png::DecodeOptions();
+				options.region					= region;
+				CHECK(decode_png(filedata, options, &document) == 0);
+				CHECK(document.width == region.width && document.height == region.height);
+				CHECK(document.frames.size() == 1 && document.frames[0].imagedata == crop(image, region));
+
+				for (uint32_t scale : {2, 4, 8})
+				{
+					options.targetWidth	 = std::max(1u, region.width / scale);
+					options.targetHeight = std::max(1u, region.height / scale);
+					const uint32_t decimation = std::min(region.width / options.targetWidth, region.height / options.targetHeight);
+
+					// Adam7 images read passes 1 for 1/8, 1-3 for 1/4 and 1-5 for 1/2, a grid of 8, 4 or 2
+					uint32_t gridStep = 1;
+					if (interlaced)
+					{
+						gridStep = decimation >= 8 ? 8 : decimation >= 4 ? 4 : decimation >= 2 ? 2 : 1;
+					}
+					CHECK(decode_png(filedata, options, &document) == 0);
+					CHECK(document.width == options.targetWidth && document.height == options.targetHeight);
+					CHECK(document.frames.size() == 1
+						  && document.frames[0].imagedata == box_reference(image, region, options.targetWidth, options.targetHeight, gridStep));
+				}
+			}
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! color conversion
+
+//! reference transfer function in double precision: encoded sample in [0, 1] to linear light
+//! param[in] gamma: file gamma, 0 for the sRGB curve
+double reference_linear(double v, double gamma)
+{
+	if (gamma == 0.0)
+	{
+		return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+	}
+	return std::pow(v, 1.0 / gamma);
+}
+
+//! 3x3 row major matrices
+void reference_multiply(const double a[9], const double b[9], double result[9])
+{
+	for (int i = 0; i < 9; ++i)
+	{
+		result[i] = 0.0;
+		for (int k = 0; k < 3; ++k)
+		{
+			result[i] += a[i / 3 * 3 + k] * b[k * 3 + i % 3];
+		}
+	}
+}
+
+void reference_invert(const double m[9], double result[9])
+{
+	// adjugate over the determinant
+	for (int i = 0; i < 9; ++i)
+	{
+		const int r = i / 3, c = i % 3;
+		const int r0 = (c + 1) % 3, r1 = (c + 2) % 3, c0 = (r + 1) % 3, c1 = (r + 2) % 3;
+		result[i] = m[r0 * 3 + c0] * m[r1 * 3 + c1] - m[r0 * 3 + c1] * m[r1 * 3 + c0];
+	}
+	const double det = m[0] * result[0] + m[1] * result[3] + m[2] * result[6];
+	for (int i = 0; i < 9; ++i)
+	{
+		result[i] /= det;
+	}
+}
+
+//! rgb -> XYZ of the primaries, scaled so rgb(1, 1, 1) is the white point
+void reference_rgb_to_XYZ(const xng::common::Chromaticities& c, double result[9])
+{
+	const double xy[4][2] = {{c.red_x, c.red_y}, {c.green_x, c.green_y}, {c.blue_x, c.blue_y}, {c.white_x, c.white_y}};
+	double		 primaries[9], white[3], inverse[9];
+	for (int p = 0; p < 4; ++p)
+	{
+		const double XYZ[3] = {xy[p][0] / xy[p][1], 1.0, (1.0 - xy[p][0] - xy[p][1]) / xy[p][1]};
+		for (int i = 0; i < 3; ++i)
+		{
+			(p < 3 ? primaries[i * 3 + p] : white[i]) = XYZ[i];
+		}
+	}
+	reference_invert(primaries, inverse);
+	for (int i = 0; i < 9; ++i)
+	{
+		const int c = i % 3;
+		result[i]	= primaries[i] * (inverse[c * 3] * white[0] + inverse[c * 3 + 1] * white[1] + inverse[c * 3 + 2] * white[2]);
+	}
+}
+
+//! source rgb -> linear sRGB, adapted to D65 by Bradford, row major
+void reference_matrix(const xng::common::Chromaticities& source, double result[9])
+{
+	static const double bradford[9] = {0.8951, 0.2664, -0.1614, -0.7502, 1.7135, 0.0367, 0.0389, -0.0685, 1.0296};
+	const xng::common::Chromaticities& srgb = xng::common::srgb_chromaticities;
+
+	double sourceToXYZ[9], srgbToXYZ[9], XYZToSrgb[9], inverseBradford[9];
+	reference_rgb_to_XYZ(source, sourceToXYZ);
+	reference_rgb_to_XYZ(srgb, srgbToXYZ);
+	reference_invert(srgbToXYZ, XYZToSrgb);
+	reference_invert(bradford, inverseBradford);
+
+	// cone responses of the white points
+	const double whites[2][2] = {{source.white_x, source.white_y}, {srgb.white_x, srgb.white_y}};
+	double		 cones[2][3];
+	for (int w = 0; w < 2; ++w)
+	{
+		const double XYZ[3] = {whites[w][0] / whites[w][1], 1.0, (1.0 - whites[w][0] - whites[w][1]) / whites[w][1]};
+		for (int i = 0; i < 3; ++i)
+		{
+			cones[w][i] = bradford[i * 3] * XYZ[0] + bradford[i * 3 + 1] * XYZ[1] + bradford[i * 3 + 2] * XYZ[2];
+		}
+	}
+	const double scale[9] = {cones[1][0] / cones[0][0], 0.0, 0.0, 0.0, cones[1][1] / cones[0][1], 0.0, 0.0, 0.0, cones[1][2] / cones[0][2]};
+
+	double scaled[9], adaptation[9], adapted[9];
+	reference_multiply(scale, bradford, scaled);
+	reference_multiply(inverseBradford, scaled, adaptation);
+	reference_multiply(adaptation, sourceToXYZ, adapted);
+	reference_multiply(XYZToSrgb, adapted, result);
+}
+
+//! reference value of a half precision float
+double reference_half(uint16_t half)
+{
+	const int	 exponent = (half >> 10) & 0x1F;
+	const double sign	  = (half & 0x8000) ? -1.0 : 1.0;
+	const double mantissa = half & 0x3FF;
+	if (exponent == 0x1F)
+	{
+		return mantissa == 0 ? sign * INFINITY : NAN;
+	}
+	return exponent == 0 ? sign * std::ldexp(mantissa, -24) : sign * std::ldexp(1024.0 + mantissa, exponent - 25);
+}
+
+//! reference of rounding to half precision: the nearest half value, ties to even mantissas, beyond the
+//! largest half to infinity
+double reference_to_half(double value)
+{
+	const double magnitude = std::fabs(value);
+	if (magnitude >= 65520.0)
+	{
+		return std::copysign(INFINITY, value);
+	}
+	const int	 exponent = magnitude < std::ldexp(1.0, -14) ? -14 : std::ilogb(magnitude);
+	const double ulp	  = std::ldexp(1.0, exponent - 10);
+	return std::copysign(std::nearbyint(magnitude / ulp) * ulp, value);
+}
+
+bool is_near(double value, double expected, double tolerance)
+{
+	return std::fabs(value - expected) <= tolerance * (1.0 + std::fabs(expected));
+}
+
+//! random 16 bit rgba PNG with the color chunks after IHDR, samples small now and then for the linear
+//! segment of the sRGB curve
+std::vector<uint8_t> make_png16(std::mt19937* rng, uint32_t width, uint32_t height, const std::vector<xng::chunk_t>& colorChunks, std::vector<uint16_t>* rgba)
+{
+	std::vector<uint8_t> header;
+	append_uint32(&header, width);
+	append_uint32(&header, height);
+	header.insert(header.end(), {16, 6, 0, 0, 0});
+	std::vector<xng::chunk_t> chunks = {make_chunk("IHDR", header)};
+	chunks.insert(chunks.end(), colorChunks.begin(), colorChunks.end());
+
+	rgba->resize(size_t(width) * height * 4);
+	const size_t		 rowSize = size_t(width) * 8;
+	std::vector<uint8_t> raw, row(rowSize), previous(rowSize, 0);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (size_t i = 0; i < size_t(width) * 4; ++i)
+		{
+			const uint16_t sample			 = uint16_t((*rng)() % 4 == 0 ? (*rng)() % 64 : (*rng)());
+			(*rgba)[size_t(y) * width * 4 + i] = sample;
+			row[i * 2]						 = uint8_t(sample >> 8);
+			row[i * 2 + 1]					 = uint8_t(sample);
+		}
+		const uint8_t filterType = uint8_t((*rng)() % 5);
+		raw.push_back(filterType);
+		raw.resize(raw.size() + rowSize);
+		xng::common::filter_scanline(&raw[raw.size() - rowSize], row.data(), previous.data(), 8, filterType, rowSize);
+		previous = row;
+	}
+	chunks.push_back(make_chunk("IDAT", zlib_stored(raw)));
+	chunks.push_back(make_chunk("IEND", {}));
+	return write_chunks(chunks);
+}
+
+//! reference RGBA32F pixels of encoded rgba samples in [0, 1]: through the transfer function, the
+//! downscaling box filter weighting by alpha in linear light, and the matrix
+//! param[in] gamma: file gamma, 0 for the sRGB curve
+//! param[in] matrix: row major, nullptr for none
+std::vector<double> linear_reference(const std::vector<double>& encoded, uint32_t width, uint32_t height, uint32_t targetWidth, uint32_t targetHeight, double gamma, const double* matrix)
+{
+	// unscaled pixels are their own box, kept as they are even if transparent
+	const bool			isScaled = targetWidth != width || targetHeight != height;
+	std::vector<double> sums(size_t(targetWidth) * targetHeight * 5, 0.0);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			const double* sample = &encoded[(size_t(y) * width + x) * 4];
+			const double  weight = isScaled ? sample[3] : 1.0;
+			double*		  sum	 = &sums[(size_t(y) * targetHeight / height * targetWidth + size_t(x) * targetWidth / width) * 5];
+			for (int c = 0; c < 3; ++c)
+			{
+				sum[c] += reference_linear(sample[c], gamma) * weight;
+			}
+			sum[3] += weight;
+			sum[4] += isScaled ? 1.0 : sample[3];
+		}
+	}
+
+	std::vector<double> rgba(size_t(targetWidth) * targetHeight * 4, 0.0);
+	for (size_t i = 0; i < size_t(targetWidth) * targetHeight; ++i)
+	{
+		const double* sum	= &sums[i * 5];
+		double*		  pixel = &rgba[i * 4];
+		if (sum[3] <= 0.0)
+		{
+			continue;
+		}
+		const double linear[3] = {sum[0] / sum[3], sum[1] / sum[3], sum[2] / sum[3]};
+		for (int c = 0; c < 3; ++c)
+		{
+			pixel[c] = matrix ? matrix[c * 3] * linear[0] + matrix[c * 3 + 1] * linear[1] + matrix[c * 3 + 2] * linear[2] : linear[c];
+		}
+		pixel[3] = isScaled ? sum[3] / sum[4] : sum[4];
+	}
+	return rgba;
+}
+
+//! true if the RGBA32F or RGBA16F frame is the reference within the tolerance
+bool is_near_linear(const xng::png::Document& document, bool isHalf, const std::vector<double>& reference, double tolerance)
+{
+	if (document.frames.size() != 1 || document.frames[0].imagedata.size() != reference.size() * (isHalf ? 2 : 4))
+	{
+		return false;
+	}
+	const uint8_t* data = document.frames[0].imagedata.data();
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		double value;
+		if (isHalf)
+		{
+			uint16_t half;
+			memcpy(&half, data + i * 2, sizeof(half));
+			value = reference_half(half);
+		}
+		else
+		{
+			float sample;
+			memcpy(&sample, data + i * 4, sizeof(sample));
+			value = sample;
+		}
+		if (!is_near(value, reference[i], tolerance))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void test_color()
+{
+	using xng::common::Chromaticities;
+	using xng::common::ColorTransform;
+	using xng::common::TransferFunction;
+
+	std::mt19937 rng(28);
+
+	// LUTs of 8 and 16 bit samples against the double precision curves, gamma 0 for the default of 2.2
+	for (uint8_t bitdepth : {8, 16})
+	{
+		for (float gamma : {0.0f, 0.45455f, 1.0f, 0.55556f, 2.2f, -1.0f})
+		{
+			ColorTransform transform;
+			const bool	   isSRGB = gamma == 0.0f;
+			build_colortransform(&transform, bitdepth, isSRGB ? TransferFunction::SRGB : TransferFunction::Gamma, gamma, nullptr);
+			const double referenceGamma = isSRGB ? 0.0 : gamma > 0.0f ? double(gamma) : 1.0 / 2.2;
+			const double maxValue		= bitdepth == 16 ? 65535.0 : 255.0;
+			CHECK(transform.lut.size() == size_t(maxValue) + 1 && transform.alphaScale == float(1.0 / maxValue) && !transform.hasMatrix);
+			bool isNear = transform.lut.front() == 0.0f && transform.lut.back() == 1.0f;
+			for (size_t i = 0; i < transform.lut.size() && isNear; ++i)
+			{
+				isNear = is_near(transform.lut[i], reference_linear(double(i) / maxValue, referenceGamma), 1e-6);
+			}
+			CHECK(isNear);
+		}
+	}
+
+	// Bradford adapted matrices of other primaries and white points, against the reference and a
+	// published Adobe RGB -> sRGB matrix
+	const Chromaticities adobe	  = {0.3127f, 0.3290f, 0.64f, 0.33f, 0.21f, 0.71f, 0.15f, 0.06f};
+	const Chromaticities proPhoto = {0.3457f, 0.3585f, 0.7347f, 0.2653f, 0.1596f, 0.8404f, 0.0366f, 0.0001f};
+	const Chromaticities rec2020  = {0.3127f, 0.3290f, 0.708f, 0.292f, 0.170f, 0.797f, 0.131f, 0.046f};
+	const Chromaticities d50srgb  = {0.3457f, 0.3585f, 0.64f, 0.33f, 0.30f, 0.60f, 0.15f, 0.06f};
+	double				 adobeMatrix[9];
+	reference_matrix(adobe, adobeMatrix);
+	const double published[9] = {1.39835, -0.39835, 0.0, 0.0, 1.0, 0.0, 0.0, -0.04293, 1.04293};
+	CHECK(std::equal(adobeMatrix, adobeMatrix + 9, published, [](double a, double b) { return std::fabs(a - b) < 1e-3; }));
+	for (const Chromaticities& chromaticities : {adobe, proPhoto, rec2020, d50srgb})
+	{
+		ColorTransform transform;
+		double		   reference[9];
+		build_colortransform(&transform, 8, TransferFunction::SRGB, 0.0f, &chromaticities);
+		reference_matrix(chromaticities, reference);
+		CHECK(transform.hasMatrix);
+		for (int i = 0; i < 9; ++i)
+		{
+			CHECK(is_near(transform.matrix[i % 3 * 4 + i / 3], reference[i], 1e-5));
+		}
+		CHECK(transform.matrix[3] == 0.0f && transform.matrix[7] == 0.0f && transform.matrix[11] == 0.0f);
+
+		// applied to pixels, alpha kept
+		std::vector<float> pixels(4 * 13), applied;
+		for (float& value : pixels)
+		{
+			value = float(rng() % 10000) / 9999.0f;
+		}
+		applied = pixels;
+		apply_colortransform_matrix(transform, applied.data(), 13);
+		for (size_t p = 0; p < pixels.size(); p += 4)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				CHECK(is_near(applied[p + c], reference[c * 3] * pixels[p] + reference[c * 3 + 1] * pixels[p + 1] + reference[c * 3 + 2] * pixels[p + 2], 1e-5));
+			}
+			CHECK(applied[p + 3] == pixels[p + 3]);
+		}
+	}
+
+	// the sRGB primaries, also as rounded by cHRM, skip the matrix and leave pixels as they are
+	const Chromaticities cHRMsrgb = {31270 / 100000.0f, 32900 / 100000.0f, 64000 / 100000.0f, 33000 / 100000.0f, 30000 / 100000.0f, 60000 / 100000.0f, 15000 / 100000.0f, 6000 / 100000.0f};
+	for (const Chromaticities& chromaticities : {xng::common::srgb_chromaticities, cHRMsrgb})
+	{
+		ColorTransform transform;
+		build_colortransform(&transform, 16, TransferFunction::Gamma, 0.45455f, &chromaticities);
+		CHECK(!transform.hasMatrix);
+		std::vector<float> pixels = {0.25f, 2.0f, -1.0f, 0.5f}, applied = pixels;
+		apply_colortransform_matrix(transform, applied.data(), 1);
+		CHECK(applied == pixels);
+	}
+
+	// half floats: every half converts to its value and back, the scalar conversion rounds random
+	// floats and the ties between halfs as the reference, the bulk one (F16C if built for it) gives
+	// the same halfs for counts with and without a remainder
+	bool isExact = true;
+	for (uint32_t half = 0; half < 0x10000; ++half)
+	{
+		const double value = reference_half(uint16_t(half));
+		const float	 f	   = xng::common::half_to_float(uint16_t(half));
+		if (std::isnan(value))
+		{
+			isExact = isExact && std::isnan(f) && std::isnan(xng::common::half_to_float(xng::common::float_to_half(f)));
+			continue;
+		}
+		isExact = isExact && double(f) == value && xng::common::float_to_half(f) == half;
+	}
+	CHECK(isExact);
+
+	std::vector<float> floats;
+	for (uint32_t half = 0; half < 0x7C00; half += 1 + rng() % 7)
+	{
+		// ties between neighbours, exact in float
+		const double tie = (reference_half(uint16_t(half)) + reference_half(uint16_t(half + 1))) / 2;
+		floats.push_back(float(tie));
+		floats.push_back(-float(tie));
+	}
+	for (int i = 0; i < 20000; ++i)
+	{
+		uint32_t bits = rng();
+		float	 value;
+		memcpy(&value, &bits, sizeof(value));
+		if (!std::isnan(value))
+		{
+			floats.push_back(value);
+		}
+	}
+	floats.insert(floats.end(), {65504.0f, 65519.0f, 65520.0f, 1e-8f, 2.98e-8f, 2.99e-8f, INFINITY, -INFINITY, 0.0f, -0.0f});
+	bool isRounded = true;
+	for (float value : floats)
+	{
+		const uint16_t half = xng::common::float_to_half(value);
+		isRounded			= isRounded && reference_half(half) == reference_to_half(value) && std::signbit(reference_half(half)) == std::signbit(value);
+	}
+	CHECK(isRounded);
+
+	for (size_t count : {size_t(0), size_t(1), size_t(3), size_t(4), size_t(17), floats.size()})
+	{
+		const size_t		  first = rng() % (floats.size() - count + 1);
+		std::vector<uint16_t> halfs(count);
+		xng::common::float_to_half(floats.data() + first, halfs.data(), count);
+		bool isSame = true;
+		for (size_t i = 0; i < count; ++i)
+		{
+			isSame = isSame && halfs[i] == xng::common::float_to_half(floats[first + i]);
+		}
+		CHECK(isSame);
+	}
+
+	// decoded to RGBA32F and RGBA16F, whole and downscaled in linear light: 16 bit samples through the
+	// 65536 entry LUT, 8 bit and palette samples through the 256 entry one
+	const std::vector<uint8_t> gAMA = {0, 0, 0xB1, 0x8F};	// 0.45455
+	std::vector<uint8_t>	   cHRM;
+	for (uint32_t value : {31270, 32900, 64000, 33000, 21000, 71000, 15000, 6000})
+	{
+		append_uint32(&cHRM, value);	// Adobe RGB
+	}
+	const Chromaticities adobeCHRM = {0.3127f, 0.329f, 0.64f, 0.33f, 0.21f, 0.71f, 0.15f, 0.06f};
+	double				 adobeCHRMMatrix[9];
+	reference_matrix(adobeCHRM, adobeCHRMMatrix);
+
+	struct ColorCase
+	{
+		std::vector<xng::chunk_t> chunks;
+		double					  gamma;	// 0: sRGB
+		const double*			  matrix;
+		uint8_t					  paletteBits;	// 16 for 16 bit rgba
+	};
+	const ColorCase cases[] = {
+	  {{make_chunk("gAMA", gAMA), make_chunk("cHRM", cHRM)}, 0.45455, adobeCHRMMatrix, 16},
+	  {{}, 0.0, nullptr, 16},
+	  {{make_chunk("gAMA", {0, 0x01, 0x86, 0xA0})}, 1.0, nullptr, 0},
+	  {{make_chunk("sRGB", {0}), make_chunk("gAMA", gAMA), make_chunk("cHRM", cHRM)}, 0.0, nullptr, 4},
+	  {{make_chunk("gAMA", {0, 0, 0xD9, 0x03}), make_chunk("cHRM", cHRM)}, 0.55555, adobeCHRMMatrix, 8},
+	};
+	for (const ColorCase& colorCase : cases)
+	{
+		const uint32_t		 width = 1 + rng() % 40, height = 1 + rng() % 40;
+		std::vector<uint8_t> filedata;
+		std::vector<double>	 encoded;
+		if (colorCase.paletteBits == 16)
+		{
+			std::vector<uint16_t> samples;
+			filedata = make_png16(&rng, width, height, colorCase.chunks, &samples);
+			for (uint16_t sample : samples)
+			{
+				encoded.push_back(sample / 65535.0);
+			}
+		}
+		else
+		{
+			TestImage image = make_png(&rng, width, height, colorCase.paletteBits, rng() % 2 != 0);
+			image.chunks.insert(image.chunks.begin() + 1, colorCase.chunks.begin(), colorCase.chunks.end());
+			filedata = write_chunks(image.chunks);
+			for (uint8_t sample : image.rgba)
+			{
+				encoded.push_back(sample / 255.0);
+			}
+		}
+
+		for (uint32_t scale : {1, 2, 3})
+		{
+			xng::png::DecodeOptions options;
+			options.targetWidth  = std::max(1u, width / scale);
+			options.targetHeight = std::max(1u, height / scale);
+			const std::vector<double> reference = linear_reference(encoded, width, height, options.targetWidth, options.targetHeight, colorCase.gamma, colorCase.matrix);
+			for (xng::png::PixelFormat format : {xng::png::PixelFormat::RGBA32F, xng::png::PixelFormat::RGBA16F})
+			{
+				const bool		   isHalf = format == xng::png::PixelFormat::RGBA16F;
+				xng::png::Document document;
+				options.format = format;
+				CHECK(decode_png(filedata, options, &document) == 0);
+				CHECK(is_near_linear(document, isHalf, reference, isHalf ? 1e-3 : 1e-5));
+			}
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! lazily inflated chunk data
+
+//! inflatefunc_t of the built-in inflate, settings is an int counting the calls
+int counting_inflate(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, void* settings)
+{
+	++*static_cast<int*>(settings);
+	return xng::common::builtin_inflate(out, outsize, in, insize, nullptr);
+}
+
+void test_lazy_chunks()
+{
+	std::mt19937 rng(27);
+
+	// zTXt, compressed and uncompressed iTXt and iCCP, keyword and compression method before the payloads
+	const std::string		   text	   = "a text long enough to be compressed, a text long enough to be compressed";
+	const std::vector<uint8_t> profile = make_data(&rng, 3000, 1);
+	const std::vector<uint8_t> zlib	   = zlib_fixed(std::vector<uint8_t>(text.begin(), text.end()));
+	std::vector<uint8_t>	   zTXt = {'C', 0, 0}, iTXt = {'I', 0, 1, 0, 'e', 'n', 0, 0}, plain = {'P', 0, 0, 0, 0, 0}, iCCP = {'s', 'R', 'G', 'B', 0, 0};
+	zTXt.insert(zTXt.end(), zlib.begin(), zlib.end());
+	iTXt.insert(iTXt.end(), zlib.begin(), zlib.end());
+	plain.insert(plain.end(), text.begin(), text.end());
+	const std::vector<uint8_t> compressedProfile = zlib_fixed(profile);
+	iCCP.insert(iCCP.end(), compressedProfile.begin(), compressedProfile.end());
+
+	TestImage image = make_png(&rng, 8, 8, 0, false);
+	image.chunks.insert(image.chunks.begin() + 1, make_chunk("iCCP", iCCP));
+	image.chunks.insert(image.chunks.end() - 1, make_chunk("tEXt", {'T', 0, 'a', 'b'}));
+	image.chunks.insert(image.chunks.end() - 1, make_chunk("zTXt", zTXt));
+	image.chunks.insert(image.chunks.end() - 1, make_chunk("iTXt", iTXt));
+	image.chunks.insert(image.chunks.end() - 1, make_chunk("iTXt", plain));
+
+	// inflated on first access only, by the built-in inflate and by a function
+	xng::png::DecoderInfo info;
+	CHECK(xng::png::read_decoderinfo(image.chunks, &info) == 0);
+	CHECK(info.texts.size() == 1 && info.compressedTexts.size() == 1 && info.internationalTexts.size() == 2 && info.iccProfile.isDefined);
+	CHECK(!info.compressedTexts[0].compressedText.isInflated && !info.iccProfile.profile.isInflated);
+	int			calls = 0;
+	std::string out;
+	CHECK(xng::png::get_text(info.compressedTexts[0], counting_inflate, &calls, &out) == 0 && out == text && calls == 1);
+	CHECK(info.compressedTexts[0].compressedText.isInflated);
+	CHECK(xng::png::get_text(info.compressedTexts[0], counting_inflate, &calls, &out) == 0 && out == text && calls == 1);
+	CHECK(xng::png::get_text(info.internationalTexts[0], nullptr, nullptr, &out) == 0 && out == text);
+	CHECK(xng::png::get_text(info.internationalTexts[1], counting_inflate, &calls, &out) == 0 && out == text && calls == 1);
+	const std::pmr::vector<uint8_t>* inflated = xng::png::get_profile(info.iccProfile, nullptr, nullptr);
+	CHECK(inflated && std::equal(inflated->begin(), inflated->end(), profile.begin(), profile.end()));
+	CHECK(xng::png::get_profile(info.iccProfile, counting_inflate, &calls) == inflated && calls == 1);
+
+	// over the size limit fails, by both inflates, also once memoized; a larger limit succeeds later
+	for (xng::common::inflatefunc_t inflatefunc : {xng::common::inflatefunc_t(nullptr), xng::common::inflatefunc_t(counting_inflate)})
+	{
+		xng::png::reset_decoderinfo(&info);
+		CHECK(xng::png::read_decoderinfo(image.chunks, &info) == 0);
+		calls = 0;
+		CHECK(xng::png::get_profile(info.iccProfile, inflatefunc, &calls, profile.size() - 1) == nullptr);
+		CHECK(!info.iccProfile.profile.isInflated && info.iccProfile.profile.inflated.empty());
+		CHECK(xng::png::get_text(info.compressedTexts[0], inflatefunc, &calls, &out, text.size() - 1) == -1);
+		CHECK(xng::png::get_text(info.compressedTexts[0], inflatefunc, &calls, &out, text.size()) == 0 && out == text);
+		CHECK(xng::png::get_text(info.compressedTexts[0], inflatefunc, &calls, &out, text.size() - 1) == -1);
+		inflated = xng::png::get_profile(info.iccProfile, inflatefunc, &calls, profile.size());
+		CHECK(inflated && inflated->size() == profile.size());
+		CHECK(calls == (inflatefunc ? 4 : 0));
+	}
+
+	// corrupt payloads fail and are not memoized, the next call inflates again; unknown compression
+	// methods fail without inflating
+	std::vector<uint8_t> corrupt = zTXt;
+	corrupt.back() ^= 0x01;
+	std::vector<uint8_t> truncated(zTXt.begin(), zTXt.end() - 6);
+	std::vector<uint8_t> method = zTXt;
+	method[2]					= 1;
+	std::vector<uint8_t> iTXtMethod = iTXt;
+	iTXtMethod[3]					= 1;
+	std::vector<uint8_t> iCCPMethod = iCCP;
+	iCCPMethod[5]					= 1;
+	std::vector<xng::chunk_t> chunks = {image.chunks[0], make_chunk("iCCP", iCCPMethod), make_chunk("zTXt", corrupt), make_chunk("zTXt", truncated),
+										make_chunk("zTXt", method), make_chunk("iTXt", iTXtMethod)};
+	chunks.insert(chunks.end(), image.chunks.begin() + 2, image.chunks.end() - 5);
+	chunks.push_back(image.chunks.back());
+	xng::png::reset_decoderinfo(&info);
+	CHECK(xng::png::read_decoderinfo(chunks, &info) == 0 && info.compressedTexts.size() == 3 && info.internationalTexts.size() == 1);
+	for (xng::common::inflatefunc_t inflatefunc : {xng::common::inflatefunc_t(nullptr), xng::common::inflatefunc_t(counting_inflate)})
+	{
+		calls = 0;
+		for (int i = 0; i < 2; ++i)
+		{
+			CHECK(xng::png::get_text(info.compressedTexts[0], inflatefunc, &calls, &out) == -1);
+			CHECK(xng::png::get_text(info.compressedTexts[1], inflatefunc, &calls, &out) == -1);
+			CHECK(!info.compressedTexts[0].compressedText.isInflated && !info.compressedTexts[1].compressedText.isInflated);
+		}
+		CHECK(calls == (inflatefunc ? 4 : 0));
+		CHECK(xng::png::get_text(info.compressedTexts[2], inflatefunc, &calls, &out) == -1);
+		CHECK(xng::png::get_text(info.internationalTexts[0], inflatefunc, &calls, &out) == -1);
+		CHECK(xng::png::get_profile(info.iccProfile, inflatefunc, &calls) == nullptr);
+		CHECK(calls == (inflatefunc ? 4 : 0));
+	}
+
+	// textual chunks skipped entirely, the other ancillary ones read
+	xng::png::ReadOptions options;
+	options.readTextualData = false;
+	xng::png::reset_decoderinfo(&info);
+	CHECK(xng::png::read_decoderinfo(image.chunks, &info, options) == 0);
+	CHECK(info.texts.empty() && info.compressedTexts.empty() && info.internationalTexts.empty() && info.iccProfile.isDefined);
+	CHECK(xng::png::get_profile(info.iccProfile, nullptr, nullptr) != nullptr);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! JPEG and JNG
+
+//! greyscale PNG image data of the alpha values, random filter types, stored blocks
+std::vector<uint8_t> alpha_imagedata(std::mt19937* rng, const std::vector<uint8_t>& alphas, uint32_t width)
+{
+	std::vector<uint8_t> raw, previous(width);
+	for (size_t row = 0; row < alphas.size(); row += width)
+	{
+		const uint8_t filterType = uint8_t((*rng)() % 5);
+		raw.push_back(filterType);
+		raw.resize(raw.size() + width);
+		xng::common::filter_scanline(&raw[raw.size() - width], &alphas[row], previous.data(), 1, filterType, width);
+		previous.assign(alphas.begin() + row, alphas.begin() + row + width);
+	}
+	return zlib_stored(raw, 1 + (*rng)() % 200);
+}
+
+//! appends data as chunks of random sizes
+void append_split(std::mt19937* rng, const char* type, const uint8_t* data, size_t size, std::vector<xng::chunk_t>* chunks)
+{
+	for (size_t pos = 0; pos < size;)
+	{
+		const size_t count = std::min(size - pos, size_t(1 + (*rng)() % 300));
+		chunks->push_back(make_chunk(type, std::vector<uint8_t>(data + pos, data + pos + count)));
+		pos += count;
+	}
+}
+
+//! decodes JNG file data (without signature), returns 0 on success
+int decode_jng(const std::vector<uint8_t>& filedata, const xng::jng::DecodeOptions& options, xng::JNGDocument* document)
+{
+	const std::vector<xng::chunk_t> chunks = xng::read_chunks(filedata.data(), filedata.size());
+	xng::jng::DecoderInfo			info;
+	if (xng::jng::read_decoderinfo(chunks, &info) != 0)
+	{
+		return -1;
+	}
+	return xng::jng::decode(info, options, document);
+}
+
+void test_jng()
+{
+	using xng::common::ByteSpan;
+	using xng::common::JpegTarget;
+
+	std::mt19937 rng(32);
+
+	// the built-in decoder against the source pixels, off by the losses of the encoder only. the stream is
+	// split into spans of random sizes, as by JDAT chunks
+	std::vector<ByteSpan> spans;
+	for (size_t pos = 0; pos < sizeof(color_jpeg);)
+	{
+		const size_t size = std::min(sizeof(color_jpeg) - pos, size_t(1 + rng() % (rng() % 2 ? 3 : 200)));
+		spans.push_back({color_jpeg + pos, size});
+		pos += size;
+	}
+	xng::common::JpegInfo jpegInfo;
+	CHECK(xng::common::read_jpeg_info(spans.data(), spans.size(), &jpegInfo) == 0);
+	CHECK(jpegInfo.width == jpeg_width && jpegInfo.height == jpeg_height && jpegInfo.components == 3);
+
+	const size_t		 stride = jpeg_width * 4;
+	std::vector<uint8_t> color(stride * jpeg_height, 7), grey(stride * jpeg_height, 7);
+	CHECK(xng::common::decode_jpeg(spans.data(), spans.size(), JpegTarget::RGBA, color.data(), stride) == 0);
+	int maxError = 0;
+	for (uint32_t y = 0; y < jpeg_height; ++y)
+	{
+		for (uint32_t x = 0; x < jpeg_width; ++x)
+		{
+			const uint8_t* pixel	  = &color[y * stride + x * 4];
+			const int	   source[3] = {int(40 + 7 * x), int(30 + 10 * y), int(200 - 3 * x - 4 * y)};
+			for (int c = 0; c < 3; ++c)
+			{
+				maxError = std::max(maxError, abs(pixel[c] - source[c]));
+			}
+			CHECK(pixel[3] == 0xFF);
+		}
+	}
+	// 4:2:0 chroma of the gradients
+	CHECK(maxError <= 12);
+
+	const ByteSpan greySpan = {grey_jpeg, sizeof(grey_jpeg)};
+	CHECK(xng::common::read_jpeg_info(&greySpan, 1, &jpegInfo) == 0 && jpegInfo.components == 1);
+	CHECK(xng::common::decode_jpeg(&greySpan, 1, JpegTarget::RGBA, grey.data(), stride) == 0);
+	maxError = 0;
+	for (uint32_t y = 0; y < jpeg_height; ++y)
+	{
+		for (uint32_t x = 0; x < jpeg_width; ++x)
+		{
+			const uint8_t* pixel = &grey[y * stride + x * 4];
+			maxError			 = std::max(maxError, abs(pixel[0] - int(16 + 5 * x + 3 * y)));
+			CHECK(pixel[0] == pixel[1] && pixel[0] == pixel[2] && pixel[3] == 0xFF);
+		}
+	}
+	CHECK(maxError <= 2);
+
+	// every truncation and random bit flips fail or decode without running out of bounds
+	std::vector<uint8_t> out(color.size());
+	for (size_t size = 0; size < sizeof(color_jpeg); ++size)
+	{
+		const ByteSpan truncated = {color_jpeg, size};
+		xng::common::decode_jpeg(&truncated, 1, JpegTarget::RGBA, out.data(), stride);
+	}
+	for (int i = 0; i < 200; ++i)
+	{
+		std::vector<uint8_t> corrupt(std::begin(color_jpeg), std::end(color_jpeg));
+		corrupt[rng() % corrupt.size()] ^= uint8_t(1 << rng() % 8);
+		const ByteSpan span = {corrupt.data(), corrupt.size()};
+		if (xng::common::read_jpeg_info(&span, 1, &jpegInfo) == 0 && jpegInfo.width == jpeg_width && jpegInfo.height == jpeg_height)
+		{
+			xng::common::decode_jpeg(&span, 1, JpegTarget::RGBA, out.data(), stride);
+		}
+	}
+
+	// JNG: color without alpha, color with PNG alpha, greyscale with JPEG alpha
+	std::vector<uint8_t> alphas(jpeg_width * jpeg_height);
+	for (uint8_t& alpha : alphas)
+	{
+		alpha = uint8_t(rng());
+	}
+	const uint8_t colorTypes[3]		   = {10, 14, 12};
+	const uint8_t alphaCompressions[3] = {0, 0, 8};
+	const uint8_t alphaDepths[3]	   = {0, 8, 8};
+
+	xng::common::ThreadPool pool(2);
+	for (int i = 0; i < 3; ++i)
+	{
+		std::vector<uint8_t> header;
+		append_uint32(&header, jpeg_width);
+		append_uint32(&header, jpeg_height);
+		header.insert(header.end(), {colorTypes[i], 8, 8, 0, alphaDepths[i], alphaCompressions[i], 0, 0});
+		std::vector<xng::chunk_t> chunks = {make_chunk("JHDR", header)};
+		if (i == 1)
+		{
+			const std::vector<uint8_t> imagedata = alpha_imagedata(&rng, alphas, jpeg_width);
+			append_split(&rng, "IDAT", imagedata.data(), imagedata.size(), &chunks);
+		}
+		if (i == 2)
+		{
+			append_split(&rng, "JDAT", grey_jpeg, sizeof(grey_jpeg), &chunks);
+			append_split(&rng, "JDAA", grey_jpeg, sizeof(grey_jpeg), &chunks);
+		}
+		else
+		{
+			append_split(&rng, "JDAT", color_jpeg, sizeof(color_jpeg), &chunks);
+		}
+		chunks.push_back(make_chunk("IEND", {}));
+		const std::vector<uint8_t> filedata = write_chunks(chunks);
+
+		// sequential, concurrent and pooled alpha decoding give the same pixels
+		std::vector<xng::jng::DecodeOptions> decodeOptions(3);
+		decodeOptions[0].concurrentAlpha = false;
+		decodeOptions[2].pool			 = &pool;
+		for (const xng::jng::DecodeOptions& options : decodeOptions)
+		{
+			xng::JNGDocument document;
+			CHECK(decode_jng(filedata, options, &document) == 0);
+			CHECK(document.width == jpeg_width && document.height == jpeg_height && document.frames.size() == 1);
+			if (document.frames.size() != 1 || document.frames[0].imagedata.size() != color.size())
+			{
+				continue;
+			}
+
+			const std::vector<uint8_t>& imagedata = document.frames[0].imagedata;
+			bool						isEqual	  = true;
+			for (size_t pixel = 0; pixel < alphas.size(); ++pixel)
+			{
+				const uint8_t* expected = i == 2 ? &grey[pixel * 4] : &color[pixel * 4];
+				const uint8_t  alpha	= i == 0 ? 0xFF : i == 1 ? alphas[pixel] : expected[0];
+				isEqual					= isEqual && memcmp(&imagedata[pixel * 4], expected, 3) == 0 && imagedata[pixel * 4 + 3] == alpha;
+			}
+			CHECK(isEqual);
+		}
+
+		corrupt_file(&rng, filedata, 30, [&](const std::vector<uint8_t>& corrupt) {
+			xng::JNGDocument document;
+			if (decode_jng(corrupt, decodeOptions[rng() % 3], &document) == 0)
+			{
+				CHECK(document.frames.size() == 1 && document.frames[0].imagedata.size() == size_t(document.width) * document.height * 4);
+			}
+		});
+	}
+
+	// image data missing or of another size than JHDR
+	std::vector<uint8_t> header;
+	append_uint32(&header, jpeg_width);
+	append_uint32(&header, jpeg_height);
+	header.insert(header.end(), {10, 8, 8, 0, 0, 0, 0, 0});
+	xng::JNGDocument document;
+	CHECK(decode_jng(write_chunks({make_chunk("JHDR", header), make_chunk("IEND", {})}), {}, &document) != 0);
+	header[3] = jpeg_width + 1;
+	CHECK(decode_jng(write_chunks({make_chunk("JHDR", header), make_chunk("JDAT", std::vector<uint8_t>(std::begin(color_jpeg), std::end(color_jpeg))), make_chunk("IEND", {})}), {}, &document) != 0);
+
+	// a huge JHDR size is rejected before the output is allocated
+	header[1] = 0x10;
+	header[5] = 0x10;
+	CHECK(decode_jng(write_chunks({make_chunk("JHDR", header), make_chunk("JDAT", std::vector<uint8_t>(std::begin(color_jpeg), std::end(color_jpeg))), make_chunk("IEND", {})}), {}, &document) != 0);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! MNG playback
+
+//! appends the chunks of a PNG of one color, rgba8
+void append_flat_png(std::vector<xng::chunk_t>* chunks, uint32_t width, uint32_t height, uint32_t rgba)
+{
+	std::vector<uint8_t> header, raw;
+	append_uint32(&header, width);
+	append_uint32(&header, height);
+	header.insert(header.end(), {8, 6, 0, 0, 0});
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			append_uint32(&raw, rgba);
+		}
+	}
+	chunks->push_back(make_chunk("IHDR", header));
+	chunks->push_back(make_chunk("IDAT", zlib_stored(raw)));
+	chunks->push_back(make_chunk("IEND", {}));
+}
+
+std::vector<uint8_t> mng_header(uint32_t width, uint32_t height, uint32_t ticksPerSecond)
+{
+	std::vector<uint8_t> data;
+	for (uint32_t value : {width, height, ticksPerSecond, 0u, 0u, 0u, 0u})
+	{
+		append_uint32(&data, value);
+	}
+	return data;
+}
+
+//! DEFI of a concrete object
+std::vector<uint8_t> mng_define(uint16_t objectId, bool isHidden, int32_t x, int32_t y)
+{
+	std::vector<uint8_t> data;
+	append_uint16(&data, objectId);
+	data.push_back(isHidden ? 1 : 0);
+	data.push_back(0);
+	append_uint32(&data, uint32_t(x));
+	append_uint32(&data, uint32_t(y));
+	return data;
+}
+
+//! SHOW of an object range
+std::vector<uint8_t> mng_show(uint16_t first, uint16_t last)
+{
+	std::vector<uint8_t> data;
+	append_uint16(&data, first);
+	append_uint16(&data, last);
+	return data;
+}
+
+uint32_t pixel_at(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t x, uint32_t y)
+{
+	const uint8_t* pixel = &rgba[(size_t(y) * width + x) * 4];
+	return uint32_t(pixel[0]) << 24 | uint32_t(pixel[1]) << 16 | uint32_t(pixel[2]) << 8 | pixel[3];
+}
+
+//! plays up to maxFrames frames of MNG file data (without signature) of up to 1M pixels, checking their
+//! size. returns the number of frames, -1 if the playback fails to open or a frame fails
+int play_mng(const std::vector<uint8_t>& filedata, int maxFrames)
+{
+	const std::vector<xng::chunk_t> chunks = xng::read_chunks(filedata.data(), filedata.size());
+	xng::mng::PlaybackOptions		options;
+	xng::mng::Playback				playback;
+	options.maxFramePixels = 1 << 20;
+	if (xng::mng::open_playback(chunks, options, &playback) != 0)
+	{
+		return -1;
+	}
+
+	xng::mng::Frame frame;
+	for (int frames = 0; frames < maxFrames; ++frames)
+	{
+		const xng::mng::PlaybackStatus status = xng::mng::next_frame(&playback, &frame);
+		if (status != xng::mng::PlaybackStatus::Frame)
+		{
+			return status == xng::mng::PlaybackStatus::End ? frames : -1;
+		}
+		CHECK(frame.imagedata.size() == size_t(playback.header.frameWidth) * playback.header.frameHeight * 4);
+	}
+	return maxFrames;
+}
+
+void test_mng()
+{
+	using xng::mng::PlaybackStatus;
+
+	std::mt19937 rng(34);
+
+	// an object moved by MOVE in an endless loop on a red background, layers accumulate
+	std::vector<xng::chunk_t> chunks = {make_chunk("MHDR", mng_header(8, 4, 10)), make_chunk("BACK", {0xFF, 0xFF, 0, 0, 0, 0})};
+	chunks.push_back(make_chunk("DEFI", mng_define(1, false, 0, 1)));
+	append_flat_png(&chunks, 2, 2, 0x00FF00FF);
+	std::vector<uint8_t> loop = {0};
+	append_uint32(&loop, 1000000000);
+	chunks.push_back(make_chunk("LOOP", loop));
+	std::vector<uint8_t> move = mng_show(1, 1);
+	move.push_back(1);
+	append_uint32(&move, 1);
+	append_uint32(&move, 0);
+	chunks.push_back(make_chunk("MOVE", move));
+	chunks.push_back(make_chunk("SHOW", mng_show(1, 1)));
+	chunks.push_back(make_chunk("ENDL", {0}));
+	chunks.push_back(make_chunk("MEND", {}));
+	const std::vector<uint8_t> loopFile = write_chunks(chunks);
+	{
+		xng::mng::Playback playback;
+		xng::mng::Frame	   frame;
+		CHECK(xng::mng::open_playback(chunks, {}, &playback) == 0);
+		CHECK(xng::mng::next_frame(&playback, &frame) == PlaybackStatus::Frame);
+		CHECK(frame.duration == 0.1f);
+		CHECK(pixel_at(frame.imagedata, 8, 0, 0) == 0xFF0000FF && pixel_at(frame.imagedata, 8, 0, 1) == 0x00FF00FF);
+		CHECK(pixel_at(frame.imagedata, 8, 2, 1) == 0xFF0000FF);
+		for (uint32_t i = 1; i <= 5; ++i)
+		{
+			CHECK(xng::mng::next_frame(&playback, &frame) == PlaybackStatus::Frame);
+			CHECK(pixel_at(frame.imagedata, 8, i + 1, 2) == 0x00FF00FF);
+		}
+		CHECK(playback.loops.size() == 1 && playback.loops[0].remaining == 1000000000 - 4);
+	}
+
+	// subframes with a FRAM delay, two objects, a clipped object
+	chunks = {make_chunk("MHDR", mng_header(4, 4, 100))};
+	std::vector<uint8_t> framing = {4, 0, 2, 0, 0, 0};
+	append_uint32(&framing, 25);
+	chunks.push_back(make_chunk("FRAM", framing));
+	chunks.push_back(make_chunk("DEFI", mng_define(1, false, 0, 0)));
+	append_flat_png(&chunks, 2, 2, 0xFF0000FF);
+	chunks.push_back(make_chunk("DEFI", mng_define(2, false, 2, 2)));
+	append_flat_png(&chunks, 2, 2, 0x0000FFFF);
+	chunks.push_back(make_chunk("FRAM", {}));
+	std::vector<uint8_t> clip = mng_show(1, 1);
+	clip.push_back(0);
+	for (uint32_t value : {0u, 1u, 0u, 1u})
+	{
+		append_uint32(&clip, value);
+	}
+	chunks.push_back(make_chunk("CLIP", clip));
+	chunks.push_back(make_chunk("SHOW", mng_show(1, 2)));
+	chunks.push_back(make_chunk("MEND", {}));
+	{
+		xng::mng::Playback playback;
+		xng::mng::Frame	   frame;
+		CHECK(xng::mng::open_playback(chunks, {}, &playback) == 0);
+		CHECK(xng::mng::next_frame(&playback, &frame) == PlaybackStatus::Frame);
+		CHECK(frame.duration == 0.25f);
+		CHECK(pixel_at(frame.imagedata, 4, 1, 1) == 0xFF0000FF && pixel_at(frame.imagedata, 4, 3, 3) == 0x0000FFFF);
+		CHECK(pixel_at(frame.imagedata, 4, 3, 0) == 0);
+		CHECK(xng::mng::next_frame(&playback, &frame) == PlaybackStatus::Frame);
+		CHECK(pixel_at(frame.imagedata, 4, 0, 0) == 0xFF0000FF && pixel_at(frame.imagedata, 4, 1, 1) == 0);
+		CHECK(pixel_at(frame.imagedata, 4, 3, 3) == 0x0000FFFF);
+		CHECK(xng::mng::next_frame(&playback, &frame) == PlaybackStatus::End);
+	}
+
+	// TERM repeating three times, full and partial clones sharing their image until it is written to,
+	// an empty loop
+	chunks = {make_chunk("MHDR", mng_header(4, 1, 0)), make_chunk("TERM", {3, 0, 0, 0, 0, 0, 0, 0, 0, 3})};
+	chunks.push_back(make_chunk("DEFI", mng_define(1, true, 0, 0)));
+	append_flat_png(&chunks, 1, 1, 0x112233FF);
+	for (uint8_t cloneType : {0, 1})
+	{
+		std::vector<uint8_t> clone = mng_show(1, cloneType == 0 ? 2 : 3);
+		clone.insert(clone.end(), {cloneType, 0, 0, 0});
+		append_uint32(&clone, 1 + cloneType);
+		append_uint32(&clone, 0);
+		chunks.push_back(make_chunk("CLON", clone));
+	}
+	std::vector<uint8_t> emptyLoop = {0};
+	append_uint32(&emptyLoop, 0x7FFFFFFF);
+	chunks.push_back(make_chunk("LOOP", emptyLoop));
+	chunks.push_back(make_chunk("ENDL", {0}));
+	chunks.push_back(make_chunk("SHOW", mng_show(1, 3)));
+	chunks.push_back(make_chunk("MEND", {}));
+	{
+		xng::mng::Playback playback;
+		xng::mng::Frame	   frame;
+		CHECK(xng::mng::open_playback(chunks, {}, &playback) == 0);
+		int			   frames = 0;
+		PlaybackStatus status;
+		while ((status = xng::mng::next_frame(&playback, &frame)) == PlaybackStatus::Frame)
+		{
+			++frames;
+			CHECK(frame.duration == 0);
+			if (frames == 1)
+			{
+				CHECK(playback.objects[1].image->buffer == playback.objects[2].image->buffer);
+				CHECK(playback.objects[1].image == playback.objects[3].image);
+				CHECK(playback.objects[1].image != playback.objects[2].image);
+				xng::mng::ImageBuffer* buffer = xng::mng::get_writable_image(&playback.objects[2]);
+				CHECK(buffer != playback.objects[1].image->buffer.get());
+				buffer->rgba[0] = 0x99;
+			}
+			if (frames % 3 == 0)
+			{
+				CHECK(pixel_at(frame.imagedata, 4, 0, 0) == 0x112233FF && pixel_at(frame.imagedata, 4, 2, 0) == 0x112233FF);
+				CHECK(pixel_at(frame.imagedata, 4, 1, 0) == (frames == 3 ? 0x992233FF : 0x112233FF));
+			}
+		}
+		CHECK(status == PlaybackStatus::End);
+		CHECK(frames == 9);
+	}
+	const std::vector<uint8_t> termFile = write_chunks(chunks);
+
+	// an embedded JNG, decoded like a JNG file
+	std::vector<uint8_t> jngHeader;
+	append_uint32(&jngHeader, jpeg_width);
+	append_uint32(&jngHeader, jpeg_height);
+	jngHeader.insert(jngHeader.end(), {10, 8, 8, 0, 0, 0, 0, 0});
+	chunks = {make_chunk("MHDR", mng_header(jpeg_width, jpeg_height, 1)), make_chunk("DEFI", mng_define(1, false, 0, 0))};
+	chunks.push_back(make_chunk("JHDR", jngHeader));
+	chunks.push_back(make_chunk("JDAT", std::vector<uint8_t>(std::begin(color_jpeg), std::end(color_jpeg))));
+	chunks.push_back(make_chunk("IEND", {}));
+	chunks.push_back(make_chunk("MEND", {}));
+	{
+		xng::mng::Playback playback;
+		xng::mng::Frame	   frame;
+		xng::JNGDocument   document;
+		CHECK(decode_jng(write_chunks({chunks.begin() + 2, chunks.end() - 1}), {}, &document) == 0);
+		CHECK(xng::mng::open_playback(chunks, {}, &playback) == 0);
+		CHECK(xng::mng::next_frame(&playback, &frame) == PlaybackStatus::Frame);
+		CHECK(document.frames.size() == 1 && frame.imagedata == document.frames[0].imagedata);
+		CHECK(xng::mng::next_frame(&playback, &frame) == PlaybackStatus::End);
+	}
+
+	// the interpreter stops at a chunk it can't interprete, corrupt files don't run out of bounds
+	CHECK(play_mng(loopFile, 100) == 100);
+	CHECK(play_mng(termFile, 100) == 9);
+	corrupt_file(&rng, loopFile, 100, [](const std::vector<uint8_t>& corrupt) {
+		play_mng(corrupt, 50);
+	});
+	corrupt_file(&rng, termFile, 100, [](const std::vector<uint8_t>& corrupt) {
+		play_mng(corrupt, 50);
+	});
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! delta-PNG
+
+uint32_t channel_count(uint8_t colorType)
+{
+	const uint32_t counts[7] = {1, 0, 3, 1, 2, 0, 4};
+	return counts[colorType];
+}
+
+//! PNG image data of the samples, filter type 0, stored blocks
+std::vector<uint8_t> sample_imagedata(const std::vector<uint32_t>& samples, uint32_t width, uint32_t height, uint8_t colorType, uint8_t bitdepth)
+{
+	const uint32_t		 channels = channel_count(colorType);
+	std::vector<uint8_t> raw;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		if (bitdepth >= 8)
+		{
+			for (uint32_t i = 0; i < width * channels; ++i)
+			{
+				const uint32_t sample = samples[y * width * channels + i];
+				if (bitdepth == 16)
+				{
+					raw.push_back(uint8_t(sample >> 8));
+				}
+				raw.push_back(uint8_t(sample));
+			}
+			continue;
+		}
+
+		const size_t rowStart = raw.size();
+		raw.resize(rowStart + (width * bitdepth + 7) / 8);
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			raw[rowStart + x * bitdepth / 8] |= uint8_t(samples[y * width + x] << (8 - bitdepth - x * bitdepth % 8));
+		}
+	}
+	return zlib_stored(raw);
+}
+
+//! rgba8 pixels of the samples, as decoded into MNG objects
+//! param[in] colorKey: samples of the transparent color of grey and truecolor images, nullptr for none
+std::vector<uint8_t> samples_to_rgba(const std::vector<uint32_t>& samples,
+									 uint8_t					  colorType,
+									 uint8_t					  bitdepth,
+									 const std::vector<uint32_t>& palette,
+									 const uint32_t*			  colorKey)
+{
+	const uint32_t		 channels = channel_count(colorType);
+	const uint32_t		 scale	  = bitdepth < 8 ? 255 / ((1u << bitdepth) - 1) : 1;
+	std::vector<uint8_t> rgba;
+	for (size_t i = 0; i < samples.size(); i += channels)
+	{
+		const uint32_t* pixel = &samples[i];
+		if (colorType == 3)
+		{
+			append_uint32(&rgba, pixel[0] < palette.size() ? palette[pixel[0]] : 0x000000FF);
+			continue;
+		}
+
+		const bool	   isColor = colorType == 2 || colorType == 6;
+		const uint32_t color[3] = {pixel[0], isColor ? pixel[1] : pixel[0], isColor ? pixel[2] : pixel[0]};
+		for (uint32_t value : color)
+		{
+			rgba.push_back(uint8_t(bitdepth == 16 ? value >> 8 : value * scale));
+		}
+		if (colorType == 4 || colorType == 6)
+		{
+			const uint32_t alpha = pixel[channels - 1];
+			rgba.push_back(uint8_t(bitdepth == 16 ? alpha >> 8 : alpha * scale));
+		}
+		else
+		{
+			const bool isKey = colorKey && color[0] == colorKey[0] && color[1] == colorKey[1] && color[2] == colorKey[2];
+			rgba.push_back(isKey ? 0 : 0xFF);
+		}
+	}
+	return rgba;
+}
+
+struct ChangeLog
+{
+	int			   calls = 0;
+	xng::mng::Rect rect;
+};
+
+void log_change(void* context, uint16_t, const xng::mng::Rect& rect)
+{
+	auto log = static_cast<ChangeLog*>(context);
+	++log->calls;
+	log->rect = rect;
+}
+
+void test_delta_png()
+{
+	std::mt19937 rng(35);
+
+	// random images of all color types and bit depths, changed by a random DHDR block of every delta type
+	// and PPLT
+	std::vector<uint8_t> deltaFile;
+	for (int i = 0; i < 300; ++i)
+	{
+		const uint8_t colorTypes[5]	 = {0, 2, 3, 4, 6};
+		const uint8_t greyDepths[5]	 = {1, 2, 4, 8, 16};
+		const uint8_t colorType		 = colorTypes[rng() % 5];
+		const uint8_t bitdepth		 = colorType == 0 ? greyDepths[rng() % 5] : colorType == 3 ? greyDepths[rng() % 4] : rng() % 4 ? 8 : 16;
+		const uint32_t width		 = 1 + rng() % 20;
+		const uint32_t height		 = 1 + rng() % 12;
+		const uint32_t channels		 = channel_count(colorType);
+		const uint32_t maxValue		 = (1u << bitdepth) - 1;
+		const uint32_t paletteSize	 = colorType == 3 ? 1 + rng() % std::min(256u, maxValue + 1) : 0;
+		const bool	   hasAlpha		 = colorType == 4 || colorType == 6;
+		const bool	   hasColorKey	 = (colorType == 0 || colorType == 2) && bitdepth != 16 && rng() % 2 == 0;
+
+		std::vector<uint32_t> samples(width * height * channels), palette(paletteSize);
+		for (uint32_t& sample : samples)
+		{
+			sample = colorType == 3 ? rng() % paletteSize : rng() % (maxValue + 1);
+		}
+		for (uint32_t& color : palette)
+		{
+			color = rng() << 8 | 0xFF;
+		}
+		// the color of a pixel, so some of them are transparent
+		uint32_t	   colorKey[3];
+		const uint32_t keyPixel = rng() % (width * height) * channels;
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			colorKey[c] = samples[keyPixel + (colorType == 2 ? c : 0)];
+		}
+
+		// the rgba8 objects keep 8 bits of 16-bit samples, additions there aren't exact
+		uint8_t deltaType = uint8_t(1 + rng() % 7);
+		if ((deltaType == 2 || deltaType == 5) && !hasAlpha)
+		{
+			deltaType = 1;
+		}
+		if (bitdepth == 16 && deltaType <= 3)
+		{
+			deltaType += 3;
+		}
+
+		std::vector<xng::chunk_t> chunks = {make_chunk("MHDR", mng_header(width, height, 1))};
+		std::vector<uint8_t>	  define = mng_define(1, false, 0, 0);
+		define[3]						 = 1;
+		chunks.push_back(make_chunk("DEFI", define));
+		std::vector<uint8_t> header;
+		append_uint32(&header, width);
+		append_uint32(&header, height);
+		header.insert(header.end(), {bitdepth, colorType, 0, 0, 0});
+		chunks.push_back(make_chunk("IHDR", header));
+		if (colorType == 3)
+		{
+			std::vector<uint8_t> colors;
+			for (uint32_t color : palette)
+			{
+				append_uint32(&colors, color);
+				colors.pop_back();
+			}
+			chunks.push_back(make_chunk("PLTE", colors));
+		}
+		if (hasColorKey)
+		{
+			std::vector<uint8_t> transparency;
+			for (uint32_t c = 0; c < (colorType == 0 ? 1 : 3); ++c)
+			{
+				append_uint16(&transparency, uint16_t(colorKey[c]));
+			}
+			chunks.push_back(make_chunk("tRNS", transparency));
+		}
+		chunks.push_back(make_chunk("IDAT", sample_imagedata(samples, width, height, colorType, bitdepth)));
+		chunks.push_back(make_chunk("IEND", {}));
+
+		// a full clone keeps the original image
+		chunks.push_back(make_chunk("CLON", {0, 1, 0, 2, 0}));
+
+		const uint32_t		 blockX		 = rng() % width;
+		const uint32_t		 blockY		 = rng() % height;
+		const uint32_t		 blockWidth	 = 1 + rng() % (width + 3);
+		const uint32_t		 blockHeight = 1 + rng() % (height + 3);
+		std::vector<uint8_t> delta		 = {0, 1, 1, deltaType};
+		if (deltaType != 7)
+		{
+			for (uint32_t value : {blockWidth, blockHeight, blockX, blockY})
+			{
+				append_uint32(&delta, value);
+			}
+		}
+		chunks.push_back(make_chunk("DHDR", delta));
+
+		std::vector<uint32_t> expected = samples, expectedPalette = palette;
+		const bool			  hasPaletteDelta = colorType == 3 && rng() % 2 == 0;
+		if (hasPaletteDelta)
+		{
+			// PPLT: RGB, alpha or RGBA, replaced or added, of a few entries, past the palette size included
+			const uint8_t		 paletteDeltaType = uint8_t(rng() % 6);
+			const uint32_t		 first			  = rng() % paletteSize;
+			const uint32_t		 last			  = std::min(255u, first + uint32_t(rng() % 4));
+			const uint32_t		 firstByte		  = paletteDeltaType == 2 || paletteDeltaType == 3 ? 3 : 0;
+			const uint32_t		 byteCount		  = paletteDeltaType < 2 ? 3 : paletteDeltaType < 4 ? 1 : 4;
+			std::vector<uint8_t> paletteDelta	  = {paletteDeltaType, uint8_t(first), uint8_t(last)};
+			if (last >= expectedPalette.size())
+			{
+				expectedPalette.resize(last + 1, 0xFF);
+			}
+			for (uint32_t index = first; index <= last; ++index)
+			{
+				uint8_t color[4];
+				for (int c = 0; c < 4; ++c)
+				{
+					color[c] = uint8_t(expectedPalette[index] >> (24 - 8 * c));
+				}
+				for (uint32_t c = firstByte; c < firstByte + byteCount; ++c)
+				{
+					const uint8_t value = uint8_t(rng());
+					paletteDelta.push_back(value);
+					color[c] = paletteDeltaType % 2 ? uint8_t(color[c] + value) : value;
+				}
+				expectedPalette[index] = uint32_t(color[0]) << 24 | uint32_t(color[1]) << 16 | uint32_t(color[2]) << 8 | color[3];
+			}
+			chunks.push_back(make_chunk("PPLT", paletteDelta));
+		}
+
+		if (deltaType != 7)
+		{
+			// alpha deltas are greyscale, color deltas drop the alpha channel
+			uint8_t deltaColorType = colorType;
+			if (deltaType == 2 || deltaType == 5 || ((deltaType == 3 || deltaType == 6) && colorType == 4))
+			{
+				deltaColorType = 0;
+			}
+			else if ((deltaType == 3 || deltaType == 6) && colorType == 6)
+			{
+				deltaColorType = 2;
+			}
+			const uint32_t		  deltaChannels = channel_count(deltaColorType);
+			std::vector<uint32_t> deltaSamples(blockWidth * blockHeight * deltaChannels);
+			for (uint32_t& sample : deltaSamples)
+			{
+				sample = colorType == 3 && (deltaType == 4 || deltaType == 6) ? rng() % paletteSize : rng() % (maxValue + 1);
+			}
+			chunks.push_back(make_chunk("IDAT", sample_imagedata(deltaSamples, blockWidth, blockHeight, deltaColorType, bitdepth)));
+
+			const uint32_t firstChannel = deltaType == 2 || deltaType == 5 ? channels - 1 : 0;
+			const uint32_t count		= deltaType == 2 || deltaType == 5 ? 1 : (deltaType == 3 || deltaType == 6) && hasAlpha ? channels - 1 : channels;
+			for (uint32_t y = blockY; y < std::min(height, blockY + blockHeight); ++y)
+			{
+				for (uint32_t x = blockX; x < std::min(width, blockX + blockWidth); ++x)
+				{
+					uint32_t*		pixel = &expected[(y * width + x) * channels];
+					const uint32_t* value = &deltaSamples[((y - blockY) * blockWidth + x - blockX) * deltaChannels];
+					for (uint32_t c = 0; c < count; ++c)
+					{
+						pixel[firstChannel + c] = deltaType <= 3 ? (pixel[firstChannel + c] + value[c]) & maxValue : value[c];
+					}
+				}
+			}
+		}
+		chunks.push_back(make_chunk("DROP", {'t', 'E', 'X', 't'}));
+		chunks.push_back(make_chunk("IEND", {}));
+		chunks.push_back(make_chunk("MEND", {}));
+
+		ChangeLog				  changes;
+		xng::mng::PlaybackOptions options;
+		options.objectChanged		 = log_change;
+		options.objectChangedContext = &changes;
+		xng::mng::Playback playback;
+		xng::mng::Frame	   frame;
+		CHECK(xng::mng::open_playback(chunks, options, &playback) == 0);
+		int						 frames = 0;
+		xng::mng::PlaybackStatus status;
+		while ((status = xng::mng::next_frame(&playback, &frame)) == xng::mng::PlaybackStatus::Frame)
+		{
+			++frames;
+		}
+		CHECK(status == xng::mng::PlaybackStatus::End && frames == 2);
+		if (!playback.objects[1].image || !playback.objects[2].image)
+		{
+			CHECK(!"objects defined");
+			continue;
+		}
+
+		const std::vector<uint8_t> changed = samples_to_rgba(expected, colorType, bitdepth, expectedPalette, hasColorKey ? colorKey : nullptr);
+		CHECK(playback.objects[1].image->buffer->rgba == changed);
+		CHECK(playback.objects[2].image->buffer->rgba == samples_to_rgba(samples, colorType, bitdepth, palette, hasColorKey ? colorKey : nullptr));
+		CHECK(hasAlpha || hasColorKey || colorType == 3 || frame.imagedata == changed);
+		if (deltaType != 7 && !hasPaletteDelta)
+		{
+			CHECK(changes.calls == 1 && changes.rect.left == int32_t(blockX) && changes.rect.top == int32_t(blockY));
+			CHECK(changes.rect.right == int32_t(std::min(width, blockX + blockWidth)) && changes.rect.bottom == int32_t(std::min(height, blockY + blockHeight)));
+		}
+		if (i == 0)
+		{
+			deltaFile = write_chunks(chunks);
+		}
+	}
+
+	// a block claiming far more pixels than its image data holds
+	std::vector<xng::chunk_t> hugeBlock = {make_chunk("MHDR", mng_header(4, 4, 1))};
+	std::vector<uint8_t>	  define	= mng_define(1, false, 0, 0);
+	define[3]							= 1;
+	hugeBlock.push_back(make_chunk("DEFI", define));
+	append_flat_png(&hugeBlock, 4, 4, 0xFF0000FF);
+	std::vector<uint8_t> delta = {0, 1, 1, 4};
+	for (uint32_t value : {0x40000000u, 0x40000000u, 0u, 0u})
+	{
+		append_uint32(&delta, value);
+	}
+	hugeBlock.push_back(make_chunk("DHDR", delta));
+	hugeBlock.push_back(make_chunk("IDAT", zlib_stored(std::vector<uint8_t>(64))));
+	hugeBlock.push_back(make_chunk("IEND", {}));
+	hugeBlock.push_back(make_chunk("MEND", {}));
+	CHECK(play_mng(write_chunks(hugeBlock), 10) == -1);
+
+	// blocks outside the object and corrupt files
+	corrupt_file(&rng, deltaFile, 200, [](const std::vector<uint8_t>& corrupt) {
+		play_mng(corrupt, 10);
+	});
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! LZ snapshots and seek indices
+
+void test_lz()
+{
+	std::mt19937 rng(36);
+	for (int i = 0; i < 60; ++i)
+	{
+		const std::vector<uint8_t> data = make_data(&rng, i < 3 ? i : rng() % 200000, i % 3);
+		std::vector<uint8_t>	   compressed;
+		xng::common::lz_compress(data.data(), data.size(), &compressed);
+		std::vector<uint8_t> out(data.size());
+		CHECK(xng::common::lz_decompress(compressed.data(), compressed.size(), out.data(), out.size()) == 0);
+		CHECK(out == data);
+		if (data.empty())
+		{
+			continue;
+		}
+
+		// other sizes than the compressed one
+		std::vector<uint8_t> longer(data.size() + 1);
+		CHECK(xng::common::lz_decompress(compressed.data(), compressed.size(), longer.data(), longer.size()) == -1);
+		CHECK(xng::common::lz_decompress(compressed.data(), compressed.size(), out.data(), out.size() - 1) == -1);
+
+		// corrupt data is rejected or decompressed within the output size
+		corrupt_file(&rng, compressed, 20, [&out](const std::vector<uint8_t>& corrupt) {
+			std::unique_ptr<uint8_t[]> input(new uint8_t[corrupt.size()]);
+			std::copy(corrupt.begin(), corrupt.end(), input.get());
+			xng::common::lz_decompress(input.get(), corrupt.size(), out.data(), out.size());
+		});
+	}
+}
+
+//! animated PNG of random frames in random regions with all dispose and blend operations,
+//! the IDAT image is the first frame. frames are 0.1 s
+std::vector<uint8_t> make_apng(std::mt19937* rng, uint32_t width, uint32_t height, uint32_t frameCount)
+{
+	std::vector<uint8_t> header, animation;
+	append_uint32(&header, width);
+	append_uint32(&header, height);
+	header.insert(header.end(), {8, 6, 0, 0, 0});
+	append_uint32(&animation, frameCount);
+	append_uint32(&animation, 0);
+	std::vector<xng::chunk_t> chunks = {make_chunk("IHDR", header), make_chunk("acTL", animation)};
+
+	uint32_t sequence = 0;
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		const uint32_t		 frameWidth	 = i == 0 ? width : 1 + (*rng)() % width;
+		const uint32_t		 frameHeight = i == 0 ? height : 1 + (*rng)() % height;
+		std::vector<uint8_t> control;
+		append_uint32(&control, sequence++);
+		append_uint32(&control, frameWidth);
+		append_uint32(&control, frameHeight);
+		append_uint32(&control, (*rng)() % (width - frameWidth + 1));
+		append_uint32(&control, (*rng)() % (height - frameHeight + 1));
+		append_uint16(&control, 1);
+		append_uint16(&control, 10);
+		control.push_back(uint8_t((*rng)() % 3));
+		control.push_back(uint8_t((*rng)() % 2));
+		chunks.push_back(make_chunk("fcTL", control));
+
+		// flat colors with transparent, translucent and opaque pixels
+		std::vector<uint8_t> raw;
+		const uint32_t		 color = (*rng)() & 0xFFFFFF00;
+		for (uint32_t y = 0; y < frameHeight; ++y)
+		{
+			raw.push_back(0);
+			for (uint32_t x = 0; x < frameWidth; ++x)
+			{
+				const uint32_t alphas[3] = {0, 0xFF, uint32_t((*rng)() & 0xFF)};
+				append_uint32(&raw, color | alphas[(*rng)() % 3]);
+			}
+		}
+		if (i == 0)
+		{
+			chunks.push_back(make_chunk("IDAT", zlib_stored(raw)));
+			continue;
+		}
+		std::vector<uint8_t> imagedata;
+		append_uint32(&imagedata, sequence++);
+		const std::vector<uint8_t> compressed = zlib_stored(raw);
+		imagedata.insert(imagedata.end(), compressed.begin(), compressed.end());
+		chunks.push_back(make_chunk("fdAT", imagedata));
+	}
+	chunks.push_back(make_chunk("IEND", {}));
+	return write_chunks(chunks);
+}
+
+//! MNG of an object moved by MOVE in nested loops on a red background, 0.1 s per frame. the object
+//! positions are state besides the canvas
+std::vector<xng::chunk_t> moving_mng()
+{
+	std::vector<xng::chunk_t> chunks = {make_chunk("MHDR", mng_header(8, 4, 10)), make_chunk("BACK", {0xFF, 0xFF, 0, 0, 0, 0})};
+	chunks.push_back(make_chunk("DEFI", mng_define(1, false, 0, 1)));
+	append_flat_png(&chunks, 2, 2, 0x00FF00FF);
+	std::vector<uint8_t> outerLoop = {0}, innerLoop = {1};
+	append_uint32(&outerLoop, 20);
+	append_uint32(&innerLoop, 8);
+	std::vector<uint8_t> move = mng_show(1, 1), moveBack = mng_show(1, 1);
+	move.push_back(1);
+	append_uint32(&move, 1);
+	append_uint32(&move, 0);
+	moveBack.push_back(1);
+	append_uint32(&moveBack, uint32_t(-8));
+	append_uint32(&moveBack, 1);
+	chunks.push_back(make_chunk("LOOP", outerLoop));
+	chunks.push_back(make_chunk("LOOP", innerLoop));
+	chunks.push_back(make_chunk("MOVE", move));
+	chunks.push_back(make_chunk("SHOW", mng_show(1, 1)));
+	chunks.push_back(make_chunk("ENDL", {1}));
+	chunks.push_back(make_chunk("MOVE", moveBack));
+	chunks.push_back(make_chunk("ENDL", {0}));
+	chunks.push_back(make_chunk("MEND", {}));
+	return chunks;
+}
+
+//! seeks to random times, forwards and backwards, and compares the frames with those of a sequential
+//! playback: frames[i] starts at starts[i]
+template <typename Playback, typename SeekIndex, typename Frame, typename Seek>
+void check_seeks(std::mt19937* rng, Playback* playback, const SeekIndex& index, const std::vector<Frame>& frames, const std::vector<double>& starts, Seek seek)
+{
+	Frame frame;
+	for (int i = 0; i < 40; ++i)
+	{
+		const size_t target = (*rng)() % frames.size();
+		const double time	= starts[target] + frames[target].duration * ((*rng)() % 4) / 4;
+		CHECK(seek(playback, index, time, &frame) == xng::common::PlaybackStatus::Frame);
+		CHECK(frame.imagedata == frames[target].imagedata);
+	}
+	CHECK(seek(playback, index, starts.back() + 1000.0, &frame) == xng::common::PlaybackStatus::End);
+}
+
+void test_seek()
+{
+	using xng::common::PlaybackStatus;
+
+	std::mt19937 rng(36);
+
+	// APNG
+	const std::vector<uint8_t>		apng   = make_apng(&rng, 24, 16, 120);
+	const std::vector<xng::chunk_t> chunks = xng::read_chunks(apng.data(), apng.size());
+	xng::png::DecoderInfo			info;
+	CHECK(xng::png::read_decoderinfo(chunks, &info) == 0);
+	{
+		std::vector<xng::png::Frame> frames;
+		std::vector<double>			 starts;
+		xng::png::Playback			 playback;
+		xng::png::Frame				 frame;
+		CHECK(xng::png::open_playback(info, {}, &playback) == 0);
+		for (double start = playback.time; xng::png::next_frame(&playback, &frame) == PlaybackStatus::Frame; start = playback.time)
+		{
+			frames.push_back(frame);
+			starts.push_back(start);
+		}
+		CHECK(frames.size() == 120);
+
+		// the memory limit of a few canvases drops keyframes and doubles the interval
+		xng::common::SeekIndexOptions seekOptions;
+		seekOptions.interval	= 0.5;
+		seekOptions.memoryLimit = 8000;
+		xng::png::SeekIndex index, limited;
+		CHECK(xng::png::build_seekindex(info, {}, {0.5, 0, 1 << 20}, &index) == 0);
+		CHECK(xng::png::build_seekindex(info, {}, seekOptions, &limited) == 0);
+		CHECK(index.keyframes.size() >= 20 && limited.keyframes.size() < index.keyframes.size() && limited.interval > 0.5);
+		CHECK(limited.memoryUsage <= seekOptions.memoryLimit);
+
+		const auto seek = [](xng::png::Playback* p, const xng::png::SeekIndex& i, double time, xng::png::Frame* f) {
+			return xng::png::seek(p, i, time, f);
+		};
+		check_seeks(&rng, &playback, index, frames, starts, seek);
+		check_seeks(&rng, &playback, limited, frames, starts, seek);
+		check_seeks(&rng, &playback, xng::png::SeekIndex{}, frames, starts, seek);
+
+		// serialized, and rejected for another region
+		std::vector<uint8_t> serialized;
+		xng::png::write_seekindex(index, &serialized);
+		xng::png::SeekIndex restored;
+		CHECK(xng::png::read_seekindex(serialized.data(), serialized.size(), playback, &restored) == 0);
+		CHECK(restored.keyframes.size() == index.keyframes.size() && restored.interval == index.interval);
+		check_seeks(&rng, &playback, restored, frames, starts, seek);
+		xng::png::DecodeOptions options;
+		options.region = {2, 2, 10, 10};
+		xng::png::Playback regionPlayback;
+		CHECK(xng::png::open_playback(info, options, &regionPlayback) == 0);
+		CHECK(xng::png::read_seekindex(serialized.data(), serialized.size(), regionPlayback, &restored) == -1);
+		CHECK(xng::png::seek(&regionPlayback, index, 1.0, &frame) == PlaybackStatus::Error);
+
+		// corrupt indices leave the index as it is when rejected, seeking with them fails or returns frames
+		corrupt_file(&rng, serialized, 100, [&](const std::vector<uint8_t>& corrupt) {
+			xng::png::SeekIndex corruptIndex = index;
+			if (xng::png::read_seekindex(corrupt.data(), corrupt.size(), playback, &corruptIndex) != 0)
+			{
+				CHECK(corruptIndex.keyframes.size() == index.keyframes.size());
+				return;
+			}
+			for (double time : {0.0, 3.3, 7.9, 11.95, 1.5})
+			{
+				xng::png::seek(&playback, corruptIndex, time, &frame);
+			}
+		});
+	}
+
+	// MNG: the object positions are state besides the canvas
+	const std::vector<xng::chunk_t> mngChunks = moving_mng();
+	{
+		std::vector<xng::mng::Frame> frames;
+		std::vector<double>			 starts;
+		xng::mng::Playback			 playback;
+		xng::mng::Frame				 frame;
+		CHECK(xng::mng::open_playback(mngChunks, {}, &playback) == 0);
+		for (double start = playback.time; xng::mng::next_frame(&playback, &frame) == PlaybackStatus::Frame; start = playback.time)
+		{
+			frames.push_back(frame);
+			starts.push_back(start);
+		}
+		// the object is shown when it is defined, then once per inner iteration
+		CHECK(frames.size() == 1 + 20 * 8);
+
+		xng::mng::SeekIndex index, partial;
+		CHECK(xng::mng::build_seekindex(mngChunks, {}, {0.5, 0, 1 << 20}, 1000.0, &index) == 0);
+		CHECK(xng::mng::build_seekindex(mngChunks, {}, {0.5, 0, 1 << 20}, 5.0, &partial) == 0);
+		CHECK(index.keyframes.size() >= 25 && partial.keyframes.size() < index.keyframes.size());
+
+		const auto seek = [](xng::mng::Playback* p, const xng::mng::SeekIndex& i, double time, xng::mng::Frame* f) {
+			return xng::mng::seek(p, i, time, f);
+		};
+		check_seeks(&rng, &playback, index, frames, starts, seek);
+		check_seeks(&rng, &playback, partial, frames, starts, seek);
+
+		std::vector<uint8_t> serialized;
+		xng::mng::write_seekindex(index, &serialized);
+		xng::mng::SeekIndex restored;
+		CHECK(xng::mng::read_seekindex(serialized.data(), serialized.size(), playback, &restored) == 0);
+		CHECK(restored.keyframes.size() == index.keyframes.size());
+		check_seeks(&rng, &playback, restored, frames, starts, seek);
+
+		corrupt_file(&rng, serialized, 100, [&](const std::vector<uint8_t>& corrupt) {
+			xng::mng::SeekIndex corruptIndex = index;
+			if (xng::mng::read_seekindex(corrupt.data(), corrupt.size(), playback, &corruptIndex) != 0)
+			{
+				CHECK(corruptIndex.keyframes.size() == index.keyframes.size());
+				return;
+			}
+			for (double time : {0.0, 3.3, 7.9, 15.95, 1.5})
+			{
+				xng::mng::seek(&playback, corruptIndex, time, &frame);
+			}
+		});
+	}
+
+	// corrupt animations
+	corrupt_file(&rng, apng, 100, [](const std::vector<uint8_t>& corrupt) {
+		const std::vector<xng::chunk_t> chunks = xng::read_chunks(corrupt.data(), corrupt.size());
+		xng::png::DecoderInfo			info;
+		xng::png::SeekIndex				index;
+		xng::png::Playback				playback;
+		xng::png::Frame					frame;
+		if (xng::png::read_decoderinfo(chunks, &info) != 0 || xng::png::build_seekindex(info, {}, {0.5, 0, 1 << 20}, &index) != 0
+			|| xng::png::open_playback(info, {}, &playback) != 0)
+		{
+			return;
+		}
+		xng::png::seek(&playback, index, 7.0, &frame);
+		xng::png::seek(&playback, index, 2.0, &frame);
+	});
+	corrupt_file(&rng, write_chunks(mngChunks), 100, [](const std::vector<uint8_t>& corrupt) {
+		const std::vector<xng::chunk_t> chunks = xng::read_chunks(corrupt.data(), corrupt.size());
+		xng::mng::PlaybackOptions		options;
+		xng::mng::SeekIndex				index;
+		xng::mng::Playback				playback;
+		xng::mng::Frame					frame;
+		options.maxFramePixels = 1 << 20;
+		if (xng::mng::build_seekindex(chunks, options, {0.5, 0, 1 << 20}, 30.0, &index) != 0 || xng::mng::open_playback(chunks, options, &playback) != 0)
+		{
+			return;
+		}
+		xng::mng::seek(&playback, index, 7.0, &frame);
+		xng::mng::seek(&playback, index, 2.0, &frame);
+	});
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! prefetching player
+
+//! presents the frames due at times startTime, startTime + step... up to endTime, waiting on underruns. every
+//! frame shown must be the frame of a sequential playback at its index, frames[index % frames.size()]
+//! param[in] playDuration: duration of a play, looping animations restart at multiples of it
+//! returns the status ending the presentation, Frame if endTime was reached
+template <typename Frame>
+xng::player::PlayerStatus present_frames(xng::player::Player* player, const std::vector<Frame>& frames, double playDuration, double startTime, double step, double endTime)
+{
+	using xng::player::PlayerStatus;
+
+	uint64_t lastIndex = 0;
+	for (double time = startTime; time < endTime;)
+	{
+		const xng::player::PlayerFrame* frame;
+		const PlayerStatus				status = xng::player::present_frame(player, time, &frame);
+		if (frame)
+		{
+			const Frame& expected = frames[frame->index % frames.size()];
+			const double start	  = double(frame->index / frames.size()) * playDuration;
+			CHECK(frame->imagedata == expected.imagedata && frame->duration == expected.duration);
+			CHECK(frame->index >= lastIndex && frame->timestamp >= start);
+			CHECK(status != PlayerStatus::Frame || frame->index == 0 || frame->timestamp <= time + 1e-9);
+			lastIndex = frame->index;
+		}
+		if (status == PlayerStatus::Underrun)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			continue;
+		}
+		if (status != PlayerStatus::Frame)
+		{
+			return status;
+		}
+		time += step;
+	}
+	return PlayerStatus::Frame;
+}
+
+void test_player()
+{
+	using xng::player::PlayerStatus;
+
+	std::mt19937 rng(37);
+
+	// an endless APNG, with rings of two frames and of the default budget
+	const std::vector<uint8_t>		apng   = make_apng(&rng, 24, 16, 40);
+	const std::vector<xng::chunk_t> chunks = xng::read_chunks(apng.data(), apng.size());
+	xng::png::DecoderInfo			info;
+	CHECK(xng::png::read_decoderinfo(chunks, &info) == 0);
+	std::vector<xng::png::Frame> frames;
+	{
+		xng::png::Playback playback;
+		xng::png::Frame	   frame;
+		CHECK(xng::png::open_playback(info, {}, &playback) == 0);
+		while (xng::png::next_frame(&playback, &frame) == xng::png::PlaybackStatus::Frame)
+		{
+			frames.push_back(frame);
+		}
+	}
+	CHECK(frames.size() == 40);
+	for (size_t memoryBudget : {size_t(2 * 24 * 16 * 4), size_t(64) << 20})
+	{
+		xng::player::PlayerOptions options;
+		options.memoryBudget = memoryBudget;
+		xng::player::Player player;
+		CHECK(xng::player::open_player(info, {}, options, &player) == 0);
+		CHECK(present_frames(&player, frames, 4.0, 0.0, 0.05, 10.0) == PlayerStatus::Frame);
+		CHECK(present_frames(&player, frames, 4.0, 10.0, 0.3, 30.0) == PlayerStatus::Frame);
+		xng::player::close_player(&player);
+	}
+
+	// a finite MNG ends with its last frame
+	const std::vector<xng::chunk_t> mngChunks = moving_mng();
+	std::vector<xng::mng::Frame>	mngFrames;
+	{
+		xng::mng::Playback playback;
+		xng::mng::Frame	   frame;
+		CHECK(xng::mng::open_playback(mngChunks, {}, &playback) == 0);
+		while (xng::mng::next_frame(&playback, &frame) == xng::mng::PlaybackStatus::Frame)
+		{
+			mngFrames.push_back(frame);
+		}
+	}
+	{
+		xng::player::Player player;
+		CHECK(xng::player::open_player(mngChunks, {}, {}, &player) == 0);
+		CHECK(present_frames(&player, mngFrames, 1000.0, 0.0, 0.05, 1000.0) == PlayerStatus::End);
+		const xng::player::PlayerFrame* frame;
+		CHECK(xng::player::present_frame(&player, 1000.0, &frame) == PlayerStatus::End);
+		CHECK(frame && frame->index == mngFrames.size() - 1 && frame->imagedata == mngFrames.back().imagedata);
+
+		// reopened while running, then destroyed while running
+		CHECK(xng::player::open_player(info, {}, {}, &player) == 0);
+		CHECK(present_frames(&player, frames, 4.0, 0.0, 0.5, 2.0) == PlayerStatus::Frame);
+		CHECK(xng::player::open_player(mngChunks, {}, {}, &player) == 0);
+	}
+
+	// image data of frame 20 that doesn't inflate: the frames before are presented, then the error
+	std::vector<xng::chunk_t> corruptChunks = chunks;
+	std::vector<uint8_t>	  corruptData(corruptChunks[3 + 20 * 2].data.begin(), corruptChunks[3 + 20 * 2].data.begin() + 4);
+	corruptData.insert(corruptData.end(), {0x78, 0x01, 0x07, 0, 0, 0, 0});
+	corruptChunks[3 + 20 * 2] = make_chunk("fdAT", corruptData);
+	const std::vector<uint8_t>		corruptFile = write_chunks(corruptChunks);
+	const std::vector<xng::chunk_t> readChunks	= xng::read_chunks(corruptFile.data(), corruptFile.size());
+	xng::png::DecoderInfo			corruptInfo;
+	CHECK(xng::png::read_decoderinfo(readChunks, &corruptInfo) == 0);
+	{
+		xng::player::Player player;
+		CHECK(xng::player::open_player(corruptInfo, {}, {}, &player) == 0);
+		CHECK(present_frames(&player, frames, 4.0, 0.0, 0.05, 10.0) == PlayerStatus::Error);
+		const xng::player::PlayerFrame* frame;
+		CHECK(xng::player::present_frame(&player, 10.0, &frame) == PlayerStatus::Error);
+		CHECK(frame && frame->index == 19);
+	}
+
+	// corrupt animations
+	corrupt_file(&rng, apng, 50, [&frames](const std::vector<uint8_t>& corrupt) {
+		const std::vector<xng::chunk_t> chunks = xng::read_chunks(corrupt.data(), corrupt.size());
+		xng::png::DecoderInfo			info;
+		xng::player::Player				player;
+		if (xng::png::read_decoderinfo(chunks, &info) == 0 && xng::player::open_player(info, {}, {}, &player) == 0)
+		{
+			for (double time = 0.0; time < 10.0; time += 0.25)
+			{
+				const xng::player::PlayerFrame* frame;
+				const PlayerStatus				status = xng::player::present_frame(&player, time, &frame);
+				if (status == PlayerStatus::Error || status == PlayerStatus::End)
+				{
+					break;
+				}
+			}
+		}
+	});
+	corrupt_file(&rng, write_chunks(mngChunks), 50, [](const std::vector<uint8_t>& corrupt) {
+		const std::vector<xng::chunk_t> chunks = xng::read_chunks(corrupt.data(), corrupt.size());
+		xng::mng::PlaybackOptions		options;
+		xng::player::Player				player;
+		options.maxFramePixels = 1 << 20;
+		if (xng::player::open_player(chunks, options, {}, &player) == 0)
+		{
+			for (double time = 0.0; time < 20.0; time += 0.25)
+			{
+				const xng::player::PlayerFrame* frame;
+				const PlayerStatus				status = xng::player::present_frame(&player, time, &frame);
+				if (status == PlayerStatus::Error || status == PlayerStatus::End)
+				{
+					break;
+				}
+			}
+		}
+	});
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! thread pool and batch decoding
+
+//! sums 1..count by tasks splitting the range in halves, waiting for the halves they submitted
+void sum_range(xng::common::ThreadPool* pool, uint64_t first, uint64_t last, std::atomic<uint64_t>* sum)
+{
+	if (last - first < 16)
+	{
+		for (uint64_t i = first; i <= last; ++i)
+		{
+			sum->fetch_add(i);
+		}
+		return;
+	}
+	xng::common::TaskGroup group;
+	const uint64_t		   middle = first + (last - first) / 2;
+	pool->submit(&group, [=] { sum_range(pool, first, middle, sum); });
+	pool->submit(&group, [=] { sum_range(pool, middle + 1, last, sum); });
+	pool->wait(&group);
+}
+
+void batch_callback(void* context, const xng::png::BatchResult& result)
+{
+	if (result.error == 0)
+	{
+		static_cast<std::atomic<int>*>(context)->fetch_add(1);
+	}
+}
+
+void test_pool()
+{
+	std::mt19937 rng(38);
+
+	// nested tasks on pools of one and of several workers, exceptions rethrown by wait
+	for (uint32_t threadCount : {1u, 4u})
+	{
+		xng::common::ThreadPool pool(threadCount);
+		CHECK(pool.thread_count() == threadCount && pool.worker_index() == threadCount);
+		std::atomic<uint64_t> sum{0};
+		sum_range(&pool, 1, 10000, &sum);
+		CHECK(sum == 10000 * 10001 / 2);
+
+		xng::common::TaskGroup group;
+		std::atomic<int>	   done{0}, badIndex{0};
+		for (int i = 0; i < 100; ++i)
+		{
+			pool.submit(&group, [&pool, &done, &badIndex, i] {
+				badIndex += pool.worker_index() > pool.thread_count();
+				if (i == 37)
+				{
+					throw std::runtime_error("task 37");
+				}
+				++done;
+			});
+		}
+		bool isThrown = false;
+		try
+		{
+			pool.wait(&group);
+		}
+		catch (const std::runtime_error& e)
+		{
+			isThrown = strcmp(e.what(), "task 37") == 0;
+		}
+		CHECK(isThrown && done == 99 && badIndex == 0 && group.pending == 0);
+	}
+
+	// PNG files of all kinds, a corrupt one among them
+	std::vector<TestImage>			  images;
+	std::vector<std::vector<uint8_t>> files;
+	const uint8_t					  paletteBits[5] = {0, 1, 2, 4, 8};
+	for (int i = 0; i < 40; ++i)
+	{
+		images.push_back(make_png(&rng, 1 + rng() % 60, 1 + rng() % 60, paletteBits[i % 5], i % 2 != 0));
+		files.push_back(write_chunks(images.back().chunks));
+	}
+	std::vector<uint8_t> corruptCRC = files[7];
+	corruptCRC[corruptCRC.size() / 2] ^= 0x10;
+
+	xng::common::ThreadPool			   pool(4);
+	xng::png::BatchOptions			   options;
+	std::vector<xng::common::ByteSpan> spans;
+	options.crcTaskSize = 64;
+	for (const std::vector<uint8_t>& file : files)
+	{
+		spans.push_back({file.data(), file.size()});
+	}
+	std::vector<xng::png::BatchResult> results;
+	CHECK(xng::png::decode_many(spans, options, &pool, &results) == 0);
+	CHECK(results.size() == files.size());
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		CHECK(results[i].error == 0 && results[i].document.frames.size() == 1 && results[i].document.frames[0].imagedata == images[i].rgba);
+	}
+
+	// the corrupt file fails on its own, without CRC checks it may decode
+	spans[7] = {corruptCRC.data(), corruptCRC.size()};
+	CHECK(xng::png::decode_many(spans, options, &pool, &results) == -1);
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		CHECK((results[i].error != 0) == (i == 7));
+	}
+	options.checkCRC = false;
+	xng::png::decode_many(spans, options, &pool, &results);
+	options.checkCRC = true;
+
+	// submitted one at a time, with a callback
+	std::atomic<int>								callbacks{0};
+	std::vector<std::future<xng::png::BatchResult>> futures;
+	for (const xng::common::ByteSpan& span : spans)
+	{
+		futures.push_back(xng::png::submit_decode(span, options, &pool, batch_callback, &callbacks));
+	}
+	for (size_t i = 0; i < futures.size(); ++i)
+	{
+		const xng::png::BatchResult result = futures[i].get();
+		CHECK(i == 7 ? result.error != 0 : result.error == 0 && result.document.frames[0].imagedata == images[i].rgba);
+	}
+	CHECK(callbacks == int(files.size()) - 1);
+
+	// corrupt files in a batch
+	std::vector<std::vector<uint8_t>> corruptFiles;
+	corrupt_file(&rng, files[3], 50, [&corruptFiles](const std::vector<uint8_t>& corrupt) {
+		corruptFiles.push_back(corrupt);
+	});
+	corrupt_file(&rng, files[8], 50, [&corruptFiles](const std::vector<uint8_t>& corrupt) {
+		corruptFiles.push_back(corrupt);
+	});
+	spans.clear();
+	for (const std::vector<uint8_t>& file : corruptFiles)
+	{
+		spans.push_back({file.data(), file.size()});
+	}
+	options.checkCRC = false;
+	CHECK(xng::png::decode_many(spans, options, &pool, &results) == -1);
+	for (const xng::png::BatchResult& result : results)
+	{
+		CHECK(result.error != 0 || (result.document.frames.size() == 1 && result.document.frames[0].imagedata.size() == size_t(result.document.width) * result.document.height * 4));
+	}
 
-int main(int argc, char** argv)
+	// scratch buffers are put back while they hold at most maxSize bytes, released otherwise
+	const TestImage			   large	  = make_png(&rng, 300, 200, 0, false);
+	const std::vector<uint8_t> largeFile = write_chunks(large.chunks);
+	xng::png::ScratchCache	   cache;
+	cache.maxSize = 64 << 10;
+	{
+		std::unique_ptr<xng::png::DecoderScratch> scratch = xng::png::take_scratch(&cache);
+		std::vector<xng::chunk_t>				  chunks  = xng::read_chunks(largeFile.data(), largeFile.size());
+		xng::png::DecoderInfo					  info;
+		xng::png::Document						  document;
+		CHECK(xng::png::read_decoderinfo(chunks, &info) == 0);
+		CHECK(xng::png::decode(info, {}, &document, scratch.get()) == 0 && xng::png::scratch_size(*scratch) > cache.maxSize);
+		xng::png::return_scratch(&cache, std::move(scratch));
+		CHECK(cache.scratches.empty());
+
+		scratch = xng::png::take_scratch(&cache);
+		chunks	= xng::read_chunks(files[0].data(), files[0].size());
+		xng::png::reset_decoderinfo(&info);
+		CHECK(xng::png::read_decoderinfo(chunks, &info) == 0);
+		CHECK(xng::png::decode(info, {}, &document, scratch.get()) == 0 && xng::png::scratch_size(*scratch) <= cache.maxSize);
+		xng::png::return_scratch(&cache, std::move(scratch));
+		CHECK(cache.scratches.size() == 1 && xng::png::take_scratch(&cache).get() != nullptr && cache.scratches.empty());
+	}
+
+	// batches and submitted files sharing a cache, the large image among small ones
+	options.checkCRC	 = true;
+	options.scratchCache = &cache;
+	spans.clear();
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		spans.push_back(i == 5 ? xng::common::ByteSpan{largeFile.data(), largeFile.size()} : xng::common::ByteSpan{files[i].data(), files[i].size()});
+	}
+	for (int run = 0; run < 2; ++run)
+	{
+		CHECK(xng::png::decode_many(spans, options, &pool, &results) == 0);
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			CHECK(results[i].error == 0 && results[i].document.frames[0].imagedata == (i == 5 ? large.rgba : images[i].rgba));
+		}
+		CHECK(cache.scratches.size() <= pool.thread_count() + 1);
+		CHECK(std::all_of(cache.scratches.begin(), cache.scratches.end(), [&cache](auto& scratch) { return xng::png::scratch_size(*scratch) <= cache.maxSize; }));
+	}
+	const xng::png::BatchResult result = xng::png::submit_decode(spans[5], options, &pool).get();
+	CHECK(result.error == 0 && result.document.frames[0].imagedata == large.rgba);
+	CHECK(std::all_of(cache.scratches.begin(), cache.scratches.end(), [&cache](auto& scratch) { return xng::png::scratch_size(*scratch) <= cache.maxSize; }));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! decode stats
+
+//! in test_xng_nostats.cpp, built without XNG_STATS
+extern const char* const nostats_expansions[];
+extern const size_t		 nostats_expansion_count;
+uint64_t				 nostats_collected();
+
+void skip_json_space(const std::string& json, size_t* pos)
+{
+	while (*pos < json.size() && (json[*pos] == ' ' || json[*pos] == '\t' || json[*pos] == '\r' || json[*pos] == '\n'))
+	{
+		++*pos;
+	}
+}
+
+bool skip_json_digits(const std::string& json, size_t* pos)
+{
+	const size_t first = *pos;
+	while (*pos < json.size() && json[*pos] >= '0' && json[*pos] <= '9')
+	{
+		++*pos;
+	}
+	return *pos > first;
+}
+
+bool skip_json_string(const std::string& json, size_t* pos)
+{
+	if (*pos >= json.size() || json[*pos] != '"')
+	{
+		return false;
+	}
+	for (++*pos; *pos < json.size(); ++*pos)
+	{
+		if (json[*pos] == '"')
+		{
+			++*pos;
+			return true;
+		}
+		if (uint8_t(json[*pos]) < 0x20 || (json[*pos] == '\\' && ++*pos == json.size()))
+		{
+			return false;
+		}
+	}
+	return false;
+}
+
+//! skips the JSON value at *pos and the whitespace around it, returns false if it isn't valid JSON
+bool skip_json(const std::string& json, size_t* pos)
+{
+	skip_json_space(json, pos);
+	if (*pos >= json.size())
+	{
+		return false;
+	}
+
+	const char first = json[*pos];
+	if (first == '{' || first == '[')
+	{
+		const char last = first == '{' ? '}' : ']';
+		++*pos;
+		skip_json_space(json, pos);
+		if (*pos < json.size() && json[*pos] == last)
+		{
+			++*pos;
+		}
+		else
+		{
+			for (;;)
+			{
+				if (first == '{')
+				{
+					skip_json_space(json, pos);
+					if (!skip_json_string(json, pos))
+					{
+						return false;
+					}
+					skip_json_space(json, pos);
+					if (*pos >= json.size() || json[(*pos)++] != ':')
+					{
+						return false;
+					}
+				}
+				if (!skip_json(json, pos) || *pos >= json.size())
+				{
+					return false;
+				}
+				if (json[*pos] == last)
+				{
+					++*pos;
+					break;
+				}
+				if (json[(*pos)++] != ',')
+				{
+					return false;
+				}
+			}
+		}
+	}
+	else if (first == '"')
+	{
+		if (!skip_json_string(json, pos))
+		{
+			return false;
+		}
+	}
+	else if (json.compare(*pos, 4, "true") == 0 || json.compare(*pos, 4, "null") == 0)
+	{
+		*pos += 4;
+	}
+	else if (json.compare(*pos, 5, "false") == 0)
+	{
+		*pos += 5;
+	}
+	else
+	{
+		*pos += first == '-';
+		if (!skip_json_digits(json, pos))
+		{
+			return false;
+		}
+		if (*pos < json.size() && json[*pos] == '.' && (++*pos, !skip_json_digits(json, pos)))
+		{
+			return false;
+		}
+		if (*pos < json.size() && (json[*pos] == 'e' || json[*pos] == 'E'))
+		{
+			++*pos;
+			*pos += *pos < json.size() && (json[*pos] == '+' || json[*pos] == '-');
+			if (!skip_json_digits(json, pos))
+			{
+				return false;
+			}
+		}
+	}
+	skip_json_space(json, pos);
+	return true;
+}
+
+//! stats expected of decoding a PNG of make_png: inflated and unfiltered bytes, chunks by type
+struct ExpectedStats
+{
+	uint64_t							 inflated	= 0;
+	uint64_t							 unfiltered = 0;
+	std::vector<xng::common::ChunkStats> chunks;
+
+	void add(const TestImage& image, uint8_t paletteBits)
+	{
+		const uint64_t rowSize = paletteBits ? (uint64_t(image.width) * paletteBits + 7) / 8 : uint64_t(image.width) * 4;
+		inflated += (rowSize + 1) * image.height;
+		unfiltered += rowSize * image.height;
+		for (const xng::chunk_t& chunk : image.chunks)
+		{
+			auto itChunk = std::find_if(chunks.begin(), chunks.end(), [&chunk](auto& stats) { return stats.id._raw == chunk.id._raw; });
+			if (itChunk == chunks.end())
+			{
+				chunks.push_back({chunk.id, 0, 0});
+				itChunk = chunks.end() - 1;
+			}
+			++itChunk->count;
+			itChunk->bytes += chunk.length;
+		}
+	}
+};
+
+//! true if the chunks were counted as expected, in any order
+bool is_same_chunks(const std::vector<xng::common::ChunkStats>& chunks, const std::vector<xng::common::ChunkStats>& expected)
+{
+	return chunks.size() == expected.size() && std::all_of(expected.begin(), expected.end(), [&chunks](auto& stats) {
+			   return std::any_of(chunks.begin(), chunks.end(), [&stats](auto& chunk) {
+				   return chunk.id._raw == stats.id._raw && chunk.count == stats.count && chunk.bytes == stats.bytes;
+			   });
+		   });
+}
+
+uint64_t span_count(const xng::common::DecodeStats& stats)
+{
+	uint64_t count = 0;
+	for (auto& stage : stats.stages)
+	{
+		count += stage.spans;
+	}
+	return count;
+}
+
+void test_stats()
+{
+	using xng::common::DecodeStats;
+	using xng::common::Stage;
+	using xng::common::StatsScope;
+
+	// without XNG_STATS the instrumentation points are empty statements and collect nothing
+	for (size_t i = 0; i < nostats_expansion_count; ++i)
+	{
+		CHECK(strcmp(nostats_expansions[i], "((void)0)") == 0);
+	}
+	CHECK(nostats_collected() == 0);
+	if (!xng::common::is_instrumented())
+	{
+		return;
+	}
+
+	std::mt19937					  rng(41);
+	std::vector<TestImage>			  images;
+	std::vector<std::vector<uint8_t>> files;
+	std::vector<ExpectedStats>		  expected;
+	const uint8_t					  paletteBits[4] = {0, 4, 8, 1};
+	for (int i = 0; i < 8; ++i)
+	{
+		images.push_back(make_png(&rng, 1 + rng() % 70, 1 + rng() % 70, paletteBits[i % 4], i % 2 != 0));
+		files.push_back(write_chunks(images.back().chunks));
+		expected.emplace_back();
+		expected.back().add(images.back(), paletteBits[i % 4]);
+	}
+
+	// one decode: bytes of the image data, one span per stage, the chunks of the file
+	xng::common::TraceRecorder recorder;
+	for (size_t i = 0; i < 4; ++i)
+	{
+		DecodeStats stats;
+		{
+			StatsScope		   scope(&stats, &xng::common::trace_hooks, &recorder);
+			xng::png::Document document;
+			CHECK(decode_png(files[i], {}, &document) == 0);
+		}
+		const xng::common::StageStats* stages = stats.stages;
+		CHECK(stages[size_t(Stage::ChunkParsing)].bytes == files[i].size() && stages[size_t(Stage::ChunkParsing)].spans == 1);
+		CHECK(stages[size_t(Stage::Inflate)].bytes == expected[i].inflated && stages[size_t(Stage::Inflate)].spans == 1);
+		CHECK(stages[size_t(Stage::Unfilter)].bytes == expected[i].unfiltered && stages[size_t(Stage::Unfilter)].spans == 1);
+		CHECK(stages[size_t(Stage::ColorConversion)].bytes == expected[i].unfiltered && stages[size_t(Stage::ColorConversion)].spans == 1);
+		CHECK(is_same_chunks(stats.chunks, expected[i].chunks));
+	}
+
+	// the trace of the spans is JSON with an event per span
+	std::string json;
+	xng::common::write_chrome_trace(&recorder, &json);
+	size_t pos = 0;
+	CHECK(!recorder.events.empty() && skip_json(json, &pos) && pos == json.size());
+	size_t eventCount = 0;
+	for (size_t found = json.find("\"ph\":\"X\""); found != std::string::npos; found = json.find("\"ph\":\"X\"", found + 1))
+	{
+		++eventCount;
+	}
+	CHECK(eventCount == recorder.events.size() && json.find("\"name\":\"unfilter\"") != std::string::npos);
+
+	// the C chunk iteration
+	{
+		DecodeStats stats;
+		{
+			StatsScope scope(&stats);
+			CHECK(xng_iterate_chunks_filtered(files[0].data(), files[0].size(), XNG_CHUNK_TRANSPARENCY, nullptr, nullptr) == 0);
+		}
+		CHECK(stats.stages[size_t(Stage::ChunkParsing)].bytes == files[0].size() && stats.stages[size_t(Stage::ChunkParsing)].spans == 1);
+		CHECK(is_same_chunks(stats.chunks, expected[0].chunks));
+	}
+
+	// a batch counts into the scope of the calling thread and into the results, its spans reach the
+	// hooks from the workers. the CRC tasks of larger files are counted too
+	xng::common::ThreadPool			   pool(3);
+	xng::png::BatchOptions			   options;
+	std::vector<xng::common::ByteSpan> spans;
+	ExpectedStats					   batchExpected;
+	uint64_t						   chunkCount = 0;
+	options.crcTaskSize = 64;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		spans.push_back({files[i].data(), files[i].size()});
+		batchExpected.add(images[i], paletteBits[i % 4]);
+		chunkCount += images[i].chunks.size();
+	}
+	std::vector<xng::png::BatchResult> results;
+	{
+		DecodeStats stats;
+		recorder.events.clear();
+		{
+			StatsScope scope(&stats, &xng::common::trace_hooks, &recorder);
+			CHECK(xng::png::decode_many(spans, options, &pool, &results) == 0);
+		}
+		CHECK(stats.stages[size_t(Stage::Inflate)].bytes == batchExpected.inflated && stats.stages[size_t(Stage::Inflate)].spans == files.size());
+		CHECK(stats.stages[size_t(Stage::Unfilter)].bytes == batchExpected.unfiltered);
+		CHECK(stats.stages[size_t(Stage::CRC)].spans == chunkCount);
+		CHECK(is_same_chunks(stats.chunks, batchExpected.chunks));
+		CHECK(recorder.events.size() == span_count(stats));
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			CHECK(results[i].stats.stages[size_t(Stage::Inflate)].bytes == expected[i].inflated && is_same_chunks(results[i].stats.chunks, expected[i].chunks));
+		}
+	}
+
+	// without a scope nothing is collected, also not into the scope of a thread helping the pool
+	CHECK(xng::png::decode_many(spans, options, &pool, &results) == 0);
+	CHECK(std::all_of(results.begin(), results.end(), [](auto& result) { return span_count(result.stats) == 0 && result.stats.chunks.empty(); }));
+
+	// a submitted decode leaves its counters in the result, the spans are forwarded
+	{
+		DecodeStats stats;
+		recorder.events.clear();
+		StatsScope					scope(&stats, &xng::common::trace_hooks, &recorder);
+		const xng::png::BatchResult result = xng::png::submit_decode(spans[1], options, &pool).get();
+		CHECK(result.error == 0 && result.stats.stages[size_t(Stage::Inflate)].bytes == expected[1].inflated);
+		CHECK(span_count(stats) == 0 && recorder.events.size() == span_count(result.stats));
+	}
+
+	// the alpha channel of a JNG, decoded sequentially, on a thread of its own and on the pool
+	std::vector<uint8_t> alphas(jpeg_width * jpeg_height);
+	for (uint8_t& alpha : alphas)
+	{
+		alpha = uint8_t(rng());
+	}
+	std::vector<uint8_t> header;
+	append_uint32(&header, jpeg_width);
+	append_uint32(&header, jpeg_height);
+	header.insert(header.end(), {14, 8, 8, 0, 8, 0, 0, 0});
+	std::vector<xng::chunk_t>  chunks	 = {make_chunk("JHDR", header)};
+	const std::vector<uint8_t> imagedata = alpha_imagedata(&rng, alphas, jpeg_width);
+	append_split(&rng, "IDAT", imagedata.data(), imagedata.size(), &chunks);
+	append_split(&rng, "JDAT", color_jpeg, sizeof(color_jpeg), &chunks);
+	chunks.push_back(make_chunk("IEND", {}));
+	const std::vector<uint8_t> jng = write_chunks(chunks);
+
+	std::vector<xng::jng::DecodeOptions> decodeOptions(3);
+	decodeOptions[0].concurrentAlpha = false;
+	decodeOptions[2].pool			 = &pool;
+	for (const xng::jng::DecodeOptions& jngOptions : decodeOptions)
+	{
+		DecodeStats stats;
+		{
+			StatsScope		 scope(&stats);
+			xng::JNGDocument document;
+			CHECK(decode_jng(jng, jngOptions, &document) == 0);
+		}
+		CHECK(stats.stages[size_t(Stage::Inflate)].bytes == uint64_t(jpeg_width + 1) * jpeg_height && stats.stages[size_t(Stage::Inflate)].spans == 1);
+		CHECK(stats.stages[size_t(Stage::Unfilter)].bytes == uint64_t(jpeg_width) * jpeg_height && stats.stages[size_t(Stage::Unfilter)].spans == 1);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! C interface
+
+struct ChunkList
+{
+	std::vector<std::string> types;
+	size_t					 stopAfter;	// chunks passed before the iterator stops
+};
+
+int list_chunk(const xng_chunk_t* chunk, void* context)
+{
+	auto list = static_cast<ChunkList*>(context);
+	list->types.push_back(std::string(chunk->id.type, 4));
+	return list->types.size() == list->stopAfter ? 1 : 0;
+}
+
+//! allocator counting its calls, failing from the failAt-th allocation on
+struct CountingAllocator
+{
+	size_t allocs = 0;
+	size_t frees  = 0;
+	size_t failAt = SIZE_MAX;
+};
+
+void* counting_alloc(void* context, size_t size)
+{
+	auto allocator = static_cast<CountingAllocator*>(context);
+	if (allocator->allocs >= allocator->failAt)
+	{
+		return nullptr;
+	}
+	++allocator->allocs;
+	return malloc(size);
+}
+
+void counting_free(void* context, void* ptr)
+{
+	++static_cast<CountingAllocator*>(context)->frees;
+	free(ptr);
+}
+
+//! calls of the global operator new while isCountingNew is set, to check that the decoder allocates
+//! through its allocator only
+std::atomic<bool>	isCountingNew{false};
+std::atomic<size_t> newCount{0};
+
+void* counted_new(size_t size, std::align_val_t alignment = std::align_val_t(alignof(std::max_align_t))) noexcept
+{
+	if (isCountingNew)
+	{
+		++newCount;
+	}
+	const size_t align = std::max(size_t(alignment), sizeof(void*));
+	void*		 ptr   = nullptr;
+	return posix_memalign(&ptr, align, size ? size : 1) == 0 ? ptr : nullptr;
+}
+
+void* checked_new(size_t size, std::align_val_t alignment = std::align_val_t(alignof(std::max_align_t)))
+{
+	void* ptr = counted_new(size, alignment);
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new(size_t size)
+{
+	return checked_new(size);
+}
+void* operator new[](size_t size)
+{
+	return checked_new(size);
+}
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	return checked_new(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return checked_new(size, alignment);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_new(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_new(size);
+}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return counted_new(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return counted_new(size, alignment);
+}
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+//! in test_xng_c.c, compiled as C
+extern "C" int c_decode_png(const uint8_t* data, size_t size, const uint8_t* expected, uint32_t width, uint32_t height);
+
+void test_c_api()
+{
+	std::mt19937 rng(40);
+
+	// chunk iteration: all chunks, stopped after IHDR, filtered, truncated
+	TestImage image = make_png(&rng, 33, 21, 0, true);
+	image.chunks.insert(image.chunks.begin() + 1, make_chunk("gAMA", {0, 0, 0xB1, 0x8F}));
+	image.chunks.insert(image.chunks.end() - 1, make_chunk("tEXt", {'a', 0, 'b'}));
+	const std::vector<uint8_t> filedata = write_chunks(image.chunks);
+	ChunkList				   list{{}, 0};
+	CHECK(xng_iterate_chunks(filedata.data(), filedata.size(), list_chunk, &list) == image.chunks.size());
+	CHECK(list.types.size() == image.chunks.size() && list.types.front() == "IHDR" && list.types.back() == "IEND");
+	list = {{}, 1};
+	CHECK(xng_iterate_chunks(filedata.data(), filedata.size(), list_chunk, &list) == 1 && list.types.size() == 1);
+	list = {{}, 0};
+	CHECK(xng_iterate_chunks_filtered(filedata.data(), filedata.size(), XNG_CHUNK_TEXT | XNG_CHUNK_COLOR, list_chunk, &list) == 2);
+	CHECK(list.types.size() == 2 && list.types[0] == "gAMA" && list.types[1] == "tEXt");
+	for (size_t size = 0; size < filedata.size(); ++size)
+	{
+		// a buffer of the exact size, so reads past it are caught
+		std::unique_ptr<uint8_t[]> truncated(new uint8_t[size + 1]);
+		std::copy(filedata.begin(), filedata.begin() + size, truncated.get());
+		list = {{}, 0};
+		CHECK(xng_iterate_chunks(truncated.get(), size, list_chunk, &list) < image.chunks.size());
+	}
+
+	// decoding through an allocator: whole images, regions and scaled, into padded rows
+	CountingAllocator	   counter;
+	const xng_allocator_t  allocator = {counting_alloc, counting_free, &counter};
+	xng_png_decoder_desc_t desc		 = {nullptr, nullptr, &allocator, XNG_CHUNK_ALL};
+	xng_png_decoder_t*	   decoder	 = xng_png_create_decoder_with(&desc);
+	CHECK(decoder);
+	const uint8_t paletteBits[5] = {0, 1, 2, 4, 8};
+	for (int i = 0; i < 20; ++i)
+	{
+		const TestImage			   source = make_png(&rng, 1 + rng() % 50, 1 + rng() % 50, paletteBits[i % 5], i % 2 != 0);
+		const std::vector<uint8_t> file	  = write_chunks(source.chunks);
+		uint32_t				   width = 0, height = 0;
+		CHECK(xng_png_read_info(decoder, file.data(), file.size(), &width, &height) == 0);
+		CHECK(width == source.width && height == source.height && xng_png_get_frame_count(decoder) == 0);
+		CHECK(c_decode_png(file.data(), file.size(), source.rgba.data(), source.width, source.height) == 0);
+
+		const size_t		 stride = width * 4 + 12;
+		std::vector<uint8_t> out(stride * height);
+		CHECK(xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA8, out.data(), stride) == 0);
+		bool isEqual = true;
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			isEqual = isEqual && memcmp(&out[y * stride], &source.rgba[y * width * 4], width * 4) == 0;
+		}
+		CHECK(isEqual);
+
+		const xng_region_t region = {uint32_t(rng() % width), uint32_t(rng() % height), 0, 0};
+		uint32_t		   regionWidth, regionHeight;
+		CHECK(xng_png_get_output_size(decoder, &region, 0, 0, &regionWidth, &regionHeight) == 0);
+		CHECK(regionWidth == width - region.x && regionHeight == height - region.y);
+		CHECK(xng_png_decode_into(decoder, &region, 0, 0, XNG_PIXEL_FORMAT_RGBA8, out.data(), stride) == 0);
+		isEqual = true;
+		for (uint32_t y = 0; y < regionHeight; ++y)
+		{
+			isEqual = isEqual && memcmp(&out[y * stride], &source.rgba[((region.y + y) * width + region.x) * 4], regionWidth * 4) == 0;
+		}
+		CHECK(isEqual);
+
+		std::vector<float> linear(size_t(width) * height * 4);
+		CHECK(xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA32F, reinterpret_cast<uint8_t*>(linear.data()), width * 16) == 0);
+		// linear light of sRGB, the default without color chunks
+		float maxError = 0.0f;
+		for (size_t c = 0; c < linear.size(); ++c)
+		{
+			const float value = source.rgba[c] / 255.0f;
+			const float light = c % 4 == 3 ? value : value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			maxError		  = std::max(maxError, std::abs(linear[c] - light));
+		}
+		CHECK(maxError < 0.001f);
+
+		// an unaligned stride and an output too small for the size are rejected
+		CHECK(xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA32F, reinterpret_cast<uint8_t*>(linear.data()), width * 16 + 2) == -1);
+		CHECK(xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA8, out.data(), width * 4 - 1) == -1);
+	}
+
+	// APNG frames, and its default image when the animation chunks are filtered
+	const std::vector<uint8_t>		apng   = make_apng(&rng, 24, 16, 12);
+	const std::vector<xng::chunk_t> chunks = xng::read_chunks(apng.data(), apng.size());
+	xng::png::DecoderInfo			info;
+	xng::png::Playback				playback;
+	xng::png::Frame					frame;
+	CHECK(xng::png::read_decoderinfo(chunks, &info) == 0 && xng::png::open_playback(info, {}, &playback) == 0);
+	CHECK(xng_png_read_info(decoder, apng.data(), apng.size(), nullptr, nullptr) == 0 && xng_png_get_frame_count(decoder) == 12);
+	CHECK(xng_png_open_playback(decoder, nullptr, 0, 0) == 0);
+	std::vector<uint8_t> out(24 * 16 * 4);
+	float				 duration;
+	while (xng::png::next_frame(&playback, &frame) == xng::png::PlaybackStatus::Frame)
+	{
+		CHECK(xng_png_next_frame(decoder, out.data(), 24 * 4, &duration) == 0);
+		CHECK(out == frame.imagedata && duration == frame.duration);
+	}
+	CHECK(xng_png_next_frame(decoder, out.data(), 24 * 4, &duration) == 1);
+	xng_png_destroy_decoder(decoder);
+	CHECK(counter.allocs > 1 && counter.allocs == counter.frees);
+
+	desc.chunk_filter = XNG_CHUNK_CRITICAL;
+	decoder			  = xng_png_create_decoder_with(&desc);
+	std::vector<uint8_t> idat(out.size());
+	CHECK(xng::png::decode_into(info, {}, idat.data(), 24 * 4) == 0);
+	CHECK(xng_png_read_info(decoder, apng.data(), apng.size(), nullptr, nullptr) == 0 && xng_png_get_frame_count(decoder) == 0);
+	CHECK(xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA8, out.data(), 24 * 4) == 0 && out == idat);
+	xng_png_destroy_decoder(decoder);
+	CHECK(counter.allocs == counter.frees);
+
+	// failing allocations fail the calls, without leaks
+	for (size_t failAt = 0; failAt < 40; ++failAt)
+	{
+		counter = {0, 0, failAt};
+		decoder = xng_png_create_decoder_with(&desc);
+		CHECK(decoder || failAt <= 1);
+		if (decoder)
+		{
+			if (xng_png_read_info(decoder, filedata.data(), filedata.size(), nullptr, nullptr) == 0)
+			{
+				std::vector<uint8_t> pixels(image.rgba.size());
+				if (xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA8, pixels.data(), image.width * 4) == 0)
+				{
+					CHECK(pixels == image.rgba);
+				}
+			}
+			xng_png_destroy_decoder(decoder);
+		}
+		CHECK(counter.allocs == counter.frees);
+	}
+
+	// once warm, reading and decoding the same images again allocates through the allocator only: the chunk
+	// copies, the decoder info with its texts and frames, and the scratch buffers
+	TestImage texts = make_png(&rng, 40, 30, 0, false);
+	texts.chunks.insert(texts.chunks.begin() + 1, make_chunk("gAMA", {0, 0, 0xB1, 0x8F}));
+	// texts longer than the small string buffers
+	const std::string longText = "a text longer than small strings";
+	std::vector<uint8_t> tEXt = {'T', 'i', 't', 'l', 'e', 0}, iTXt = {'D', 0, 0, 0};
+	tEXt.insert(tEXt.end(), longText.begin(), longText.end());
+	for (int i = 0; i < 3; ++i)
+	{
+		iTXt.insert(iTXt.end(), longText.begin(), longText.end() + (i < 2 ? 1 : 0));
+	}
+	texts.chunks.insert(texts.chunks.end() - 1, make_chunk("tEXt", tEXt));
+	texts.chunks.insert(texts.chunks.end() - 1, make_chunk("zTXt", {'C', 0, 0, 0x78, 0x01, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01}));
+	texts.chunks.insert(texts.chunks.end() - 1, make_chunk("iTXt", iTXt));
+	const std::vector<uint8_t> textsFile = write_chunks(texts.chunks);
+	counter								 = {};
+	desc.chunk_filter					 = XNG_CHUNK_ALL;
+	decoder								 = xng_png_create_decoder_with(&desc);
+	std::vector<uint8_t> pixels(40 * 30 * 16);
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		const size_t allocs = counter.allocs;
+		newCount			= 0;
+		isCountingNew		= pass == 1;
+		for (const std::vector<uint8_t>* file : {&filedata, &textsFile, &apng})
+		{
+			CHECK(xng_png_read_info(decoder, file->data(), file->size(), nullptr, nullptr) == 0);
+			CHECK(xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA8, pixels.data(), 40 * 16) == 0);
+			CHECK(xng_png_decode_into(decoder, nullptr, 5, 4, XNG_PIXEL_FORMAT_RGBA8, pixels.data(), 40 * 16) == 0);
+			CHECK(xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA32F, pixels.data(), 40 * 16) == 0);
+		}
+		isCountingNew = false;
+		CHECK(pass == 0 || newCount == 0);
+		CHECK(counter.allocs > allocs);
+	}
+	xng_png_destroy_decoder(decoder);
+	CHECK(counter.allocs == counter.frees);
+
+	// corrupt files: read_info or decoding fail, or decode within the output size
+	desc.allocator	  = nullptr;
+	desc.chunk_filter = XNG_CHUNK_ALL;
+	decoder			  = xng_png_create_decoder_with(&desc);
+	for (const std::vector<uint8_t>* file : {&filedata, &apng})
+	{
+		corrupt_file(&rng, *file, 100, [decoder](const std::vector<uint8_t>& corrupt) {
+			uint32_t width, height;
+			if (xng_png_read_info(decoder, corrupt.data(), corrupt.size(), &width, &height) != 0)
+			{
+				return;
+			}
+			std::vector<uint8_t> pixels(size_t(width) * height * 4);
+			xng_png_decode_into(decoder, nullptr, 0, 0, XNG_PIXEL_FORMAT_RGBA8, pixels.data(), width * 4);
+			if (xng_png_open_playback(decoder, nullptr, 0, 0) == 0)
+			{
+				for (int frames = 0; frames < 20 && xng_png_next_frame(decoder, pixels.data(), width * 4, nullptr) == 0; ++frames)
+				{
+				}
+			}
+		});
+	}
+	xng_png_destroy_decoder(decoder);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! optimizer
+
+//! deflatefunc_t of zlib_fixed, settings is an std::atomic<int> counting the calls
+int fixed_deflate(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, void* settings)
+{
+	static_cast<std::atomic<int>*>(settings)->fetch_add(1);
+	const std::vector<uint8_t> compressed = zlib_fixed(std::vector<uint8_t>(in, in + insize));
+	*out								  = static_cast<unsigned char*>(malloc(compressed.size()));
+	if (!*out)
+	{
+		return -1;
+	}
+	memcpy(*out, compressed.data(), compressed.size());
+	*outsize = compressed.size();
+	return 0;
+}
+
+//! frames of an APNG by their start time, 0 on success
+int play_apng(const std::vector<uint8_t>& filedata, std::vector<double>* starts, std::vector<std::vector<uint8_t>>* frames)
+{
+	const std::vector<xng::chunk_t> chunks = xng::read_chunks(filedata.data(), filedata.size());
+	xng::png::DecoderInfo			info;
+	xng::png::Playback				playback;
+	xng::png::Frame					frame;
+	if (xng::png::read_decoderinfo(chunks, &info) != 0 || xng::png::open_playback(info, {}, &playback) != 0)
+	{
+		return -1;
+	}
+
+	xng::png::PlaybackStatus status;
+	for (double start = playback.time; (status = xng::png::next_frame(&playback, &frame)) == xng::png::PlaybackStatus::Frame; start = playback.time)
+	{
+		starts->push_back(start);
+		frames->push_back(frame.imagedata);
+	}
+	return status == xng::png::PlaybackStatus::End ? 0 : -1;
+}
+
+//! the optimized APNG shows the frames of the original at their start times
+bool is_same_animation(const std::vector<uint8_t>& original, const std::vector<uint8_t>& optimized)
+{
+	std::vector<double>				  starts, optimizedStarts;
+	std::vector<std::vector<uint8_t>> frames, optimizedFrames;
+	if (play_apng(original, &starts, &frames) != 0 || play_apng(optimized, &optimizedStarts, &optimizedFrames) != 0)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const size_t shown = std::upper_bound(optimizedStarts.begin(), optimizedStarts.end(), starts[i] + 1e-9) - optimizedStarts.begin();
+		if (shown == 0 || optimizedFrames[shown - 1] != frames[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void test_optimizer()
 {
-	assert(argc >= 2);
-	std::shared_ptr<FILE> file(fopen(argv[1], "rb"), fclose);
-	assert(file);
+	using xng::optimizer::OptimizeOptions;
+	using xng::optimizer::OptimizeStats;
+
+	std::mt19937			rng(41);
+	std::atomic<int>		deflateCalls{0};
+	xng::common::ThreadPool pool(4);
+	OptimizeOptions			recompress;
+	recompress.deflatefunc		   = fixed_deflate;
+	recompress.deflatefuncSettings = &deflateCalls;
+
+	// images of all kinds with their image data split into IDAT chunks, stored or compressed, and
+	// ancillary chunks: the same pixels, the kept chunks spliced
+	const uint8_t paletteBits[5] = {0, 1, 2, 4, 8};
+	for (int i = 0; i < 30; ++i)
+	{
+		TestImage image = make_png(&rng, 1 + rng() % 60, 1 + rng() % 60, paletteBits[i % 5], i % 2 != 0);
+		image.chunks.insert(image.chunks.begin() + 1, make_chunk("gAMA", {0, 0, 0xB1, 0x8F}));
+		image.chunks.insert(image.chunks.end() - 1, make_chunk("tEXt", {'a', 0, 'b'}));
+		const std::vector<uint8_t> filedata = write_chunks(image.chunks);
+
+		for (const OptimizeOptions& options : {OptimizeOptions{}, recompress})
+		{
+			std::vector<uint8_t> optimized;
+			OptimizeStats		 stats;
+			CHECK(xng::optimizer::optimize(filedata.data(), filedata.size(), options, i % 3 ? &pool : nullptr, &optimized, &stats) == 0);
+			CHECK(optimized.size() <= filedata.size());
+			xng::png::Document document;
+			CHECK(decode_png(optimized, {}, &document) == 0);
+			CHECK(document.frames.size() == 1 && document.frames[0].imagedata == image.rgba);
 
-	if (fseek(file.get(), 0, SEEK_END) != 0)
+			std::vector<std::string> types;
+			for (const xng::chunk_t& chunk : xng::read_chunks(optimized.data(), optimized.size()))
+			{
+				types.push_back(std::string(chunk.id.type, 4));
+			}
+			CHECK(std::count(types.begin(), types.end(), "IDAT") == 1 && std::count(types.begin(), types.end(), "tEXt") == 0);
+			CHECK(types.size() > 1 && types[1] == "gAMA" && stats.splicedChunks >= 2);
+		}
+	}
+	CHECK(deflateCalls > 0);
+
+	// animations, their frames merged and cropped
+	for (int i = 0; i < 10; ++i)
+	{
+		const std::vector<uint8_t> apng = make_apng(&rng, 1 + rng() % 30, 1 + rng() % 30, 2 + rng() % 20);
+		for (const OptimizeOptions& options : {OptimizeOptions{}, recompress})
+		{
+			std::vector<uint8_t> optimized;
+			CHECK(xng::optimizer::optimize(apng.data(), apng.size(), options, i % 2 ? &pool : nullptr, &optimized) == 0);
+			CHECK(is_same_animation(apng, optimized));
+		}
+	}
+
+	// a frame drawing transparent pixels over the frame before doesn't change the output, it's merged
+	// into that frame
+	const std::vector<uint8_t> threeFrames = make_apng(&rng, 8, 8, 3);
+	std::vector<xng::chunk_t>  chunks	   = xng::read_chunks(threeFrames.data(), threeFrames.size());
+	std::vector<uint8_t>	   control(chunks[6].data.begin(), chunks[6].data.end()), raw;
+	for (int c = 4; c < 20; ++c)
+	{
+		control[c] = 0;
+	}
+	control[7] = control[11] = 8;
+	control[24]				 = 0;	// APNG_DISPOSE_OP_NONE
+	control[25]				 = 1;	// APNG_BLEND_OP_OVER
+	chunks[6]				 = make_chunk("fcTL", control);
+	control.assign(chunks[4].data.begin(), chunks[4].data.end());
+	control[24]				 = 0;
+	chunks[4]				 = make_chunk("fcTL", control);
+	for (int y = 0; y < 8; ++y)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), 8 * 4, 0);
+	}
+	std::vector<uint8_t>	   imagedata(chunks[7].data.begin(), chunks[7].data.begin() + 4);
+	const std::vector<uint8_t> compressed = zlib_stored(raw);
+	imagedata.insert(imagedata.end(), compressed.begin(), compressed.end());
+	chunks[7] = make_chunk("fdAT", imagedata);
+	{
+		const std::vector<uint8_t> apng = write_chunks(chunks);
+		std::vector<uint8_t>	   optimized;
+		OptimizeStats			   stats;
+		CHECK(xng::optimizer::optimize(apng.data(), apng.size(), recompress, &pool, &optimized, &stats) == 0);
+		CHECK(stats.mergedFrames == 1 && is_same_animation(apng, optimized));
+	}
+
+	// corrupt files fail, or optimize to files decoding like them
+	TestImage image = make_png(&rng, 37, 23, 0, false);
+	for (const std::vector<uint8_t>& filedata : {write_chunks(image.chunks), make_apng(&rng, 16, 16, 6)})
+	{
+		corrupt_file(&rng, filedata, 100, [&](const std::vector<uint8_t>& corrupt) {
+			std::vector<uint8_t> optimized;
+			if (xng::optimizer::optimize(corrupt.data(), corrupt.size(), recompress, &pool, &optimized) != 0)
+			{
+				return;
+			}
+			xng::png::Document document, optimizedDocument;
+			if (decode_png(corrupt, {}, &document) == 0)
+			{
+				// merged APNG frames leave the first one as it is
+				CHECK(decode_png(optimized, {}, &optimizedDocument) == 0 && !optimizedDocument.frames.empty());
+				CHECK(optimizedDocument.frames.empty() || optimizedDocument.frames[0].imagedata == document.frames[0].imagedata);
+			}
+		});
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! chunk listing of a file
+
+int dump_file(const char* path)
+{
+	std::shared_ptr<FILE> file(fopen(path, "rb"), fclose);
+	if (!file || fseek(file.get(), 0, SEEK_END) != 0)
 	{
 		return -1;
 	}
@@ -18,7 +3708,10 @@ int main(int argc, char** argv)
 	size_t size = ftell(file.get());
 	rewind(file.get());
 
-	assert(size > 8);
+	if (size <= 8)
+	{
+		return -1;
+	}
 	uint8_t signature[8];
 	fread(signature, 1, 8, file.get());
 
@@ -27,9 +3720,9 @@ int main(int argc, char** argv)
 
 	auto chunks = xng::read_chunks(filedata.data(), filedata.size());
 
-	printf("read %i chunks\n", chunks.size());
+	printf("read %zu chunks\n", chunks.size());
 	std::for_each(chunks.begin(), chunks.end(), [](auto& chunk) {
-		printf("\t'%c%c%c%c': length: %i, crc: 0x%x\n",
+		printf("\t'%c%c%c%c': length: %u, crc: 0x%x\n",
 			   chunk.id.type[0],
 			   chunk.id.type[1],
 			   chunk.id.type[2],
@@ -44,32 +3737,32 @@ int main(int argc, char** argv)
 
 	xng::chunkhandlerstate_t state = {{
 	  xng::chunkhandler_t{{.type = {'I', 'H', 'D', 'R'}},
-						  [](const xng::chunk_t* chunk, void* target) {
+						  [](const xng::chunk_t*, void*) {
 							  printf("IHDR\n");
 							  return 0;
 						  }},
 	  xng::chunkhandler_t{{.type = {'I', 'E', 'N', 'D'}},
-						  [](const xng::chunk_t* chunk, void* target) {
+						  [](const xng::chunk_t*, void*) {
 							  printf("IEND\n");
 							  return 0;
 						  }},
 	  xng::chunkhandler_t{{.type = {'I', 'D', 'A', 'T'}},
-						  [](const xng::chunk_t* chunk, void* target) {
+						  [](const xng::chunk_t*, void*) {
 							  printf("IDAT\n");
 							  return 0;
 						  }},
 	  xng::chunkhandler_t{{.type = {'a', 'c', 'T', 'L'}},
-						  [](const xng::chunk_t* chunk, void* target) {
+						  [](const xng::chunk_t*, void*) {
 							  printf("acTL\n");
 							  return 0;
 						  }},
 	  xng::chunkhandler_t{{.type = {'f', 'c', 'T', 'L'}},
-						  [](const xng::chunk_t* chunk, void* target) {
+						  [](const xng::chunk_t*, void*) {
 							  printf("fcTL\n");
 							  return 0;
 						  }},
 	  xng::chunkhandler_t{{.type = {'f', 'd', 'A', 'T'}},
-						  [](const xng::chunk_t* chunk, void* target) {
+						  [](const xng::chunk_t*, void*) {
 							  printf("fdAT\n");
 							  return 0;
 						  }},
@@ -81,9 +3774,9 @@ int main(int argc, char** argv)
 	//C-API test
 	printf("//C - API test\n");
 	size_t chunk_count = xng_iterate_chunks(filedata.data(),
-											filedata.size(),	
-											[](const xng_chunk_t* chunk, void* context) {
-												printf("\t'%c%c%c%c': length: %i, crc: 0x%x %s\n",
+											filedata.size(),
+											[](const xng_chunk_t* chunk, void*) {
+												printf("\t'%c%c%c%c': length: %u, crc: 0x%x %s\n",
 													   chunk->id.type[0],
 													   chunk->id.type[1],
 													   chunk->id.type[2],
@@ -94,7 +3787,35 @@ int main(int argc, char** argv)
 												return 0;
 											},
 											(void*)nullptr);
-	printf("iterated over %i chunks\n", chunk_count);
+	printf("iterated over %zu chunks\n", chunk_count);
 
-	return 0;
+	return err;
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2)
+	{
+		return dump_file(argv[1]);
+	}
+
+	test_inflatestream();
+	test_builtin_inflate();
+	test_region_scaling();
+	test_color();
+	test_lazy_chunks();
+	test_jng();
+	test_mng();
+	test_delta_png();
+	test_lz();
+	test_seek();
+	test_player();
+	test_pool();
+	test_stats();
+	test_c_api();
+	test_optimizer();
+
+	printf("%s: %i failed checks\n", failures ? "FAILED" : "passed", failures);
+	return failures;
 }
@@ -0,0 +1,56 @@
+//-- the C side of the tests: compiled as C, so xng/xng.h is checked to be a C header, and the decoding
+//-- interface is used the way C and FFI callers use it. called from test_xng.cpp
+
+#include "xng/xng.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//! allocator hooks counting their calls
+typedef struct c_allocation_count_t
+{
+	size_t allocs;
+	size_t frees;
+} c_allocation_count_t;
+
+void* c_count_alloc(void* context, size_t size)
+{
+	++((c_allocation_count_t*)context)->allocs;
+	return malloc(size);
+}
+
+void c_count_free(void* context, void* ptr)
+{
+	++((c_allocation_count_t*)context)->frees;
+	free(ptr);
+}
+
+//! decodes PNG file data (after the signature) through the C interface, with allocator hooks
+//! returns 0 if the image has the size and the rgba8 pixels expected, and all memory went through the
+//!  hooks and was freed
+int c_decode_png(const uint8_t* data, size_t size, const uint8_t* expected, uint32_t width, uint32_t height)
+{
+	c_allocation_count_t		 count	   = {0, 0};
+	const xng_allocator_t		 allocator = {c_count_alloc, c_count_free, &count};
+	const xng_png_decoder_desc_t desc	   = {NULL, NULL, &allocator, XNG_CHUNK_ALL};
+	xng_png_decoder_t*			 decoder   = xng_png_create_decoder_with(&desc);
+	if (!decoder)
+	{
+		return -1;
+	}
+
+	int		 result		 = -1;
+	uint32_t imageWidth	 = 0;
+	uint32_t imageHeight = 0;
+	uint8_t* pixels		 = (uint8_t*)malloc((size_t)width * height * 4 + 1);
+	if (pixels && xng_png_read_info(decoder, data, size, &imageWidth, &imageHeight) == 0 && imageWidth == width
+		&& imageHeight == height
+		&& xng_png_decode_into(decoder, NULL, 0, 0, XNG_PIXEL_FORMAT_RGBA8, pixels, (size_t)width * 4) == 0
+		&& memcmp(pixels, expected, (size_t)width * height * 4) == 0)
+	{
+		result = 0;
+	}
+	free(pixels);
+	xng_png_destroy_decoder(decoder);
+	return result == 0 && count.allocs > 0 && count.allocs == count.frees ? 0 : -1;
+}
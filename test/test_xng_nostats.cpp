@@ -0,0 +1,49 @@
+//-- the instrumentation points as a translation unit built without XNG_STATS sees them: they must
+//-- compile to nothing, even where their arguments name no declared variable. called from test_xng.cpp
+
+#undef XNG_STATS
+#include "xng/common/xng_stats.h"
+
+#define XNG_EXPANSION(...) XNG_STRING(__VA_ARGS__)
+#define XNG_STRING(...) #__VA_ARGS__
+
+//! expansions of all instrumentation points, each is ((void)0)
+extern const char* const nostats_expansions[] = {
+  XNG_EXPANSION(XNG_STAGE(Inflate, 1)),
+  XNG_EXPANSION(XNG_STAGE_BYTES(1)),
+  XNG_EXPANSION(XNG_STAGE_TOTAL(total, Inflate)),
+  XNG_EXPANSION(XNG_STAGE_SECTION(total, 1)),
+  XNG_EXPANSION(XNG_COUNT_CHUNK(id, 1)),
+  XNG_EXPANSION(XNG_COUNT_ALLOCATION(1)),
+};
+extern const size_t nostats_expansion_count = sizeof(nostats_expansions) / sizeof(nostats_expansions[0]);
+
+//! runs every instrumentation point inside a StatsScope, returns the number of spans, chunks and
+//! allocations collected
+uint64_t nostats_collected()
+{
+	xng::common::DecodeStats stats;
+	{
+		xng::common::StatsScope scope(&stats);
+		{
+			XNG_STAGE(Inflate, 100);
+			XNG_STAGE_BYTES(200);
+		}
+		{
+			XNG_STAGE_TOTAL(unfilterTotal, Unfilter);
+			for (int i = 0; i < 4; ++i)
+			{
+				XNG_STAGE_SECTION(unfilterTotal, 10);
+			}
+		}
+		XNG_COUNT_CHUNK(undeclaredId, 5);
+		XNG_COUNT_ALLOCATION(64);
+	}
+
+	uint64_t collected = stats.chunks.size() + stats.allocations + stats.allocatedBytes;
+	for (auto& stage : stats.stages)
+	{
+		collected += stage.spans + stage.bytes;
+	}
+	return collected;
+}
@@ -0,0 +1,342 @@
+#include "xng_color.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XNG_SSE2 1
+#else
+#define XNG_SSE2 0
+#endif	// defined(__SSE2__) || defined(_M_X64)
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#define XNG_F16C 1
+#else
+#define XNG_F16C 0
+#endif	// defined(__F16C__)
+
+namespace xng
+{
+	namespace common
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! 3x3 matrix helpers, row major
+
+		inline void multiply(const double a[9], const double b[9], double result[9])
+		{
+			for (int r = 0; r < 3; ++r)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					result[r * 3 + c] = a[r * 3 + 0] * b[0 * 3 + c] + a[r * 3 + 1] * b[1 * 3 + c] + a[r * 3 + 2] * b[2 * 3 + c];
+				}
+			}
+		}
+
+		inline bool invert(const double m[9], double result[9])
+		{
+			const double det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6])
+							   + m[2] * (m[3] * m[7] - m[4] * m[6]);
+			if (std::fabs(det) < 1e-12)
+			{
+				return false;
+			}
+
+			const double inv = 1.0 / det;
+			result[0]		 = (m[4] * m[8] - m[5] * m[7]) * inv;
+			result[1]		 = (m[2] * m[7] - m[1] * m[8]) * inv;
+			result[2]		 = (m[1] * m[5] - m[2] * m[4]) * inv;
+			result[3]		 = (m[5] * m[6] - m[3] * m[8]) * inv;
+			result[4]		 = (m[0] * m[8] - m[2] * m[6]) * inv;
+			result[5]		 = (m[2] * m[3] - m[0] * m[5]) * inv;
+			result[6]		 = (m[3] * m[7] - m[4] * m[6]) * inv;
+			result[7]		 = (m[1] * m[6] - m[0] * m[7]) * inv;
+			result[8]		 = (m[0] * m[4] - m[1] * m[3]) * inv;
+			return true;
+		}
+
+		inline void xy_to_XYZ(double x, double y, double XYZ[3])
+		{
+			XYZ[0] = x / y;
+			XYZ[1] = 1.0;
+			XYZ[2] = (1.0 - x - y) / y;
+		}
+
+		//! rgb -> XYZ matrix for the given primaries
+		inline bool rgb_to_XYZ(const Chromaticities& c, double result[9])
+		{
+			if (c.white_y <= 0.0f || c.red_y <= 0.0f || c.green_y <= 0.0f || c.blue_y <= 0.0f)
+			{
+				return false;
+			}
+
+			double r[3], g[3], b[3], w[3];
+			xy_to_XYZ(c.red_x, c.red_y, r);
+			xy_to_XYZ(c.green_x, c.green_y, g);
+			xy_to_XYZ(c.blue_x, c.blue_y, b);
+			xy_to_XYZ(c.white_x, c.white_y, w);
+
+			const double primaries[9] = {r[0], g[0], b[0], r[1], g[1], b[1], r[2], g[2], b[2]};
+			double		 inverse[9];
+			if (!invert(primaries, inverse))
+			{
+				return false;
+			}
+
+			// scale primaries so that rgb(1,1,1) maps to the white point
+			double scale[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				scale[i] = inverse[i * 3 + 0] * w[0] + inverse[i * 3 + 1] * w[1] + inverse[i * 3 + 2] * w[2];
+			}
+
+			for (int i = 0; i < 9; ++i)
+			{
+				result[i] = primaries[i] * scale[i % 3];
+			}
+			return true;
+		}
+
+		//! Bradford chromatic adaptation between two white points
+		inline bool bradford(const Chromaticities& from, const Chromaticities& to, double result[9])
+		{
+			static const double bradford[9] = {
+			  0.8951, 0.2664, -0.1614, -0.7502, 1.7135, 0.0367, 0.0389, -0.0685, 1.0296};
+
+			double inverse[9];
+			if (!invert(bradford, inverse))
+			{
+				return false;
+			}
+
+			double fromXYZ[3], toXYZ[3], fromLMS[3], toLMS[3];
+			xy_to_XYZ(from.white_x, from.white_y, fromXYZ);
+			xy_to_XYZ(to.white_x, to.white_y, toXYZ);
+			for (int i = 0; i < 3; ++i)
+			{
+				fromLMS[i] = bradford[i * 3 + 0] * fromXYZ[0] + bradford[i * 3 + 1] * fromXYZ[1] + bradford[i * 3 + 2] * fromXYZ[2];
+				toLMS[i]   = bradford[i * 3 + 0] * toXYZ[0] + bradford[i * 3 + 1] * toXYZ[1] + bradford[i * 3 + 2] * toXYZ[2];
+			}
+
+			const double scale[9] = {
+			  toLMS[0] / fromLMS[0], 0.0, 0.0, 0.0, toLMS[1] / fromLMS[1], 0.0, 0.0, 0.0, toLMS[2] / fromLMS[2]};
+
+			double temp[9];
+			multiply(scale, bradford, temp);
+			multiply(inverse, temp, result);
+			return true;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! build_colortransform
+
+		void build_colortransform(ColorTransform* transform, uint8_t bitdepth, TransferFunction transfer, float gamma, const Chromaticities* chromaticities)
+		{
+			assert(transform);
+
+			const size_t entries	 = bitdepth == 16 ? 65536 : 256;
+			const double maxValue	= double(entries - 1);
+			const double decodeGamma = gamma > 0.0f ? 1.0 / gamma : 2.2;
+			transform->alphaScale	= float(1.0 / maxValue);
+
+			transform->lut.resize(entries);
+			for (size_t i = 0; i < entries; ++i)
+			{
+				const double v = double(i) / maxValue;
+				if (transfer == TransferFunction::SRGB)
+				{
+					transform->lut[i] = float(v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4));
+				}
+				else
+				{
+					transform->lut[i] = float(std::pow(v, decodeGamma));
+				}
+			}
+
+			// source rgb -> XYZ -> (adapted to D65) -> linear sRGB
+			double matrix[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+			transform->hasMatrix = false;
+			if (chromaticities)
+			{
+				double sourceToXYZ[9], srgbToXYZ[9], XYZToSrgb[9], adaptation[9], temp[9];
+				if (rgb_to_XYZ(*chromaticities, sourceToXYZ) && rgb_to_XYZ(srgb_chromaticities, srgbToXYZ)
+					&& invert(srgbToXYZ, XYZToSrgb) && bradford(*chromaticities, srgb_chromaticities, adaptation))
+				{
+					multiply(adaptation, sourceToXYZ, temp);
+					multiply(XYZToSrgb, temp, matrix);
+
+					for (int i = 0; i < 9; ++i)
+					{
+						const double identity = (i % 4 == 0) ? 1.0 : 0.0;
+						if (std::fabs(matrix[i] - identity) > 1e-4)
+						{
+							transform->hasMatrix = true;
+						}
+					}
+				}
+			}
+
+			// column major, 4 floats per column for SIMD
+			for (int c = 0; c < 3; ++c)
+			{
+				for (int r = 0; r < 3; ++r)
+				{
+					transform->matrix[c * 4 + r] = float(matrix[r * 3 + c]);
+				}
+				transform->matrix[c * 4 + 3] = 0.0f;
+			}
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! apply_colortransform_matrix
+
+		void apply_colortransform_matrix(const ColorTransform& transform, float* rgba, size_t count)
+		{
+			if (!transform.hasMatrix)
+			{
+				return;
+			}
+
+			const float* m = transform.matrix;
+#if XNG_SSE2
+			const __m128 c0 = _mm_loadu_ps(m + 0);
+			const __m128 c1 = _mm_loadu_ps(m + 4);
+			const __m128 c2 = _mm_loadu_ps(m + 8);
+			const __m128 c3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+			for (size_t i = 0; i < count; ++i, rgba += 4)
+			{
+				const __m128 p = _mm_loadu_ps(rgba);
+				__m128		 r = _mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)));
+				r			   = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+				r			   = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+				r			   = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3))));
+				_mm_storeu_ps(rgba, r);
+			}
+#else
+			for (size_t i = 0; i < count; ++i, rgba += 4)
+			{
+				const float r = rgba[0];
+				const float g = rgba[1];
+				const float b = rgba[2];
+				rgba[0]		  = m[0] * r + m[4] * g + m[8] * b;
+				rgba[1]		  = m[1] * r + m[5] * g + m[9] * b;
+				rgba[2]		  = m[2] * r + m[6] * g + m[10] * b;
+			}
+#endif	// XNG_SSE2
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! half precision floats
+		//-- round to nearest even, overflow to infinity, NaN stays NaN
+
+		uint16_t float_to_half(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+
+			const uint32_t sign	 = (bits >> 16) & 0x8000;
+			const int32_t  exponent = int32_t((bits >> 23) & 0xFF) - 127 + 15;
+			uint32_t	   mantissa = bits & 0x7FFFFF;
+
+			if (((bits >> 23) & 0xFF) == 0xFF)
+			{
+				return uint16_t(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+			}
+			if (exponent >= 31)
+			{
+				return uint16_t(sign | 0x7C00);
+			}
+			if (exponent <= 0)
+			{
+				if (exponent < -10)
+				{
+					return uint16_t(sign);
+				}
+
+				// subnormal
+				mantissa |= 0x800000;
+				const uint32_t shift   = uint32_t(14 - exponent);
+				uint32_t	   half	= mantissa >> shift;
+				const uint32_t rest	= mantissa & ((1u << shift) - 1);
+				const uint32_t halfway = 1u << (shift - 1);
+				if (rest > halfway || (rest == halfway && (half & 1)))
+				{
+					++half;
+				}
+				return uint16_t(sign | half);
+			}
+
+			uint32_t	   half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+			const uint32_t rest = mantissa & 0x1FFF;
+			if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			{
+				// may carry into the exponent, which is the correct result
+				++half;
+			}
+			return uint16_t(sign | half);
+		}
+
+		float half_to_float(uint16_t value)
+		{
+			const uint32_t sign		= uint32_t(value & 0x8000) << 16;
+			uint32_t	   exponent = (value >> 10) & 0x1F;
+			uint32_t	   mantissa = value & 0x3FF;
+			uint32_t	   bits;
+
+			if (exponent == 0x1F)
+			{
+				bits = sign | 0x7F800000 | (mantissa << 13);
+			}
+			else if (exponent == 0)
+			{
+				if (mantissa == 0)
+				{
+					bits = sign;
+				}
+				else
+				{
+					// normalize subnormal
+					exponent = 127 - 15 + 1;
+					while ((mantissa & 0x400) == 0)
+					{
+						mantissa <<= 1;
+						--exponent;
+					}
+					bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+				}
+			}
+			else
+			{
+				bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+			}
+
+			float result;
+			memcpy(&result, &bits, sizeof(result));
+			return result;
+		}
+
+		void float_to_half(const float* values, uint16_t* halfs, size_t count)
+		{
+			size_t i = 0;
+#if XNG_F16C
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i h = _mm_cvtps_ph(_mm_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(halfs + i), h);
+			}
+#endif	// XNG_F16C
+			for (; i < count; ++i)
+			{
+				halfs[i] = float_to_half(values[i]);
+			}
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+
+	}	// namespace common
+}	// namespace xng
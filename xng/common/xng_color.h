@@ -0,0 +1,73 @@
+#ifndef XNG_COLOR_H_INC
+#define XNG_COLOR_H_INC
+
+#include "xng/xng.h"
+
+#include <cctype>
+#include <vector>
+
+namespace xng
+{
+	namespace common
+	{
+		//-------------------------------------------------------------------------
+		//! color space description, as stored in gAMA/cHRM/sRGB chunks
+
+		enum class TransferFunction : uint8_t
+		{
+			SRGB = 0,	// sRGB piecewise curve (IEC 61966-2-1)
+			Gamma,		// pure power law
+		};
+
+		struct Chromaticities
+		{
+			float white_x;
+			float white_y;
+			float red_x;
+			float red_y;
+			float green_x;
+			float green_y;
+			float blue_x;
+			float blue_y;
+		};
+
+		//! sRGB/Rec.709 primaries with D65 white point, i.e. the linear output space
+		static const Chromaticities srgb_chromaticities = {0.3127f, 0.3290f, 0.64f, 0.33f, 0.30f, 0.60f, 0.15f, 0.06f};
+
+		//-------------------------------------------------------------------------
+		//! encoded samples to linear light
+
+		struct ColorTransform
+		{
+			std::vector<float> lut;				// encoded sample -> linear, 256 or 65536 entries
+			float			   alphaScale;		// 1 / max sample value
+			bool			   hasMatrix;		// false if the primaries are the output ones
+			float			   matrix[12];		// 3x3 source rgb -> linear sRGB, column major, padded to 4 rows
+		};
+
+		//! build_colortransform
+		//! param[out] transform: transform to initialize
+		//! param[in] bitdepth: sample bitdepth, LUT has 65536 entries for 16 bit, 256 otherwise
+		//! param[in] transfer: transfer function of the encoded samples
+		//! param[in] gamma: file gamma (e.g. 0.45455), only used for TransferFunction::Gamma
+		//! param[in] chromaticities: source primaries and white point, nullptr for sRGB
+		void build_colortransform(ColorTransform* transform, uint8_t bitdepth, TransferFunction transfer, float gamma, const Chromaticities* chromaticities);
+
+		//! apply_colortransform_matrix
+		//! applies the 3x3 matrix in place to count linear rgba pixels, alpha is kept
+		void apply_colortransform_matrix(const ColorTransform& transform, float* rgba, size_t count);
+
+		//-------------------------------------------------------------------------
+		//! half precision floats
+
+		uint16_t float_to_half(float value);
+		float half_to_float(uint16_t value);
+
+		//! converts count floats to half precision
+		void float_to_half(const float* values, uint16_t* halfs, size_t count);
+
+	}	// namespace common
+}	// namespace xng
+
+
+#endif	// XNG_COLOR_H_INC
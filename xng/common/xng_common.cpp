@@ -0,0 +1,466 @@
+#include "xng_common.h"
+#include "xng_inflate.h"
+#include "xng_stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+namespace xng
+{
+	namespace common
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! deflate
+
+		std::vector<uint8_t> deflate(const std::vector<uint8_t>& data, deflatefunc_t deflatefunc, void* settings)
+		{
+			assert(deflatefunc);
+			std::vector<uint8_t> compressed;
+			if (!deflatefunc)
+			{
+				return compressed;
+			}
+
+			unsigned char* out	 = nullptr;
+			size_t		   outsize = 0;
+			if (deflatefunc(&out, &outsize, data.data(), data.size(), settings) == 0 && out)
+			{
+				compressed.assign(out, out + outsize);
+			}
+
+			free(out);
+			return compressed;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! inflate
+
+		std::vector<uint8_t> inflate(const std::vector<uint8_t>& data, inflatefunc_t inflatefunc, void* settings)
+		{
+			std::vector<uint8_t> decompressed;
+			if (!inflatefunc)
+			{
+				inflatefunc = builtin_inflate;
+			}
+
+			XNG_STAGE(Inflate, 0);
+			unsigned char* out	 = nullptr;
+			size_t		   outsize = 0;
+			if (inflatefunc(&out, &outsize, data.data(), data.size(), settings) == 0 && out)
+			{
+				decompressed.assign(out, out + outsize);
+				XNG_STAGE_BYTES(outsize);
+				XNG_COUNT_ALLOCATION(outsize);
+			}
+
+			free(out);
+			return decompressed;
+		}
+
+		//! inflates into std::vector and std::pmr::vector buffers alike
+		template <typename Buffer>
+		int inflate_into(const uint8_t* data, size_t size, inflatefunc_t inflatefunc, void* settings, Buffer* out)
+		{
+			assert(out);
+			if (!inflatefunc)
+			{
+				inflatefunc = builtin_inflate;
+			}
+
+			// only the built-in inflate fills a preallocated buffer, functions modeled after lodepng's
+			// would realloc or free it
+			XNG_STAGE(Inflate, 0);
+			const bool	   isInPlace  = inflatefunc == builtin_inflate && !out->empty();
+			unsigned char* buffer	  = isInPlace ? out->data() : nullptr;
+			size_t		   buffersize = isInPlace ? out->size() : 0;
+			int			   err		  = inflatefunc(&buffer, &buffersize, data, size, settings);
+
+			if (isInPlace)
+			{
+				// filled in place
+				out->resize(std::min(buffersize, out->size()));
+				XNG_STAGE_BYTES(out->size());
+				return err;
+			}
+
+			if (err == 0 && buffer)
+			{
+				out->assign(buffer, buffer + buffersize);
+				XNG_STAGE_BYTES(buffersize);
+				XNG_COUNT_ALLOCATION(buffersize);
+			}
+			else
+			{
+				out->clear();
+			}
+
+			free(buffer);
+			return err;
+		}
+
+		int inflate(const std::vector<uint8_t>& data, inflatefunc_t inflatefunc, void* settings, std::vector<uint8_t>* out)
+		{
+			return inflate_into(data.data(), data.size(), inflatefunc, settings, out);
+		}
+
+		int inflate(const uint8_t* data, size_t size, inflatefunc_t inflatefunc, void* settings, std::vector<uint8_t>* out)
+		{
+			return inflate_into(data, size, inflatefunc, settings, out);
+		}
+
+		int inflate(const uint8_t* data, size_t size, inflatefunc_t inflatefunc, void* settings, std::pmr::vector<uint8_t>* out)
+		{
+			return inflate_into(data, size, inflatefunc, settings, out);
+		}
+
+		//! inflates by the built-in stream straight into out, growing it as the output arrives
+		//! returns 0 on success, -1 for corrupt or truncated data and output over maxSize
+		int inflate_bounded(const uint8_t* data, size_t size, size_t maxSize, std::pmr::vector<uint8_t>* out)
+		{
+			InflateStream stream;
+			if (stream.reset(&builtin_inflatestream, nullptr) != 0 || stream.feed(data, size) != 0)
+			{
+				return -1;
+			}
+
+			// one byte more than allowed, to tell output of exactly maxSize bytes from more
+			const size_t capacity = maxSize < SIZE_MAX ? maxSize + 1 : SIZE_MAX;
+			size_t		 inflated = 0;
+			for (;;)
+			{
+				if (inflated == out->size())
+				{
+					if (inflated == capacity)
+					{
+						return -1;
+					}
+					out->resize(std::min(std::max<size_t>(inflated * 2, 4096), capacity));
+				}
+
+				size_t				written = 0;
+				const InflateStatus status	= stream.drain(out->data() + inflated, out->size() - inflated, &written);
+				inflated += written;
+				if (status == InflateStatus::Done)
+				{
+					out->resize(inflated);
+					return inflated <= maxSize ? 0 : -1;
+				}
+				if (status != InflateStatus::Ok)
+				{
+					// corrupt, or all input consumed before the end of the stream
+					return -1;
+				}
+			}
+		}
+
+		const std::pmr::vector<uint8_t>* inflate(const LazyInflatedData& data, inflatefunc_t inflatefunc, void* settings, size_t maxSize)
+		{
+			if (data.isInflated)
+			{
+				return data.inflated.size() <= maxSize ? &data.inflated : nullptr;
+			}
+
+			XNG_STAGE(Inflate, 0);
+			int err = -1;
+			if (!inflatefunc || inflatefunc == builtin_inflate)
+			{
+				err = inflate_bounded(data.compressed, data.compressedSize, maxSize, &data.inflated);
+			}
+			else
+			{
+				// functions modeled after lodepng's allocate the whole output themselves, it's copied
+				unsigned char* out	   = nullptr;
+				size_t		   outsize = 0;
+				err					   = inflatefunc(&out, &outsize, data.compressed, data.compressedSize, settings);
+				if (err == 0 && outsize <= maxSize)
+				{
+					data.inflated.assign(out, out + (out ? outsize : 0));
+					XNG_COUNT_ALLOCATION(outsize);
+				}
+				else
+				{
+					err = -1;
+				}
+				free(out);
+			}
+
+			if (err != 0)
+			{
+				// not memoized, a later call inflates again
+				data.inflated.clear();
+				data.inflated.shrink_to_fit();
+				return nullptr;
+			}
+
+			XNG_STAGE_BYTES(data.inflated.size());
+			data.isInflated = true;
+			return &data.inflated;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! scanline unfiltering
+		//-- see PNG spec, 9 Filtering
+
+		inline uint8_t paeth_predictor(int16_t a, int16_t b, int16_t c)
+		{
+			int16_t pa = std::abs(b - c);
+			int16_t pb = std::abs(a - c);
+			int16_t pc = std::abs(a + b - c - c);
+
+			if (pc < pa && pc < pb)
+			{
+				return uint8_t(c);
+			}
+			else if (pb < pa)
+			{
+				return uint8_t(b);
+			}
+			return uint8_t(a);
+		}
+
+		int unfilter_scanline(uint8_t* recon, const uint8_t* precon, size_t bytewidth, uint8_t filterType, size_t length)
+		{
+			switch (filterType)
+			{
+				case 0:
+					break;
+				case 1:
+					for (size_t i = bytewidth; i < length; ++i)
+					{
+						recon[i] += recon[i - bytewidth];
+					}
+					break;
+				case 2:
+					for (size_t i = 0; i < length; ++i)
+					{
+						recon[i] += precon[i];
+					}
+					break;
+				case 3:
+					for (size_t i = 0; i < bytewidth; ++i)
+					{
+						recon[i] += precon[i] >> 1;
+					}
+					for (size_t i = bytewidth; i < length; ++i)
+					{
+						recon[i] += uint8_t((recon[i - bytewidth] + precon[i]) >> 1);
+					}
+					break;
+				case 4:
+					for (size_t i = 0; i < bytewidth; ++i)
+					{
+						recon[i] += precon[i];
+					}
+					for (size_t i = bytewidth; i < length; ++i)
+					{
+						recon[i] += paeth_predictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]);
+					}
+					break;
+				default:
+					return -1;
+			}
+			return 0;
+		}
+
+		int filter_scanline(uint8_t* filtered, const uint8_t* recon, const uint8_t* precon, size_t bytewidth, uint8_t filterType, size_t length)
+		{
+			switch (filterType)
+			{
+				case 0:
+					memcpy(filtered, recon, length);
+					break;
+				case 1:
+					for (size_t i = 0; i < length; ++i)
+					{
+						filtered[i] = recon[i] - (i >= bytewidth ? recon[i - bytewidth] : 0);
+					}
+					break;
+				case 2:
+					for (size_t i = 0; i < length; ++i)
+					{
+						filtered[i] = recon[i] - precon[i];
+					}
+					break;
+				case 3:
+					for (size_t i = 0; i < length; ++i)
+					{
+						const uint8_t left = i >= bytewidth ? recon[i - bytewidth] : 0;
+						filtered[i]		   = recon[i] - uint8_t((left + precon[i]) >> 1);
+					}
+					break;
+				case 4:
+					for (size_t i = 0; i < length; ++i)
+					{
+						const uint8_t left	   = i >= bytewidth ? recon[i - bytewidth] : 0;
+						const uint8_t upperLeft = i >= bytewidth ? precon[i - bytewidth] : 0;
+						filtered[i]			   = recon[i] - paeth_predictor(left, precon[i], upperLeft);
+					}
+					break;
+				default:
+					return -1;
+			}
+			return 0;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! streaming inflate
+
+		InflateStream::~InflateStream()
+		{
+			if (state)
+			{
+				backend->destroy(state);
+			}
+		}
+
+		int InflateStream::reset(const inflatestream_t* streamBackend, void* streamSettings)
+		{
+			assert(streamBackend);
+			if (state && (backend != streamBackend || settings != streamSettings))
+			{
+				backend->destroy(state);
+				state = nullptr;
+			}
+
+			backend  = streamBackend;
+			settings = streamSettings;
+			if (!state)
+			{
+				state = backend->create(settings);
+				return state ? 0 : -1;
+			}
+			return backend->reset(state);
+		}
+
+		int InflateStream::feed(const uint8_t* data, size_t size)
+		{
+			assert(state);
+			return backend->feed(state, data, size);
+		}
+
+		InflateStatus InflateStream::drain(uint8_t* out, size_t size, size_t* written)
+		{
+			assert(state);
+			return backend->drain(state, out, size, written);
+		}
+
+		bool InflateStream::read(uint8_t* out, size_t size)
+		{
+			while (size > 0)
+			{
+				size_t		  written = 0;
+				InflateStatus status  = drain(out, size, &written);
+				out += written;
+				size -= written;
+				if (status != InflateStatus::Ok && size > 0)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+
+		///////////////////////////////////////////////////////////////////////////
+		//! serialization
+
+		void ByteWriter::write_uint8(uint8_t value)
+		{
+			out->push_back(value);
+		}
+
+		void ByteWriter::write_uint16(uint16_t value)
+		{
+			const size_t offset = out->size();
+			out->resize(offset + sizeof(value));
+			write_uint16_t(value, out->data() + offset, nullptr);
+		}
+
+		void ByteWriter::write_uint32(uint32_t value)
+		{
+			const size_t offset = out->size();
+			out->resize(offset + sizeof(value));
+			write_uint32_t(value, out->data() + offset, nullptr);
+		}
+
+		void ByteWriter::write_uint64(uint64_t value)
+		{
+			write_uint32(uint32_t(value >> 32));
+			write_uint32(uint32_t(value));
+		}
+
+		void ByteWriter::write_double(double value)
+		{
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			write_uint64(bits);
+		}
+
+		void ByteWriter::write_bytes(const std::vector<uint8_t>& bytes)
+		{
+			write_uint64(bytes.size());
+			out->insert(out->end(), bytes.begin(), bytes.end());
+		}
+
+		uint8_t ByteReader::read_uint8()
+		{
+			if (end - data_iter < 1)
+			{
+				isValid = false;
+				return 0;
+			}
+			return read_uint8_t(data_iter, &data_iter);
+		}
+
+		uint16_t ByteReader::read_uint16()
+		{
+			if (end - data_iter < 2)
+			{
+				isValid = false;
+				return 0;
+			}
+			return read_uint16_t(data_iter, &data_iter);
+		}
+
+		uint32_t ByteReader::read_uint32()
+		{
+			if (end - data_iter < 4)
+			{
+				isValid = false;
+				return 0;
+			}
+			return read_uint32_t(data_iter, &data_iter);
+		}
+
+		uint64_t ByteReader::read_uint64()
+		{
+			const uint64_t high = read_uint32();
+			return high << 32 | read_uint32();
+		}
+
+		double ByteReader::read_double()
+		{
+			const uint64_t bits = read_uint64();
+			double		   value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		void ByteReader::read_bytes(std::vector<uint8_t>* bytes)
+		{
+			const uint64_t size = read_uint64();
+			if (!isValid || uint64_t(end - data_iter) < size)
+			{
+				isValid = false;
+				bytes->clear();
+				return;
+			}
+			bytes->assign(data_iter, data_iter + size);
+			data_iter += size;
+		}
+
+	}	// namespace common
+}	// namespace xng
@@ -4,6 +4,8 @@
 #include "xng/xng.h"
 
 #include <cctype>
+#include <cstring>
+#include <memory_resource>
 #include <vector>
 
 namespace xng
@@ -16,9 +18,61 @@ namespace xng
 		};
 
 
-		typedef int (*deflatefunc_t)((unsigned char**, size_t*, const unsigned char*, void* settings);
-		typedef int (*inflatefunc_t)((unsigned char**, size_t*, const unsigned char*, void* settings);
-		
+		//! view of one piece of a stream split across chunks (e.g. JDAT, IDAT)
+		//! the viewed data is owned by the chunks and must outlive the view
+		struct ByteSpan
+		{
+			const uint8_t* data;
+			size_t		   size;
+		};
+
+		//! total size of the spans, in a std::vector or std::pmr::vector
+		template <typename Spans>
+		size_t spans_size(const Spans& spans)
+		{
+			size_t size = 0;
+			for (const ByteSpan& span : spans)
+			{
+				size += span.size;
+			}
+			return size;
+		}
+
+		//! join_spans
+		//! returns the spans as one contiguous span: a single span as it is, more are copied into buffer
+		//! param[in] spans: the pieces of the stream
+		//! param[out] buffer: receives the joined pieces, reused
+		//! returns the contiguous data, valid as long as the spans and the buffer
+		template <typename Spans, typename Buffer>
+		ByteSpan join_spans(const Spans& spans, Buffer* buffer)
+		{
+			if (spans.size() <= 1)
+			{
+				return spans.empty() ? ByteSpan{nullptr, 0} : spans.front();
+			}
+
+			buffer->resize(spans_size(spans));
+			uint8_t* target = buffer->data();
+			for (const ByteSpan& span : spans)
+			{
+				memcpy(target, span.data, span.size);
+				target += span.size;
+			}
+			return {buffer->data(), buffer->size()};
+		}
+
+
+		//! signature of the (de)compression functions, modeled after lodepng's custom_zlib
+		//! param[out] out: output buffer, allocated by the function using malloc(), released by the caller.
+		//!  nullptr on input
+		//! param[out] outsize: size of the output buffer
+		//! param[in] in: input data
+		//! param[in] insize: size of the input data
+		//! param[in] settings: user-defined settings
+		//! returns 0 on success
+		typedef int (*deflatefunc_t)(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, void* settings);
+		typedef int (*inflatefunc_t)(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, void* settings);
+
 		//! deflate
 		//! compresses the input data, returns the compressed buffer
 		//! param[in] data: uncompressed data
@@ -31,11 +85,161 @@ namespace xng
 		//! inflate
 		//! decompresses the input data, returns the decompressed buffer
 		//! param[in] data: compressed data
-		//! param[in] inflatefunc: inflate function (e.g. wrapping zlib)
+		//! param[in] inflatefunc: inflate function (e.g. wrapping zlib), nullptr for the built-in one
 		//! param[in] settings: settings for inflate function
 		//! returns decompressed data
 		std::vector<uint8_t> inflate(const std::vector<uint8_t>& data, inflatefunc_t inflatefunc, void* settings);
 
+		//! inflate
+		//! decompresses the input data into a reused buffer
+		//! param[in] data: compressed data
+		//! param[in] inflatefunc: inflate function (e.g. wrapping zlib), nullptr for the built-in one
+		//! param[in] settings: settings for inflate function
+		//! param[in,out] out: decompressed data. its size on input is the expected size; the built-in
+		//!  inflate fills it in place without allocating, other functions allocate and are copied from
+		//! returns 0 on success
+		int inflate(const std::vector<uint8_t>& data, inflatefunc_t inflatefunc, void* settings, std::vector<uint8_t>* out);
+
+		//! inflate
+		//! same for data in memory of the caller, e.g. joined spans (see join_spans)
+		int inflate(const uint8_t* data, size_t size, inflatefunc_t inflatefunc, void* settings, std::vector<uint8_t>* out);
+		int inflate(const uint8_t* data, size_t size, inflatefunc_t inflatefunc, void* settings, std::pmr::vector<uint8_t>* out);
+
+
+		//! streaming inflate
+		//! stateful decompression of a zlib stream fed in pieces and drained into caller-provided
+		//! output windows, so the whole output never needs to be in memory
+
+		enum class InflateStatus : int8_t
+		{
+			Error = -1,	// corrupt stream or backend failure
+			Ok	= 0,	 // output window filled, more output may follow
+			NeedsInput,	// all fed input consumed before the window was filled
+			Done		   // end of stream, remaining output drained
+		};
+
+		//! backend of an inflate stream
+		struct inflatestream_t
+		{
+			//! returns a new state, nullptr on failure
+			void* (*create)(void* settings);
+			//! releases the state
+			void (*destroy)(void* state);
+			//! prepares the state for a new stream, keeping its buffers. returns 0 on success
+			int (*reset)(void* state);
+			//! queues input. the data is not copied and must stay valid until drain returned NeedsInput or Done
+			int (*feed)(void* state, const unsigned char* in, size_t insize);
+			//! decompresses up to outsize bytes into out, *written receives the number of bytes written
+			InflateStatus (*drain)(void* state, unsigned char* out, size_t outsize, size_t* written);
+		};
+
+		//! owns the state of an inflate stream backend
+		struct InflateStream
+		{
+			const inflatestream_t* backend  = nullptr;
+			void*				   settings = nullptr;
+			void*				   state	= nullptr;
+
+			InflateStream() = default;
+			InflateStream(const InflateStream&) = delete;
+			InflateStream& operator=(const InflateStream&) = delete;
+			~InflateStream();
+
+			//! starts a new stream. the state is kept if backend and settings didn't change, so buffers are reused
+			//! returns 0 on success
+			int reset(const inflatestream_t* streamBackend, void* streamSettings);
+			int feed(const uint8_t* data, size_t size);
+			InflateStatus drain(uint8_t* out, size_t size, size_t* written);
+
+			//! fills out completely, returns false if the stream fails or ends before
+			//! not timed, callers reading per scanline time it as a section of an image (see XNG_STAGE_TOTAL)
+			bool read(uint8_t* out, size_t size);
+		};
+
+
+		//! unfilter_scanline
+		//! reconstructs a PNG filtered scanline in place (PNG, JNG alpha, MNG)
+		//! param[in,out] recon: filtered scanline, without the filter type byte
+		//! param[in] precon: previous reconstructed scanline, all zeroes for the first one
+		//! param[in] bytewidth: bytes per complete pixel, at least 1
+		//! param[in] filterType: filter type byte of the scanline
+		//! param[in] length: scanline size in bytes
+		//! returns 0 on success, -1 for unknown filter types
+		//! not timed, callers time it as a section of an image (see XNG_STAGE_TOTAL)
+		int unfilter_scanline(uint8_t* recon, const uint8_t* precon, size_t bytewidth, uint8_t filterType, size_t length);
+
+		//! filter_scanline
+		//! filters a reconstructed scanline, the inverse of unfilter_scanline
+		//! param[out] filtered: filtered scanline, without the filter type byte
+		//! param[in] recon: scanline to filter
+		//! param[in] precon: previous reconstructed scanline, all zeroes for the first one
+		//! param[in] bytewidth: bytes per complete pixel, at least 1
+		//! param[in] filterType: filter type to apply
+		//! param[in] length: scanline size in bytes
+		//! returns 0 on success, -1 for unknown filter types
+		int filter_scanline(uint8_t* filtered, const uint8_t* recon, const uint8_t* precon, size_t bytewidth, uint8_t filterType, size_t length);
+
+
+		//! lazily inflated data
+		//! zero-copy view into compressed data (e.g. chunk data), inflated on first access and memoized.
+		//! the viewed data must outlive this. not thread-safe.
+		struct LazyInflatedData
+		{
+			const uint8_t* compressed	 = nullptr;
+			size_t		   compressedSize = 0;
+
+			mutable bool					  isInflated = false;
+			mutable std::pmr::vector<uint8_t> inflated;	// memo, allocated from the resource
+
+			explicit LazyInflatedData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : inflated(resource)
+			{
+			}
+		};
+
+		//! inflate
+		//! returns the decompressed data, inflating it on the first successful call only. failures are not
+		//! memoized, a later call (e.g. with another inflate function or a larger maxSize) inflates again
+		//! param[in] data: lazily inflated data
+		//! param[in] inflatefunc: inflate function (e.g. wrapping zlib), nullptr for the built-in one, which
+		//!  inflates straight into the memo and stops at maxSize
+		//! param[in] settings: settings for inflate function
+		//! param[in] maxSize: largest decompressed size accepted
+		//! returns the decompressed data, nullptr for corrupt data or data over maxSize
+		const std::pmr::vector<uint8_t>* inflate(const LazyInflatedData& data, inflatefunc_t inflatefunc, void* settings, size_t maxSize);
+
+
+		//! serialization
+		//! big-endian fields, used to persist seek indices
+
+		//! appends fields to out
+		struct ByteWriter
+		{
+			std::vector<uint8_t>* out;
+
+			void write_uint8(uint8_t value);
+			void write_uint16(uint16_t value);
+			void write_uint32(uint32_t value);
+			void write_uint64(uint64_t value);
+			void write_double(double value);
+			void write_bytes(const std::vector<uint8_t>& bytes);	// size prefixed
+		};
+
+		//! reads fields as written by ByteWriter. reading past the end returns zeroes and clears isValid
+		struct ByteReader
+		{
+			const uint8_t* data_iter;
+			const uint8_t* end;
+			bool		   isValid = true;
+
+			uint8_t	 read_uint8();
+			uint16_t read_uint16();
+			uint32_t read_uint32();
+			uint64_t read_uint64();
+			double	 read_double();
+			void	 read_bytes(std::vector<uint8_t>* bytes);
+		};
+
 	}	// namespace common
 }	// namespace xng
 
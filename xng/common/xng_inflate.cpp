@@ -0,0 +1,1542 @@
+#include "xng_inflate.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XNG_SSE2 1
+#else
+#define XNG_SSE2 0
+#endif	// defined(__SSE2__) || defined(_M_X64)
+
+#ifdef XNG_ZLIB
+#include <zlib.h>
+#endif	// XNG_ZLIB
+
+namespace xng
+{
+	namespace common
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! deflate tables (RFC 1951, 3.2.5)
+
+		static const uint16_t length_base[29]	= {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+												   31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+		static const uint8_t  length_extra[29]   = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+												   2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+		static const uint16_t distance_base[30]  = {1,	2,	3,	4,	5,	7,	 9,	13,	17,	25,
+												   33,   49,   65,   97,   129,  193,  257,  385,  513,  769,
+												   1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+		static const uint8_t  distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+													6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+		static const uint8_t codelength_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+		static const unsigned max_codelength = 15;
+		static const unsigned fast_bits		 = 9;
+		static const size_t   window_size	= 32768;	// largest match distance
+		static const size_t   max_match		 = 258;
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! huffman decoding tables
+
+		struct Huffman
+		{
+			uint16_t fast[1 << fast_bits];			// symbol << 4 | code length for codes up to fast_bits, 0 otherwise
+			uint16_t count[max_codelength + 1];	 // number of codes per length
+			uint16_t symbol[288];					// symbols ordered by code
+		};
+
+		inline unsigned reverse_bits(unsigned code, unsigned length)
+		{
+			unsigned reversed = 0;
+			for (unsigned i = 0; i < length; ++i, code >>= 1)
+			{
+				reversed = (reversed << 1) | (code & 1);
+			}
+			return reversed;
+		}
+
+		//! builds canonical code tables from code lengths
+		//! returns false for over-subscribed codes; incomplete ones fail when an unused code is met
+		inline bool build_huffman(Huffman* huffman, const uint8_t* lengths, unsigned count)
+		{
+			memset(huffman->count, 0, sizeof(huffman->count));
+			for (unsigned i = 0; i < count; ++i)
+			{
+				++huffman->count[lengths[i]];
+			}
+			huffman->count[0] = 0;
+
+			int left = 1;
+			for (unsigned length = 1; length <= max_codelength; ++length)
+			{
+				left = (left << 1) - huffman->count[length];
+				if (left < 0)
+				{
+					return false;
+				}
+			}
+
+			uint16_t offsets[max_codelength + 1] = {0};
+			for (unsigned length = 1; length < max_codelength; ++length)
+			{
+				offsets[length + 1] = offsets[length] + huffman->count[length];
+			}
+			for (unsigned i = 0; i < count; ++i)
+			{
+				if (lengths[i] != 0)
+				{
+					huffman->symbol[offsets[lengths[i]]++] = uint16_t(i);
+				}
+			}
+
+			// deflate stores codes msb first in an lsb first bit stream, the table is indexed by the reversed code
+			memset(huffman->fast, 0, sizeof(huffman->fast));
+			unsigned code  = 0;
+			unsigned index = 0;
+			for (unsigned length = 1; length <= fast_bits; ++length, code <<= 1)
+			{
+				for (unsigned k = 0; k < huffman->count[length]; ++k, ++code, ++index)
+				{
+					const uint16_t entry = uint16_t(huffman->symbol[index] << 4 | length);
+					for (unsigned j = reverse_bits(code, length); j < (1u << fast_bits); j += 1u << length)
+					{
+						huffman->fast[j] = entry;
+					}
+				}
+			}
+			return true;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! adler32
+
+		static const uint32_t adler_modulus = 65521;
+
+		inline uint32_t update_adler32(uint32_t adler, const uint8_t* data, size_t size)
+		{
+			uint32_t a = adler & 0xffff;
+			uint32_t b = adler >> 16;
+
+#if XNG_SSE2
+			// 32 byte blocks: a sums up per block, b adds a per block and each byte weighted by its
+			// distance to the block end. at most 128 blocks, so per position byte sums fit signed 16 bit
+			const __m128i zero	= _mm_setzero_si128();
+			const __m128i weights0 = _mm_setr_epi16(32, 31, 30, 29, 28, 27, 26, 25);
+			const __m128i weights1 = _mm_setr_epi16(24, 23, 22, 21, 20, 19, 18, 17);
+			const __m128i weights2 = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+			const __m128i weights3 = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+			while (size >= 32)
+			{
+				const size_t blocks = std::min<size_t>(size / 32, 128);
+				__m128i		 sumA   = zero;
+				__m128i		 sumB   = zero;
+				__m128i		 bytes0 = zero;
+				__m128i		 bytes1 = zero;
+				__m128i		 bytes2 = zero;
+				__m128i		 bytes3 = zero;
+				for (size_t i = 0; i < blocks; ++i, data += 32)
+				{
+					const __m128i low  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+					const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+					sumB			   = _mm_add_epi32(sumB, sumA);
+					sumA			   = _mm_add_epi32(sumA, _mm_add_epi32(_mm_sad_epu8(low, zero), _mm_sad_epu8(high, zero)));
+					bytes0			   = _mm_add_epi16(bytes0, _mm_unpacklo_epi8(low, zero));
+					bytes1			   = _mm_add_epi16(bytes1, _mm_unpackhi_epi8(low, zero));
+					bytes2			   = _mm_add_epi16(bytes2, _mm_unpacklo_epi8(high, zero));
+					bytes3			   = _mm_add_epi16(bytes3, _mm_unpackhi_epi8(high, zero));
+				}
+
+				sumB = _mm_slli_epi32(sumB, 5);
+				sumB = _mm_add_epi32(sumB, _mm_madd_epi16(bytes0, weights0));
+				sumB = _mm_add_epi32(sumB, _mm_madd_epi16(bytes1, weights1));
+				sumB = _mm_add_epi32(sumB, _mm_madd_epi16(bytes2, weights2));
+				sumB = _mm_add_epi32(sumB, _mm_madd_epi16(bytes3, weights3));
+
+				uint32_t lanesA[4];
+				uint32_t lanesB[4];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(lanesA), sumA);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(lanesB), sumB);
+
+				const uint64_t blockB = uint64_t(b) + uint64_t(a) * blocks * 32 + lanesB[0] + lanesB[1] + lanesB[2] + lanesB[3];
+				a					  = uint32_t((uint64_t(a) + lanesA[0] + lanesA[2]) % adler_modulus);
+				b					  = uint32_t(blockB % adler_modulus);
+				size -= blocks * 32;
+			}
+#endif	// XNG_SSE2
+
+			while (size > 0)
+			{
+				// largest block before b may overflow
+				const size_t block = std::min<size_t>(size, 5552);
+				for (size_t i = 0; i < block; ++i)
+				{
+					a += data[i];
+					b += a;
+				}
+				a %= adler_modulus;
+				b %= adler_modulus;
+				data += block;
+				size -= block;
+			}
+			return b << 16 | a;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! built-in streaming inflater
+		//-- decodes into a ring buffer holding the match history and the output not drained yet.
+		//-- whenever input runs out mid-symbol or mid-header, the bit reader is rolled back to the
+		//-- last checkpoint, so decoding resumes with the next feed as if the input was contiguous
+
+		struct BuiltinInflater
+		{
+			enum class State : uint8_t
+			{
+				Header,
+				BlockHeader,
+				Stored,
+				Huffman,
+				Trailer,
+				Done,
+				Error
+			};
+
+			struct Span
+			{
+				const uint8_t* data;
+				size_t		   size;
+			};
+
+			struct Position
+			{
+				size_t   span;
+				size_t   offset;
+				uint64_t bits;
+				unsigned bitcount;
+			};
+
+			std::vector<Span>	spans;
+			std::vector<uint8_t> carry;		// unconsumed input kept when running out of input
+			std::vector<uint8_t> carryNext;
+			Position			 input;
+			bool				 underflow;
+
+			State	state;
+			bool	 isFinal;
+			uint32_t storedRemaining;
+			Huffman  fixedLiterals;
+			Huffman  fixedDistances;
+			Huffman  dynamicLiterals;
+			Huffman  dynamicDistances;
+			Huffman* literals;
+			Huffman* distances;
+
+			std::vector<uint8_t> window;	// history + output not drained yet
+			uint64_t			 produced;
+			uint64_t			 drained;
+			uint32_t			 adler;
+			uint32_t			 expectedAdler;
+
+			BuiltinInflater()
+			  : window(2 * window_size)
+			{
+				uint8_t lengths[288 + 30];
+				std::fill(lengths, lengths + 144, uint8_t(8));
+				std::fill(lengths + 144, lengths + 256, uint8_t(9));
+				std::fill(lengths + 256, lengths + 280, uint8_t(7));
+				std::fill(lengths + 280, lengths + 288, uint8_t(8));
+				std::fill(lengths + 288, lengths + 318, uint8_t(5));
+				build_huffman(&fixedLiterals, lengths, 288);
+				build_huffman(&fixedDistances, lengths + 288, 30);
+				reset();
+			}
+
+			void reset()
+			{
+				spans.clear();
+				input	 = {0, 0, 0, 0};
+				underflow = false;
+				state	 = State::Header;
+				isFinal   = false;
+				produced  = 0;
+				drained   = 0;
+				adler	 = 1;
+			}
+
+			///////////////////////////////////////////////////////////////////////
+			//! bit reader
+
+			//! skips exhausted spans, returns false if no input is left
+			bool has_input()
+			{
+				while (input.span < spans.size() && input.offset == spans[input.span].size)
+				{
+					++input.span;
+					input.offset = 0;
+				}
+				return input.span < spans.size();
+			}
+
+			bool next_byte()
+			{
+				if (!has_input())
+				{
+					return false;
+				}
+
+				input.bits |= uint64_t(spans[input.span].data[input.offset++]) << input.bitcount;
+				input.bitcount += 8;
+				return true;
+			}
+
+			bool need(unsigned count)
+			{
+				while (input.bitcount < count)
+				{
+					if (!next_byte())
+					{
+						underflow = true;
+						return false;
+					}
+				}
+				return true;
+			}
+
+			uint32_t take(unsigned count)
+			{
+				assert(count <= input.bitcount);
+				const uint32_t value = uint32_t(input.bits & ((uint64_t(1) << count) - 1));
+				input.bits >>= count;
+				input.bitcount -= count;
+				return value;
+			}
+
+			void align_to_byte()
+			{
+				take(input.bitcount % 8);
+			}
+
+			bool decode_symbol(const Huffman& huffman, uint32_t* symbol)
+			{
+				while (input.bitcount < max_codelength && next_byte())
+				{
+				}
+
+				const uint16_t entry = huffman.fast[input.bits & ((1u << fast_bits) - 1)];
+				if (entry != 0 && (entry & 15u) <= input.bitcount)
+				{
+					take(entry & 15u);
+					*symbol = entry >> 4;
+					return true;
+				}
+
+				// codes longer than fast_bits, one bit at a time
+				int code  = 0;
+				int first = 0;
+				int index = 0;
+				for (unsigned length = 1; length <= max_codelength; ++length)
+				{
+					if (!need(1))
+					{
+						return false;
+					}
+					code |= int(take(1));
+					const int count = huffman.count[length];
+					if (code < first + count)
+					{
+						*symbol = huffman.symbol[index + code - first];
+						return true;
+					}
+					index += count;
+					first = (first + count) << 1;
+					code <<= 1;
+				}
+				return false;
+			}
+
+			//! copies input after the current position, which a rolled back symbol or header may still
+			//! need, so the fed data is released
+			void keep_unconsumed()
+			{
+				carryNext.clear();
+				for (size_t i = input.span; i < spans.size(); ++i)
+				{
+					const size_t offset = i == input.span ? input.offset : 0;
+					carryNext.insert(carryNext.end(), spans[i].data + offset, spans[i].data + spans[i].size);
+				}
+
+				carry.swap(carryNext);
+				spans.clear();
+				input.span   = 0;
+				input.offset = 0;
+				if (!carry.empty())
+				{
+					spans.push_back({carry.data(), carry.size()});
+				}
+			}
+
+			///////////////////////////////////////////////////////////////////////
+			//! output
+
+			size_t space() const
+			{
+				return window_size - size_t(produced - drained);
+			}
+
+			void put(uint8_t value)
+			{
+				window[produced++ & (window.size() - 1)] = value;
+			}
+
+			///////////////////////////////////////////////////////////////////////
+			//! stream parts, return false on underflow or error
+
+			bool read_header()
+			{
+				if (!need(16))
+				{
+					return false;
+				}
+
+				const uint32_t cmf = take(8);
+				const uint32_t flg = take(8);
+				if ((cmf * 256 + flg) % 31 != 0 || (cmf & 15) != 8 || (cmf >> 4) > 7 || (flg & 32) != 0)
+				{
+					return false;
+				}
+
+				state = State::BlockHeader;
+				return true;
+			}
+
+			bool read_dynamic_tables()
+			{
+				if (!need(14))
+				{
+					return false;
+				}
+
+				const unsigned literalCount  = take(5) + 257;
+				const unsigned distanceCount = take(5) + 1;
+				const unsigned lengthCount   = take(4) + 4;
+				if (literalCount > 286 || distanceCount > 30)
+				{
+					return false;
+				}
+
+				uint8_t lengths[288 + 32] = {0};
+				for (unsigned i = 0; i < lengthCount; ++i)
+				{
+					if (!need(3))
+					{
+						return false;
+					}
+					lengths[codelength_order[i]] = uint8_t(take(3));
+				}
+
+				Huffman lengthCodes;
+				if (!build_huffman(&lengthCodes, lengths, 19))
+				{
+					return false;
+				}
+
+				memset(lengths, 0, sizeof(lengths));
+				for (unsigned i = 0; i < literalCount + distanceCount;)
+				{
+					uint32_t symbol;
+					if (!decode_symbol(lengthCodes, &symbol))
+					{
+						return false;
+					}
+
+					if (symbol < 16)
+					{
+						lengths[i++] = uint8_t(symbol);
+						continue;
+					}
+
+					uint8_t  value  = 0;
+					unsigned repeat = 0;
+					if (symbol == 16)
+					{
+						if (i == 0 || !need(2))
+						{
+							return false;
+						}
+						value  = lengths[i - 1];
+						repeat = 3 + take(2);
+					}
+					else if (symbol == 17)
+					{
+						if (!need(3))
+						{
+							return false;
+						}
+						repeat = 3 + take(3);
+					}
+					else
+					{
+						if (!need(7))
+						{
+							return false;
+						}
+						repeat = 11 + take(7);
+					}
+
+					if (i + repeat > literalCount + distanceCount)
+					{
+						return false;
+					}
+					std::fill(lengths + i, lengths + i + repeat, value);
+					i += repeat;
+				}
+
+				if (lengths[256] == 0 || !build_huffman(&dynamicLiterals, lengths, literalCount)
+					|| !build_huffman(&dynamicDistances, lengths + literalCount, distanceCount))
+				{
+					return false;
+				}
+
+				literals  = &dynamicLiterals;
+				distances = &dynamicDistances;
+				return true;
+			}
+
+			bool read_block_header()
+			{
+				if (!need(3))
+				{
+					return false;
+				}
+
+				isFinal				= take(1) != 0;
+				const uint32_t type = take(2);
+				if (type == 0)
+				{
+					align_to_byte();
+					if (!need(32))
+					{
+						return false;
+					}
+
+					const uint32_t length		  = take(16);
+					const uint32_t lengthComplement = take(16);
+					if (length != (~lengthComplement & 0xffff))
+					{
+						return false;
+					}
+
+					storedRemaining = length;
+					state			= State::Stored;
+					return true;
+				}
+
+				if (type == 1)
+				{
+					literals  = &fixedLiterals;
+					distances = &fixedDistances;
+				}
+				else if (type != 2 || !read_dynamic_tables())
+				{
+					return false;
+				}
+
+				state = State::Huffman;
+				return true;
+			}
+
+			bool copy_stored()
+			{
+				while (storedRemaining > 0 && space() > 0)
+				{
+					if (input.bitcount >= 8)
+					{
+						put(uint8_t(take(8)));
+						--storedRemaining;
+						continue;
+					}
+
+					// byte aligned and the bit buffer is empty, copy straight from the input
+					if (!has_input())
+					{
+						underflow = true;
+						return false;
+					}
+
+					const Span&  span	 = spans[input.span];
+					const size_t position = size_t(produced & (window.size() - 1));
+					const size_t count	= std::min({size_t(storedRemaining), space(), span.size - input.offset, window.size() - position});
+					memcpy(&window[position], span.data + input.offset, count);
+					input.offset += count;
+					produced += count;
+					storedRemaining -= uint32_t(count);
+				}
+
+				if (storedRemaining == 0)
+				{
+					state = isFinal ? State::Trailer : State::BlockHeader;
+				}
+				return true;
+			}
+
+			bool decode_huffman()
+			{
+				const size_t mask = window.size() - 1;
+				while (space() >= max_match)
+				{
+					const Position checkpoint = input;
+
+					uint32_t symbol;
+					if (!decode_symbol(*literals, &symbol))
+					{
+						if (underflow)
+						{
+							input = checkpoint;
+						}
+						return false;
+					}
+
+					if (symbol < 256)
+					{
+						put(uint8_t(symbol));
+						continue;
+					}
+					if (symbol == 256)
+					{
+						state = isFinal ? State::Trailer : State::BlockHeader;
+						return true;
+					}
+
+					symbol -= 257;
+					uint32_t distanceSymbol;
+					if (symbol >= 29 || !need(length_extra[symbol]))
+					{
+						if (underflow)
+						{
+							input = checkpoint;
+						}
+						return false;
+					}
+					const uint32_t length = length_base[symbol] + take(length_extra[symbol]);
+
+					if (!decode_symbol(*distances, &distanceSymbol) || distanceSymbol >= 30 || !need(distance_extra[distanceSymbol]))
+					{
+						if (underflow)
+						{
+							input = checkpoint;
+						}
+						return false;
+					}
+					const uint32_t distance = distance_base[distanceSymbol] + take(distance_extra[distanceSymbol]);
+					if (distance > produced)
+					{
+						return false;
+					}
+
+					for (uint32_t i = 0; i < length; ++i, ++produced)
+					{
+						window[produced & mask] = window[(produced - distance) & mask];
+					}
+				}
+				return true;
+			}
+
+			bool read_trailer()
+			{
+				align_to_byte();
+				if (!need(32))
+				{
+					return false;
+				}
+
+				expectedAdler = 0;
+				for (int i = 0; i < 4; ++i)
+				{
+					expectedAdler = expectedAdler << 8 | take(8);
+				}
+				state = State::Done;
+				return true;
+			}
+
+			///////////////////////////////////////////////////////////////////////
+			//! decodes until the window is full, the input runs out or the stream ends
+
+			InflateStatus decode()
+			{
+				for (;;)
+				{
+					const Position checkpoint = input;
+					const State	current	= state;
+					bool		   isOk		  = true;
+					switch (state)
+					{
+						case State::Header: isOk = read_header(); break;
+						case State::BlockHeader: isOk = read_block_header(); break;
+						case State::Stored: isOk = copy_stored(); break;
+						case State::Huffman: isOk = decode_huffman(); break;
+						case State::Trailer: isOk = read_trailer(); break;
+						case State::Done: return InflateStatus::Done;
+						case State::Error: return InflateStatus::Error;
+					}
+
+					if (!isOk)
+					{
+						if (!underflow)
+						{
+							state = State::Error;
+							return InflateStatus::Error;
+						}
+
+						// stored blocks and huffman data keep their progress, headers are read again
+						if (current != State::Stored && current != State::Huffman)
+						{
+							input = checkpoint;
+						}
+						underflow = false;
+						return InflateStatus::NeedsInput;
+					}
+
+					if (state == current && (state == State::Stored || state == State::Huffman))
+					{
+						// window full
+						return InflateStatus::Ok;
+					}
+				}
+			}
+
+			InflateStatus drain(uint8_t* out, size_t outsize, size_t* written)
+			{
+				// spans before the current one are consumed
+				spans.erase(spans.begin(), spans.begin() + std::min(input.span, spans.size()));
+				input.span = 0;
+
+				*written = 0;
+				for (;;)
+				{
+					const size_t mask  = window.size() - 1;
+					size_t		 count = std::min(size_t(produced - drained), outsize - *written);
+					while (count > 0)
+					{
+						const size_t position = size_t(drained & mask);
+						const size_t part	 = std::min(count, window.size() - position);
+						memcpy(out + *written, &window[position], part);
+						adler = update_adler32(adler, out + *written, part);
+						*written += part;
+						drained += part;
+						count -= part;
+					}
+
+					if (state == State::Done && produced == drained)
+					{
+						if (adler != expectedAdler)
+						{
+							state = State::Error;
+							return InflateStatus::Error;
+						}
+						return InflateStatus::Done;
+					}
+					if (*written == outsize)
+					{
+						return InflateStatus::Ok;
+					}
+
+					const uint64_t before = produced;
+					InflateStatus  status = decode();
+					if (status == InflateStatus::Error)
+					{
+						return status;
+					}
+					if (status == InflateStatus::NeedsInput && produced == before && produced == drained)
+					{
+						keep_unconsumed();
+						return status;
+					}
+				}
+			}
+		};
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! one-shot inflate into a buffer of known size
+		//-- decodes with two-level tables: a primary table indexed by the next table bits, longer codes continue
+		//-- in subtables. literal/length entries hold two literals when both codes fit in the primary bits.
+		//-- lengths and distances come with their base and extra bit count, so a match takes two lookups.
+		//-- the output never grows, matches are copied 16 (or 8) bytes at a time while there is room
+		//-- behind them for the overshoot
+
+		static const unsigned litlen_table_bits   = 11;
+		static const unsigned distance_table_bits = 8;
+		static const unsigned codelength_bits	 = 7;
+		static const size_t   litlen_table_size   = 2342;	// primary + worst case subtables, see zlib's enough
+		static const size_t   distance_table_size = 402;
+		static const size_t   match_slack		  = 16;		// bytes wide copies may write past a match
+
+		// entry: bits 0-7 code length to consume, 8-11 extra bits (subtable bits for subtables), 12-14 kind,
+		// 15 second literal, 16-31 value: literal(s), length/distance base or subtable offset
+		enum : uint32_t
+		{
+			entry_literal		 = 0u << 12,	// also distances and code length symbols
+			entry_length		 = 1u << 12,
+			entry_end			 = 2u << 12,
+			entry_subtable		 = 3u << 12,
+			entry_invalid		 = 4u << 12,
+			entry_kind_mask		 = 7u << 12,
+			entry_second_literal = 1u << 15,
+		};
+
+		inline uint32_t entry_kind(uint32_t entry)
+		{
+			return entry & entry_kind_mask;
+		}
+
+		inline unsigned entry_codelength(uint32_t entry)
+		{
+			return entry & 0xff;
+		}
+
+		inline unsigned entry_extra(uint32_t entry)
+		{
+			return (entry >> 8) & 15;
+		}
+
+		//! entries by symbol, without code length
+		struct SymbolEntries
+		{
+			uint32_t litlen[288];
+			uint32_t distance[32];
+			uint32_t codelength[19];
+
+			SymbolEntries()
+			{
+				for (uint32_t i = 0; i < 256; ++i)
+				{
+					litlen[i] = entry_literal | i << 16;
+				}
+				litlen[256] = entry_end;
+				for (uint32_t i = 0; i < 29; ++i)
+				{
+					litlen[257 + i] = entry_length | uint32_t(length_extra[i]) << 8 | uint32_t(length_base[i]) << 16;
+				}
+				litlen[286] = litlen[287] = entry_invalid;
+
+				for (uint32_t i = 0; i < 30; ++i)
+				{
+					distance[i] = entry_literal | uint32_t(distance_extra[i]) << 8 | uint32_t(distance_base[i]) << 16;
+				}
+				distance[30] = distance[31] = entry_invalid;
+
+				for (uint32_t i = 0; i < 19; ++i)
+				{
+					codelength[i] = entry_literal | i << 16;
+				}
+			}
+		};
+
+		static const SymbolEntries symbol_entries;
+
+		//! builds a two-level decoding table, returns false for over-subscribed codes
+		inline bool build_table(uint32_t*			 table,
+								size_t				 tableSize,
+								unsigned			 tableBits,
+								const uint8_t*		 lengths,
+								unsigned			 count,
+								const uint32_t*		 entries)
+		{
+			uint16_t lengthCount[max_codelength + 1] = {0};
+			for (unsigned i = 0; i < count; ++i)
+			{
+				++lengthCount[lengths[i]];
+			}
+			lengthCount[0] = 0;
+
+			int left = 1;
+			for (unsigned length = 1; length <= max_codelength; ++length)
+			{
+				left = (left << 1) - lengthCount[length];
+				if (left < 0)
+				{
+					return false;
+				}
+			}
+
+			uint32_t nextCode[max_codelength + 1] = {0};
+			for (unsigned length = 1; length <= max_codelength; ++length)
+			{
+				nextCode[length] = (nextCode[length - 1] + lengthCount[length - 1]) << 1;
+			}
+
+			// reversed codes, and the longest code per primary index for the subtable sizes
+			const uint32_t primarySize = 1u << tableBits;
+			uint32_t	   codes[288];
+			uint8_t		   longest[1 << litlen_table_bits] = {0};
+			for (unsigned i = 0; i < count; ++i)
+			{
+				if (lengths[i] != 0)
+				{
+					codes[i] = reverse_bits(nextCode[lengths[i]]++, lengths[i]);
+					if (lengths[i] > tableBits)
+					{
+						uint8_t& length = longest[codes[i] & (primarySize - 1)];
+						length			= std::max(length, lengths[i]);
+					}
+				}
+			}
+
+			std::fill(table, table + primarySize, uint32_t(entry_invalid));
+			size_t used = primarySize;
+			for (unsigned i = 0; i < count; ++i)
+			{
+				const unsigned length = lengths[i];
+				if (length == 0)
+				{
+					continue;
+				}
+
+				if (length <= tableBits)
+				{
+					for (uint32_t j = codes[i]; j < primarySize; j += 1u << length)
+					{
+						table[j] = entries[i] | length;
+					}
+					continue;
+				}
+
+				uint32_t& primary = table[codes[i] & (primarySize - 1)];
+				if (entry_kind(primary) != entry_subtable)
+				{
+					const unsigned subtableBits = longest[codes[i] & (primarySize - 1)] - tableBits;
+					if (used + (size_t(1) << subtableBits) > tableSize)
+					{
+						return false;
+					}
+					primary = entry_subtable | subtableBits << 8 | uint32_t(used) << 16 | tableBits;
+					std::fill(table + used, table + used + (size_t(1) << subtableBits), uint32_t(entry_invalid));
+					used += size_t(1) << subtableBits;
+				}
+
+				uint32_t* subtable = table + (primary >> 16);
+				for (uint32_t j = codes[i] >> tableBits; j < (1u << entry_extra(primary)); j += 1u << (length - tableBits))
+				{
+					subtable[j] = entries[i] | (length - tableBits);
+				}
+			}
+			return true;
+		}
+
+		//! merges literal pairs whose codes both fit in the primary bits into one entry
+		inline void pair_literals(uint32_t* table)
+		{
+			// descending, so table[i >> length] still holds a single literal
+			for (uint32_t i = (1u << litlen_table_bits); i-- > 0;)
+			{
+				const uint32_t entry  = table[i];
+				const unsigned length = entry_codelength(entry);
+				if (entry_kind(entry) != entry_literal || length >= litlen_table_bits)
+				{
+					continue;
+				}
+
+				const uint32_t next = table[i >> length];
+				if (entry_kind(next) == entry_literal && (next & entry_second_literal) == 0
+					&& entry_codelength(next) <= litlen_table_bits - length)
+				{
+					table[i] = (entry & 0x00ff0000) | (next & 0x00ff0000) << 8 | entry_second_literal
+							   | (length + entry_codelength(next));
+				}
+			}
+		}
+
+		struct FixedTables
+		{
+			uint32_t litlen[litlen_table_size];
+			uint32_t distance[distance_table_size];
+
+			FixedTables()
+			{
+				uint8_t lengths[288 + 32];
+				std::fill(lengths, lengths + 144, uint8_t(8));
+				std::fill(lengths + 144, lengths + 256, uint8_t(9));
+				std::fill(lengths + 256, lengths + 280, uint8_t(7));
+				std::fill(lengths + 280, lengths + 288, uint8_t(8));
+				std::fill(lengths + 288, lengths + 320, uint8_t(5));
+				build_table(litlen, litlen_table_size, litlen_table_bits, lengths, 288, symbol_entries.litlen);
+				build_table(distance, distance_table_size, distance_table_bits, lengths + 288, 32, symbol_entries.distance);
+				pair_literals(litlen);
+			}
+		};
+
+		static const FixedTables fixed_tables;
+
+		inline void copy16(uint8_t* dst, const uint8_t* src)
+		{
+#if XNG_SSE2
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+#else
+			memcpy(dst, src, 8);
+			memcpy(dst + 8, src + 8, 8);
+#endif	// XNG_SSE2
+		}
+
+		//! copies a match, dst - distance being inside the output
+		inline void copy_match(uint8_t* dst, size_t distance, size_t length, const uint8_t* dstEnd)
+		{
+			const uint8_t* src = dst - distance;
+			uint8_t*	   end = dst + length;
+			if (size_t(dstEnd - dst) < length + match_slack)
+			{
+				// at the end of the output, exact copy
+				for (; dst != end; ++dst, ++src)
+				{
+					*dst = *src;
+				}
+				return;
+			}
+
+			if (distance >= 16)
+			{
+				do
+				{
+					copy16(dst, src);
+					dst += 16;
+					src += 16;
+				} while (dst < end);
+				return;
+			}
+
+			if (distance == 1)
+			{
+				memset(dst, *src, length);
+				return;
+			}
+
+			if (distance < 8)
+			{
+				// short repeating patterns, e.g. pixels: after 8 bytes, copy from the nearest multiple of the
+				// distance that is at least 8 bytes back
+				for (int i = 0; i < 8; ++i)
+				{
+					dst[i] = src[i];
+				}
+				dst += 8;
+				src = dst - (7 + distance) / distance * distance;
+			}
+
+			while (dst < end)
+			{
+				memcpy(dst, src, 8);
+				dst += 8;
+				src += 8;
+			}
+		}
+
+		//! bit reader over contiguous input. reads 8 bytes at once while they are available, past the end it
+		//! supplies zero bytes and counts them, so running out of input is detected once, at the end
+		struct FastBitReader
+		{
+			const uint8_t* in;
+			const uint8_t* inEnd;
+			uint64_t	   bits;
+			unsigned	   bitcount;
+			size_t		   overread;
+
+			//! makes at least 56 bits available
+			void refill()
+			{
+				if (inEnd - in >= 8)
+				{
+					// bits above bitcount are the following input or 0, or-ing them again changes nothing
+					uint64_t word;
+					memcpy(&word, in, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+					word = __builtin_bswap64(word);
+#endif
+					bits |= word << bitcount;
+					in += (63 - bitcount) >> 3;
+					bitcount |= 56;
+					return;
+				}
+
+				while (bitcount <= 56)
+				{
+					if (in < inEnd)
+					{
+						bits |= uint64_t(*in++) << bitcount;
+					}
+					else
+					{
+						++overread;
+					}
+					bitcount += 8;
+				}
+			}
+
+			uint32_t take(unsigned count)
+			{
+				const uint32_t value = uint32_t(bits & ((uint64_t(1) << count) - 1));
+				bits >>= count;
+				bitcount -= count;
+				return value;
+			}
+
+			//! true if only real input was consumed
+			bool is_valid() const
+			{
+				return overread <= bitcount / 8;
+			}
+
+			//! drops the bits up to the next byte boundary and rewinds to it, for byte reads from in
+			bool align_to_byte()
+			{
+				take(bitcount % 8);
+				if (!is_valid())
+				{
+					return false;
+				}
+
+				in -= bitcount / 8 - overread;
+				bits	 = 0;
+				bitcount = 0;
+				overread = 0;
+				return true;
+			}
+		};
+
+		inline bool read_fast_dynamic_tables(FastBitReader& reader, uint32_t* litlen, uint32_t* distance)
+		{
+			reader.refill();
+			const unsigned literalCount  = reader.take(5) + 257;
+			const unsigned distanceCount = reader.take(5) + 1;
+			const unsigned lengthCount   = reader.take(4) + 4;
+			if (literalCount > 286 || distanceCount > 30)
+			{
+				return false;
+			}
+
+			uint8_t lengths[288 + 32] = {0};
+			for (unsigned i = 0; i < lengthCount; ++i)
+			{
+				reader.refill();
+				lengths[codelength_order[i]] = uint8_t(reader.take(3));
+			}
+
+			uint32_t lengthTable[1 << codelength_bits];
+			if (!build_table(lengthTable, 1 << codelength_bits, codelength_bits, lengths, 19, symbol_entries.codelength))
+			{
+				return false;
+			}
+
+			memset(lengths, 0, sizeof(lengths));
+			for (unsigned i = 0; i < literalCount + distanceCount;)
+			{
+				reader.refill();
+				const uint32_t entry = lengthTable[reader.bits & ((1u << codelength_bits) - 1)];
+				if (entry_kind(entry) == entry_invalid)
+				{
+					return false;
+				}
+				reader.take(entry_codelength(entry));
+
+				const uint32_t symbol = entry >> 16;
+				if (symbol < 16)
+				{
+					lengths[i++] = uint8_t(symbol);
+					continue;
+				}
+
+				uint8_t  value  = 0;
+				unsigned repeat = 0;
+				if (symbol == 16)
+				{
+					if (i == 0)
+					{
+						return false;
+					}
+					value  = lengths[i - 1];
+					repeat = 3 + reader.take(2);
+				}
+				else if (symbol == 17)
+				{
+					repeat = 3 + reader.take(3);
+				}
+				else
+				{
+					repeat = 11 + reader.take(7);
+				}
+
+				if (i + repeat > literalCount + distanceCount)
+				{
+					return false;
+				}
+				std::fill(lengths + i, lengths + i + repeat, value);
+				i += repeat;
+			}
+
+			if (lengths[256] == 0
+				|| !build_table(litlen, litlen_table_size, litlen_table_bits, lengths, literalCount, symbol_entries.litlen)
+				|| !build_table(distance, distance_table_size, distance_table_bits, lengths + literalCount, distanceCount, symbol_entries.distance))
+			{
+				return false;
+			}
+
+			pair_literals(litlen);
+			return true;
+		}
+
+		//! inflates a zlib stream into out, which has to be large enough for all of it
+		//! returns 0 on success, *written receiving the decompressed size
+		inline int inflate_exact(uint8_t* out, size_t outsize, size_t* written, const uint8_t* in, size_t insize)
+		{
+			if (insize < 2 || (in[0] * 256 + in[1]) % 31 != 0 || (in[0] & 15) != 8 || (in[0] >> 4) > 7 || (in[1] & 32) != 0)
+			{
+				return -1;
+			}
+
+			FastBitReader reader = {in + 2, in + insize, 0, 0, 0};
+			uint32_t	  dynamicLitlen[litlen_table_size];
+			uint32_t	  dynamicDistance[distance_table_size];
+			uint8_t*	  dst	= out;
+			uint8_t*	  dstEnd = out + outsize;
+			bool		  isFinal = false;
+
+			while (!isFinal)
+			{
+				reader.refill();
+				isFinal				= reader.take(1) != 0;
+				const uint32_t type = reader.take(2);
+
+				if (type == 0)
+				{
+					if (!reader.align_to_byte() || reader.inEnd - reader.in < 4)
+					{
+						return -1;
+					}
+
+					const size_t length = size_t(reader.in[0]) | size_t(reader.in[1]) << 8;
+					if (length != (~(size_t(reader.in[2]) | size_t(reader.in[3]) << 8) & 0xffff))
+					{
+						return -1;
+					}
+					reader.in += 4;
+					if (length > size_t(reader.inEnd - reader.in) || length > size_t(dstEnd - dst))
+					{
+						return -1;
+					}
+
+					memcpy(dst, reader.in, length);
+					reader.in += length;
+					dst += length;
+					continue;
+				}
+
+				const uint32_t* litlen	= fixed_tables.litlen;
+				const uint32_t* distances = fixed_tables.distance;
+				if (type == 2)
+				{
+					if (!read_fast_dynamic_tables(reader, dynamicLitlen, dynamicDistance))
+					{
+						return -1;
+					}
+					litlen	= dynamicLitlen;
+					distances = dynamicDistance;
+				}
+				else if (type != 1)
+				{
+					return -1;
+				}
+
+				for (;;)
+				{
+					// a length/distance pair takes up to 15 + 5 + 15 + 13 bits, one refill covers it
+					reader.refill();
+					uint32_t entry = litlen[reader.bits & ((1u << litlen_table_bits) - 1)];
+					if (entry_kind(entry) == entry_subtable)
+					{
+						reader.take(litlen_table_bits);
+						entry = litlen[(entry >> 16) + (reader.bits & ((1u << entry_extra(entry)) - 1))];
+					}
+					reader.take(entry_codelength(entry));
+
+					const uint32_t kind = entry_kind(entry);
+					if (kind == entry_literal)
+					{
+						if (entry & entry_second_literal)
+						{
+							if (dstEnd - dst < 2)
+							{
+								return -1;
+							}
+							dst[0] = uint8_t(entry >> 16);
+							dst[1] = uint8_t(entry >> 24);
+							dst += 2;
+						}
+						else
+						{
+							if (dst == dstEnd)
+							{
+								return -1;
+							}
+							*dst++ = uint8_t(entry >> 16);
+						}
+						continue;
+					}
+					if (kind == entry_end)
+					{
+						break;
+					}
+					if (kind != entry_length)
+					{
+						return -1;
+					}
+
+					const size_t length = (entry >> 16) + reader.take(entry_extra(entry));
+
+					entry = distances[reader.bits & ((1u << distance_table_bits) - 1)];
+					if (entry_kind(entry) == entry_subtable)
+					{
+						reader.take(distance_table_bits);
+						entry = distances[(entry >> 16) + (reader.bits & ((1u << entry_extra(entry)) - 1))];
+					}
+					if (entry_kind(entry) != entry_literal)
+					{
+						return -1;
+					}
+					reader.take(entry_codelength(entry));
+
+					const size_t distance = (entry >> 16) + reader.take(entry_extra(entry));
+					if (distance > size_t(dst - out) || length > size_t(dstEnd - dst))
+					{
+						return -1;
+					}
+					copy_match(dst, distance, length, dstEnd);
+					dst += length;
+				}
+			}
+
+			if (!reader.align_to_byte() || reader.inEnd - reader.in < 4)
+			{
+				return -1;
+			}
+
+			const uint32_t expected = uint32_t(reader.in[0]) << 24 | uint32_t(reader.in[1]) << 16 | uint32_t(reader.in[2]) << 8 | reader.in[3];
+			*written				= size_t(dst - out);
+			return update_adler32(1, out, *written) == expected ? 0 : -1;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! built-in backend
+
+		inline BuiltinInflater* as_builtin(void* state)
+		{
+			assert(state);
+			return static_cast<BuiltinInflater*>(state);
+		}
+
+		void* builtin_create(void*)
+		{
+			return new (std::nothrow) BuiltinInflater;
+		}
+
+		void builtin_destroy(void* state)
+		{
+			delete as_builtin(state);
+		}
+
+		int builtin_reset(void* state)
+		{
+			as_builtin(state)->reset();
+			return 0;
+		}
+
+		int builtin_feed(void* state, const unsigned char* in, size_t insize)
+		{
+			if (insize > 0)
+			{
+				as_builtin(state)->spans.push_back({in, insize});
+			}
+			return 0;
+		}
+
+		InflateStatus builtin_drain(void* state, unsigned char* out, size_t outsize, size_t* written)
+		{
+			return as_builtin(state)->drain(out, outsize, written);
+		}
+
+		const inflatestream_t builtin_inflatestream = {builtin_create, builtin_destroy, builtin_reset, builtin_feed, builtin_drain};
+
+		int builtin_inflate(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, void*)
+		{
+			assert(out);
+			assert(outsize);
+
+			if (*out)
+			{
+				// preallocated, the stream has to fit
+				size_t written = 0;
+				int	err	 = inflate_exact(*out, *outsize, &written, in, insize);
+				*outsize	   = written;
+				return err;
+			}
+
+			// unknown size, grow while draining
+			BuiltinInflater inflater;
+			inflater.spans.push_back({in, insize});
+
+			size_t		   capacity = std::max<size_t>(insize * 4, 1024);
+			size_t		   size		= 0;
+			unsigned char* buffer   = static_cast<unsigned char*>(malloc(capacity));
+			for (;;)
+			{
+				if (!buffer)
+				{
+					return -1;
+				}
+
+				size_t		  written = 0;
+				InflateStatus status  = inflater.drain(buffer + size, capacity - size, &written);
+				size += written;
+				if (status == InflateStatus::Done)
+				{
+					*out	 = buffer;
+					*outsize = size;
+					return 0;
+				}
+				if (status != InflateStatus::Ok)
+				{
+					free(buffer);
+					return -1;
+				}
+
+				unsigned char* grown = static_cast<unsigned char*>(realloc(buffer, capacity * 2));
+				if (!grown)
+				{
+					free(buffer);
+				}
+				buffer = grown;
+				capacity *= 2;
+			}
+		}
+
+
+#ifdef XNG_ZLIB
+		///////////////////////////////////////////////////////////////////////////
+		//! zlib backend
+
+		struct ZlibInflater
+		{
+			z_stream stream;
+			std::vector<std::pair<const uint8_t*, size_t>> pending;	// fed input not handed to zlib yet
+			size_t										   next;
+		};
+
+		inline ZlibInflater* as_zlib(void* state)
+		{
+			assert(state);
+			return static_cast<ZlibInflater*>(state);
+		}
+
+		void* zlib_create(void*)
+		{
+			ZlibInflater* inflater = new (std::nothrow) ZlibInflater;
+			if (!inflater)
+			{
+				return nullptr;
+			}
+
+			memset(&inflater->stream, 0, sizeof(inflater->stream));
+			inflater->next = 0;
+			if (inflateInit(&inflater->stream) != Z_OK)
+			{
+				delete inflater;
+				return nullptr;
+			}
+			return inflater;
+		}
+
+		void zlib_destroy(void* state)
+		{
+			ZlibInflater* inflater = as_zlib(state);
+			inflateEnd(&inflater->stream);
+			delete inflater;
+		}
+
+		int zlib_reset(void* state)
+		{
+			ZlibInflater* inflater	 = as_zlib(state);
+			inflater->stream.avail_in = 0;
+			inflater->pending.clear();
+			inflater->next = 0;
+			return inflateReset(&inflater->stream) == Z_OK ? 0 : -1;
+		}
+
+		int zlib_feed(void* state, const unsigned char* in, size_t insize)
+		{
+			if (insize > 0)
+			{
+				as_zlib(state)->pending.push_back({in, insize});
+			}
+			return 0;
+		}
+
+		InflateStatus zlib_drain(void* state, unsigned char* out, size_t outsize, size_t* written)
+		{
+			ZlibInflater* inflater = as_zlib(state);
+			z_stream&	 stream   = inflater->stream;
+			const uInt	window   = uInt(std::min<size_t>(outsize, UINT_MAX));
+			stream.next_out		   = out;
+			stream.avail_out	   = window;
+
+			for (;;)
+			{
+				if (stream.avail_in == 0 && inflater->next < inflater->pending.size())
+				{
+					auto& span = inflater->pending[inflater->next];
+					const uInt part = uInt(std::min<size_t>(span.second, UINT_MAX));
+					stream.next_in	= const_cast<Bytef*>(span.first);
+					stream.avail_in = part;
+					span.first += part;
+					span.second -= part;
+					if (span.second == 0)
+					{
+						++inflater->next;
+					}
+				}
+
+				const int result = inflate(&stream, Z_NO_FLUSH);
+				*written		 = window - stream.avail_out;
+				if (result == Z_STREAM_END)
+				{
+					return InflateStatus::Done;
+				}
+				if (result != Z_OK && result != Z_BUF_ERROR)
+				{
+					return InflateStatus::Error;
+				}
+				if (stream.avail_out == 0)
+				{
+					return InflateStatus::Ok;
+				}
+				if (stream.avail_in == 0 && inflater->next == inflater->pending.size())
+				{
+					inflater->pending.clear();
+					inflater->next = 0;
+					return InflateStatus::NeedsInput;
+				}
+			}
+		}
+
+		const inflatestream_t zlib_inflatestream = {zlib_create, zlib_destroy, zlib_reset, zlib_feed, zlib_drain};
+#endif	// XNG_ZLIB
+
+		///////////////////////////////////////////////////////////////////////////
+
+	}	// namespace common
+}	// namespace xng
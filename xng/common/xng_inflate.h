@@ -0,0 +1,30 @@
+#ifndef XNG_INFLATE_H_INC
+#define XNG_INFLATE_H_INC
+
+#include "xng/common/xng_common.h"
+
+namespace xng
+{
+	namespace common
+	{
+		//-------------------------------------------------------------------------
+		//! built-in inflate (zlib format, RFC 1950/1951), no external dependencies
+
+		//! streaming backend, settings are unused
+		extern const inflatestream_t builtin_inflatestream;
+
+		//! one-shot inflate function. unlike other inflatefunc_t, a non-null *out is a preallocated buffer
+		//! of *outsize bytes it fills in place (see common::inflate)
+		int builtin_inflate(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, void* settings);
+
+#ifdef XNG_ZLIB
+		//-------------------------------------------------------------------------
+		//! zlib streaming backend, settings are unused
+		extern const inflatestream_t zlib_inflatestream;
+#endif	// XNG_ZLIB
+
+	}	// namespace common
+}	// namespace xng
+
+
+#endif	// XNG_INFLATE_H_INC
@@ -0,0 +1,1342 @@
+#include "xng_jpeg.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XNG_SSE2 1
+#else
+#define XNG_SSE2 0
+#endif	// defined(__SSE2__) || defined(_M_X64)
+
+namespace xng
+{
+	namespace common
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! tables
+
+		//! zigzag order -> natural order
+		//! padded with 63 so a corrupt run length can't index past the block
+		static const uint8_t dezigzag[64 + 15] = {
+		  0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33,
+		  40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36,
+		  29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54,
+		  47, 55, 62, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63};
+
+		//! AAN scale factors, cos(k * pi / 16) * sqrt(2) for k > 0
+		static const float aan_scale[8] = {1.0f,		  1.387039845f, 1.306562965f, 1.175875602f,
+										   1.0f,		  0.785694958f, 0.541196100f, 0.275899379f};
+
+		static const unsigned jpeg_fast_bits = 9;
+		static const int	  marker_none	= -1;
+		static const int	  marker_end	 = 0x100;	// end of data reached in entropy coded data
+		static const unsigned max_components = 3;
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! huffman decoding tables (T.81, C and F.2.2.3)
+
+		struct JpegHuffman
+		{
+			uint8_t  fast[1 << jpeg_fast_bits];		// symbol index for codes up to jpeg_fast_bits, 255 otherwise
+			int16_t  fastAC[1 << jpeg_fast_bits];	// coefficient << 8 | run << 4 | total bits for small AC values, 0 otherwise
+			uint16_t code[256];
+			uint8_t  size[257];
+			uint8_t  values[256];
+			uint32_t maxcode[18];	// first code above each length, left aligned to 16 bits
+			int32_t  delta[17];		// symbol index - code, per length
+		};
+
+		//! builds the tables from the DHT code counts per length and symbols
+		//! returns 0 on success, -1 for oversubscribed codes
+		int build_huffman(JpegHuffman* huffman, const uint8_t counts[16], const uint8_t* values, unsigned valueCount)
+		{
+			unsigned k = 0;
+			for (unsigned i = 0; i < 16; ++i)
+			{
+				for (unsigned j = 0; j < counts[i]; ++j)
+				{
+					huffman->size[k++] = uint8_t(i + 1);
+				}
+			}
+			huffman->size[k] = 0;
+			memcpy(huffman->values, values, valueCount);
+
+			uint32_t code = 0;
+			k			  = 0;
+			for (unsigned length = 1; length <= 16; ++length)
+			{
+				huffman->delta[length] = int32_t(k) - int32_t(code);
+				if (huffman->size[k] == length)
+				{
+					while (huffman->size[k] == length)
+					{
+						huffman->code[k++] = uint16_t(code++);
+					}
+					if (code - 1 >= (1u << length))
+					{
+						return -1;
+					}
+				}
+				huffman->maxcode[length] = code << (16 - length);
+				code <<= 1;
+			}
+			huffman->maxcode[17] = 0xFFFFFFFF;
+
+			memset(huffman->fast, 255, sizeof(huffman->fast));
+			for (unsigned i = 0; i < k; ++i)
+			{
+				const unsigned length = huffman->size[i];
+				if (length <= jpeg_fast_bits)
+				{
+					const unsigned first = unsigned(huffman->code[i]) << (jpeg_fast_bits - length);
+					const unsigned count = 1u << (jpeg_fast_bits - length);
+					memset(huffman->fast + first, int(i), count);
+				}
+			}
+
+			// AC symbols whose code and magnitude bits both fit into the fast lookup
+			memset(huffman->fastAC, 0, sizeof(huffman->fastAC));
+			for (unsigned i = 0; i < (1u << jpeg_fast_bits); ++i)
+			{
+				const uint8_t index = huffman->fast[i];
+				if (index == 255)
+				{
+					continue;
+				}
+
+				const unsigned symbol  = huffman->values[index];
+				const unsigned run	 = symbol >> 4;
+				const unsigned magbits = symbol & 15;
+				const unsigned length  = huffman->size[index];
+				if (magbits == 0 || length + magbits > jpeg_fast_bits)
+				{
+					continue;
+				}
+
+				int value = int(((i << length) & ((1u << jpeg_fast_bits) - 1)) >> (jpeg_fast_bits - magbits));
+				if (value < (1 << (magbits - 1)))
+				{
+					value += 1 - (1 << magbits);
+				}
+				if (value >= -128 && value <= 127)
+				{
+					huffman->fastAC[i] = int16_t(value * 256 + int(run * 16 + length + magbits));
+				}
+			}
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! decoder state
+
+		//! reads the stream across its spans
+		struct JpegSource
+		{
+			const ByteSpan* spans;
+			size_t			count;
+			size_t			index;
+			const uint8_t*  p;
+			const uint8_t*  end;
+
+			void init(const ByteSpan* sourceSpans, size_t sourceCount)
+			{
+				spans = sourceSpans;
+				count = sourceCount;
+				index = 0;
+				p = end = nullptr;
+				if (count > 0)
+				{
+					p   = spans[0].data;
+					end = p + spans[0].size;
+				}
+			}
+
+			//! returns the next byte, -1 at the end of the data
+			int next()
+			{
+				while (p == end)
+				{
+					if (index + 1 >= count)
+					{
+						return -1;
+					}
+					++index;
+					p   = spans[index].data;
+					end = p + spans[index].size;
+				}
+				return *p++;
+			}
+
+			//! returns the next big endian 16 bit value, -1 at the end of the data
+			int next16()
+			{
+				const int high = next();
+				const int low  = next();
+				return (high < 0 || low < 0) ? -1 : (high << 8) | low;
+			}
+
+			bool skip(size_t size)
+			{
+				for (; size > 0; --size)
+				{
+					if (next() < 0)
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+		};
+
+		struct JpegComponent
+		{
+			uint8_t  id;
+			uint8_t  h;	// sampling factors
+			uint8_t  v;
+			uint8_t  tq;	// quantization table
+			uint8_t  td;	// huffman tables of the current scan
+			uint8_t  ta;
+			int		 dcPred;
+			uint32_t width;	// samples
+			uint32_t height;
+			size_t	 stride;	// plane row size, whole MCUs
+			uint32_t rows;		// plane rows: one MCU row when banded, all otherwise
+			std::vector<uint8_t> plane;
+			float	 dequant[64];	// quantization table scaled for the AAN IDCT, natural order
+		};
+
+		struct JpegDecoder
+		{
+			JpegSource source;
+
+			uint16_t	quant[4][64];	// natural order
+			bool		hasQuant[4];
+			JpegHuffman dc[4];
+			JpegHuffman ac[4];
+			bool		hasDC[4];
+			bool		hasAC[4];
+
+			// frame
+			bool		  hasFrame;
+			uint32_t	  width;
+			uint32_t	  height;
+			uint8_t		  componentCount;
+			JpegComponent components[max_components];
+			uint8_t		  hmax;
+			uint8_t		  vmax;
+			uint32_t	  mcusX;
+			uint32_t	  mcusY;
+			uint16_t	  restartInterval;
+			int			  adobeTransform;	// -1: no Adobe APP14 segment
+			bool		  isBanded;			// all components in one scan, planes hold one MCU row
+			unsigned	  decodedComponents;	// bit mask
+
+			// scan
+			uint8_t  scanCount;
+			uint8_t  scanComponents[max_components];
+			uint32_t bits;	// msb first
+			int		 bitCount;
+			int		 marker;	// marker found in the entropy coded data
+
+			// output
+			JpegTarget		   target;
+			uint8_t*		   output;
+			size_t			   outputStride;
+			const JpegRowHook* hook;
+		};
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! entropy decoding (T.81, F.2.2)
+
+		//! makes at least 25 bits available, zeroes once a marker or the end of the data is reached
+		inline void fill_bits(JpegDecoder& d)
+		{
+			while (d.bitCount <= 24)
+			{
+				int byte = 0;
+				if (d.marker == marker_none)
+				{
+					byte = d.source.next();
+					if (byte == 0xFF)
+					{
+						int next = d.source.next();
+						while (next == 0xFF)
+						{
+							next = d.source.next();
+						}
+						if (next != 0)
+						{
+							d.marker = next < 0 ? marker_end : next;
+							byte	 = 0;
+						}
+					}
+					else if (byte < 0)
+					{
+						d.marker = marker_end;
+						byte	 = 0;
+					}
+				}
+				d.bits |= uint32_t(byte) << (24 - d.bitCount);
+				d.bitCount += 8;
+			}
+		}
+
+		//! returns the next symbol, -1 for invalid codes
+		inline int decode_huffman(JpegDecoder& d, const JpegHuffman& huffman)
+		{
+			if (d.bitCount < 16)
+			{
+				fill_bits(d);
+			}
+
+			const unsigned index = huffman.fast[d.bits >> (32 - jpeg_fast_bits)];
+			if (index < 255)
+			{
+				const int length = huffman.size[index];
+				d.bits <<= length;
+				d.bitCount -= length;
+				return huffman.values[index];
+			}
+
+			const uint32_t top = d.bits >> 16;
+			int			   length;
+			for (length = jpeg_fast_bits + 1; top >= huffman.maxcode[length]; ++length)
+			{
+			}
+			if (length == 17)
+			{
+				return -1;
+			}
+
+			const int symbol = int(d.bits >> (32 - length)) + huffman.delta[length];
+			d.bits <<= length;
+			d.bitCount -= length;
+			return (symbol >= 0 && symbol < 256) ? huffman.values[symbol] : -1;
+		}
+
+		//! reads count magnitude bits and extends them to a signed value (F.2.2.1)
+		inline int receive_extend(JpegDecoder& d, int count)
+		{
+			if (d.bitCount < count)
+			{
+				fill_bits(d);
+			}
+
+			const uint32_t value = d.bits >> (32 - count);
+			d.bits <<= count;
+			d.bitCount -= count;
+			return value < (1u << (count - 1)) ? int(value) + 1 - (1 << count) : int(value);
+		}
+
+		//! decodes the quantized coefficients of one block in natural order
+		//! returns the zigzag position after the last coefficient (1: DC only), -1 on error
+		int decode_block(JpegDecoder& d, JpegComponent& component, int16_t coefficients[64])
+		{
+			const JpegHuffman& dc = d.dc[component.td];
+			const JpegHuffman& ac = d.ac[component.ta];
+
+			const int magbits = decode_huffman(d, dc);
+			if (magbits < 0 || magbits > 11)
+			{
+				return -1;
+			}
+
+			memset(coefficients, 0, 64 * sizeof(int16_t));
+			component.dcPred += magbits ? receive_extend(d, magbits) : 0;
+			coefficients[0] = int16_t(component.dcPred);
+
+			int k = 1;
+			do
+			{
+				if (d.bitCount < 16)
+				{
+					fill_bits(d);
+				}
+
+				const int fast = ac.fastAC[d.bits >> (32 - jpeg_fast_bits)];
+				if (fast)
+				{
+					const int length = fast & 15;
+					k += (fast >> 4) & 15;
+					d.bits <<= length;
+					d.bitCount -= length;
+					coefficients[dezigzag[k++]] = int16_t(fast >> 8);
+					continue;
+				}
+
+				const int symbol = decode_huffman(d, ac);
+				if (symbol < 0)
+				{
+					return -1;
+				}
+
+				const int run  = symbol >> 4;
+				const int size = symbol & 15;
+				if (size == 0)
+				{
+					if (run != 15)
+					{
+						break;	// EOB
+					}
+					k += 16;	// ZRL
+				}
+				else
+				{
+					k += run;
+					coefficients[dezigzag[k++]] = int16_t(receive_extend(d, size));
+				}
+			} while (k < 64);
+
+			return k;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! inverse DCT
+		//-- floating point AAN algorithm (as libjpeg's jidctflt), dequantization is pre-scaled by
+		//-- aan_scale[row] * aan_scale[column] / 8. both 1D passes work on whole rows of 8 samples,
+		//-- the block is transposed in between
+
+#if XNG_SSE2
+		struct Row8
+		{
+			__m128 lo;
+			__m128 hi;
+		};
+
+		inline Row8 operator+(const Row8& a, const Row8& b)
+		{
+			return {_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)};
+		}
+
+		inline Row8 operator-(const Row8& a, const Row8& b)
+		{
+			return {_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)};
+		}
+
+		inline Row8 operator*(const Row8& a, float b)
+		{
+			const __m128 factor = _mm_set1_ps(b);
+			return {_mm_mul_ps(a.lo, factor), _mm_mul_ps(a.hi, factor)};
+		}
+
+		inline Row8 load_row(const int16_t* coefficients, const float* dequant)
+		{
+			const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients));
+			// sign extend to 32 bit
+			const __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16));
+			const __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(c, c), 16));
+			return {_mm_mul_ps(lo, _mm_loadu_ps(dequant)), _mm_mul_ps(hi, _mm_loadu_ps(dequant + 4))};
+		}
+
+		inline void transpose(Row8 rows[8])
+		{
+			_MM_TRANSPOSE4_PS(rows[0].lo, rows[1].lo, rows[2].lo, rows[3].lo);
+			_MM_TRANSPOSE4_PS(rows[0].hi, rows[1].hi, rows[2].hi, rows[3].hi);
+			_MM_TRANSPOSE4_PS(rows[4].lo, rows[5].lo, rows[6].lo, rows[7].lo);
+			_MM_TRANSPOSE4_PS(rows[4].hi, rows[5].hi, rows[6].hi, rows[7].hi);
+			for (int i = 0; i < 4; ++i)
+			{
+				std::swap(rows[i].hi, rows[i + 4].lo);
+			}
+		}
+
+		//! level shift, round and clamp two rows to 16 samples
+		inline void store_rows(const Row8& a, const Row8& b, uint8_t* out, size_t stride)
+		{
+			const __m128  shift = _mm_set1_ps(128.0f);
+			const __m128i wa	= _mm_packs_epi32(_mm_cvtps_epi32(_mm_add_ps(a.lo, shift)), _mm_cvtps_epi32(_mm_add_ps(a.hi, shift)));
+			const __m128i wb	= _mm_packs_epi32(_mm_cvtps_epi32(_mm_add_ps(b.lo, shift)), _mm_cvtps_epi32(_mm_add_ps(b.hi, shift)));
+			const __m128i bytes = _mm_packus_epi16(wa, wb);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out), bytes);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + stride), _mm_srli_si128(bytes, 8));
+		}
+#else
+		struct Row8
+		{
+			float v[8];
+		};
+
+		inline Row8 operator+(const Row8& a, const Row8& b)
+		{
+			Row8 result;
+			for (int i = 0; i < 8; ++i)
+			{
+				result.v[i] = a.v[i] + b.v[i];
+			}
+			return result;
+		}
+
+		inline Row8 operator-(const Row8& a, const Row8& b)
+		{
+			Row8 result;
+			for (int i = 0; i < 8; ++i)
+			{
+				result.v[i] = a.v[i] - b.v[i];
+			}
+			return result;
+		}
+
+		inline Row8 operator*(const Row8& a, float b)
+		{
+			Row8 result;
+			for (int i = 0; i < 8; ++i)
+			{
+				result.v[i] = a.v[i] * b;
+			}
+			return result;
+		}
+
+		inline Row8 load_row(const int16_t* coefficients, const float* dequant)
+		{
+			Row8 result;
+			for (int i = 0; i < 8; ++i)
+			{
+				result.v[i] = coefficients[i] * dequant[i];
+			}
+			return result;
+		}
+
+		inline void transpose(Row8 rows[8])
+		{
+			for (int r = 0; r < 8; ++r)
+			{
+				for (int c = r + 1; c < 8; ++c)
+				{
+					std::swap(rows[r].v[c], rows[c].v[r]);
+				}
+			}
+		}
+
+		inline void store_rows(const Row8& a, const Row8& b, uint8_t* out, size_t stride)
+		{
+			for (int i = 0; i < 8; ++i)
+			{
+				out[i]			= uint8_t(std::clamp(long(std::lrint(a.v[i] + 128.0f)), 0L, 255L));
+				out[stride + i] = uint8_t(std::clamp(long(std::lrint(b.v[i] + 128.0f)), 0L, 255L));
+			}
+		}
+#endif	// XNG_SSE2
+
+		//! one 1D pass over the 8 rows, element-wise
+		inline void idct_pass(Row8 rows[8])
+		{
+			// even part
+			Row8 tmp10 = rows[0] + rows[4];
+			Row8 tmp11 = rows[0] - rows[4];
+			Row8 tmp13 = rows[2] + rows[6];
+			Row8 tmp12 = (rows[2] - rows[6]) * 1.414213562f - tmp13;
+
+			const Row8 tmp0 = tmp10 + tmp13;
+			const Row8 tmp3 = tmp10 - tmp13;
+			const Row8 tmp1 = tmp11 + tmp12;
+			const Row8 tmp2 = tmp11 - tmp12;
+
+			// odd part
+			const Row8 z13 = rows[5] + rows[3];
+			const Row8 z10 = rows[5] - rows[3];
+			const Row8 z11 = rows[1] + rows[7];
+			const Row8 z12 = rows[1] - rows[7];
+
+			const Row8 tmp7 = z11 + z13;
+			tmp11			= (z11 - z13) * 1.414213562f;
+
+			const Row8 z5 = (z10 + z12) * 1.847759065f;
+			tmp10		  = z12 * 1.082392200f - z5;
+			tmp12		  = z5 - z10 * 2.613125930f;
+
+			const Row8 tmp6 = tmp12 - tmp7;
+			const Row8 tmp5 = tmp11 - tmp6;
+			const Row8 tmp4 = tmp10 + tmp5;
+
+			rows[0] = tmp0 + tmp7;
+			rows[7] = tmp0 - tmp7;
+			rows[1] = tmp1 + tmp6;
+			rows[6] = tmp1 - tmp6;
+			rows[2] = tmp2 + tmp5;
+			rows[5] = tmp2 - tmp5;
+			rows[4] = tmp3 + tmp4;
+			rows[3] = tmp3 - tmp4;
+		}
+
+		//! dequantizes and transforms a block into 8x8 samples
+		//! last: zigzag position after the last decoded coefficient, see decode_block
+		void idct_block(const int16_t coefficients[64], int last, const float dequant[64], uint8_t* out, size_t stride)
+		{
+			if (last <= 1)
+			{
+				// DC only: flat block
+				const long	value = std::clamp(long(std::lrint(coefficients[0] * dequant[0] + 128.0f)), 0L, 255L);
+				for (int r = 0; r < 8; ++r)
+				{
+					memset(out + r * stride, int(value), 8);
+				}
+				return;
+			}
+
+			Row8 rows[8];
+			for (int r = 0; r < 8; ++r)
+			{
+				rows[r] = load_row(coefficients + r * 8, dequant + r * 8);
+			}
+
+			idct_pass(rows);	// columns
+			transpose(rows);
+			idct_pass(rows);	// rows
+			transpose(rows);
+
+			for (int r = 0; r < 8; r += 2)
+			{
+				store_rows(rows[r], rows[r + 1], out + r * stride, stride);
+			}
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! color conversion
+		//-- YCbCr -> RGB (JFIF) in 16 bit fixed point: Y with 4 fraction bits, chroma differences
+		//-- scaled by 128 and multiplied by the coefficients * 8192, keeping the high 16 bits.
+		//-- the SSE2 and scalar paths compute the same values
+
+		static const int16_t cr_to_r = 11485;	// 1.402
+		static const int16_t cb_to_g = -2819;	// -0.344136
+		static const int16_t cr_to_g = -5850;	// -0.714136
+		static const int16_t cb_to_b = 14516;	// 1.772
+
+		inline uint8_t clamp_sample(int value)
+		{
+			return uint8_t(std::clamp(value, 0, 255));
+		}
+
+		template <bool keepAlpha>
+		inline void ycbcr_to_rgba(int y, int cb, int cr, uint8_t* rgba)
+		{
+			const int y16 = (y << 4) + 8;
+			const int cb7 = (cb - 128) * 128;
+			const int cr7 = (cr - 128) * 128;
+			rgba[0]		  = clamp_sample((y16 + ((cr7 * cr_to_r) >> 16)) >> 4);
+			rgba[1]		  = clamp_sample((y16 + ((cb7 * cb_to_g) >> 16) + ((cr7 * cr_to_g) >> 16)) >> 4);
+			rgba[2]		  = clamp_sample((y16 + ((cb7 * cb_to_b) >> 16)) >> 4);
+			if (!keepAlpha)
+			{
+				rgba[3] = 0xFF;
+			}
+		}
+
+#if XNG_SSE2
+		//! 8 pixels from 8 luma samples and 8 (upsampled) chroma samples, all widened to 16 bit
+		template <bool keepAlpha>
+		inline void ycbcr_to_rgba(__m128i y, __m128i cb, __m128i cr, uint8_t* rgba)
+		{
+			const __m128i bias = _mm_set1_epi16(8);
+			const __m128i half = _mm_set1_epi16(128);
+			const __m128i y16  = _mm_add_epi16(_mm_slli_epi16(y, 4), bias);
+			const __m128i cb7  = _mm_slli_epi16(_mm_sub_epi16(cb, half), 7);
+			const __m128i cr7  = _mm_slli_epi16(_mm_sub_epi16(cr, half), 7);
+
+			const __m128i r = _mm_srai_epi16(_mm_add_epi16(y16, _mm_mulhi_epi16(cr7, _mm_set1_epi16(cr_to_r))), 4);
+			const __m128i g = _mm_srai_epi16(
+			  _mm_add_epi16(_mm_add_epi16(y16, _mm_mulhi_epi16(cb7, _mm_set1_epi16(cb_to_g))), _mm_mulhi_epi16(cr7, _mm_set1_epi16(cr_to_g))), 4);
+			const __m128i b = _mm_srai_epi16(_mm_add_epi16(y16, _mm_mulhi_epi16(cb7, _mm_set1_epi16(cb_to_b))), 4);
+
+			// interleave to rgba, merging the alpha bytes of the output if kept
+			const __m128i rg   = _mm_packus_epi16(r, g);
+			const __m128i ba   = _mm_packus_epi16(b, keepAlpha ? _mm_setzero_si128() : _mm_set1_epi16(0xFF));
+			const __m128i rgLo = _mm_unpacklo_epi8(rg, _mm_srli_si128(rg, 8));
+			const __m128i baLo = _mm_unpacklo_epi8(ba, _mm_srli_si128(ba, 8));
+			__m128i		  lo   = _mm_unpacklo_epi16(rgLo, baLo);
+			__m128i		  hi   = _mm_unpackhi_epi16(rgLo, baLo);
+			if (keepAlpha)
+			{
+				const __m128i alphaMask = _mm_set1_epi32(int32_t(0xFF000000));
+				lo = _mm_or_si128(lo, _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba)), alphaMask));
+				hi = _mm_or_si128(hi, _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 16)), alphaMask));
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 16), hi);
+		}
+
+		inline __m128i load8(const uint8_t* p)
+		{
+			return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+		}
+
+		//! 4 samples, each doubled
+		inline __m128i load4x2(const uint8_t* p)
+		{
+			int32_t word;
+			memcpy(&word, p, sizeof(word));
+			const __m128i samples = _mm_cvtsi32_si128(word);
+			return _mm_unpacklo_epi8(_mm_unpacklo_epi8(samples, samples), _mm_setzero_si128());
+		}
+#endif	// XNG_SSE2
+
+		//! converts one output row, upsampling chroma horizontally (box filter) on the fly
+		//! planes are padded to whole MCUs, so reading 8 samples past width is safe
+		template <bool keepAlpha>
+		void convert_ycbcr_row(const JpegDecoder& d, const uint8_t* rows[3], uint8_t* rgba)
+		{
+			const JpegComponent* c	 = d.components;
+			uint32_t			 x	 = 0;
+#if XNG_SSE2
+			const bool isFullY = c[0].h == d.hmax;
+			if (isFullY && c[1].h == d.hmax && c[2].h == d.hmax)
+			{
+				for (; x + 8 <= d.width; x += 8)
+				{
+					ycbcr_to_rgba<keepAlpha>(load8(rows[0] + x), load8(rows[1] + x), load8(rows[2] + x), rgba + size_t(x) * 4);
+				}
+			}
+			else if (isFullY && c[1].h * 2 == d.hmax && c[2].h * 2 == d.hmax)
+			{
+				for (; x + 8 <= d.width; x += 8)
+				{
+					ycbcr_to_rgba<keepAlpha>(load8(rows[0] + x), load4x2(rows[1] + x / 2), load4x2(rows[2] + x / 2), rgba + size_t(x) * 4);
+				}
+			}
+#endif	// XNG_SSE2
+			for (; x < d.width; ++x)
+			{
+				ycbcr_to_rgba<keepAlpha>(rows[0][x * c[0].h / d.hmax], rows[1][x * c[1].h / d.hmax], rows[2][x * c[2].h / d.hmax], rgba + size_t(x) * 4);
+			}
+		}
+
+		//! converts output rows [first, last) from the planes, which start at output row planeStart
+		void convert_rows(JpegDecoder& d, uint32_t first, uint32_t last, uint32_t planeStart)
+		{
+			const JpegComponent* c		= d.components;
+			const bool			 isRGB = d.componentCount == 3
+									  && (d.adobeTransform == 0
+										  || (d.adobeTransform < 0 && c[0].id == 'R' && c[1].id == 'G' && c[2].id == 'B'));
+			const bool			 keepAlpha = d.target == JpegTarget::RGB;
+
+			if (d.hook && d.hook->before)
+			{
+				d.hook->before(d.hook->context, last);
+			}
+
+			for (uint32_t y = first; y < last; ++y)
+			{
+				const uint32_t planeY = y - planeStart;
+				const uint8_t* rows[max_components];
+				for (unsigned i = 0; i < d.componentCount; ++i)
+				{
+					rows[i] = c[i].plane.data() + size_t(planeY * c[i].v / d.vmax) * c[i].stride;
+				}
+
+				uint8_t* rgba = d.output + size_t(y) * d.outputStride;
+				if (d.target == JpegTarget::Alpha)
+				{
+					for (uint32_t x = 0; x < d.width; ++x)
+					{
+						rgba[size_t(x) * 4 + 3] = rows[0][x * c[0].h / d.hmax];
+					}
+				}
+				else if (d.componentCount == 1)
+				{
+					for (uint32_t x = 0; x < d.width; ++x, rgba += 4)
+					{
+						rgba[0] = rgba[1] = rgba[2] = rows[0][x];
+						if (!keepAlpha)
+						{
+							rgba[3] = 0xFF;
+						}
+					}
+				}
+				else if (isRGB)
+				{
+					for (uint32_t x = 0; x < d.width; ++x, rgba += 4)
+					{
+						rgba[0] = rows[0][x * c[0].h / d.hmax];
+						rgba[1] = rows[1][x * c[1].h / d.hmax];
+						rgba[2] = rows[2][x * c[2].h / d.hmax];
+						if (!keepAlpha)
+						{
+							rgba[3] = 0xFF;
+						}
+					}
+				}
+				else if (keepAlpha)
+				{
+					convert_ycbcr_row<true>(d, rows, rgba);
+				}
+				else
+				{
+					convert_ycbcr_row<false>(d, rows, rgba);
+				}
+			}
+
+			if (d.hook && d.hook->after)
+			{
+				d.hook->after(d.hook->context, last);
+			}
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! marker segments (T.81, B.2)
+
+		//! returns the next marker code, -1 at the end of the data
+		//! bytes before the marker (e.g. the rest of entropy coded data) are skipped
+		int read_marker(JpegDecoder& d)
+		{
+			if (d.marker != marker_none)
+			{
+				const int marker = d.marker;
+				d.marker		 = marker_none;
+				return marker == marker_end ? -1 : marker;
+			}
+
+			int byte = d.source.next();
+			while (byte >= 0)
+			{
+				if (byte != 0xFF)
+				{
+					byte = d.source.next();
+					continue;
+				}
+
+				do
+				{
+					byte = d.source.next();
+				} while (byte == 0xFF);
+
+				if (byte > 0)
+				{
+					return byte;
+				}
+			}
+			return -1;
+		}
+
+		//! reads the segment length, returns the payload size, -1 if invalid
+		int read_segment_length(JpegDecoder& d)
+		{
+			const int length = d.source.next16();
+			return length < 2 ? -1 : length - 2;
+		}
+
+		int read_DQT(JpegDecoder& d)
+		{
+			int size = read_segment_length(d);
+			while (size > 0)
+			{
+				const int pqtq	  = d.source.next();
+				const int precision = pqtq >> 4;
+				const int table	 = pqtq & 15;
+				if (pqtq < 0 || precision > 1 || table > 3 || size < 1 + 64 * (precision + 1))
+				{
+					return -1;
+				}
+
+				for (int i = 0; i < 64; ++i)
+				{
+					const int value = precision ? d.source.next16() : d.source.next();
+					if (value < 0)
+					{
+						return -1;
+					}
+					d.quant[table][dezigzag[i]] = uint16_t(value);
+				}
+				d.hasQuant[table] = true;
+				size -= 1 + 64 * (precision + 1);
+			}
+			return size == 0 ? 0 : -1;
+		}
+
+		int read_DHT(JpegDecoder& d)
+		{
+			int size = read_segment_length(d);
+			while (size > 0)
+			{
+				const int tcth  = d.source.next();
+				const int tc	= tcth >> 4;
+				const int th	= tcth & 15;
+				if (tcth < 0 || tc > 1 || th > 3 || size < 17)
+				{
+					return -1;
+				}
+
+				uint8_t  counts[16];
+				unsigned valueCount = 0;
+				for (int i = 0; i < 16; ++i)
+				{
+					const int count = d.source.next();
+					if (count < 0)
+					{
+						return -1;
+					}
+					counts[i] = uint8_t(count);
+					valueCount += unsigned(count);
+				}
+				if (valueCount > 256 || size < int(17 + valueCount))
+				{
+					return -1;
+				}
+
+				uint8_t values[256];
+				for (unsigned i = 0; i < valueCount; ++i)
+				{
+					const int value = d.source.next();
+					if (value < 0)
+					{
+						return -1;
+					}
+					values[i] = uint8_t(value);
+				}
+
+				JpegHuffman& huffman = tc ? d.ac[th] : d.dc[th];
+				if (build_huffman(&huffman, counts, values, valueCount) != 0)
+				{
+					return -1;
+				}
+				(tc ? d.hasAC : d.hasDC)[th] = true;
+				size -= int(17 + valueCount);
+			}
+			return size == 0 ? 0 : -1;
+		}
+
+		//! SOF0/SOF1
+		int read_SOF(JpegDecoder& d)
+		{
+			const int size		= read_segment_length(d);
+			const int precision = d.source.next();
+			const int height	= d.source.next16();
+			const int width		= d.source.next16();
+			const int count		= d.source.next();
+			if (d.hasFrame || precision != 8 || height <= 0 || width <= 0 || (count != 1 && count != 3)
+				|| size != 6 + count * 3)
+			{
+				// 12 bit precision, DNL defined height, CMYK
+				return -1;
+			}
+
+			d.hasFrame		 = true;
+			d.width			 = uint32_t(width);
+			d.height		 = uint32_t(height);
+			d.componentCount = uint8_t(count);
+			d.hmax = d.vmax = 1;
+			for (int i = 0; i < count; ++i)
+			{
+				JpegComponent& component = d.components[i];
+				const int	   id		 = d.source.next();
+				const int	   hv		 = d.source.next();
+				const int	   tq		 = d.source.next();
+				component.h				 = uint8_t(hv >> 4);
+				component.v				 = uint8_t(hv & 15);
+				if (id < 0 || hv < 0 || tq < 0 || tq > 3 || component.h < 1 || component.h > 4 || component.v < 1
+					|| component.v > 4)
+				{
+					return -1;
+				}
+				component.id = uint8_t(id);
+				component.tq = uint8_t(tq);
+				d.hmax		 = std::max(d.hmax, component.h);
+				d.vmax		 = std::max(d.vmax, component.v);
+			}
+
+			// a single component is coded block by block, whatever its sampling factors
+			if (count == 1)
+			{
+				d.components[0].h = d.components[0].v = 1;
+				d.hmax = d.vmax = 1;
+			}
+
+			d.mcusX = (d.width + d.hmax * 8 - 1) / (d.hmax * 8);
+			d.mcusY = (d.height + d.vmax * 8 - 1) / (d.vmax * 8);
+			for (int i = 0; i < count; ++i)
+			{
+				JpegComponent& component = d.components[i];
+				component.width			 = (d.width * component.h + d.hmax - 1) / d.hmax;
+				component.height		 = (d.height * component.v + d.vmax - 1) / d.vmax;
+				component.stride		 = size_t(d.mcusX) * component.h * 8;
+			}
+			return 0;
+		}
+
+		int read_DRI(JpegDecoder& d)
+		{
+			const int size	 = read_segment_length(d);
+			const int interval = d.source.next16();
+			if (size != 2 || interval < 0)
+			{
+				return -1;
+			}
+			d.restartInterval = uint16_t(interval);
+			return 0;
+		}
+
+		//! APP14, only the Adobe color transform is kept
+		int read_APP14(JpegDecoder& d)
+		{
+			int size = read_segment_length(d);
+			if (size < 0)
+			{
+				return -1;
+			}
+
+			if (size >= 12)
+			{
+				uint8_t data[12];
+				for (int i = 0; i < 12; ++i)
+				{
+					const int byte = d.source.next();
+					if (byte < 0)
+					{
+						return -1;
+					}
+					data[i] = uint8_t(byte);
+				}
+				size -= 12;
+				if (memcmp(data, "Adobe", 5) == 0)
+				{
+					d.adobeTransform = data[11];
+				}
+			}
+			return d.source.skip(size_t(size)) ? 0 : -1;
+		}
+
+		int skip_segment(JpegDecoder& d)
+		{
+			const int size = read_segment_length(d);
+			return (size >= 0 && d.source.skip(size_t(size))) ? 0 : -1;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! scans
+
+		int read_SOS(JpegDecoder& d)
+		{
+			const int size  = read_segment_length(d);
+			const int count = d.source.next();
+			if (!d.hasFrame || count < 1 || count > int(d.componentCount) || size != 4 + count * 2)
+			{
+				return -1;
+			}
+
+			d.scanCount = uint8_t(count);
+			for (int i = 0; i < count; ++i)
+			{
+				const int id   = d.source.next();
+				const int tdta = d.source.next();
+				if (id < 0 || tdta < 0)
+				{
+					return -1;
+				}
+
+				unsigned index = 0;
+				while (index < d.componentCount && d.components[index].id != id)
+				{
+					++index;
+				}
+
+				const unsigned td = unsigned(tdta) >> 4;
+				const unsigned ta = unsigned(tdta) & 15;
+				if (index == d.componentCount || (d.decodedComponents & (1u << index)) || td > 3 || ta > 3 || !d.hasDC[td]
+					|| !d.hasAC[ta] || !d.hasQuant[d.components[index].tq])
+				{
+					return -1;
+				}
+
+				JpegComponent& component = d.components[index];
+				component.td			 = uint8_t(td);
+				component.ta			 = uint8_t(ta);
+				d.scanComponents[i]		 = uint8_t(index);
+				d.decodedComponents |= 1u << index;
+			}
+
+			// sequential DCT: full spectral range, no successive approximation
+			const int ss   = d.source.next();
+			const int se   = d.source.next();
+			const int ahal = d.source.next();
+			if (ss != 0 || se != 63 || ahal != 0)
+			{
+				return -1;
+			}
+			return 0;
+		}
+
+		//! allocates the planes before the first scan
+		void init_planes(JpegDecoder& d)
+		{
+			// a scan with all components can be converted MCU row by MCU row
+			d.isBanded = d.scanCount == d.componentCount;
+			for (unsigned i = 0; i < d.componentCount; ++i)
+			{
+				JpegComponent& component = d.components[i];
+				component.rows			 = component.v * 8 * (d.isBanded ? 1 : d.mcusY);
+				component.plane.resize(component.stride * component.rows);
+			}
+		}
+
+		//! handles the restart marker expected after the interval, returns 0 on success
+		int restart(JpegDecoder& d)
+		{
+			const int marker = read_marker(d);
+			if (marker < 0xD0 || marker > 0xD7)
+			{
+				return -1;
+			}
+
+			d.bits	 = 0;
+			d.bitCount = 0;
+			for (unsigned i = 0; i < d.componentCount; ++i)
+			{
+				d.components[i].dcPred = 0;
+			}
+			return 0;
+		}
+
+		//! decodes a block into the plane of the component, block coordinates in blocks
+		inline int decode_block_at(JpegDecoder& d, JpegComponent& component, uint32_t blockX, uint32_t blockY)
+		{
+			alignas(16) int16_t coefficients[64];
+			const int			last = decode_block(d, component, coefficients);
+			if (last < 0)
+			{
+				return -1;
+			}
+
+			const size_t row = (size_t(blockY) * 8) % component.rows;
+			idct_block(coefficients, last, component.dequant, component.plane.data() + row * component.stride + size_t(blockX) * 8,
+					   component.stride);
+			return 0;
+		}
+
+		int decode_scan(JpegDecoder& d)
+		{
+			for (unsigned i = 0; i < d.scanCount; ++i)
+			{
+				JpegComponent& component = d.components[d.scanComponents[i]];
+				const uint16_t* quant	= d.quant[component.tq];
+				for (int k = 0; k < 64; ++k)
+				{
+					component.dequant[k] = quant[k] * aan_scale[k / 8] * aan_scale[k % 8] / 8.0f;
+				}
+				component.dcPred = 0;
+			}
+
+			d.bits	 = 0;
+			d.bitCount = 0;
+			d.marker   = marker_none;
+
+			const uint32_t bandHeight = uint32_t(d.vmax) * 8;
+			uint32_t	   todo		  = d.restartInterval;
+			if (d.scanCount == 1)
+			{
+				// non-interleaved: one block per MCU, covering the component only
+				JpegComponent& component = d.components[d.scanComponents[0]];
+				const uint32_t blocksX	 = (component.width + 7) / 8;
+				const uint32_t blocksY	 = (component.height + 7) / 8;
+				for (uint32_t by = 0; by < blocksY; ++by)
+				{
+					for (uint32_t bx = 0; bx < blocksX; ++bx)
+					{
+						if (decode_block_at(d, component, bx, by) != 0)
+						{
+							return -1;
+						}
+						if (d.restartInterval && --todo == 0 && (bx + 1 < blocksX || by + 1 < blocksY))
+						{
+							if (restart(d) != 0)
+							{
+								return -1;
+							}
+							todo = d.restartInterval;
+						}
+					}
+
+					if (d.isBanded)
+					{
+						// single component frame, one block row per band
+						convert_rows(d, by * 8, std::min(d.height, by * 8 + 8), by * 8);
+					}
+				}
+				return 0;
+			}
+
+			for (uint32_t my = 0; my < d.mcusY; ++my)
+			{
+				for (uint32_t mx = 0; mx < d.mcusX; ++mx)
+				{
+					for (unsigned i = 0; i < d.scanCount; ++i)
+					{
+						JpegComponent& component = d.components[d.scanComponents[i]];
+						for (uint32_t v = 0; v < component.v; ++v)
+						{
+							for (uint32_t h = 0; h < component.h; ++h)
+							{
+								if (decode_block_at(d, component, mx * component.h + h, my * component.v + v) != 0)
+								{
+									return -1;
+								}
+							}
+						}
+					}
+
+					if (d.restartInterval && --todo == 0 && (mx + 1 < d.mcusX || my + 1 < d.mcusY))
+					{
+						if (restart(d) != 0)
+						{
+							return -1;
+						}
+						todo = d.restartInterval;
+					}
+				}
+
+				if (d.isBanded)
+				{
+					convert_rows(d, my * bandHeight, std::min(d.height, (my + 1) * bandHeight), my * bandHeight);
+				}
+			}
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! stream parsing
+
+		//! parses marker segments, decoding scans if output is set, until EOI (or SOF for !output)
+		int read_stream(JpegDecoder& d)
+		{
+			if (d.source.next() != 0xFF || d.source.next() != 0xD8)
+			{
+				return -1;
+			}
+
+			for (;;)
+			{
+				const int marker = read_marker(d);
+				int		  result = 0;
+				switch (marker)
+				{
+					case 0xC0:	// SOF0 baseline
+					case 0xC1:	// SOF1 extended sequential, huffman coded
+						result = read_SOF(d);
+						if (result == 0 && !d.output)
+						{
+							return 0;
+						}
+						break;
+					case 0xC4:
+						result = read_DHT(d);
+						break;
+					case 0xDB:
+						result = read_DQT(d);
+						break;
+					case 0xDD:
+						result = read_DRI(d);
+						break;
+					case 0xDA:
+						result = read_SOS(d);
+						if (result == 0 && !d.output)
+						{
+							return -1;	// SOS before SOF
+						}
+						if (result == 0)
+						{
+							if (d.components[0].plane.empty())
+							{
+								init_planes(d);
+							}
+							result = decode_scan(d);
+						}
+						break;
+					case 0xEE:
+						result = read_APP14(d);
+						break;
+					case 0xD0:
+					case 0xD1:
+					case 0xD2:
+					case 0xD3:
+					case 0xD4:
+					case 0xD5:
+					case 0xD6:
+					case 0xD7:
+					case 0x01:	// TEM
+						break;
+					case 0xD9:	// EOI
+					case -1:	// missing EOI
+						if (!d.output || d.decodedComponents != (1u << d.componentCount) - 1)
+						{
+							return -1;
+						}
+						if (!d.isBanded)
+						{
+							convert_rows(d, 0, d.height, 0);
+						}
+						return 0;
+					default:
+						if ((marker >= 0xC2 && marker <= 0xCF) || marker == 0xD8)
+						{
+							// progressive, lossless, arithmetic coded frames or a nested SOI
+							return -1;
+						}
+						// APPn, COM, DNL, ...
+						result = skip_segment(d);
+						break;
+				}
+
+				if (result != 0)
+				{
+					return -1;
+				}
+			}
+		}
+
+		int read_jpeg_info(const ByteSpan* spans, size_t count, JpegInfo* info)
+		{
+			assert(info);
+			JpegDecoder* d = new (std::nothrow) JpegDecoder();
+			if (!d)
+			{
+				return -1;
+			}
+
+			d->source.init(spans, count);
+			d->marker		  = marker_none;
+			d->adobeTransform = -1;
+			const int result  = read_stream(*d);
+			if (result == 0)
+			{
+				info->width		 = d->width;
+				info->height	 = d->height;
+				info->components = d->componentCount;
+			}
+			delete d;
+			return result;
+		}
+
+		int decode_jpeg(const ByteSpan* spans, size_t count, JpegTarget target, uint8_t* rgba, size_t stride, const JpegRowHook* hook)
+		{
+			assert(rgba);
+			JpegDecoder* d = new (std::nothrow) JpegDecoder();
+			if (!d)
+			{
+				return -1;
+			}
+
+			d->source.init(spans, count);
+			d->marker		  = marker_none;
+			d->adobeTransform = -1;
+			d->target		  = target;
+			d->output		  = rgba;
+			d->outputStride   = stride;
+			d->hook			  = hook;
+			const int result  = read_stream(*d);
+			delete d;
+			return result;
+		}
+
+	}	// namespace common
+}	// namespace xng
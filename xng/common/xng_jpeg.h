@@ -0,0 +1,72 @@
+#ifndef XNG_JPEG_H_INC
+#define XNG_JPEG_H_INC
+
+#include "xng/common/xng_common.h"
+
+namespace xng
+{
+	namespace common
+	{
+		//-------------------------------------------------------------------------
+		//! built-in baseline JPEG decoder (ITU T.81 sequential DCT, huffman coded, 8 bit samples)
+		//! used for the JDAT/JDAA streams of JNG. progressive, lossless, arithmetic coded and
+		//! 12 bit streams are not supported.
+		//! the stream is passed as spans, e.g. the payloads of consecutive chunks, which are read
+		//! in place; a marker or segment may cross span boundaries
+
+		struct JpegInfo
+		{
+			uint32_t width;
+			uint32_t height;
+			uint8_t  components;	// 1: greyscale, 3: YCbCr (RGB with an Adobe APP14 transform of 0)
+		};
+
+		//! what decode_jpeg writes into the 4 byte pixels of the output
+		enum class JpegTarget : uint8_t
+		{
+			RGBA = 0,	// color, alpha set to 0xFF
+			RGB,		// color, alpha bytes kept (e.g. merged with an alpha channel decoded before or concurrently)
+			Alpha,		// first component into the alpha byte only, color untouched
+		};
+
+		//! lets decode_jpeg share its output with another writer, e.g. a concurrent alpha decoder
+		//! rows are written top to bottom, in bands of up to one MCU row (all rows at once for multi-scan streams)
+		struct JpegRowHook
+		{
+			//! called before output rows [0, rows) are complete, may block. nullptr: no call
+			void (*before)(void* context, uint32_t rows);
+			//! called once output rows [0, rows) are written. nullptr: no call
+			void (*after)(void* context, uint32_t rows);
+			void* context;
+		};
+
+		//! read_jpeg_info
+		//! reads the frame header
+		//! param[in] spans: pieces of the JPEG stream, starting with SOI
+		//! param[in] count: number of spans
+		//! param[out] info: frame size and component count
+		//! returns 0 on success, -1 for corrupt or unsupported streams
+		int read_jpeg_info(const ByteSpan* spans, size_t count, JpegInfo* info);
+
+		//! decode_jpeg
+		//! decodes the stream into 4 byte pixels, converting to RGB and upsampling chroma (box filter)
+		//! one MCU row at a time for single-scan streams
+		//! param[in] spans: pieces of the JPEG stream, starting with SOI
+		//! param[in] count: number of spans
+		//! param[in] target: channels to write
+		//! param[out] rgba: output pixels, width x height as returned by read_jpeg_info
+		//! param[in] stride: distance between output rows in bytes
+		//! param[in] hook: synchronization with other writers of rgba, nullptr for none
+		//! returns 0 on success, -1 for corrupt or unsupported streams
+		int decode_jpeg(const ByteSpan*	spans,
+						size_t			   count,
+						JpegTarget		   target,
+						uint8_t*		   rgba,
+						size_t			   stride,
+						const JpegRowHook* hook = nullptr);
+
+	}	// namespace common
+}	// namespace xng
+
+
+#endif	// XNG_JPEG_H_INC
@@ -0,0 +1,193 @@
+#include "xng_lz.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace xng
+{
+	namespace common
+	{
+		//-- sequence: token (literal count << 4 | match length - 4), literal count extension, literals,
+		//-- match offset (16 bit little endian), match length extension. counts of 15 are extended by
+		//-- bytes of 255 and a final byte below. the last sequence has literals only
+
+		static const size_t lz_min_match	= 4;
+		static const size_t lz_hash_bits	= 14;
+		static const size_t lz_max_offset	= 0xFFFF;
+		static const size_t lz_literal_tail = 8;	// bytes at the end never starting a match
+
+		inline uint32_t read_word(const uint8_t* p)
+		{
+			uint32_t word;
+			memcpy(&word, p, sizeof(word));
+			return word;
+		}
+
+		inline uint32_t hash_word(uint32_t word)
+		{
+			return (word * 2654435761u) >> (32 - lz_hash_bits);
+		}
+
+		inline void write_count(std::vector<uint8_t>& out, size_t count)
+		{
+			for (; count >= 255; count -= 255)
+			{
+				out.push_back(255);
+			}
+			out.push_back(uint8_t(count));
+		}
+
+		inline void write_sequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+		{
+			const size_t matchCount = matchLength == 0 ? 0 : matchLength - lz_min_match;
+			out.push_back(uint8_t((literalCount < 15 ? literalCount : 15) << 4 | (matchCount < 15 ? matchCount : 15)));
+			if (literalCount >= 15)
+			{
+				write_count(out, literalCount - 15);
+			}
+			out.insert(out.end(), literals, literals + literalCount);
+			if (matchLength == 0)
+			{
+				return;
+			}
+
+			out.push_back(uint8_t(offset));
+			out.push_back(uint8_t(offset >> 8));
+			if (matchCount >= 15)
+			{
+				write_count(out, matchCount - 15);
+			}
+		}
+
+		void lz_compress(const uint8_t* data, size_t size, std::vector<uint8_t>* out)
+		{
+			assert(out);
+			out->clear();
+			out->reserve(size + size / 255 + 16);
+
+			std::vector<uint32_t> table(size_t(1) << lz_hash_bits, 0);
+			size_t				  anchor = 0;
+			size_t				  pos	 = 1;
+			const size_t		  limit	 = size > lz_literal_tail ? size - lz_literal_tail : 0;
+			while (pos < limit)
+			{
+				const uint32_t word		 = read_word(data + pos);
+				const uint32_t hash		 = hash_word(word);
+				const size_t   candidate = table[hash];
+				table[hash]				 = uint32_t(pos);
+
+				if (pos - candidate > lz_max_offset || read_word(data + candidate) != word)
+				{
+					// skip faster through incompressible data
+					pos += 1 + ((pos - anchor) >> 6);
+					continue;
+				}
+
+				// extend backwards over pending literals, then forwards
+				size_t start = pos;
+				size_t from	 = candidate;
+				while (start > anchor && from > 0 && data[start - 1] == data[from - 1])
+				{
+					--start;
+					--from;
+				}
+				size_t length = pos - start + lz_min_match;
+				while (start + length < limit && data[start + length] == data[from + length])
+				{
+					++length;
+				}
+
+				write_sequence(*out, data + anchor, start - anchor, start - from, length);
+				pos	   = start + length;
+				anchor = pos;
+				if (pos - 2 < limit)
+				{
+					table[hash_word(read_word(data + pos - 2))] = uint32_t(pos - 2);
+				}
+			}
+
+			write_sequence(*out, data + anchor, size - anchor, 0, 0);
+		}
+
+		//! reads an extended count, returns false at the end of the data
+		inline bool read_count(const uint8_t*& data_iter, const uint8_t* end, size_t* count)
+		{
+			uint8_t byte;
+			do
+			{
+				if (data_iter == end)
+				{
+					return false;
+				}
+				byte = *data_iter++;
+				*count += byte;
+			} while (byte == 255);
+			return true;
+		}
+
+		int lz_decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outsize)
+		{
+			assert(data || size == 0);
+			const uint8_t* data_iter = data;
+			const uint8_t* end		 = data + size;
+			size_t		   written	 = 0;
+			while (data_iter != end)
+			{
+				const uint8_t token		   = *data_iter++;
+				size_t		  literalCount = token >> 4;
+				if (literalCount == 15 && !read_count(data_iter, end, &literalCount))
+				{
+					return -1;
+				}
+				if (size_t(end - data_iter) < literalCount || outsize - written < literalCount)
+				{
+					return -1;
+				}
+				if (literalCount > 0)
+				{
+					memcpy(out + written, data_iter, literalCount);
+				}
+				data_iter += literalCount;
+				written += literalCount;
+				if (data_iter == end)
+				{
+					break;
+				}
+
+				if (end - data_iter < 2)
+				{
+					return -1;
+				}
+				const size_t offset = size_t(data_iter[0]) | size_t(data_iter[1]) << 8;
+				data_iter += 2;
+				size_t length = token & 0x0F;
+				if (length == 15 && !read_count(data_iter, end, &length))
+				{
+					return -1;
+				}
+				length += lz_min_match;
+				if (offset == 0 || offset > written || outsize - written < length)
+				{
+					return -1;
+				}
+
+				// overlapping matches repeat the last offset bytes: copy whole periods, doubling the piece
+				// size, so no copy overlaps
+				const uint8_t* source = out + written - offset;
+				uint8_t*	   target = out + written;
+				for (size_t copied = 0; copied < length;)
+				{
+					const size_t piece = std::min(copied + offset, length - copied);
+					memcpy(target + copied, source, piece);
+					copied += piece;
+				}
+				written += length;
+			}
+
+			return written == outsize ? 0 : -1;
+		}
+
+	}	// namespace common
+}	// namespace xng
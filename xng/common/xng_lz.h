@@ -0,0 +1,35 @@
+#ifndef XNG_LZ_H_INC
+#define XNG_LZ_H_INC
+
+#include "xng/common/xng_common.h"
+
+namespace xng
+{
+	namespace common
+	{
+		//-------------------------------------------------------------------------
+		//! fast byte-oriented LZ77 codec (LZ4 style sequences, 64k window) for in-memory snapshots
+		//! favors speed over ratio: canvases with flat areas or repeated rows shrink well, noise doesn't.
+		//! not a storage format of any image file
+
+		//! lz_compress
+		//! compresses size bytes at data
+		//! param[in] data: uncompressed data
+		//! param[in] size: size of the data
+		//! param[out] out: compressed data, replaced
+		void lz_compress(const uint8_t* data, size_t size, std::vector<uint8_t>* out);
+
+		//! lz_decompress
+		//! decompresses data compressed by lz_compress
+		//! param[in] data: compressed data
+		//! param[in] size: size of the compressed data
+		//! param[out] out: decompressed data
+		//! param[in] outsize: size of the decompressed data, as passed to lz_compress
+		//! returns 0 on success, -1 for corrupt data or a size mismatch
+		int lz_decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outsize);
+
+	}	// namespace common
+}	// namespace xng
+
+
+#endif	// XNG_LZ_H_INC
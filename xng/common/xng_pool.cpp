@@ -0,0 +1,215 @@
+#include "xng_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <utility>
+
+namespace xng
+{
+	namespace common
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! workers
+
+		// pool and index of the worker running on this thread
+		static thread_local const ThreadPool* current_pool  = nullptr;
+		static thread_local uint32_t		  current_index = 0;
+
+		void run_worker(ThreadPool* pool, uint32_t index)
+		{
+			current_pool  = pool;
+			current_index = index;
+			for (;;)
+			{
+				if (pool->run_task(index))
+				{
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(pool->sleepMutex);
+				pool->wake.wait(lock, [pool] { return pool->isStopping || pool->queued.load() > 0; });
+				if (pool->isStopping && pool->queued.load() == 0)
+				{
+					return;
+				}
+			}
+		}
+
+		//! lets the workers run out of tasks and joins them
+		void stop_workers(ThreadPool* pool)
+		{
+			{
+				std::lock_guard<std::mutex> lock(pool->sleepMutex);
+				pool->isStopping = true;
+			}
+			pool->wake.notify_all();
+			for (auto& thread : pool->threads)
+			{
+				thread.join();
+			}
+			pool->threads.clear();
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! pool
+
+		ThreadPool::ThreadPool(uint32_t threadCount)
+		{
+			if (threadCount == 0)
+			{
+				threadCount = std::max(1u, std::thread::hardware_concurrency());
+			}
+
+			for (uint32_t i = 0; i < threadCount; ++i)
+			{
+				queues.push_back(std::make_unique<WorkerQueue>());
+			}
+			try
+			{
+				for (uint32_t i = 0; i < threadCount; ++i)
+				{
+					threads.emplace_back(run_worker, this, i);
+				}
+			}
+			catch (...)
+			{
+				stop_workers(this);
+				throw;
+			}
+		}
+
+		ThreadPool::~ThreadPool()
+		{
+			stop_workers(this);
+		}
+
+		uint32_t ThreadPool::thread_count() const
+		{
+			return uint32_t(queues.size());
+		}
+
+		uint32_t ThreadPool::worker_index() const
+		{
+			return current_pool == this ? current_index : thread_count();
+		}
+
+		void ThreadPool::submit(task_t task)
+		{
+			// workers queue their own tasks, so they stay close to the data they were created from
+			const uint32_t index = worker_index();
+			WorkerQueue&   queue = *queues[index < thread_count() ? index : nextQueue.fetch_add(1) % thread_count()];
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.tasks.push_back(std::move(task));
+			}
+			queued.fetch_add(1);
+
+			// a worker checking queued before the increment is waiting once this gets the mutex
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			wake.notify_one();
+		}
+
+		void ThreadPool::submit(TaskGroup* group, task_t task)
+		{
+			assert(group);
+			group->pending.fetch_add(1);
+			try
+			{
+				submit([group, task = std::move(task)] {
+					std::exception_ptr exception;
+					try
+					{
+						task();
+					}
+					catch (...)
+					{
+						exception = std::current_exception();
+					}
+
+					// the waiter returns after getting the mutex, so the group outlives this
+					std::lock_guard<std::mutex> lock(group->mutex);
+					if (exception && !group->exception)
+					{
+						group->exception = exception;
+					}
+					if (group->pending.fetch_sub(1) == 1)
+					{
+						group->done.notify_all();
+					}
+				});
+			}
+			catch (...)
+			{
+				// not queued, e.g. std::bad_alloc
+				std::lock_guard<std::mutex> lock(group->mutex);
+				group->pending.fetch_sub(1);
+				throw;
+			}
+		}
+
+		void ThreadPool::wait(TaskGroup* group)
+		{
+			assert(group);
+			const uint32_t index = worker_index();
+			while (group->pending.load() > 0)
+			{
+				if (run_task(index))
+				{
+					continue;
+				}
+
+				// the remaining tasks run on other threads. they may queue more, so look again now and then
+				std::unique_lock<std::mutex> lock(group->mutex);
+				group->done.wait_for(lock, std::chrono::milliseconds(1), [group] { return group->pending.load() == 0; });
+			}
+
+			// the last task may still hold the mutex
+			std::lock_guard<std::mutex> lock(group->mutex);
+			if (group->exception)
+			{
+				std::rethrow_exception(std::exchange(group->exception, nullptr));
+			}
+		}
+
+		bool ThreadPool::run_task(uint32_t index)
+		{
+			const uint32_t count = thread_count();
+			task_t		   task;
+			if (index < count)
+			{
+				// own tasks, newest first
+				WorkerQueue&				queue = *queues[index];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (!queue.tasks.empty())
+				{
+					task = std::move(queue.tasks.back());
+					queue.tasks.pop_back();
+				}
+			}
+			for (uint32_t i = 1; !task && i <= count; ++i)
+			{
+				// steal, oldest first
+				WorkerQueue&				victim = *queues[(index + i) % count];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.tasks.empty())
+				{
+					task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+				}
+			}
+			if (!task)
+			{
+				return false;
+			}
+
+			queued.fetch_sub(1);
+			task();
+			return true;
+		}
+
+	}	// namespace common
+}	// namespace xng
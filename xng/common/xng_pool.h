@@ -0,0 +1,85 @@
+#ifndef XNG_POOL_H_INC
+#define XNG_POOL_H_INC
+
+#include "xng/common/xng_common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xng
+{
+	namespace common
+	{
+		//-------------------------------------------------------------------------
+		//! work-stealing thread pool
+		//-- every worker has a queue of its own: it runs the tasks it submitted last first (their data
+		//-- is still in its caches), and steals the oldest ones of the other workers when it runs out.
+		//-- tasks submitted from other threads are spread round robin
+
+		typedef std::function<void()> task_t;
+
+		//! counts the pending tasks of a group, e.g. the pieces of one file
+		struct TaskGroup
+		{
+			std::atomic<size_t>		pending{0};
+			std::mutex				mutex;
+			std::condition_variable done;
+			std::exception_ptr		exception;	// first one thrown by a task, rethrown by wait
+		};
+
+		struct WorkerQueue
+		{
+			std::mutex		   mutex;
+			std::deque<task_t> tasks;
+		};
+
+		struct ThreadPool
+		{
+			std::vector<std::unique_ptr<WorkerQueue>> queues;	// one per worker
+			std::vector<std::thread>				  threads;
+			std::atomic<size_t>						  queued{0};
+			std::atomic<uint32_t>					  nextQueue{0};	// round robin of outside submissions
+			std::mutex								  sleepMutex;
+			std::condition_variable					  wake;
+			bool									  isStopping = false;
+
+			//! starts threadCount workers, 0 for one per hardware thread
+			explicit ThreadPool(uint32_t threadCount = 0);
+			ThreadPool(const ThreadPool&) = delete;
+			ThreadPool& operator=(const ThreadPool&) = delete;
+			//! runs the queued tasks, then joins the workers
+			~ThreadPool();
+
+			uint32_t thread_count() const;
+
+			//! index of the calling worker, thread_count() for threads not of this pool.
+			//! indexes per-thread state of the tasks
+			uint32_t worker_index() const;
+
+			//! submits a task, which must not throw: an exception escaping it ends the process
+			void submit(task_t task);
+
+			//! submits a task counted by the group. the task is done when it returns or throws
+			void submit(TaskGroup* group, task_t task);
+
+			//! runs queued tasks on the calling thread until the tasks of the group are done, so tasks
+			//! may wait for the tasks they submitted without tying up a worker. then rethrows the first
+			//! exception thrown by one of them
+			void wait(TaskGroup* group);
+
+			//! runs one queued task, the own ones of worker index first. returns false if there was none
+			bool run_task(uint32_t index);
+		};
+
+	}	// namespace common
+}	// namespace xng
+
+
+#endif	// XNG_POOL_H_INC
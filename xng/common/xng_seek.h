@@ -0,0 +1,260 @@
+#ifndef XNG_SEEK_H_INC
+#define XNG_SEEK_H_INC
+
+#include "xng/common/xng_common.h"
+#include "xng/common/xng_lz.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <vector>
+
+namespace xng
+{
+	namespace common
+	{
+		//-------------------------------------------------------------------------
+		//! playback and seek indices
+		//-- periodic snapshots of the playback state of animations (canvas, MNG object store), so seeking
+		//-- restores the last snapshot before the target time and plays a bounded number of frames.
+		//-- the APNG and MNG playbacks differ in the state they snapshot only
+
+		enum class PlaybackStatus : int8_t
+		{
+			Error = -1,	// corrupt or unsupported data
+			Frame = 0,	// a frame was produced
+			End			// no more frames
+		};
+
+		struct SeekIndexOptions
+		{
+			// playback time between snapshots in seconds, 0: no limit
+			double interval = 1.0;
+
+			// chunk data interpreted between snapshots in bytes, 0: no limit. bounds the work of a seek for
+			// animations whose frames differ a lot in decoding cost (or have no timing)
+			uint64_t byteInterval = uint64_t(4) << 20;
+
+			// snapshot memory in bytes. when exceeded, every other snapshot is dropped and the intervals are
+			// doubled, so long animations keep an evenly spread index
+			size_t memoryLimit = size_t(64) << 20;
+		};
+
+		//! playback state before the frame starting at time
+		template <typename State>
+		struct Keyframe
+		{
+			State				 state;	// the state of the playback besides the canvas and the position
+			uint64_t			 frameIndex;
+			double				 time;
+			uint64_t			 bytesRead;
+			std::vector<uint8_t> canvas;	// lz_compress'ed
+		};
+
+		template <typename State>
+		struct SeekIndex
+		{
+			SeekIndexOptions			 options;
+			double						 interval;		// current intervals, doubled whenever the memory limit is hit
+			uint64_t					 byteInterval;
+			size_t						 memoryUsage;
+			uint32_t					 fingerprint;	// of the animation the index was recorded for
+			std::vector<Keyframe<State>> keyframes;		// ascending in time
+		};
+
+		static const uint8_t seekindex_version = 1;
+
+		//! frames played in a row without time passing, after which seeking gives up: endless loops of
+		//! frames without delay (e.g. MNG with a tick rate of 0) never reach a later time
+		static const uint32_t max_stalled_frames = 1 << 16;
+
+		//! is_stalled
+		//! counts the frames played in a row without time passing
+		//! param[in] frameStart, frameEnd: playback time before and after the frame
+		//! param[in,out] stalledFrames: the count, 0 before the first frame
+		//! returns true once max_stalled_frames frames didn't advance the time
+		inline bool is_stalled(double frameStart, double frameEnd, uint32_t* stalledFrames)
+		{
+			*stalledFrames = frameEnd > frameStart ? 0 : *stalledFrames + 1;
+			return *stalledFrames >= max_stalled_frames;
+		}
+
+		//! init_seekindex
+		//! prepares an empty index
+		//! param[in] options: snapshot intervals and memory limit
+		//! param[in] fingerprint: identifies the animation
+		//! param[out] index: index to initialize
+		template <typename State>
+		void init_seekindex(const SeekIndexOptions& options, uint32_t fingerprint, SeekIndex<State>* index)
+		{
+			assert(index);
+			index->options		= options;
+			index->interval		= options.interval;
+			index->byteInterval = options.byteInterval;
+			index->memoryUsage	= 0;
+			index->fingerprint	= fingerprint;
+			index->keyframes.clear();
+		}
+
+		//! is_keyframe_due
+		//! returns whether a playback at the position is an interval past the last keyframe. frames
+		//! played again after seeking back are indexed already
+		template <typename State>
+		bool is_keyframe_due(const SeekIndex<State>& index, uint64_t frameIndex, double time, uint64_t bytesRead)
+		{
+			const Keyframe<State>* last = index.keyframes.empty() ? nullptr : &index.keyframes.back();
+			if (frameIndex <= (last ? last->frameIndex : 0))
+			{
+				return false;
+			}
+			return (index.interval > 0.0 && time - (last ? last->time : 0.0) >= index.interval)
+				   || (index.byteInterval > 0 && bytesRead - (last ? last->bytesRead : 0) >= index.byteInterval);
+		}
+
+		//! add_keyframe
+		//! appends the keyframe, then drops every other keyframe and doubles the intervals while the
+		//! index is over its memory limit
+		//! param[in,out] index: the index
+		//! param[in] keyframe: keyframe with its state and position, without canvas
+		//! param[in] canvas, size: canvas of the playback, compressed into the keyframe
+		//! param[in] memory_of: memory held by the keyframes of an index
+		template <typename State>
+		void add_keyframe(SeekIndex<State>* index, Keyframe<State>&& keyframe, const uint8_t* canvas, size_t size, size_t (*memory_of)(const SeekIndex<State>&))
+		{
+			assert(index && memory_of);
+			lz_compress(canvas, size, &keyframe.canvas);
+			keyframe.canvas.shrink_to_fit();
+			index->keyframes.push_back(std::move(keyframe));
+			index->memoryUsage = memory_of(*index);
+
+			while (index->memoryUsage > index->options.memoryLimit && index->keyframes.size() > 1)
+			{
+				size_t kept = 1;
+				for (size_t i = 2; i < index->keyframes.size(); i += 2)
+				{
+					index->keyframes[kept++] = std::move(index->keyframes[i]);
+				}
+				index->keyframes.resize(kept);
+				index->memoryUsage = memory_of(*index);
+				index->interval *= 2.0;
+				index->byteInterval *= 2;
+			}
+		}
+
+		//! seek
+		//! restores the last keyframe at or before time, unless the playback is between it and time
+		//! already, and plays up to the frame shown at time
+		//! param[in,out] playback: APNG or MNG playback the index was recorded for
+		//! param[in] index: the index, may be empty (seeking then plays from the start)
+		//! param[in] time: seconds from the start
+		//! param[out] frame: receives the frame shown at time
+		//! param[in] restart: reopens the playback at the start, returns 0 on success
+		//! param[in] restore: restores the state and position of a keyframe, the canvas is restored already
+		//! param[in] next_frame: composes the next frame of the playback
+		//! returns PlaybackStatus::Frame on success, End if time is past the animation or the animation
+		//!  stalls before it (see max_stalled_frames)
+		template <typename Playback, typename State, typename Frame>
+		PlaybackStatus seek(Playback* playback, const SeekIndex<State>& index, double time, Frame* frame, int (*restart)(Playback*),
+							void (*restore)(const Keyframe<State>&, Playback*), PlaybackStatus (*next_frame)(Playback*, Frame*))
+		{
+			assert(playback && frame);
+			Playback& p = *playback;
+
+			auto		 itNext	   = std::upper_bound(index.keyframes.begin(), index.keyframes.end(), time, [](double t, const Keyframe<State>& keyframe) {
+				 return t < keyframe.time;
+			 });
+			const double startTime = itNext == index.keyframes.begin() ? 0.0 : std::prev(itNext)->time;
+			if (p.time > time || p.time < startTime)
+			{
+				if (itNext == index.keyframes.begin())
+				{
+					if (restart(&p) != 0)
+					{
+						return PlaybackStatus::Error;
+					}
+				}
+				else
+				{
+					const Keyframe<State>& keyframe = *std::prev(itNext);
+					if (lz_decompress(keyframe.canvas.data(), keyframe.canvas.size(), p.canvas.data(), p.canvas.size()) != 0)
+					{
+						return PlaybackStatus::Error;
+					}
+					restore(keyframe, &p);
+				}
+			}
+
+			for (uint32_t stalledFrames = 0;;)
+			{
+				const double		 frameStart = p.time;
+				const PlaybackStatus status		= next_frame(&p, frame);
+				if (status != PlaybackStatus::Frame || frameStart + frame->duration > time)
+				{
+					return status;
+				}
+				if (is_stalled(frameStart, p.time, &stalledFrames))
+				{
+					return PlaybackStatus::End;
+				}
+			}
+		}
+
+		//! write_seekindex_header
+		//! starts a serialized index with the signature of the format, the version and the index fields
+		//! param[in] signature: signature of the format
+		//! param[in] index: the index
+		//! param[out] out: serialized header, replaced
+		template <typename State>
+		void write_seekindex_header(const uint8_t (&signature)[4], const SeekIndex<State>& index, std::vector<uint8_t>* out)
+		{
+			assert(out);
+			out->assign(signature, signature + sizeof(signature));
+			ByteWriter writer{out};
+			writer.write_uint8(seekindex_version);
+			writer.write_uint32(index.fingerprint);
+			writer.write_double(index.options.interval);
+			writer.write_uint64(index.options.byteInterval);
+			writer.write_uint64(index.options.memoryLimit);
+			writer.write_double(index.interval);
+			writer.write_uint64(index.byteInterval);
+		}
+
+		//! read_seekindex_header
+		//! reads a header written by write_seekindex_header into an index without keyframes
+		//! param[in] signature: signature of the format
+		//! param[in] fingerprint: fingerprint of the animation the index is going to be used with
+		//! param[in,out] reader: reader at the start of the serialized index
+		//! param[out] index: the index
+		//! returns true if the signature, version and fingerprint match
+		template <typename State>
+		bool read_seekindex_header(const uint8_t (&signature)[4], uint32_t fingerprint, ByteReader* reader, SeekIndex<State>* index)
+		{
+			assert(reader && index);
+			for (uint8_t c : signature)
+			{
+				if (reader->read_uint8() != c)
+				{
+					return false;
+				}
+			}
+			if (reader->read_uint8() != seekindex_version || reader->read_uint32() != fingerprint)
+			{
+				return false;
+			}
+
+			index->options.interval		= reader->read_double();
+			index->options.byteInterval = reader->read_uint64();
+			index->options.memoryLimit	= size_t(reader->read_uint64());
+			index->interval				= reader->read_double();
+			index->byteInterval			= reader->read_uint64();
+			index->memoryUsage			= 0;
+			index->fingerprint			= fingerprint;
+			index->keyframes.clear();
+			return reader->isValid;
+		}
+
+	}	// namespace common
+}	// namespace xng
+
+
+#endif	// XNG_SEEK_H_INC
@@ -0,0 +1,202 @@
+#include "xng_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+
+namespace xng
+{
+	namespace common
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! scopes
+
+		static thread_local StatsScope* current_scope = nullptr;
+
+		StatsScope::StatsScope(DecodeStats* collectedStats, const stathooks_t* statHooks, void* hookContext)
+			: stats(collectedStats)
+			, hooks(statHooks)
+			, context(hookContext)
+			, previous(current_scope)
+		{
+			current_scope = stats ? this : nullptr;
+		}
+
+		StatsScope::~StatsScope()
+		{
+			assert(current_scope == (stats ? this : nullptr));
+			current_scope = previous;
+			if (stats && hooks && hooks->finish)
+			{
+				hooks->finish(context, *stats);
+			}
+		}
+
+		StatsScope* current_statsscope()
+		{
+			return current_scope;
+		}
+
+		TaskStatsHooks capture_statshooks()
+		{
+			TaskStatsHooks captured;
+			if (current_scope)
+			{
+				captured.isCollecting = true;
+				captured.hooks.span	  = current_scope->hooks ? current_scope->hooks->span : nullptr;
+				captured.context	  = current_scope->context;
+			}
+			return captured;
+		}
+
+		bool is_instrumented()
+		{
+#ifdef XNG_STATS
+			return true;
+#else
+			return false;
+#endif	// XNG_STATS
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! counters
+
+		void add_span(StatsScope* scope, Stage stage, uint64_t startNs, uint64_t durationNs, uint64_t bytes)
+		{
+			assert(scope && stage < Stage::Count);
+			StageStats& stats = scope->stats->stages[size_t(stage)];
+			stats.ns += durationNs;
+			stats.bytes += bytes;
+			++stats.spans;
+			if (scope->hooks && scope->hooks->span)
+			{
+				scope->hooks->span(scope->context, stage, startNs, durationNs, bytes);
+			}
+		}
+
+		void count_chunk(const chunkid_t& id, uint64_t bytes)
+		{
+			if (!current_scope)
+			{
+				return;
+			}
+
+			std::vector<ChunkStats>& chunks = current_scope->stats->chunks;
+			auto itChunk = std::find_if(chunks.begin(), chunks.end(), [&id](auto& chunk) { return chunk.id._raw == id._raw; });
+			if (itChunk == chunks.end())
+			{
+				chunks.push_back({id, 0, 0});
+				itChunk = chunks.end() - 1;
+			}
+			++itChunk->count;
+			itChunk->bytes += bytes;
+		}
+
+		void count_allocation(uint64_t bytes)
+		{
+			if (current_scope)
+			{
+				++current_scope->stats->allocations;
+				current_scope->stats->allocatedBytes += bytes;
+			}
+		}
+
+		void add_stats(DecodeStats* stats, const DecodeStats& taskStats)
+		{
+			assert(stats);
+			for (size_t i = 0; i < stage_count; ++i)
+			{
+				stats->stages[i].ns += taskStats.stages[i].ns;
+				stats->stages[i].bytes += taskStats.stages[i].bytes;
+				stats->stages[i].spans += taskStats.stages[i].spans;
+			}
+			for (auto& taskChunk : taskStats.chunks)
+			{
+				auto itChunk = std::find_if(stats->chunks.begin(), stats->chunks.end(), [&taskChunk](auto& chunk) { return chunk.id._raw == taskChunk.id._raw; });
+				if (itChunk == stats->chunks.end())
+				{
+					stats->chunks.push_back({taskChunk.id, 0, 0});
+					itChunk = stats->chunks.end() - 1;
+				}
+				itChunk->count += taskChunk.count;
+				itChunk->bytes += taskChunk.bytes;
+			}
+			stats->allocations += taskStats.allocations;
+			stats->allocatedBytes += taskStats.allocatedBytes;
+		}
+
+		const char* stage_name(Stage stage)
+		{
+			switch (stage)
+			{
+				case Stage::IO:
+					return "io";
+				case Stage::ChunkParsing:
+					return "chunk parsing";
+				case Stage::CRC:
+					return "crc";
+				case Stage::Inflate:
+					return "inflate";
+				case Stage::Unfilter:
+					return "unfilter";
+				case Stage::ColorConversion:
+					return "color conversion";
+				case Stage::Composition:
+					return "composition";
+				default:
+					return "unknown";
+			}
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! chrome traces
+
+		static std::atomic<uint32_t> trace_thread_count{0};
+		static thread_local uint32_t trace_thread = UINT32_MAX;
+
+		void record_span(void* context, Stage stage, uint64_t startNs, uint64_t durationNs, uint64_t bytes)
+		{
+			assert(context);
+			TraceRecorder& recorder = *static_cast<TraceRecorder*>(context);
+			if (trace_thread == UINT32_MAX)
+			{
+				trace_thread = trace_thread_count.fetch_add(1);
+			}
+
+			std::lock_guard<std::mutex> lock(recorder.mutex);
+			recorder.events.push_back({stage, trace_thread, startNs, durationNs, bytes});
+		}
+
+		const stathooks_t trace_hooks = {record_span, nullptr};
+
+		void write_chrome_trace(TraceRecorder* recorder, std::string* json)
+		{
+			assert(recorder && json);
+			std::lock_guard<std::mutex> lock(recorder->mutex);
+
+			// timestamps in microseconds, relative to the first span
+			uint64_t origin = UINT64_MAX;
+			for (auto& event : recorder->events)
+			{
+				origin = std::min(origin, event.start);
+			}
+
+			json->assign("{\"traceEvents\":[");
+			char buffer[256];
+			for (size_t i = 0; i < recorder->events.size(); ++i)
+			{
+				const TraceEvent& event = recorder->events[i];
+				const uint64_t	  start = event.start - origin;
+				snprintf(buffer, sizeof(buffer),
+						 "%s\n{\"name\":\"%s\",\"cat\":\"xng\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 ",\"args\":{\"bytes\":%" PRIu64 "}}",
+						 i == 0 ? "" : ",", stage_name(event.stage), event.thread, start / 1000, start % 1000,
+						 event.duration / 1000, event.duration % 1000, event.bytes);
+				json->append(buffer);
+			}
+			json->append("\n],\"displayTimeUnit\":\"ns\"}\n");
+		}
+
+	}	// namespace common
+}	// namespace xng
@@ -0,0 +1,277 @@
+#ifndef XNG_STATS_H_INC
+#define XNG_STATS_H_INC
+
+#include "xng/xng.h"
+
+#include <cctype>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace xng
+{
+	namespace common
+	{
+		//-------------------------------------------------------------------------
+		//! decode instrumentation
+		//-- per-stage time and byte counters, chunk counts and allocation counts of the decodes running
+		//-- on a thread, collected while a StatsScope is installed on it. the library is instrumented only
+		//-- if built with XNG_STATS defined, otherwise the instrumentation points compile to nothing and
+		//-- the counters stay zero (except the stages the caller times itself, e.g. Stage::IO)
+
+		enum class Stage : uint8_t
+		{
+			IO = 0,			  // reading the file, timed by the caller
+			ChunkParsing,	  // splitting the file data into chunks
+			CRC,			  // checking chunk CRCs
+			Inflate,		  // decompressing image data, bytes are the inflated ones
+			Unfilter,		  // reconstructing filtered scanlines
+			ColorConversion,  // converting samples to the output format, including downscaling
+			Composition,	  // composing animation frames and emitting them
+			Count
+		};
+
+		static const size_t stage_count = size_t(Stage::Count);
+
+		struct StageStats
+		{
+			uint64_t ns	= 0;
+			uint64_t bytes = 0;
+			uint64_t spans = 0;	// timed spans, one per image for the stages running per scanline
+		};
+
+		struct ChunkStats
+		{
+			chunkid_t id;
+			uint64_t  count;
+			uint64_t  bytes;	// chunk data
+		};
+
+		struct DecodeStats
+		{
+			StageStats				stages[stage_count];
+			std::vector<ChunkStats> chunks;	// by type, in the order first seen
+			uint64_t				allocations	= 0;	// buffers allocated or grown by the decoder
+			uint64_t				allocatedBytes = 0;
+		};
+
+		//! forwards the counters, e.g. to a metrics system. any of the functions may be nullptr
+		struct stathooks_t
+		{
+			//! called at the end of every timed span on the collecting thread: per chunk, image or frame
+			//! for the stages running per scanline (see StageTotal)
+			void (*span)(void* context, Stage stage, uint64_t startNs, uint64_t durationNs, uint64_t bytes);
+			//! called when the scope collecting into stats ends
+			void (*finish)(void* context, const DecodeStats& stats);
+		};
+
+		//! collects the counters of the calling thread into stats while it exists. scopes may be nested,
+		//! the innermost one collects. a scope without stats collects nothing, hiding the scopes around it.
+		//! the library carries the scope into the tasks it submits to other threads (see TaskStatsScope)
+		struct StatsScope
+		{
+			DecodeStats*		stats;
+			const stathooks_t* hooks;
+			void*				context;
+			StatsScope*		previous;
+
+			explicit StatsScope(DecodeStats* collectedStats, const stathooks_t* statHooks = nullptr, void* hookContext = nullptr);
+			StatsScope(const StatsScope&) = delete;
+			StatsScope& operator=(const StatsScope&) = delete;
+			~StatsScope();
+		};
+
+		//! the scope collecting on the calling thread, nullptr if there is none
+		StatsScope* current_statsscope();
+
+		//! the hooks of the scope of a thread submitting a task to another one, e.g. to a pool worker
+		struct TaskStatsHooks
+		{
+			bool		isCollecting = false;				 // the submitting thread had a scope
+			stathooks_t hooks		 = {nullptr, nullptr};	 // its span hook, without finish
+			void*		context		 = nullptr;
+		};
+
+		//! captures the hooks of the scope of the calling thread, for the tasks it submits
+		TaskStatsHooks capture_statshooks();
+
+		//! collects the counters of a task into taskStats while it exists, forwarding the spans to the
+		//! captured hooks as they end. the submitting thread adds taskStats to its scope by add_stats once
+		//! the task is done. if it had no scope, the task collects nothing, also not into a scope of the
+		//! thread running it (e.g. one waiting for its own tasks)
+		struct TaskStatsScope : StatsScope
+		{
+			TaskStatsScope(const TaskStatsHooks& captured, DecodeStats* taskStats)
+				: StatsScope(captured.isCollecting ? taskStats : nullptr, &captured.hooks, captured.context)
+			{
+			}
+		};
+
+		//! adds the counters of taskStats to stats, without calling any hooks
+		void add_stats(DecodeStats* stats, const DecodeStats& taskStats);
+
+		//! true if the library was built with XNG_STATS
+		bool is_instrumented();
+
+		inline uint64_t stats_clock()
+		{
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		//! adds a span of the stage to the current scope
+		void add_span(StatsScope* scope, Stage stage, uint64_t startNs, uint64_t durationNs, uint64_t bytes);
+
+		//! counts a chunk read (by type) to the current scope, if any
+		void count_chunk(const chunkid_t& id, uint64_t bytes);
+
+		//! counts an allocation to the current scope, if any
+		void count_allocation(uint64_t bytes);
+
+		//! times the scope it lives in as a span of the stage, if a StatsScope is installed
+		struct StageTimer
+		{
+			StatsScope* scope;
+			Stage		stage;
+			uint64_t	bytes;
+			uint64_t	start;
+
+			explicit StageTimer(Stage timedStage, uint64_t timedBytes = 0)
+				: scope(current_statsscope())
+				, stage(timedStage)
+				, bytes(timedBytes)
+				, start(scope ? stats_clock() : 0)
+			{
+			}
+			StageTimer(const StageTimer&) = delete;
+			StageTimer& operator=(const StageTimer&) = delete;
+			~StageTimer()
+			{
+				if (scope)
+				{
+					add_span(scope, stage, start, stats_clock() - start, bytes);
+				}
+			}
+		};
+
+		//! sums the sections of a stage that run many times per image (e.g. once per scanline) and adds
+		//! them to the scope as one span when it ends: starting with the first section, lasting their summed
+		//! time. nothing is added if no bytes were counted
+		struct StageTotal
+		{
+			StatsScope* scope;
+			Stage		stage;
+			uint64_t	start = 0;
+			uint64_t	ns	  = 0;
+			uint64_t	bytes = 0;
+
+			explicit StageTotal(Stage totalStage)
+				: scope(current_statsscope())
+				, stage(totalStage)
+			{
+			}
+			StageTotal(const StageTotal&) = delete;
+			StageTotal& operator=(const StageTotal&) = delete;
+			~StageTotal()
+			{
+				if (scope && bytes > 0)
+				{
+					add_span(scope, stage, start, ns, bytes);
+				}
+			}
+		};
+
+		//! times the scope it lives in as a section of a StageTotal
+		struct StageSection
+		{
+			StageTotal& total;
+			uint64_t	start;
+
+			StageSection(StageTotal& sectionTotal, uint64_t sectionBytes)
+				: total(sectionTotal)
+				, start(sectionTotal.scope ? stats_clock() : 0)
+			{
+				total.bytes += sectionBytes;
+				total.start = total.start == 0 ? start : total.start;
+			}
+			StageSection(const StageSection&) = delete;
+			StageSection& operator=(const StageSection&) = delete;
+			~StageSection()
+			{
+				if (total.scope)
+				{
+					total.ns += stats_clock() - start;
+				}
+			}
+		};
+
+		//! resizes a buffer reused between decodes, counting the allocation when it has to grow
+		template <typename T, typename Allocator>
+		inline void resize_buffer(std::vector<T, Allocator>* buffer, size_t size)
+		{
+#ifdef XNG_STATS
+			if (size > buffer->capacity())
+			{
+				count_allocation(size * sizeof(T));
+			}
+#endif	// XNG_STATS
+			buffer->resize(size);
+		}
+
+		//! stage name as used in traces, e.g. "inflate"
+		const char* stage_name(Stage stage);
+
+
+		//! chrome traces
+		//! records the spans of one or more threads for chrome://tracing or Perfetto
+
+		struct TraceEvent
+		{
+			Stage	 stage;
+			uint32_t thread;	// numbered in the order the threads first recorded
+			uint64_t start;		// ns
+			uint64_t duration;	// ns
+			uint64_t bytes;
+		};
+
+		struct TraceRecorder
+		{
+			std::mutex				mutex;	// scopes on several threads may record into one recorder
+			std::vector<TraceEvent> events;
+		};
+
+		//! hooks recording the spans into the TraceRecorder passed as context
+		extern const stathooks_t trace_hooks;
+
+		//! write_chrome_trace
+		//! writes the recorded spans as chrome trace event JSON
+		//! param[in] recorder: recorded spans
+		//! param[out] json: trace, replaced
+		void write_chrome_trace(TraceRecorder* recorder, std::string* json);
+
+	}	// namespace common
+}	// namespace xng
+
+
+//! instrumentation points of the library
+//-- XNG_STAGE times the rest of the enclosing block, one per block. XNG_STAGE_BYTES sets its byte
+//-- count when it is only known at the end. stages running per scanline declare an XNG_STAGE_TOTAL
+//-- for the image and time the rest of the enclosing block as a section of it by XNG_STAGE_SECTION
+#ifdef XNG_STATS
+#define XNG_STAGE(stage, bytes) xng::common::StageTimer stageTimer(xng::common::Stage::stage, bytes)
+#define XNG_STAGE_BYTES(count) (stageTimer.bytes = (count))
+#define XNG_STAGE_TOTAL(total, stage) xng::common::StageTotal total(xng::common::Stage::stage)
+#define XNG_STAGE_SECTION(total, bytes) xng::common::StageSection total##Section(total, bytes)
+#define XNG_COUNT_CHUNK(id, bytes) xng::common::count_chunk(id, bytes)
+#define XNG_COUNT_ALLOCATION(bytes) xng::common::count_allocation(bytes)
+#else
+#define XNG_STAGE(stage, bytes) ((void)0)
+#define XNG_STAGE_BYTES(count) ((void)0)
+#define XNG_STAGE_TOTAL(total, stage) ((void)0)
+#define XNG_STAGE_SECTION(total, bytes) ((void)0)
+#define XNG_COUNT_CHUNK(id, bytes) ((void)0)
+#define XNG_COUNT_ALLOCATION(bytes) ((void)0)
+#endif	// XNG_STATS
+
+
+#endif	// XNG_STATS_H_INC
@@ -0,0 +1,599 @@
+#include "xng_jng.h"
+#include "xng/common/xng_inflate.h"
+#include "xng/common/xng_jpeg.h"
+#include "xng/common/xng_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace xng
+{
+	namespace jng
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! chunk data helpers
+
+		inline DecoderInfo* as_decoderinfo(void* target)
+		{
+			assert(target);
+			return static_cast<DecoderInfo*>(target);
+		}
+
+		inline bool has_alpha(ColorType colorType)
+		{
+			return colorType == ColorType::GREY_ALPHA || colorType == ColorType::COLOR_ALPHA;
+		}
+
+		inline bool is_valid_alpha_depth(AlphaCompression compression, uint8_t depth)
+		{
+			if (compression == AlphaCompression::JPEG)
+			{
+				return depth == 8;
+			}
+			return depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+		}
+
+		inline void add_span(std::vector<common::ByteSpan>* spans, const chunk_t* chunk)
+		{
+			if (!chunk->data.empty())
+			{
+				spans->push_back({chunk->data.data(), chunk->data.size()});
+			}
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! chunk handlers
+
+		int handle_JHDR(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 16)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter   = chunk->data.data();
+			info->width				   = read_uint32_t(data_iter, &data_iter);
+			info->height			   = read_uint32_t(data_iter, &data_iter);
+			info->colorType			   = ColorType(read_uint8_t(data_iter, &data_iter));
+			info->sampleDepth		   = read_uint8_t(data_iter, &data_iter);
+			info->compressionMethod	= read_uint8_t(data_iter, &data_iter);
+			info->interlaceMethod	  = read_uint8_t(data_iter, &data_iter);
+			info->alphaSampleDepth	 = read_uint8_t(data_iter, &data_iter);
+			info->alphaCompression	 = AlphaCompression(read_uint8_t(data_iter, &data_iter));
+			info->alphaFilterMethod	= read_uint8_t(data_iter, &data_iter);
+			info->alphaInterlaceMethod = read_uint8_t(data_iter, &data_iter);
+			info->hasSeparator		   = false;
+
+			const uint8_t colorType = uint8_t(info->colorType);
+			if (info->width == 0 || info->height == 0 || (colorType != 8 && colorType != 10 && colorType != 12 && colorType != 14)
+				|| (info->sampleDepth != 8 && info->sampleDepth != 12 && info->sampleDepth != 20)
+				|| info->compressionMethod != 8 || (info->interlaceMethod != 0 && info->interlaceMethod != 8))
+			{
+				return -1;
+			}
+
+			if (has_alpha(info->colorType)
+				&& (!is_valid_alpha_depth(info->alphaCompression, info->alphaSampleDepth)
+					|| (info->alphaCompression != AlphaCompression::PNG && info->alphaCompression != AlphaCompression::JPEG)))
+			{
+				return -1;
+			}
+
+			return 0;
+		}
+
+		int handle_JDAT(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+
+			// with 20 bit sample depth, the 12 bit stream follows JSEP
+			if (!info->hasSeparator)
+			{
+				add_span(&info->colorData, chunk);
+			}
+			return 0;
+		}
+
+		int handle_JSEP(const chunk_t*, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (info->sampleDepth != 20 || info->hasSeparator)
+			{
+				return -1;
+			}
+
+			info->hasSeparator = true;
+			return 0;
+		}
+
+		int handle_IDAT(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (!has_alpha(info->colorType) || info->alphaCompression != AlphaCompression::PNG)
+			{
+				return -1;
+			}
+
+			add_span(&info->alphaData, chunk);
+			return 0;
+		}
+
+		int handle_JDAA(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (!has_alpha(info->colorType) || info->alphaCompression != AlphaCompression::JPEG)
+			{
+				return -1;
+			}
+
+			add_span(&info->alphaData, chunk);
+			return 0;
+		}
+
+		int handle_IEND(const chunk_t*, void*)
+		{
+			return 0;
+		}
+
+		//! ancillary chunks shared with PNG, not interpreted yet
+		int handle_skipped(const chunk_t*, void*)
+		{
+			return 0;
+		}
+
+		inline const chunkhandlerstate_t& jng_chunkhandlers()
+		{
+			static const chunkhandlerstate_t state = {{
+			  chunkhandler_t{{.type = {'J', 'H', 'D', 'R'}}, handle_JHDR},
+			  chunkhandler_t{{.type = {'J', 'D', 'A', 'T'}}, handle_JDAT},
+			  chunkhandler_t{{.type = {'J', 'S', 'E', 'P'}}, handle_JSEP},
+			  chunkhandler_t{{.type = {'I', 'D', 'A', 'T'}}, handle_IDAT},
+			  chunkhandler_t{{.type = {'J', 'D', 'A', 'A'}}, handle_JDAA},
+			  chunkhandler_t{{.type = {'I', 'E', 'N', 'D'}}, handle_IEND},
+			  chunkhandler_t{{.type = {'g', 'A', 'M', 'A'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'c', 'H', 'R', 'M'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'s', 'R', 'G', 'B'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'i', 'C', 'C', 'P'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'b', 'K', 'G', 'D'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'p', 'H', 'Y', 's'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'s', 'B', 'I', 'T'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'t', 'E', 'X', 't'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'z', 'T', 'X', 't'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'i', 'T', 'X', 't'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'t', 'I', 'M', 'E'}}, handle_skipped},
+			}};
+			return state;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! read_decoderinfo
+
+		int read_decoderinfo(const std::vector<chunk_t>& chunks, DecoderInfo* info)
+		{
+			return read_decoderinfo(chunks.data(), chunks.size(), info);
+		}
+
+		int read_decoderinfo(const chunk_t* chunks, size_t count, DecoderInfo* info)
+		{
+			assert(info);
+			// JHDR must come first
+			if (count == 0 || memcmp(chunks[0].id.type, "JHDR", sizeof(chunkid_t)) != 0)
+			{
+				return -1;
+			}
+
+			info->colorData.clear();
+			info->alphaData.clear();
+			return handle_chunks(chunks, count, jng_chunkhandlers(), info);
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! alpha channel
+		//-- written straight into the alpha bytes of the output, row by row. when decoding concurrently,
+		//-- the color conversion waits for the alpha rows it merges with
+
+		//! number of alpha rows written, shared by the alpha and the color decoder
+		struct AlphaProgress
+		{
+			std::mutex				mutex;
+			std::condition_variable condition;
+			uint32_t				rows = 0;
+
+			void publish(uint32_t count)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					rows = count;
+				}
+				condition.notify_all();
+			}
+
+			void wait(uint32_t count)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&] { return rows >= count; });
+			}
+
+			// JpegRowHook callback
+			static void publish_rows(void* context, uint32_t count)
+			{
+				static_cast<AlphaProgress*>(context)->publish(count);
+			}
+		};
+
+		//! rows between progress updates of the PNG alpha decoder
+		static const uint32_t alpha_publish_rows = 16;
+
+		//! drains an inflate stream, feeding the IDAT payloads as it runs out of input
+		struct SpanInflater
+		{
+			common::InflateStream&				 stream;
+			const std::vector<common::ByteSpan>& spans;
+			size_t								 next;
+
+			//! fills out completely, returns false if the data is corrupt or too short
+			bool read(uint8_t* out, size_t size)
+			{
+				while (size > 0)
+				{
+					size_t				  written = 0;
+					common::InflateStatus status  = stream.drain(out, size, &written);
+					out += written;
+					size -= written;
+					if (status == common::InflateStatus::NeedsInput && size > 0)
+					{
+						if (next == spans.size() || stream.feed(spans[next].data, spans[next].size) != 0)
+						{
+							return false;
+						}
+						++next;
+					}
+					else if (status != common::InflateStatus::Ok && size > 0)
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+		};
+
+		//! decodes the greyscale PNG alpha image into the alpha bytes of the rgba8 output
+		//! scanlines are inflated and unfiltered one at a time
+		int decode_png_alpha(const DecoderInfo& info, const DecodeOptions& options, uint8_t* dst, size_t stride, AlphaProgress* progress)
+		{
+			if (info.alphaInterlaceMethod != 0)
+			{
+				return -1;
+			}
+
+			common::InflateStream stream;
+			if (stream.reset(options.inflatestream ? options.inflatestream : &common::builtin_inflatestream,
+							 options.inflatestreamSettings)
+				!= 0)
+			{
+				return -1;
+			}
+
+			const uint8_t depth		= info.alphaSampleDepth;
+			const size_t  linesize  = (size_t(info.width) * depth + 7) / 8;
+			const size_t  bytewidth = depth == 16 ? 2 : 1;
+			const uint8_t scale		= depth < 8 ? uint8_t(255 / ((1 << depth) - 1)) : 1;
+
+			// filter byte + scanline, twice, and the zeroes preceding the first scanline
+			std::vector<uint8_t> buffer(3 * (linesize + 1), 0);
+			const uint8_t*		 precon = buffer.data() + 2 * (linesize + 1) + 1;
+			SpanInflater		 inflater{stream, info.alphaData, 0};
+
+			XNG_STAGE_TOTAL(inflateTotal, Inflate);
+			XNG_STAGE_TOTAL(unfilterTotal, Unfilter);
+			for (uint32_t y = 0; y < info.height; ++y)
+			{
+				uint8_t* line = buffer.data() + (y & 1) * (linesize + 1);
+				{
+					XNG_STAGE_SECTION(inflateTotal, linesize + 1);
+					if (!inflater.read(line, linesize + 1))
+					{
+						return -1;
+					}
+				}
+				{
+					XNG_STAGE_SECTION(unfilterTotal, linesize);
+					if (common::unfilter_scanline(line + 1, precon, bytewidth, line[0], linesize) != 0)
+					{
+						return -1;
+					}
+				}
+
+				const uint8_t* recon = line + 1;
+				uint8_t*	   alpha = dst + size_t(y) * stride + 3;
+				if (depth == 8)
+				{
+					for (uint32_t x = 0; x < info.width; ++x)
+					{
+						alpha[size_t(x) * 4] = recon[x];
+					}
+				}
+				else if (depth == 16)
+				{
+					for (uint32_t x = 0; x < info.width; ++x)
+					{
+						alpha[size_t(x) * 4] = recon[size_t(x) * 2];
+					}
+				}
+				else
+				{
+					const uint32_t perByte = 8 / depth;
+					const uint8_t  mask	= uint8_t((1 << depth) - 1);
+					for (uint32_t x = 0; x < info.width; ++x)
+					{
+						const uint32_t shift = 8 - depth - (x % perByte) * depth;
+						alpha[size_t(x) * 4] = uint8_t(((recon[x / perByte] >> shift) & mask) * scale);
+					}
+				}
+				precon = recon;
+
+				if (progress && (y + 1) % alpha_publish_rows == 0)
+				{
+					progress->publish(y + 1);
+				}
+			}
+			return 0;
+		}
+
+		//! decodes the alpha channel (IDAT or JDAA) into the alpha bytes of the rgba8 output
+		//! progress: receives the rows written, nullptr if not decoding concurrently
+		int decode_alpha(const DecoderInfo& info, const DecodeOptions& options, uint8_t* dst, size_t stride, AlphaProgress* progress)
+		{
+			if (info.alphaCompression == AlphaCompression::PNG)
+			{
+				return decode_png_alpha(info, options, dst, stride, progress);
+			}
+
+			common::JpegInfo alpha;
+			if (common::read_jpeg_info(info.alphaData.data(), info.alphaData.size(), &alpha) != 0 || alpha.width != info.width
+				|| alpha.height != info.height)
+			{
+				return -1;
+			}
+
+			const common::JpegRowHook hook = {nullptr, AlphaProgress::publish_rows, progress};
+			return common::decode_jpeg(info.alphaData.data(), info.alphaData.size(), common::JpegTarget::Alpha, dst, stride,
+									   progress ? &hook : nullptr);
+		}
+
+
+		//! the alpha decode running concurrently to the color decode, as a pool task or on a thread of its
+		//! own. whichever side gets to it first runs it: the color decoder runs it itself if it needs alpha
+		//! rows before the task started, so it never waits for a free worker
+		struct AlphaTask
+		{
+			const DecoderInfo*	 info;
+			const DecodeOptions* options;
+			uint8_t*			 dst;
+			size_t				 stride;
+			AlphaProgress		 progress;
+			std::atomic<bool>	 isClaimed{false};
+			int					 result = -1;
+
+			common::TaskStatsHooks statHooks = common::capture_statshooks();	// of the color decoder
+			common::DecodeStats	   stats;
+
+			//! decodes the alpha channel unless it is already claimed. doesn't throw
+			void run()
+			{
+				if (isClaimed.exchange(true))
+				{
+					return;
+				}
+
+				{
+					common::TaskStatsScope scope(statHooks, &stats);
+					try
+					{
+						result = decode_alpha(*info, *options, dst, stride, &progress);
+					}
+					catch (...)
+					{
+						result = -1;
+					}
+				}
+				progress.publish(UINT32_MAX);	// done or failed, release the color decoder either way
+			}
+
+			//! claims the alpha decode without running it, e.g. after the color decode failed
+			void cancel()
+			{
+				if (!isClaimed.exchange(true))
+				{
+					progress.publish(UINT32_MAX);
+				}
+			}
+
+			// JpegRowHook callback of the color decoder
+			static void wait_rows(void* context, uint32_t count)
+			{
+				AlphaTask* task = static_cast<AlphaTask*>(context);
+				task->run();
+				task->progress.wait(count);
+			}
+		};
+
+		//! joins the alpha thread when leaving the scope, also when unwinding
+		struct ThreadJoiner
+		{
+			std::thread& thread;
+
+			~ThreadJoiner()
+			{
+				if (thread.joinable())
+				{
+					thread.join();
+				}
+			}
+		};
+
+		//! waits for the alpha task when leaving the scope, also when unwinding
+		struct TaskWaiter
+		{
+			common::ThreadPool* pool;
+			common::TaskGroup&	group;
+
+			~TaskWaiter()
+			{
+				if (pool)
+				{
+					pool->wait(&group);
+				}
+			}
+		};
+
+		//! adds the stats of the alpha decode to the scope of the color decoder when leaving the scope, once
+		//! the alpha decode is joined
+		struct AlphaStatsMerger
+		{
+			AlphaTask& alpha;
+
+			~AlphaStatsMerger()
+			{
+				if (common::StatsScope* scope = common::current_statsscope())
+				{
+					common::add_stats(scope->stats, alpha.stats);
+				}
+			}
+		};
+
+		//! decodes color and alpha concurrently
+		int decode_concurrently(const DecoderInfo& info, const DecodeOptions& options, uint8_t* dst, size_t stride)
+		{
+			AlphaTask alpha;
+			alpha.info	  = &info;
+			alpha.options = &options;
+			alpha.dst	  = dst;
+			alpha.stride  = stride;
+
+			AlphaStatsMerger  merger{alpha};	// declared before the joiners, runs after them
+			std::thread		  thread;
+			common::TaskGroup group;
+			ThreadJoiner	  joiner{thread};
+			TaskWaiter		  waiter{options.pool, group};
+			if (options.pool)
+			{
+				options.pool->submit(&group, [&alpha] { alpha.run(); });
+			}
+			else
+			{
+				try
+				{
+					thread = std::thread([&alpha] { alpha.run(); });
+				}
+				catch (const std::system_error&)
+				{
+					// no thread available, the color decoder runs the alpha decode first
+				}
+			}
+
+			int colorResult = -1;
+			try
+			{
+				const common::JpegRowHook hook = {AlphaTask::wait_rows, nullptr, &alpha};
+				colorResult = common::decode_jpeg(info.colorData.data(), info.colorData.size(), common::JpegTarget::RGB, dst, stride, &hook);
+			}
+			catch (...)
+			{
+				alpha.cancel();
+				throw;
+			}
+
+			if (colorResult != 0)
+			{
+				alpha.cancel();
+				return -1;
+			}
+			alpha.run();
+			alpha.progress.wait(UINT32_MAX);
+			return alpha.result == 0 ? 0 : -1;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! decode
+
+		int check_size(const DecoderInfo& info)
+		{
+			if (info.sampleDepth == 12 || info.colorData.empty())
+			{
+				// only the 8 bit stream is supported
+				return -1;
+			}
+
+			common::JpegInfo jpeg;
+			if (common::read_jpeg_info(info.colorData.data(), info.colorData.size(), &jpeg) != 0
+				|| jpeg.width != info.width || jpeg.height != info.height)
+			{
+				return -1;
+			}
+			return 0;
+		}
+
+		int decode_into(const DecoderInfo& info, const DecodeOptions& options, uint8_t* dst, size_t stride)
+		{
+			assert(dst);
+			if (check_size(info) != 0)
+			{
+				return -1;
+			}
+
+			if (!has_alpha(info.colorType))
+			{
+				return common::decode_jpeg(info.colorData.data(), info.colorData.size(), common::JpegTarget::RGBA, dst, stride);
+			}
+
+			if (options.concurrentAlpha)
+			{
+				return decode_concurrently(info, options, dst, stride);
+			}
+
+			if (decode_alpha(info, options, dst, stride, nullptr) != 0)
+			{
+				return -1;
+			}
+			return common::decode_jpeg(info.colorData.data(), info.colorData.size(), common::JpegTarget::RGB, dst, stride);
+		}
+
+		int decode(const DecoderInfo& info, const DecodeOptions& options, Document* document)
+		{
+			assert(document);
+			if (check_size(info) != 0)
+			{
+				document->frames.clear();
+				return -1;
+			}
+
+			document->width  = info.width;
+			document->height = info.height;
+			document->frames.resize(1);
+
+			Frame& frame   = document->frames.front();
+			frame.duration = 0.0f;
+			frame.imagedata.resize(size_t(info.width) * info.height * 4);
+			if (decode_into(info, options, frame.imagedata.data(), size_t(info.width) * 4) != 0)
+			{
+				document->frames.clear();
+				return -1;
+			}
+			return 0;
+		}
+
+	}	// namespace jng
+}	// namespace xng
@@ -2,6 +2,8 @@
 #define XNG_JNG_H_INC
 
 #include "xng/xng.h"
+#include "xng/common/xng_common.h"
+#include "xng/common/xng_pool.h"
 
 #include <cctype>
 #include <vector>
@@ -10,17 +12,123 @@ namespace xng
 {
 	namespace jng
 	{
+		//-------------------------------------------------------------------------
+		//! enums used in intermediate structures
+
+		enum class ColorType : uint8_t
+		{
+			GREY	   = 8,
+			COLOR	  = 10,	// YCbCr
+			GREY_ALPHA = 12,
+			COLOR_ALPHA = 14,
+		};
+
+		enum class AlphaCompression : uint8_t
+		{
+			PNG  = 0,	// IDAT, greyscale PNG image data
+			JPEG = 8,	// JDAA, greyscale JPEG
+		};
+
+		//-------------------------------------------------------------------------
+		//! intermediate container
+
+		struct DecoderInfo
+		{
+			// JHDR
+			uint32_t		 width;
+			uint32_t		 height;
+			ColorType		 colorType;
+			uint8_t			 sampleDepth;		// 8, 12, or 20 (8 bit and 12 bit streams separated by JSEP)
+			uint8_t			 compressionMethod;
+			uint8_t			 interlaceMethod;	// 0: sequential, 8: progressive JPEG
+			uint8_t			 alphaSampleDepth;	// 0 without alpha, 1, 2, 4, 8, 16 for PNG, 8 for JPEG
+			AlphaCompression alphaCompression;
+			uint8_t			 alphaFilterMethod;
+			uint8_t			 alphaInterlaceMethod;
+
+			// JDAT payloads of the 8 bit stream, views into the chunk data
+			std::vector<common::ByteSpan> colorData;
+
+			// IDAT or JDAA payloads, views into the chunk data
+			std::vector<common::ByteSpan> alphaData;
+
+			// JSEP
+			bool hasSeparator;
+		};
+
+		//-------------------------------------------------------------------------
+		//! final data structures
 
 		struct Frame
 		{
+			float				 duration;	 // seconds, 0 for single images
+			std::vector<uint8_t> imagedata;	// rgba8
 		};
 
 		struct Document
 		{
+			uint32_t width;
+			uint32_t height;
 
 			std::vector<Frame> frames;
 		};
 
+		//-------------------------------------------------------------------------
+		//! decoding
+
+		struct DecodeOptions
+		{
+			// zlib stream decompression for IDAT alpha, see png::DecodeOptions
+			// nullptr: the built-in streaming inflate
+			const common::inflatestream_t* inflatestream		 = nullptr;
+			void*						   inflatestreamSettings = nullptr;
+
+			// decode the alpha channel on a second thread while the color is decoded on the calling one
+			bool concurrentAlpha = true;
+
+			// runs the concurrent alpha decode as a task of the pool, nullptr for a thread of its own
+			common::ThreadPool* pool = nullptr;
+		};
+
+		//! read_decoderinfo
+		//! interpretes the chunks into the intermediate container
+		//! JDAT/IDAT/JDAA payloads are kept as views into the chunk data, so the chunks must outlive
+		//! the decoder info
+		//! param[in] chunks: chunks as read by xng::read_chunks, starting with JHDR
+		//! param[out] info: decoder info to fill
+		//! returns 0 on success
+		int read_decoderinfo(const std::vector<chunk_t>& chunks, DecoderInfo* info);
+
+		//! read_decoderinfo
+		//! same for count chunks starting at chunks, e.g. an image embedded in a MNG
+		int read_decoderinfo(const chunk_t* chunks, size_t count, DecoderInfo* info);
+
+		//! check_size
+		//! checks the JHDR size against the frame header of the color stream, before output memory for
+		//! the claimed size is allocated
+		//! param[in] info: decoder info as filled by read_decoderinfo
+		//! returns 0 if they match, -1 for corrupt or unsupported (12 bit only) images
+		int check_size(const DecoderInfo& info);
+
+		//! decode
+		//! decodes the image to a single rgba8 frame
+		//! param[in] info: decoder info as filled by read_decoderinfo
+		//! param[in] options: inflate backend for the alpha channel
+		//! param[out] document: decoded document
+		//! returns 0 on success, -1 for corrupt or unsupported (progressive, 12 bit only) images
+		int decode(const DecoderInfo& info, const DecodeOptions& options, Document* document);
+
+		//! decode_into
+		//! decodes the image as rgba8 into caller memory
+		//! the alpha decoder writes the alpha bytes of the output directly, the color conversion merges
+		//! them into whole pixels once their rows are done, so there is no separate alpha plane
+		//! param[in] info: decoder info as filled by read_decoderinfo
+		//! param[in] options: inflate backend for the alpha channel
+		//! param[out] dst: output pixels, width x height
+		//! param[in] stride: distance between rows in bytes
+		//! returns 0 on success
+		int decode_into(const DecoderInfo& info, const DecodeOptions& options, uint8_t* dst, size_t stride);
+
 	}	// namespace jng
 
 	using JNGFrame	= jng::Frame;
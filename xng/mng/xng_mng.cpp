@@ -0,0 +1,1910 @@
+#include "xng_mng.h"
+#include "xng/common/xng_lz.h"
+#include "xng/common/xng_stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <set>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XNG_SSE2 1
+#else
+#define XNG_SSE2 0
+#endif	// defined(__SSE2__) || defined(_M_X64)
+
+namespace xng
+{
+	namespace mng
+	{
+		static const uint32_t infinite_iterations = 0x7FFFFFFF;
+
+		///////////////////////////////////////////////////////////////////////////
+		//! chunk data helpers
+
+		inline Playback* as_playback(void* target)
+		{
+			assert(target);
+			return static_cast<Playback*>(target);
+		}
+
+		//! reads the fields of a chunk in order, fields past the end of the data keep their default
+		//! (many MNG chunks have optional trailing fields)
+		struct FieldReader
+		{
+			const uint8_t* data_iter;
+			const uint8_t* end;
+
+			explicit FieldReader(const chunk_t* chunk)
+			  : data_iter(chunk->data.data())
+			  , end(chunk->data.data() + chunk->data.size())
+			{
+			}
+
+			bool has(size_t size) const
+			{
+				return size_t(end - data_iter) >= size;
+			}
+
+			uint8_t read_uint8(uint8_t value)
+			{
+				return has(1) ? read_uint8_t(data_iter, &data_iter) : value;
+			}
+
+			uint16_t read_uint16(uint16_t value)
+			{
+				return has(2) ? read_uint16_t(data_iter, &data_iter) : value;
+			}
+
+			uint32_t read_uint32(uint32_t value)
+			{
+				return has(4) ? read_uint32_t(data_iter, &data_iter) : value;
+			}
+
+			int32_t read_int32(int32_t value)
+			{
+				return has(4) ? read_int32_t(data_iter, &data_iter) : value;
+			}
+
+			//! left, right, top, bottom
+			bool read_rect(Rect* rect)
+			{
+				if (!has(16))
+				{
+					return false;
+				}
+				rect->left   = read_int32_t(data_iter, &data_iter);
+				rect->right  = read_int32_t(data_iter, &data_iter);
+				rect->top	= read_int32_t(data_iter, &data_iter);
+				rect->bottom = read_int32_t(data_iter, &data_iter);
+				return true;
+			}
+		};
+
+		inline bool is_per_layer(FramingMode mode)
+		{
+			return mode == FramingMode::Layers || mode == FramingMode::LayersOnBackground;
+		}
+
+		inline bool is_empty(const Rect& rect)
+		{
+			return rect.left >= rect.right || rect.top >= rect.bottom;
+		}
+
+		inline Rect intersect(const Rect& a, const Rect& b)
+		{
+			return {std::max(a.left, b.left), std::min(a.right, b.right), std::max(a.top, b.top), std::min(a.bottom, b.bottom)};
+		}
+
+		//! bounding box of both
+		inline Rect unite(const Rect& a, const Rect& b)
+		{
+			if (is_empty(a))
+			{
+				return is_empty(b) ? Rect{0, 0, 0, 0} : b;
+			}
+			if (is_empty(b))
+			{
+				return a;
+			}
+			return {std::min(a.left, b.left), std::max(a.right, b.right), std::min(a.top, b.top), std::max(a.bottom, b.bottom)};
+		}
+
+		//! delta type 0: absolute, 1: relative to the current value
+		inline int32_t apply_delta(uint8_t deltaType, int32_t current, int32_t value)
+		{
+			return deltaType == 0 ? value : int32_t(uint32_t(current) + uint32_t(value));
+		}
+
+		inline Rect apply_delta(uint8_t deltaType, const Rect& current, const Rect& value)
+		{
+			return {apply_delta(deltaType, current.left, value.left), apply_delta(deltaType, current.right, value.right),
+					apply_delta(deltaType, current.top, value.top), apply_delta(deltaType, current.bottom, value.bottom)};
+		}
+
+		//! returns the index of the IEND closing the image starting at first, chunks.size() if missing
+		inline size_t find_iend(const std::vector<chunk_t>& chunks, size_t first)
+		{
+			for (size_t i = first; i < chunks.size(); ++i)
+			{
+				if (memcmp(chunks[i].id.type, "IEND", sizeof(chunkid_t)) == 0)
+				{
+					return i;
+				}
+			}
+			return chunks.size();
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! composition
+
+		inline void blend_over(uint8_t* target, const uint8_t* source)
+		{
+			const uint32_t sa = source[3];
+			if (sa == 255)
+			{
+				memcpy(target, source, 4);
+				return;
+			}
+			if (sa == 0)
+			{
+				return;
+			}
+
+			// out_a = sa + da * (1 - sa), out_c = (sc * sa + dc * da * (1 - sa)) / out_a
+			const uint32_t da	= target[3] * (255 - sa) / 255;
+			const uint32_t outa = sa + da;
+			for (int c = 0; c < 3; ++c)
+			{
+				target[c] = uint8_t((source[c] * sa + target[c] * da + outa / 2) / outa);
+			}
+			target[3] = uint8_t(outa);
+		}
+
+		void clear_canvas(Playback& p)
+		{
+			uint32_t pixel;
+			memcpy(&pixel, p.background, 4);
+			for (size_t i = 0; i < p.canvas.size(); i += 4)
+			{
+				memcpy(&p.canvas[i], &pixel, 4);
+			}
+			p.dirty = {0, int32_t(p.header.frameWidth), 0, int32_t(p.header.frameHeight)};
+		}
+
+		//! composes the object onto the canvas as a new layer
+		void show_object(Playback& p, const Object& object)
+		{
+			if (!object.image || !object.image->buffer)
+			{
+				return;
+			}
+
+			if (p.framingMode == FramingMode::LayersOnBackground
+				|| (p.framingMode == FramingMode::SubframeOnBackground && !p.hasPendingLayers))
+			{
+				clear_canvas(p);
+			}
+
+			const ImageBuffer& image = *object.image->buffer;
+			const Rect		   canvasRect{0, int32_t(p.header.frameWidth), 0, int32_t(p.header.frameHeight)};
+			const Rect		   imageRect{object.x, int32_t(int64_t(object.x) + image.width), object.y,
+								 int32_t(int64_t(object.y) + image.height)};
+
+			Rect rect = intersect(intersect(imageRect, p.subframeClip), canvasRect);
+			if (object.hasClip)
+			{
+				rect = intersect(rect, object.clip);
+			}
+
+			XNG_STAGE(Composition, is_empty(rect) ? 0 : size_t(rect.right - rect.left) * size_t(rect.bottom - rect.top) * 4);
+			for (int32_t y = rect.top; y < rect.bottom; ++y)
+			{
+				uint8_t*	   target = &p.canvas[(size_t(y) * p.header.frameWidth + size_t(rect.left)) * 4];
+				const uint8_t* source = &image.rgba[(size_t(int64_t(y) - object.y) * image.width + size_t(int64_t(rect.left) - object.x)) * 4];
+				for (int32_t x = rect.left; x < rect.right; ++x, target += 4, source += 4)
+				{
+					blend_over(target, source);
+				}
+			}
+			p.dirty = unite(p.dirty, rect);
+
+			++p.layerCount;
+			p.hasPendingLayers = true;
+			if (is_per_layer(p.framingMode))
+			{
+				p.isFrameReady	 = true;
+				p.frameDelay	   = p.subframeDelay;
+				p.hasPendingLayers = false;
+			}
+		}
+
+		//! completes the frame of the current subframe, if any layers were shown
+		void finish_subframe(Playback& p)
+		{
+			if (p.hasPendingLayers && !is_per_layer(p.framingMode))
+			{
+				p.isFrameReady	 = true;
+				p.frameDelay	   = p.subframeDelay;
+				p.hasPendingLayers = false;
+			}
+		}
+
+		//! state at the start of the chunks after MHDR (and after TERM when repeating)
+		void reset_state(Playback& p)
+		{
+			p.objects.clear();
+			p.loops.clear();
+			p.defaultObjectId = 0;
+			p.defaultObject	  = Object();
+			p.showResume	  = 0;
+			p.hasPendingLayers = false;
+			clear_canvas(p);
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! chunk handlers
+		//-- p.next already points past the chunk, handlers jump by changing it
+
+		int handle_MHDR(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() < 12)
+			{
+				return -1;
+			}
+
+			FieldReader reader(chunk);
+			Header&		header		 = p->header;
+			header.frameWidth		 = reader.read_uint32(0);
+			header.frameHeight		 = reader.read_uint32(0);
+			header.ticksPerSecond	= reader.read_uint32(0);
+			header.nominalLayerCount = reader.read_uint32(0);
+			header.nominalFrameCount = reader.read_uint32(0);
+			header.nominalPlayTime   = reader.read_uint32(0);
+			header.simplicityProfile = reader.read_uint32(0);
+			if (header.frameWidth == 0 || header.frameHeight == 0 || header.frameWidth > INT32_MAX || header.frameHeight > INT32_MAX
+				|| uint64_t(header.frameWidth) * header.frameHeight > p->options.maxFramePixels)
+			{
+				return -1;
+			}
+
+			p->canvas.resize(size_t(header.frameWidth) * header.frameHeight * 4);
+			p->defaultClip  = {0, int32_t(header.frameWidth), 0, int32_t(header.frameHeight)};
+			p->subframeClip = p->defaultClip;
+			reset_state(*p);
+			return 0;
+		}
+
+		int handle_MEND(const chunk_t*, void* target)
+		{
+			auto p = as_playback(target);
+			finish_subframe(*p);
+
+			if (p->termination == TerminationAction::Repeat && p->terminationIterations > 1 && p->layerCount > 0)
+			{
+				if (p->terminationIterations != infinite_iterations)
+				{
+					--p->terminationIterations;
+				}
+				reset_state(*p);
+				p->next = p->terminationRestart;
+				return 0;
+			}
+
+			p->isEnded = true;
+			return 0;
+		}
+
+		int handle_TERM(const chunk_t* chunk, void* target)
+		{
+			auto		p = as_playback(target);
+			FieldReader reader(chunk);
+			p->termination = TerminationAction(reader.read_uint8(0));
+			reader.read_uint8(0);	// action after iterations
+			reader.read_uint32(0);	// delay
+			p->terminationIterations = reader.read_uint32(infinite_iterations);
+			p->terminationRestart	= p->next;
+			if (uint8_t(p->termination) > uint8_t(TerminationAction::Repeat))
+			{
+				return -1;
+			}
+			return 0;
+		}
+
+		int handle_BACK(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() < 6)
+			{
+				return -1;
+			}
+
+			FieldReader reader(chunk);
+			p->background[0] = uint8_t(reader.read_uint16(0) >> 8);
+			p->background[1] = uint8_t(reader.read_uint16(0) >> 8);
+			p->background[2] = uint8_t(reader.read_uint16(0) >> 8);
+			p->background[3] = 0xFF;
+			if (p->layerCount == 0)
+			{
+				clear_canvas(*p);
+			}
+			return 0;
+		}
+
+		int handle_FRAM(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+
+			// the layers shown so far make up the frame of the ending subframe
+			finish_subframe(*p);
+
+			FieldReader reader(chunk);
+			const uint8_t mode = reader.read_uint8(0);
+			if (mode > 4)
+			{
+				return -1;
+			}
+			if (mode != 0)
+			{
+				p->framingMode = FramingMode(mode);
+			}
+
+			// subframe name
+			while (reader.has(1) && reader.read_uint8(0) != 0)
+			{
+			}
+
+			const uint8_t changeDelay   = reader.read_uint8(0);
+			const uint8_t changeTimeout = reader.read_uint8(0);
+			const uint8_t changeClip	= reader.read_uint8(0);
+			reader.read_uint8(0);	// change sync id list
+
+			p->subframeDelay = p->defaultDelay;
+			p->subframeClip  = p->defaultClip;
+			if (changeDelay != 0)
+			{
+				p->subframeDelay = reader.read_uint32(p->defaultDelay);
+				if (changeDelay == 2)
+				{
+					p->defaultDelay = p->subframeDelay;
+				}
+			}
+			if (changeTimeout != 0)
+			{
+				reader.read_uint32(0);	// timeout, user input is not supported
+			}
+			if (changeClip != 0)
+			{
+				const uint8_t deltaType = reader.read_uint8(0);
+				Rect		  clip;
+				if (!reader.read_rect(&clip))
+				{
+					return -1;
+				}
+				p->subframeClip = apply_delta(deltaType, p->defaultClip, clip);
+				if (changeClip == 2)
+				{
+					p->defaultClip = p->subframeClip;
+				}
+			}
+			return 0;
+		}
+
+		int handle_DEFI(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() < 2)
+			{
+				return -1;
+			}
+
+			FieldReader reader(chunk);
+			Object		object;
+			p->defaultObjectId = reader.read_uint16(0);
+			object.isVisible   = reader.read_uint8(0) == 0;
+			object.isConcrete  = reader.read_uint8(0) != 0;
+			object.x		   = reader.read_int32(0);
+			object.y		   = reader.read_int32(0);
+			object.hasClip	 = reader.read_rect(&object.clip);
+			p->defaultObject   = object;
+			return 0;
+		}
+
+		//! decodes the PNG or JNG image of chunks [first, last] to rgba8
+		int decode_embedded(const Playback& p, size_t first, size_t last, ImageBuffer* buffer)
+		{
+			const std::vector<chunk_t>& chunks = *p.chunks;
+			buffer->isPNG					   = memcmp(chunks[first].id.type, "IHDR", sizeof(chunkid_t)) == 0;
+			buffer->hasColorKey				   = false;
+			buffer->indices.clear();
+			buffer->sourceFirst = first;
+			buffer->sourceCount = last + 1 - first;
+
+			if (buffer->isPNG)
+			{
+				png::DecoderInfo info;
+				if (png::read_decoderinfo(&chunks[first], last + 1 - first, &info) != 0)
+				{
+					return -1;
+				}
+
+				png::DecodeOptions options = p.options.png;
+				options.region			   = {0, 0, 0, 0};
+				options.targetWidth		   = 0;
+				options.targetHeight	   = 0;
+				options.format			   = png::PixelFormat::RGBA8;
+				// validates the size against the image data before allocating
+				if (png::get_output_size(info, options, &buffer->width, &buffer->height) != 0)
+				{
+					return -1;
+				}
+				buffer->rgba.resize(size_t(info.width) * info.height * 4);
+				if (png::decode_into(info, options, buffer->rgba.data(), size_t(info.width) * 4) != 0)
+				{
+					return -1;
+				}
+
+				buffer->colorType = info.colorType;
+				buffer->bitdepth  = info.bitdepth;
+				buffer->palette.assign(info.palette.colors.begin(), info.palette.colors.end());
+				if (info.colorType != png::ColorType::PALETTE && info.transparency.isDefined && !info.transparency.alphas.empty())
+				{
+					// grey keys have one sample
+					const auto& key		  = info.transparency.alphas;
+					buffer->hasColorKey	  = true;
+					buffer->colorKey[0]	  = key[0];
+					buffer->colorKey[1]	  = key.size() == 3 ? key[1] : key[0];
+					buffer->colorKey[2]	  = key.size() == 3 ? key[2] : key[0];
+				}
+				return 0;
+			}
+
+			jng::DecoderInfo info;
+			if (jng::read_decoderinfo(&chunks[first], last + 1 - first, &info) != 0 || jng::check_size(info) != 0)
+			{
+				return -1;
+			}
+
+			buffer->width  = info.width;
+			buffer->height = info.height;
+			buffer->rgba.resize(size_t(info.width) * info.height * 4);
+			return jng::decode_into(info, p.options.jng, buffer->rgba.data(), size_t(info.width) * 4);
+		}
+
+		//! IHDR and JHDR: decodes the embedded image up to IEND into the default object
+		int handle_image(const chunk_t*, void* target)
+		{
+			auto		 p	   = as_playback(target);
+			const size_t first = p->next - 1;
+			const size_t last  = find_iend(*p->chunks, first);
+			if (last == p->chunks->size())
+			{
+				return -1;
+			}
+
+			auto buffer = std::make_shared<ImageBuffer>();
+			if (decode_embedded(*p, first, last, buffer.get()) != 0)
+			{
+				return -1;
+			}
+
+			Object object		 = p->defaultObject;
+			object.image		 = std::make_shared<ImageRef>();
+			object.image->buffer = std::move(buffer);
+			if (p->defaultObjectId != 0)
+			{
+				// object 0 is shown, but not kept
+				p->objects[p->defaultObjectId] = object;
+			}
+			if (object.isVisible)
+			{
+				show_object(*p, object);
+			}
+
+			p->next = last + 1;
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! delta-PNG
+		//-- deltas are applied to the rgba8 pixels of the object in place, in the sample space of the
+		//-- source image: 8 bit samples map 1:1, sub-byte grey samples are rescaled, palette images
+		//-- keep their indices. 16 bit images only keep their high bytes, additions there lose the carry
+		//-- of the low bytes
+
+		//! per-byte dst += src & mask, mask repeating every pixel
+		inline void add_pixels(uint8_t* dst, const uint8_t* src, uint32_t count, const uint8_t mask[4])
+		{
+			uint32_t i = 0;
+#if XNG_SSE2
+			int32_t maskBits;
+			memcpy(&maskBits, mask, 4);
+			const __m128i vmask = _mm_set1_epi32(maskBits);
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+				const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_add_epi8(d, _mm_and_si128(s, vmask)));
+			}
+#endif	// XNG_SSE2
+			for (; i < count; ++i)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					dst[i * 4 + c] = uint8_t(dst[i * 4 + c] + (src[i * 4 + c] & mask[c]));
+				}
+			}
+		}
+
+		//! per-byte dst = (dst & ~mask) | (src & mask), mask repeating every pixel
+		inline void replace_pixels(uint8_t* dst, const uint8_t* src, uint32_t count, const uint8_t mask[4])
+		{
+			uint32_t i = 0;
+#if XNG_SSE2
+			int32_t maskBits;
+			memcpy(&maskBits, mask, 4);
+			const __m128i vmask = _mm_set1_epi32(maskBits);
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+				const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_andnot_si128(vmask, d), _mm_and_si128(s, vmask)));
+			}
+#endif	// XNG_SSE2
+			for (; i < count; ++i)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					dst[i * 4 + c] = uint8_t((dst[i * 4 + c] & ~mask[c]) | (src[i * 4 + c] & mask[c]));
+				}
+			}
+		}
+
+		//! factor from sub-byte grey samples to 8 bit
+		inline uint8_t sample_scale(uint8_t bitdepth)
+		{
+			return bitdepth < 8 ? uint8_t(255 / ((1u << bitdepth) - 1)) : 1;
+		}
+
+		//! palette mapping index i to (i, i, i, 0xFF), so decoding yields the indices
+		inline void identity_palette(uint8_t bitdepth, std::pmr::vector<uint32_t>* colors)
+		{
+			colors->resize(size_t(1) << bitdepth);
+			for (uint32_t i = 0; i < colors->size(); ++i)
+			{
+				(*colors)[i] = i << 24 | i << 16 | i << 8 | 0xFF;
+			}
+		}
+
+		//! reads the indices of a palette image from its source chunks
+		int read_indices(const Playback& p, ImageBuffer* image)
+		{
+			if (!image->indices.empty())
+			{
+				return 0;
+			}
+
+			png::DecoderInfo info;
+			if (png::read_decoderinfo(&(*p.chunks)[image->sourceFirst], image->sourceCount, &info) != 0)
+			{
+				return -1;
+			}
+			identity_palette(info.bitdepth, &info.palette.colors);
+
+			png::DecodeOptions options = p.options.png;
+			options.region			   = {0, 0, 0, 0};
+			options.targetWidth		   = 0;
+			options.targetHeight	   = 0;
+			options.format			   = png::PixelFormat::RGBA8;
+			std::vector<uint8_t> rgba(image->rgba.size());
+			if (png::decode_into(info, options, rgba.data(), size_t(image->width) * 4) != 0)
+			{
+				return -1;
+			}
+
+			image->indices.resize(size_t(image->width) * image->height);
+			for (size_t i = 0; i < image->indices.size(); ++i)
+			{
+				image->indices[i] = rgba[i * 4];
+			}
+			return 0;
+		}
+
+		//! rgba of pixels [first, first + count) from their indices
+		inline void map_indices(ImageBuffer& image, size_t first, uint32_t count)
+		{
+			const uint32_t colorCount = uint32_t(image.palette.size());
+			for (size_t i = first; i < first + count; ++i)
+			{
+				const uint8_t  index = image.indices[i];
+				const uint32_t color = index < colorCount ? image.palette[index] : 0x000000FF;
+				uint8_t*	   rgba	 = &image.rgba[i * 4];
+				rgba[0]				 = uint8_t(color >> 24);
+				rgba[1]				 = uint8_t(color >> 16);
+				rgba[2]				 = uint8_t(color >> 8);
+				rgba[3]				 = uint8_t(color);
+			}
+		}
+
+		//! alpha of grey and truecolor pixels with tRNS, from their color
+		inline void apply_color_key(ImageBuffer& image, size_t first, uint32_t count)
+		{
+			// 16 bit keys are compared by their high byte
+			const uint8_t scale = sample_scale(image.bitdepth);
+			uint8_t		  key[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				key[c] = image.bitdepth == 16 ? uint8_t(image.colorKey[c] >> 8) : uint8_t(image.colorKey[c] * scale);
+			}
+
+			for (size_t i = first; i < first + count; ++i)
+			{
+				uint8_t* rgba = &image.rgba[i * 4];
+				rgba[3]		  = rgba[0] == key[0] && rgba[1] == key[1] && rgba[2] == key[2] ? 0 : 0xFF;
+			}
+		}
+
+		//! state of a delta-PNG datastream, DHDR to IEND
+		struct DeltaState
+		{
+			const Playback*				  playback;
+			ImageBuffer*				  image;
+			DeltaType					  type;
+			Rect						  block;			// in object pixels
+			std::vector<common::ByteSpan> compressedData;	// IDAT payloads of the block
+			Rect						  dirty;
+		};
+
+		inline DeltaState* as_deltastate(void* target)
+		{
+			assert(target);
+			return static_cast<DeltaState*>(target);
+		}
+
+		int handle_delta_IDAT(const chunk_t* chunk, void* target)
+		{
+			auto state = as_deltastate(target);
+			if (!chunk->data.empty())
+			{
+				state->compressedData.push_back({chunk->data.data(), chunk->data.size()});
+			}
+			return 0;
+		}
+
+		int handle_delta_PPLT(const chunk_t* chunk, void* target)
+		{
+			auto		 state = as_deltastate(target);
+			ImageBuffer& image = *state->image;
+			if (!image.isPNG || image.colorType != png::ColorType::PALETTE || chunk->data.empty()
+				|| read_indices(*state->playback, &image) != 0)
+			{
+				return -1;
+			}
+
+			// 0/1: rgb, 2/3: alpha, 4/5: rgba; even: replace, odd: add
+			const uint8_t  deltaType = chunk->data[0];
+			const size_t   firstByte = deltaType < 2 ? 0 : (deltaType < 4 ? 3 : 0);
+			const size_t   byteCount = deltaType < 2 ? 3 : (deltaType < 4 ? 1 : 4);
+			const uint8_t* data_iter = chunk->data.data() + 1;
+			const uint8_t* end		 = chunk->data.data() + chunk->data.size();
+			if (deltaType > 5)
+			{
+				return -1;
+			}
+
+			bool isChanged[256] = {};
+			while (data_iter != end)
+			{
+				if (end - data_iter < 2)
+				{
+					return -1;
+				}
+				const uint8_t first = data_iter[0];
+				const uint8_t last	= data_iter[1];
+				data_iter += 2;
+				if (last < first || size_t(end - data_iter) < (size_t(last) - first + 1) * byteCount)
+				{
+					return -1;
+				}
+				if (last >= image.palette.size())
+				{
+					image.palette.resize(size_t(last) + 1, 0x000000FF);
+				}
+
+				for (uint32_t index = first; index <= last; ++index)
+				{
+					uint8_t color[4];
+					for (int c = 0; c < 4; ++c)
+					{
+						color[c] = uint8_t(image.palette[index] >> (24 - c * 8));
+					}
+					for (size_t c = firstByte; c < firstByte + byteCount; ++c)
+					{
+						color[c] = deltaType % 2 == 0 ? *data_iter : uint8_t(color[c] + *data_iter);
+						++data_iter;
+					}
+					image.palette[index] = uint32_t(color[0]) << 24 | uint32_t(color[1]) << 16 | uint32_t(color[2]) << 8 | color[3];
+					isChanged[index]	 = true;
+				}
+			}
+
+			// remap the pixels of the changed entries only
+			Rect dirty{INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN};
+			for (uint32_t y = 0; y < image.height; ++y)
+			{
+				const size_t row = size_t(y) * image.width;
+				for (uint32_t x = 0; x < image.width; ++x)
+				{
+					if (isChanged[image.indices[row + x]])
+					{
+						map_indices(image, row + x, 1);
+						dirty = {std::min(dirty.left, int32_t(x)), std::max(dirty.right, int32_t(x) + 1),
+								 std::min(dirty.top, int32_t(y)), int32_t(y) + 1};
+					}
+				}
+			}
+			if (!is_empty(dirty))
+			{
+				state->dirty = unite(state->dirty, dirty);
+			}
+			return 0;
+		}
+
+		int handle_delta_DROP(const chunk_t* chunk, void*)
+		{
+			// objects don't keep ancillary chunks, so there is nothing to drop
+			return chunk->data.size() % sizeof(chunkid_t) == 0 ? 0 : -1;
+		}
+
+		inline const chunkhandlerstate_t& delta_chunkhandlers()
+		{
+			static const chunkhandlerstate_t state = {{
+			  chunkhandler_t{{.type = {'I', 'D', 'A', 'T'}}, handle_delta_IDAT},
+			  chunkhandler_t{{.type = {'P', 'P', 'L', 'T'}}, handle_delta_PPLT},
+			  chunkhandler_t{{.type = {'D', 'R', 'O', 'P'}}, handle_delta_DROP},
+			}};
+			return state;
+		}
+
+		//! decodes the IDAT block and applies it to the object
+		int apply_block(DeltaState& state)
+		{
+			ImageBuffer&	image	= *state.image;
+			const DeltaType type	= state.type;
+			const bool		isAdd	= type == DeltaType::AddPixels || type == DeltaType::AddAlpha || type == DeltaType::AddColor;
+			const bool		isAlpha = type == DeltaType::AddAlpha || type == DeltaType::ReplaceAlpha;
+			const bool		isColor = type == DeltaType::AddColor || type == DeltaType::ReplaceColor;
+			const bool hasAlpha = image.colorType == png::ColorType::GREY_ALPHA || image.colorType == png::ColorType::RGBA;
+			if ((isAlpha && !hasAlpha) || state.compressedData.empty())
+			{
+				return -1;
+			}
+
+			// alpha data is greyscale, color data lacks the alpha channel of the image
+			png::DecoderInfo info{};
+			info.width	   = uint32_t(state.block.right - state.block.left);
+			info.height	   = uint32_t(state.block.bottom - state.block.top);
+			info.bitdepth  = image.bitdepth;
+			info.colorType = image.colorType;
+			if (isAlpha || (isColor && image.colorType == png::ColorType::GREY_ALPHA))
+			{
+				info.colorType = png::ColorType::GREY;
+			}
+			else if (isColor && image.colorType == png::ColorType::RGBA)
+			{
+				info.colorType = png::ColorType::RGB;
+			}
+			if (info.colorType == png::ColorType::PALETTE)
+			{
+				identity_palette(info.bitdepth, &info.palette.colors);
+				if (read_indices(*state.playback, &image) != 0)
+				{
+					return -1;
+				}
+			}
+			info.frames.emplace_back();
+			info.frames.back().compressedData.assign(state.compressedData.begin(), state.compressedData.end());
+
+			png::DecodeOptions options = state.playback->options.png;
+			options.region			   = {0, 0, 0, 0};
+			options.targetWidth		   = 0;
+			options.targetHeight	   = 0;
+			options.format			   = png::PixelFormat::RGBA8;
+			// validates the block size against the image data before allocating
+			if (png::get_output_size(info, options, nullptr, nullptr) != 0)
+			{
+				return -1;
+			}
+			std::vector<uint8_t> block(size_t(info.width) * info.height * 4);
+			if (png::decode_into(info, options, block.data(), size_t(info.width) * 4) != 0)
+			{
+				return -1;
+			}
+
+			if (isAlpha)
+			{
+				for (size_t i = 0; i < block.size(); i += 4)
+				{
+					block[i + 3] = block[i];
+				}
+			}
+
+			// the alpha of images without alpha channel follows from tRNS
+			uint8_t mask[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+			if (isAlpha)
+			{
+				mask[0] = mask[1] = mask[2] = 0;
+			}
+			else if (isColor || !hasAlpha)
+			{
+				mask[3] = 0;
+			}
+
+			const Rect	   rect	 = intersect(state.block, {0, int32_t(image.width), 0, int32_t(image.height)});
+			const uint32_t count = is_empty(rect) ? 0 : uint32_t(rect.right - rect.left);
+			const uint8_t  scale = sample_scale(image.bitdepth);
+			for (int32_t y = rect.top; y < rect.bottom && count > 0; ++y)
+			{
+				const size_t   first  = size_t(y) * image.width + size_t(rect.left);
+				const uint8_t* source = &block[(size_t(y - state.block.top) * info.width + size_t(rect.left - state.block.left)) * 4];
+				uint8_t*	   target = &image.rgba[first * 4];
+				if (image.colorType == png::ColorType::PALETTE)
+				{
+					const uint8_t maxIndex = uint8_t((1u << image.bitdepth) - 1);
+					for (uint32_t x = 0; x < count; ++x)
+					{
+						uint8_t& index = image.indices[first + x];
+						index		   = isAdd ? uint8_t((index + source[x * 4]) & maxIndex) : source[x * 4];
+					}
+					map_indices(image, first, count);
+				}
+				else if (isAdd && image.bitdepth < 8)
+				{
+					// sub-byte grey, added in sample space
+					const uint8_t maxSample = uint8_t((1u << image.bitdepth) - 1);
+					for (uint32_t x = 0; x < count; ++x)
+					{
+						const uint8_t v = uint8_t(((target[x * 4] / scale + source[x * 4] / scale) & maxSample) * scale);
+						target[x * 4 + 0] = target[x * 4 + 1] = target[x * 4 + 2] = v;
+					}
+				}
+				else if (isAdd)
+				{
+					add_pixels(target, source, count, mask);
+				}
+				else
+				{
+					replace_pixels(target, source, count, mask);
+				}
+
+				if (image.hasColorKey)
+				{
+					apply_color_key(image, first, count);
+				}
+			}
+
+			state.dirty = unite(state.dirty, rect);
+			return 0;
+		}
+
+		int handle_DHDR(const chunk_t* chunk, void* target)
+		{
+			auto		p = as_playback(target);
+			FieldReader reader(chunk);
+			// the block is width, height, x and y; a partial one is an error
+			if (chunk->data.size() != 4 && chunk->data.size() != 20)
+			{
+				return -1;
+			}
+
+			const uint16_t	objectId  = reader.read_uint16(0);
+			const uint8_t	imageType = reader.read_uint8(0);	// 0: unspecified, 1: PNG, 2: JNG
+			const DeltaType deltaType = DeltaType(reader.read_uint8(0));
+			const bool		hasBlock  = reader.has(16);
+			const uint32_t	blockWidth	= reader.read_uint32(0);
+			const uint32_t	blockHeight = reader.read_uint32(0);
+			const uint32_t	blockX		= reader.read_uint32(0);
+			const uint32_t	blockY		= reader.read_uint32(0);
+
+			const std::vector<chunk_t>& chunks = *p->chunks;
+			const size_t				first  = p->next;
+			const size_t				last   = find_iend(chunks, first);
+			auto						it	   = p->objects.find(objectId);
+			if (last == chunks.size() || it == p->objects.end() || !it->second.image || !it->second.image->buffer
+				|| uint8_t(deltaType) > uint8_t(DeltaType::NoChange) || imageType > 2)
+			{
+				return -1;
+			}
+
+			Object& object = it->second;
+			Rect	dirty{0, 0, 0, 0};
+			if (deltaType == DeltaType::Replace && first < last
+				&& (memcmp(chunks[first].id.type, "IHDR", sizeof(chunkid_t)) == 0 || memcmp(chunks[first].id.type, "JHDR", sizeof(chunkid_t)) == 0))
+			{
+				// a new image, partial clones see it as well
+				auto buffer = std::make_shared<ImageBuffer>();
+				if (decode_embedded(*p, first, last, buffer.get()) != 0)
+				{
+					return -1;
+				}
+				dirty				 = {0, int32_t(buffer->width), 0, int32_t(buffer->height)};
+				object.image->buffer = std::move(buffer);
+			}
+			else
+			{
+				ImageBuffer* image = get_writable_image(&object);
+				if (!image->isPNG && deltaType != DeltaType::NoChange)
+				{
+					// block deltas of JNG images are not supported
+					return -1;
+				}
+
+				DeltaState state{p, image, deltaType, {0, int32_t(image->width), 0, int32_t(image->height)}, {}, {0, 0, 0, 0}};
+				if (deltaType != DeltaType::Replace && deltaType != DeltaType::NoChange)
+				{
+					if (!hasBlock || blockWidth == 0 || blockHeight == 0 || blockWidth > INT32_MAX || blockHeight > INT32_MAX
+						|| blockX > INT32_MAX - blockWidth || blockY > INT32_MAX - blockHeight)
+					{
+						return -1;
+					}
+					state.block = {int32_t(blockX), int32_t(blockX + blockWidth), int32_t(blockY), int32_t(blockY + blockHeight)};
+				}
+
+				for (size_t i = first; i < last; ++i)
+				{
+					if (handle_chunk(chunks[i], delta_chunkhandlers(), &state) != 0)
+					{
+						return -1;
+					}
+				}
+				if (deltaType != DeltaType::NoChange && apply_block(state) != 0)
+				{
+					return -1;
+				}
+				dirty = state.dirty;
+			}
+
+			if (!is_empty(dirty) && p->options.objectChanged)
+			{
+				p->options.objectChanged(p->options.objectChangedContext, objectId, dirty);
+			}
+			if (object.isVisible)
+			{
+				show_object(*p, object);
+			}
+
+			p->next = last + 1;
+			return 0;
+		}
+
+		int handle_CLON(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() < 4)
+			{
+				return -1;
+			}
+
+			FieldReader	reader(chunk);
+			const uint16_t sourceId  = reader.read_uint16(0);
+			const uint16_t cloneId   = reader.read_uint16(0);
+			const uint8_t  cloneType = reader.read_uint8(0);
+			auto		   itSource  = p->objects.find(sourceId);
+			if (itSource == p->objects.end() || cloneId == 0 || cloneType > 2)
+			{
+				return -1;
+			}
+
+			Object clone = itSource->second;
+			if (cloneType == 0 && clone.image)
+			{
+				// full clone: own image reference, the buffer is shared until modified
+				clone.image = std::make_shared<ImageRef>(*clone.image);
+			}
+			else if (cloneType == 2)
+			{
+				// renumber
+				p->objects.erase(itSource);
+			}
+
+			clone.isVisible			= reader.read_uint8(clone.isVisible ? 0 : 1) == 0;
+			clone.isConcrete		= reader.read_uint8(clone.isConcrete ? 1 : 0) != 0;
+			const uint8_t deltaType = reader.read_uint8(0);
+			if (reader.has(8))
+			{
+				clone.x = apply_delta(deltaType, clone.x, reader.read_int32(0));
+				clone.y = apply_delta(deltaType, clone.y, reader.read_int32(0));
+			}
+
+			p->objects[cloneId] = std::move(clone);
+			return 0;
+		}
+
+		int handle_MOVE(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() != 13)
+			{
+				return -1;
+			}
+
+			FieldReader	reader(chunk);
+			const uint16_t first	 = reader.read_uint16(0);
+			const uint16_t last		 = reader.read_uint16(0);
+			const uint8_t  deltaType = reader.read_uint8(0);
+			const int32_t  x		 = reader.read_int32(0);
+			const int32_t  y		 = reader.read_int32(0);
+			for (auto it = p->objects.lower_bound(first); it != p->objects.end() && it->first <= last; ++it)
+			{
+				it->second.x = apply_delta(deltaType, it->second.x, x);
+				it->second.y = apply_delta(deltaType, it->second.y, y);
+			}
+			return 0;
+		}
+
+		int handle_CLIP(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() != 21)
+			{
+				return -1;
+			}
+
+			FieldReader	reader(chunk);
+			const uint16_t first	 = reader.read_uint16(0);
+			const uint16_t last		 = reader.read_uint16(0);
+			const uint8_t  deltaType = reader.read_uint8(0);
+			Rect		   clip = {0, 0, 0, 0};
+			reader.read_rect(&clip);
+			for (auto it = p->objects.lower_bound(first); it != p->objects.end() && it->first <= last; ++it)
+			{
+				Object& object = it->second;
+				object.clip	= apply_delta(deltaType, object.hasClip ? object.clip : Rect{0, 0, 0, 0}, clip);
+				object.hasClip = true;
+			}
+			return 0;
+		}
+
+		int handle_DISC(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.empty())
+			{
+				p->objects.clear();
+				return 0;
+			}
+
+			FieldReader reader(chunk);
+			while (reader.has(2))
+			{
+				p->objects.erase(reader.read_uint16(0));
+			}
+			return 0;
+		}
+
+		int handle_SHOW(const chunk_t* chunk, void* target)
+		{
+			auto		p = as_playback(target);
+			FieldReader reader(chunk);
+			uint16_t	first = reader.read_uint16(1);
+			uint16_t	last  = reader.read_uint16(chunk->data.empty() ? 0xFFFF : first);
+			const uint8_t mode = reader.read_uint8(0);
+			if (mode > 7)
+			{
+				return -1;
+			}
+			if (last < first)
+			{
+				std::swap(first, last);
+			}
+
+			auto itFirst = p->objects.lower_bound(first);
+			auto itEnd	 = p->objects.upper_bound(last);
+			if (mode >= 6)
+			{
+				// cycle: the object after the visible one becomes the only visible one
+				auto itVisible = std::find_if(itFirst, itEnd, [](auto& entry) { return entry.second.isVisible; });
+				auto itNext	= (itVisible == itEnd || std::next(itVisible) == itEnd) ? itFirst : std::next(itVisible);
+				for (auto it = itFirst; it != itEnd; ++it)
+				{
+					it->second.isVisible = it == itNext;
+				}
+				if (mode == 6 && itNext != itEnd)
+				{
+					show_object(*p, itNext->second);
+				}
+				return 0;
+			}
+
+			// per-layer framing: one layer per call, the chunk is interpreted again for the next one
+			if (p->showResume != 0)
+			{
+				// kept within the range, as a restored keyframe may come from a corrupt seek index
+				itFirst		  = p->showResume > last ? itEnd : p->objects.lower_bound(uint16_t(std::max<uint32_t>(p->showResume, first)));
+				p->showResume = 0;
+			}
+
+			for (auto it = itFirst; it != itEnd; ++it)
+			{
+				Object& object = it->second;
+				if (mode == 0 || mode == 3)
+				{
+					object.isVisible = true;
+				}
+				else if (mode == 1)
+				{
+					object.isVisible = false;
+				}
+				else if (mode == 4 || mode == 5)
+				{
+					object.isVisible = !object.isVisible;
+				}
+
+				const bool isShown = object.isVisible && (mode == 0 || mode == 2 || mode == 4);
+				if (isShown)
+				{
+					show_object(*p, object);
+				}
+				if (p->isFrameReady && std::next(it) != itEnd)
+				{
+					p->showResume = uint32_t(it->first) + 1;
+					p->next		  = p->next - 1;
+					return 0;
+				}
+			}
+			return 0;
+		}
+
+		int handle_LOOP(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() < 5)
+			{
+				return -1;
+			}
+
+			FieldReader	reader(chunk);
+			const uint8_t  nestLevel  = reader.read_uint8(0);
+			const uint32_t iterations = reader.read_uint32(0);
+			if (iterations == 0)
+			{
+				// skip the body
+				const std::vector<chunk_t>& chunks = *p->chunks;
+				for (size_t i = p->next; i < chunks.size(); ++i)
+				{
+					if (memcmp(chunks[i].id.type, "ENDL", sizeof(chunkid_t)) == 0 && !chunks[i].data.empty()
+						&& chunks[i].data[0] == nestLevel)
+					{
+						p->next = i + 1;
+						return 0;
+					}
+				}
+				return -1;
+			}
+
+			p->loops.push_back({nestLevel, p->next, iterations, p->layerCount});
+			return 0;
+		}
+
+		int handle_ENDL(const chunk_t* chunk, void* target)
+		{
+			auto p = as_playback(target);
+			if (chunk->data.size() != 1)
+			{
+				return -1;
+			}
+
+			// loops nested deeper without ENDL are closed as well
+			const uint8_t nestLevel = chunk->data[0];
+			while (!p->loops.empty() && p->loops.back().nestLevel > nestLevel)
+			{
+				p->loops.pop_back();
+			}
+			if (p->loops.empty() || p->loops.back().nestLevel != nestLevel)
+			{
+				return 0;
+			}
+
+			LoopState& loop = p->loops.back();
+			if (loop.remaining != infinite_iterations)
+			{
+				--loop.remaining;
+			}
+
+			// a body without layers can't produce frames, don't spin on it
+			if (loop.remaining > 0 && p->layerCount != loop.layerCount)
+			{
+				loop.layerCount = p->layerCount;
+				p->next			= loop.bodyStart;
+			}
+			else
+			{
+				p->loops.pop_back();
+			}
+			return 0;
+		}
+
+		int handle_skipped(const chunk_t*, void*)
+		{
+			return 0;
+		}
+
+		inline const chunkhandlerstate_t& mng_chunkhandlers()
+		{
+			static const chunkhandlerstate_t state = {{
+			  chunkhandler_t{{.type = {'M', 'H', 'D', 'R'}}, handle_MHDR},
+			  chunkhandler_t{{.type = {'M', 'E', 'N', 'D'}}, handle_MEND},
+			  chunkhandler_t{{.type = {'T', 'E', 'R', 'M'}}, handle_TERM},
+			  chunkhandler_t{{.type = {'B', 'A', 'C', 'K'}}, handle_BACK},
+			  chunkhandler_t{{.type = {'F', 'R', 'A', 'M'}}, handle_FRAM},
+			  chunkhandler_t{{.type = {'D', 'E', 'F', 'I'}}, handle_DEFI},
+			  chunkhandler_t{{.type = {'I', 'H', 'D', 'R'}}, handle_image},
+			  chunkhandler_t{{.type = {'J', 'H', 'D', 'R'}}, handle_image},
+			  chunkhandler_t{{.type = {'D', 'H', 'D', 'R'}}, handle_DHDR},
+			  chunkhandler_t{{.type = {'C', 'L', 'O', 'N'}}, handle_CLON},
+			  chunkhandler_t{{.type = {'M', 'O', 'V', 'E'}}, handle_MOVE},
+			  chunkhandler_t{{.type = {'C', 'L', 'I', 'P'}}, handle_CLIP},
+			  chunkhandler_t{{.type = {'D', 'I', 'S', 'C'}}, handle_DISC},
+			  chunkhandler_t{{.type = {'S', 'H', 'O', 'W'}}, handle_SHOW},
+			  chunkhandler_t{{.type = {'L', 'O', 'O', 'P'}}, handle_LOOP},
+			  chunkhandler_t{{.type = {'E', 'N', 'D', 'L'}}, handle_ENDL},
+			  // global chunks not interpreted yet
+			  chunkhandler_t{{.type = {'P', 'L', 'T', 'E'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'t', 'R', 'N', 'S'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'g', 'A', 'M', 'A'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'c', 'H', 'R', 'M'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'s', 'R', 'G', 'B'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'i', 'C', 'C', 'P'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'p', 'H', 'Y', 's'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'p', 'H', 'Y', 'g'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'t', 'E', 'X', 't'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'z', 'T', 'X', 't'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'i', 'T', 'X', 't'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'t', 'I', 'M', 'E'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'S', 'A', 'V', 'E'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'S', 'E', 'E', 'K'}}, handle_skipped},
+			  chunkhandler_t{{.type = {'n', 'E', 'E', 'D'}}, handle_skipped},
+			}};
+			return state;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! playback
+
+		int open_playback(const std::vector<chunk_t>& chunks, const PlaybackOptions& options, Playback* playback)
+		{
+			assert(playback);
+			// MHDR must come first
+			if (chunks.empty() || memcmp(chunks.front().id.type, "MHDR", sizeof(chunkid_t)) != 0)
+			{
+				return -1;
+			}
+
+			Playback& p = *playback;
+			p.chunks	= &chunks;
+			p.next		= 1;
+			p.options	= options;
+			memset(p.background, 0, sizeof(p.background));
+			p.framingMode			= FramingMode::Layers;
+			p.defaultDelay			= 1;
+			p.subframeDelay			= 1;
+			p.termination			= TerminationAction::ShowLast;
+			p.terminationRestart	= 1;
+			p.terminationIterations = 1;
+			p.layerCount			= 0;
+			p.isFrameReady			= false;
+			p.frameDelay			= 0;
+			p.isEnded				= false;
+			p.dirty					= {0, 0, 0, 0};
+			p.lastFrame				= nullptr;
+			p.frameIndex			= 0;
+			p.time					= 0.0;
+			p.bytesRead				= 0;
+			return handle_MHDR(&chunks.front(), &p);
+		}
+
+		PlaybackStatus next_frame(Playback* playback, Frame* frame)
+		{
+			assert(playback && frame);
+			Playback& p = *playback;
+			while (!p.isFrameReady)
+			{
+				if (p.isEnded)
+				{
+					return PlaybackStatus::End;
+				}
+				if (p.next >= p.chunks->size())
+				{
+					// missing MEND
+					finish_subframe(p);
+					p.isEnded = true;
+					continue;
+				}
+
+				const chunk_t& chunk = (*p.chunks)[p.next++];
+				p.bytesRead += chunk.data.size();
+				if (handle_chunk(chunk, mng_chunkhandlers(), &p) != 0)
+				{
+					p.isEnded = true;
+					return PlaybackStatus::Error;
+				}
+			}
+
+			p.isFrameReady  = false;
+			frame->duration = p.header.ticksPerSecond ? float(p.frameDelay) / float(p.header.ticksPerSecond) : 0.0f;
+			frame->dirty	= p.dirty;
+			XNG_STAGE(Composition, 0);
+			if (frame == p.lastFrame && frame->imagedata.size() == p.canvas.size())
+			{
+				// the frame holds the previous canvas
+				const size_t stride = size_t(p.header.frameWidth) * 4;
+				const size_t offset = size_t(p.dirty.left) * 4;
+				const size_t size	= size_t(p.dirty.right - p.dirty.left) * 4;
+				for (int32_t y = p.dirty.top; y < p.dirty.bottom && size > 0; ++y)
+				{
+					memcpy(&frame->imagedata[size_t(y) * stride + offset], &p.canvas[size_t(y) * stride + offset], size);
+				}
+				XNG_STAGE_BYTES(is_empty(p.dirty) ? 0 : size * size_t(p.dirty.bottom - p.dirty.top));
+			}
+			else
+			{
+				common::resize_buffer(&frame->imagedata, p.canvas.size());
+				std::copy(p.canvas.begin(), p.canvas.end(), frame->imagedata.begin());
+				XNG_STAGE_BYTES(p.canvas.size());
+			}
+			p.dirty		= {0, 0, 0, 0};
+			p.lastFrame = frame;
+			++p.frameIndex;
+			p.time += frame->duration;
+			return PlaybackStatus::Frame;
+		}
+
+		ImageBuffer* get_writable_image(Object* object)
+		{
+			assert(object);
+			if (!object->image || !object->image->buffer)
+			{
+				return nullptr;
+			}
+
+			std::shared_ptr<ImageBuffer>& buffer = object->image->buffer;
+			if (buffer.use_count() > 1)
+			{
+				buffer = std::make_shared<ImageBuffer>(*buffer);
+			}
+			return buffer.get();
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! seek index
+
+		static const uint8_t  seekindex_signature[4] = {'m', 'S', 'E', 'K'};
+		static const uint32_t no_image				 = 0xFFFFFFFF;
+
+		//! identifies the chunks, so an index isn't used with another animation
+		inline uint32_t fingerprint_of(const Playback& playback)
+		{
+			std::vector<uint8_t> description;
+			common::ByteWriter	 writer{&description};
+			writer.write_uint64(playback.chunks->size());
+			for (auto& chunk : *playback.chunks)
+			{
+				for (size_t i = 0; i < sizeof(chunkid_t); ++i)
+				{
+					writer.write_uint8(chunk.id.type[i]);
+				}
+				writer.write_uint32(uint32_t(chunk.data.size()));
+				writer.write_uint32(chunk.crc);
+			}
+			return compute_crc32(description.data(), description.size());
+		}
+
+		//! copies the interpreter state, all but chunks, options, header, canvas and the last frame.
+		//! the objects get ImageRefs of their own that share the buffers, so partial clones stay partial
+		//! clones of each other, and modifying either state copies the buffer first
+		void copy_state(const Playback& source, Playback* target)
+		{
+			std::map<const ImageRef*, std::shared_ptr<ImageRef>> refs;
+			auto copy_object = [&refs](const Object& object) {
+				Object copy = object;
+				if (object.image)
+				{
+					std::shared_ptr<ImageRef>& ref = refs[object.image.get()];
+					if (!ref)
+					{
+						ref = std::make_shared<ImageRef>(*object.image);
+					}
+					copy.image = ref;
+				}
+				return copy;
+			};
+
+			Playback& p = *target;
+			p.next		= source.next;
+			p.objects.clear();
+			for (auto& entry : source.objects)
+			{
+				p.objects[entry.first] = copy_object(entry.second);
+			}
+			p.defaultObjectId		= source.defaultObjectId;
+			p.defaultObject			= copy_object(source.defaultObject);
+			p.framingMode			= source.framingMode;
+			p.defaultDelay			= source.defaultDelay;
+			p.subframeDelay			= source.subframeDelay;
+			p.defaultClip			= source.defaultClip;
+			p.subframeClip			= source.subframeClip;
+			p.loops					= source.loops;
+			p.termination			= source.termination;
+			p.terminationRestart	= source.terminationRestart;
+			p.terminationIterations = source.terminationIterations;
+			p.showResume			= source.showResume;
+			memcpy(p.background, source.background, sizeof(p.background));
+			p.layerCount	   = source.layerCount;
+			p.hasPendingLayers = source.hasPendingLayers;
+			p.isFrameReady	   = source.isFrameReady;
+			p.frameDelay	   = source.frameDelay;
+			p.isEnded		   = source.isEnded;
+			p.dirty			   = source.dirty;
+			p.frameIndex	   = source.frameIndex;
+			p.time			   = source.time;
+			p.bytesRead		   = source.bytesRead;
+		}
+
+		//! keyframe state of the playback, before copy_state
+		inline void init_state(const Playback& playback, Playback* state)
+		{
+			state->chunks	 = playback.chunks;
+			state->options	 = playback.options;
+			state->header	 = playback.header;
+			state->lastFrame = nullptr;
+			state->canvas.clear();
+		}
+
+		//! canvases and the distinct image buffers held by the keyframes
+		inline size_t memory_of(const SeekIndex& index)
+		{
+			std::set<const ImageBuffer*> buffers;
+			size_t						 usage = 0;
+			for (auto& keyframe : index.keyframes)
+			{
+				usage += keyframe.canvas.size();
+				for (auto& entry : keyframe.state.objects)
+				{
+					const Object& object = entry.second;
+					if (object.image && object.image->buffer && buffers.insert(object.image->buffer.get()).second)
+					{
+						usage += object.image->buffer->rgba.size() + object.image->buffer->indices.size();
+					}
+				}
+			}
+			return usage;
+		}
+
+		void init_seekindex(const Playback& playback, const common::SeekIndexOptions& options, SeekIndex* index)
+		{
+			common::init_seekindex(options, fingerprint_of(playback), index);
+		}
+
+		void update_seekindex(SeekIndex* index, const Playback& playback)
+		{
+			assert(index);
+			if (common::is_keyframe_due(*index, playback.frameIndex, playback.time, playback.bytesRead))
+			{
+				Keyframe keyframe;
+				init_state(playback, &keyframe.state);
+				copy_state(playback, &keyframe.state);
+				keyframe.frameIndex = playback.frameIndex;
+				keyframe.time		= playback.time;
+				keyframe.bytesRead	= playback.bytesRead;
+				common::add_keyframe(index, std::move(keyframe), playback.canvas.data(), playback.canvas.size(), memory_of);
+			}
+		}
+
+		int build_seekindex(const std::vector<chunk_t>& chunks, const PlaybackOptions& options, const common::SeekIndexOptions& seekOptions, double maxTime, SeekIndex* index)
+		{
+			Playback playback;
+			if (open_playback(chunks, options, &playback) != 0)
+			{
+				return -1;
+			}
+
+			init_seekindex(playback, seekOptions, index);
+			Frame		   frame;
+			PlaybackStatus status = PlaybackStatus::End;
+			for (uint32_t stalledFrames = 0; playback.time < maxTime;)
+			{
+				const double frameStart = playback.time;
+				if ((status = next_frame(&playback, &frame)) != PlaybackStatus::Frame)
+				{
+					break;
+				}
+				update_seekindex(index, playback);
+
+				// frames past a stall can't be seeked to
+				if (common::is_stalled(frameStart, playback.time, &stalledFrames))
+				{
+					break;
+				}
+			}
+			return status != PlaybackStatus::Error ? 0 : -1;
+		}
+
+		inline int restart_playback(Playback* playback)
+		{
+			return open_playback(*playback->chunks, playback->options, playback);
+		}
+
+		inline void restore_keyframe(const Keyframe& keyframe, Playback* playback)
+		{
+			copy_state(keyframe.state, playback);
+			playback->lastFrame = nullptr;	// no frame holds the restored canvas
+		}
+
+		PlaybackStatus seek(Playback* playback, const SeekIndex& index, double time, Frame* frame)
+		{
+			assert(playback && frame);
+			if (!index.keyframes.empty() && index.fingerprint != fingerprint_of(*playback))
+			{
+				return PlaybackStatus::Error;
+			}
+
+			const PlaybackStatus status = common::seek(playback, index, time, frame, restart_playback, restore_keyframe, next_frame);
+
+			// frames in between were skipped
+			frame->dirty = {0, int32_t(playback->header.frameWidth), 0, int32_t(playback->header.frameHeight)};
+			return status;
+		}
+
+		inline void write_rect(common::ByteWriter& writer, const Rect& rect)
+		{
+			writer.write_uint32(uint32_t(rect.left));
+			writer.write_uint32(uint32_t(rect.right));
+			writer.write_uint32(uint32_t(rect.top));
+			writer.write_uint32(uint32_t(rect.bottom));
+		}
+
+		inline Rect read_rect(common::ByteReader& reader)
+		{
+			Rect rect;
+			rect.left	= int32_t(reader.read_uint32());
+			rect.right	= int32_t(reader.read_uint32());
+			rect.top	= int32_t(reader.read_uint32());
+			rect.bottom = int32_t(reader.read_uint32());
+			return rect;
+		}
+
+		inline void write_compressed(common::ByteWriter& writer, const std::vector<uint8_t>& data)
+		{
+			std::vector<uint8_t> compressed;
+			common::lz_compress(data.data(), data.size(), &compressed);
+			writer.write_bytes(compressed);
+		}
+
+		//! reads data of size bytes written by write_compressed
+		inline bool read_compressed(common::ByteReader& reader, size_t size, std::vector<uint8_t>* data)
+		{
+			// lz_compress output is at least 1/255 of its input, checked before allocating
+			std::vector<uint8_t> compressed;
+			reader.read_bytes(&compressed);
+			if (!reader.isValid || size / 255 > compressed.size())
+			{
+				return false;
+			}
+			data->resize(size);
+			return common::lz_decompress(compressed.data(), compressed.size(), data->data(), size) == 0;
+		}
+
+		//! image buffers are kept as rgba8 in memory, so their size must be addressable
+		inline bool is_valid_size(uint32_t width, uint32_t height)
+		{
+			return width <= 0x7FFFFFFF && height <= 0x7FFFFFFF && (height == 0 || width <= SIZE_MAX / 4 / height);
+		}
+
+		inline void write_object(common::ByteWriter& writer, const Object& object, const std::map<const ImageRef*, uint32_t>& refs)
+		{
+			writer.write_uint32(object.image ? refs.at(object.image.get()) : no_image);
+			writer.write_uint32(uint32_t(object.x));
+			writer.write_uint32(uint32_t(object.y));
+			writer.write_uint8(object.hasClip);
+			write_rect(writer, object.clip);
+			writer.write_uint8(object.isVisible);
+			writer.write_uint8(object.isConcrete);
+		}
+
+		inline bool read_object(common::ByteReader& reader, const std::vector<std::shared_ptr<ImageRef>>& refs, Object* object)
+		{
+			const uint32_t ref = reader.read_uint32();
+			object->image	   = ref < refs.size() ? refs[ref] : nullptr;
+			object->x		   = int32_t(reader.read_uint32());
+			object->y		   = int32_t(reader.read_uint32());
+			object->hasClip	   = reader.read_uint8() != 0;
+			object->clip	   = read_rect(reader);
+			object->isVisible  = reader.read_uint8() != 0;
+			object->isConcrete = reader.read_uint8() != 0;
+			return ref == no_image || ref < refs.size();
+		}
+
+		void write_seekindex(const SeekIndex& index, std::vector<uint8_t>* out)
+		{
+			common::write_seekindex_header(seekindex_signature, index, out);
+			common::ByteWriter writer{out};
+
+			// image buffers shared by the keyframes are written once
+			std::map<const ImageBuffer*, uint32_t> bufferIds;
+			std::vector<const ImageBuffer*>		   buffers;
+			for (auto& keyframe : index.keyframes)
+			{
+				for (auto& entry : keyframe.state.objects)
+				{
+					const Object& object = entry.second;
+					if (object.image && object.image->buffer && bufferIds.emplace(object.image->buffer.get(), uint32_t(buffers.size())).second)
+					{
+						buffers.push_back(object.image->buffer.get());
+					}
+				}
+			}
+
+			writer.write_uint32(uint32_t(buffers.size()));
+			for (const ImageBuffer* buffer : buffers)
+			{
+				writer.write_uint32(buffer->width);
+				writer.write_uint32(buffer->height);
+				write_compressed(writer, buffer->rgba);
+				writer.write_uint8(buffer->isPNG);
+				if (!buffer->isPNG)
+				{
+					continue;
+				}
+				writer.write_uint8(uint8_t(buffer->colorType));
+				writer.write_uint8(buffer->bitdepth);
+				writer.write_uint32(uint32_t(buffer->palette.size()));
+				for (uint32_t color : buffer->palette)
+				{
+					writer.write_uint32(color);
+				}
+				writer.write_uint8(buffer->hasColorKey);
+				for (int c = 0; c < 3; ++c)
+				{
+					writer.write_uint16(buffer->colorKey[c]);
+				}
+				writer.write_uint64(buffer->sourceFirst);
+				writer.write_uint64(buffer->sourceCount);
+				writer.write_uint8(!buffer->indices.empty());
+				if (!buffer->indices.empty())
+				{
+					write_compressed(writer, buffer->indices);
+				}
+			}
+
+			writer.write_uint64(index.keyframes.size());
+			for (auto& keyframe : index.keyframes)
+			{
+				const Playback& state = keyframe.state;
+
+				// ImageRefs, shared by partial clones
+				std::map<const ImageRef*, uint32_t> refIds;
+				std::vector<const ImageRef*>		refs;
+				auto								add_ref = [&refIds, &refs](const Object& object) {
+					 if (object.image && refIds.emplace(object.image.get(), uint32_t(refs.size())).second)
+					 {
+						 refs.push_back(object.image.get());
+					 }
+				};
+				for (auto& entry : state.objects)
+				{
+					add_ref(entry.second);
+				}
+				add_ref(state.defaultObject);
+
+				writer.write_uint32(uint32_t(refs.size()));
+				for (const ImageRef* ref : refs)
+				{
+					writer.write_uint32(ref->buffer ? bufferIds.at(ref->buffer.get()) : no_image);
+				}
+				writer.write_uint32(uint32_t(state.objects.size()));
+				for (auto& entry : state.objects)
+				{
+					writer.write_uint16(entry.first);
+					write_object(writer, entry.second, refIds);
+				}
+				writer.write_uint16(state.defaultObjectId);
+				write_object(writer, state.defaultObject, refIds);
+
+				writer.write_uint64(state.next);
+				writer.write_uint8(uint8_t(state.framingMode));
+				writer.write_uint32(state.defaultDelay);
+				writer.write_uint32(state.subframeDelay);
+				write_rect(writer, state.defaultClip);
+				write_rect(writer, state.subframeClip);
+				writer.write_uint32(uint32_t(state.loops.size()));
+				for (auto& loop : state.loops)
+				{
+					writer.write_uint8(loop.nestLevel);
+					writer.write_uint64(loop.bodyStart);
+					writer.write_uint32(loop.remaining);
+					writer.write_uint64(loop.layerCount);
+				}
+				writer.write_uint8(uint8_t(state.termination));
+				writer.write_uint64(state.terminationRestart);
+				writer.write_uint32(state.terminationIterations);
+				writer.write_uint32(state.showResume);
+				for (int c = 0; c < 4; ++c)
+				{
+					writer.write_uint8(state.background[c]);
+				}
+				writer.write_uint64(state.layerCount);
+				writer.write_uint8(state.hasPendingLayers);
+				writer.write_uint8(state.isFrameReady);
+				writer.write_uint32(state.frameDelay);
+				writer.write_uint8(state.isEnded);
+				write_rect(writer, state.dirty);
+				writer.write_uint64(state.frameIndex);
+				writer.write_double(state.time);
+				writer.write_uint64(state.bytesRead);
+				writer.write_bytes(keyframe.canvas);
+			}
+		}
+
+		int read_seekindex(const uint8_t* data, size_t size, const Playback& playback, SeekIndex* index)
+		{
+			assert((data || size == 0) && index);
+
+			// parsed into a copy, so index is left as it is on failure
+			SeekIndex		   result;
+			common::ByteReader reader{data, data + size};
+			if (!common::read_seekindex_header(seekindex_signature, fingerprint_of(playback), &reader, &result))
+			{
+				return -1;
+			}
+
+			const size_t						  chunkCount  = playback.chunks->size();
+			const uint32_t						  bufferCount = reader.read_uint32();
+			std::vector<std::shared_ptr<ImageBuffer>> buffers;
+			for (uint32_t i = 0; i < bufferCount && reader.isValid; ++i)
+			{
+				auto buffer	   = std::make_shared<ImageBuffer>();
+				buffer->width  = reader.read_uint32();
+				buffer->height = reader.read_uint32();
+				if (!is_valid_size(buffer->width, buffer->height) || !read_compressed(reader, size_t(buffer->width) * buffer->height * 4, &buffer->rgba))
+				{
+					return -1;
+				}
+				buffer->isPNG		= reader.read_uint8() != 0;
+				buffer->hasColorKey = false;
+				buffer->sourceFirst = 0;
+				buffer->sourceCount = 0;
+				if (buffer->isPNG)
+				{
+					buffer->colorType				= png::ColorType(reader.read_uint8());
+					buffer->bitdepth				= reader.read_uint8();
+					const uint32_t paletteSize		= reader.read_uint32();
+					if (!png::is_valid_bitdepth(buffer->colorType, buffer->bitdepth) || paletteSize > 256)
+					{
+						return -1;
+					}
+					buffer->palette.resize(paletteSize);
+					for (uint32_t& color : buffer->palette)
+					{
+						color = reader.read_uint32();
+					}
+					buffer->hasColorKey = reader.read_uint8() != 0;
+					for (int c = 0; c < 3; ++c)
+					{
+						buffer->colorKey[c] = reader.read_uint16();
+					}
+					buffer->sourceFirst = size_t(reader.read_uint64());
+					buffer->sourceCount = size_t(reader.read_uint64());
+					if (buffer->sourceFirst > chunkCount || buffer->sourceCount > chunkCount - buffer->sourceFirst
+						|| (reader.read_uint8() != 0 && !read_compressed(reader, size_t(buffer->width) * buffer->height, &buffer->indices)))
+					{
+						return -1;
+					}
+				}
+				buffers.push_back(std::move(buffer));
+			}
+
+			const uint64_t keyframeCount = reader.read_uint64();
+			for (uint64_t i = 0; i < keyframeCount && reader.isValid; ++i)
+			{
+				result.keyframes.emplace_back();
+				Keyframe& keyframe = result.keyframes.back();
+				Playback& state	   = keyframe.state;
+				init_state(playback, &state);
+
+				const uint32_t							refCount = reader.read_uint32();
+				std::vector<std::shared_ptr<ImageRef>> refs;
+				for (uint32_t r = 0; r < refCount && reader.isValid; ++r)
+				{
+					const uint32_t buffer = reader.read_uint32();
+					if (buffer != no_image && buffer >= buffers.size())
+					{
+						return -1;
+					}
+					refs.push_back(std::make_shared<ImageRef>());
+					refs.back()->buffer = buffer != no_image ? buffers[buffer] : nullptr;
+				}
+				const uint32_t objectCount = reader.read_uint32();
+				for (uint32_t o = 0; o < objectCount && reader.isValid; ++o)
+				{
+					const uint16_t id = reader.read_uint16();
+					if (!read_object(reader, refs, &state.objects[id]))
+					{
+						return -1;
+					}
+				}
+				state.defaultObjectId = reader.read_uint16();
+				if (!read_object(reader, refs, &state.defaultObject))
+				{
+					return -1;
+				}
+
+				state.next			= size_t(reader.read_uint64());
+				state.framingMode	= FramingMode(reader.read_uint8());
+				state.defaultDelay	= reader.read_uint32();
+				state.subframeDelay = reader.read_uint32();
+				state.defaultClip	= read_rect(reader);
+				state.subframeClip	= read_rect(reader);
+				const uint32_t loopCount = reader.read_uint32();
+				for (uint32_t l = 0; l < loopCount && reader.isValid; ++l)
+				{
+					LoopState loop;
+					loop.nestLevel	= reader.read_uint8();
+					loop.bodyStart	= size_t(reader.read_uint64());
+					loop.remaining	= reader.read_uint32();
+					loop.layerCount = reader.read_uint64();
+					if (loop.bodyStart > chunkCount)
+					{
+						return -1;
+					}
+					state.loops.push_back(loop);
+				}
+				state.termination			= TerminationAction(reader.read_uint8());
+				state.terminationRestart	= size_t(reader.read_uint64());
+				state.terminationIterations = reader.read_uint32();
+				state.showResume			= reader.read_uint32();
+				for (int c = 0; c < 4; ++c)
+				{
+					state.background[c] = reader.read_uint8();
+				}
+				state.layerCount	   = reader.read_uint64();
+				state.hasPendingLayers = reader.read_uint8() != 0;
+				state.isFrameReady	   = reader.read_uint8() != 0;
+				state.frameDelay	   = reader.read_uint32();
+				state.isEnded		   = reader.read_uint8() != 0;
+				state.dirty			   = read_rect(reader);
+				state.frameIndex	   = reader.read_uint64();
+				state.time			   = reader.read_double();
+				state.bytesRead		   = reader.read_uint64();
+				reader.read_bytes(&keyframe.canvas);
+				keyframe.frameIndex = state.frameIndex;
+				keyframe.time		= state.time;
+				keyframe.bytesRead	= state.bytesRead;
+
+				const bool isOrdered = i == 0 || state.time >= result.keyframes[size_t(i) - 1].state.time;
+				if (state.next > chunkCount || state.terminationRestart > chunkCount || !isOrdered
+					|| state.framingMode < FramingMode::Layers || state.framingMode > FramingMode::SubframeOnBackground
+					|| state.termination > TerminationAction::Repeat)
+				{
+					return -1;
+				}
+			}
+			if (!reader.isValid || reader.data_iter != reader.end)
+			{
+				return -1;
+			}
+			result.memoryUsage = memory_of(result);
+			*index			   = std::move(result);
+			return 0;
+		}
+
+	}	// namespace mng
+}	// namespace xng
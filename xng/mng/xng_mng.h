@@ -0,0 +1,284 @@
+#ifndef XNG_MNG_H_INC
+#define XNG_MNG_H_INC
+
+#include "xng/xng.h"
+#include "xng/common/xng_common.h"
+#include "xng/common/xng_seek.h"
+#include "xng/jng/xng_jng.h"
+#include "xng/png/xng_png.h"
+
+#include <cctype>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace xng
+{
+	namespace mng
+	{
+		//-------------------------------------------------------------------------
+		//! enums used in intermediate structures
+
+		enum class FramingMode : uint8_t
+		{
+			Layers				 = 1,	// every layer is a frame
+			Subframe			 = 2,	// all layers up to the next FRAM are one frame
+			LayersOnBackground   = 3,	// same as Layers, background restored before every layer
+			SubframeOnBackground = 4,	// same as Subframe, background restored before the first layer
+		};
+
+		enum class TerminationAction : uint8_t
+		{
+			ShowLast = 0,	// keep showing the last frame
+			Cease,			// stop showing the animation
+			ShowFirst,		// show the first frame after TERM
+			Repeat,			// play again from the chunk after TERM
+		};
+
+		enum class DeltaType : uint8_t	// DHDR
+		{
+			Replace		  = 0,	// the whole image, from an embedded IHDR/JHDR or as a block covering the image
+			AddPixels	  = 1,	// samples are added modulo 2^bitdepth
+			AddAlpha	  = 2,	// greyscale data added to the alpha channel
+			AddColor	  = 3,	// RGB or grey data added to the color channels
+			ReplacePixels = 4,
+			ReplaceAlpha  = 5,
+			ReplaceColor  = 6,
+			NoChange	  = 7,	// PPLT or ancillary chunks only
+		};
+
+		//-------------------------------------------------------------------------
+		//! intermediate structures
+
+		struct Header	// MHDR
+		{
+			uint32_t frameWidth;
+			uint32_t frameHeight;
+			uint32_t ticksPerSecond;
+			uint32_t nominalLayerCount;
+			uint32_t nominalFrameCount;
+			uint32_t nominalPlayTime;
+			uint32_t simplicityProfile;
+		};
+
+		struct Rect
+		{
+			int32_t left;
+			int32_t right;	// exclusive
+			int32_t top;
+			int32_t bottom;	// exclusive
+		};
+
+		//! decoded rgba8 pixels of an object
+		//! delta-PNG data (DHDR) is coded in the samples of the source image, so its format is kept
+		struct ImageBuffer
+		{
+			uint32_t			 width;
+			uint32_t			 height;
+			std::vector<uint8_t> rgba;
+
+			// source format, PNG only
+			bool				  isPNG;
+			png::ColorType		  colorType;
+			uint8_t				  bitdepth;
+			std::vector<uint32_t> palette;		// rrggbbaa, tRNS merged as in png::Palette
+			bool				  hasColorKey;	// tRNS of grey and truecolor images
+			uint16_t			  colorKey[3];
+
+			// palette images: one index per pixel, read from the source chunks on the first delta
+			std::vector<uint8_t> indices;
+			size_t				 sourceFirst;	// chunk range of the source image (IHDR to IEND)
+			size_t				 sourceCount;
+		};
+
+		//! the image of one or more objects
+		//! full clones (CLON type 0) get their own ImageRef sharing the buffer, which is copied when
+		//! either of them is modified (see get_writable_image); partial clones share the ImageRef and
+		//! so see each other's modifications
+		struct ImageRef
+		{
+			std::shared_ptr<ImageBuffer> buffer;
+		};
+
+		struct Object
+		{
+			std::shared_ptr<ImageRef> image;	// nullptr until an image is defined for the object
+			int32_t					  x;
+			int32_t					  y;
+			bool					  hasClip;
+			Rect					  clip;
+			bool					  isVisible;	// !do_not_show
+			bool					  isConcrete;
+		};
+
+		//-------------------------------------------------------------------------
+		//! playback
+		//-- the chunks are interpreted as a program: LOOP/ENDL and TERM jump back in the chunk list,
+		//-- so nothing is unrolled, and frames are composed when asked for
+
+		struct Frame
+		{
+			float				 duration;	 // seconds
+			std::vector<uint8_t> imagedata;	// rgba8, frame width x frame height
+			Rect				 dirty;		 // area changed since the previous frame, empty if none
+		};
+
+		struct PlaybackOptions
+		{
+			// inflate settings of embedded PNG images, which are always decoded completely to rgba8
+			png::DecodeOptions png;
+			jng::DecodeOptions jng;
+
+			// called when delta-PNG data changed the pixels of an object in place, rect in object pixels
+			void (*objectChanged)(void* context, uint16_t objectId, const Rect& rect) = nullptr;
+			void* objectChangedContext = nullptr;
+
+			// larger MHDR frame sizes are rejected. unlike image sizes, the frame size isn't backed by any data,
+			// so a corrupt MHDR could claim any amount of canvas memory
+			uint64_t maxFramePixels = uint64_t(1) << 28;
+		};
+
+		using PlaybackStatus = common::PlaybackStatus;
+
+		struct LoopState
+		{
+			uint8_t  nestLevel;
+			size_t	 bodyStart;	// chunk index after LOOP
+			uint32_t remaining;	// iterations left, infinite_iterations for endless loops
+			uint64_t layerCount;	// layers shown before the current iteration
+		};
+
+		//! interpreter and composition state
+		struct Playback
+		{
+			const std::vector<chunk_t>* chunks;
+			size_t						next;	// index of the next chunk to interprete
+			PlaybackOptions				options;
+			Header						header;
+
+			// object store
+			std::map<uint16_t, Object> objects;
+
+			// DEFI: object id and attributes of the next embedded images
+			uint16_t defaultObjectId;
+			Object	 defaultObject;
+
+			// FRAM
+			FramingMode framingMode;
+			uint32_t	defaultDelay;	// ticks
+			uint32_t	subframeDelay;
+			Rect		defaultClip;	// layer clipping
+			Rect		subframeClip;
+
+			// LOOP/ENDL
+			std::vector<LoopState> loops;
+
+			// TERM
+			TerminationAction termination;
+			size_t			  terminationRestart;	// chunk index after TERM
+			uint32_t		  terminationIterations;
+
+			// SHOW, resumed after every layer in the per-layer framing modes
+			uint32_t showResume;	// first object id to continue with, 0: not resuming
+
+			// composition
+			uint8_t				 background[4];	// BACK
+			std::vector<uint8_t> canvas;
+			uint64_t			 layerCount;
+			bool				 hasPendingLayers;	// layers shown since the last frame
+			bool				 isFrameReady;
+			uint32_t			 frameDelay;
+			bool				 isEnded;
+			Rect				 dirty;		 // canvas area changed since the last frame
+			const Frame*		 lastFrame;	 // frame that received the last canvas
+
+			// position
+			uint64_t frameIndex;	// frames produced so far
+			double	 time;			// start of the next frame, seconds
+			uint64_t bytesRead;		// chunk data interpreted so far
+		};
+
+		//! open_playback
+		//! reads MHDR and prepares the interpretation of the chunks
+		//! param[in] chunks: chunks as read by xng::read_chunks, starting with MHDR. must outlive the playback
+		//! param[in] options: decoding options of the embedded images
+		//! param[out] playback: playback to initialize
+		//! returns 0 on success
+		int open_playback(const std::vector<chunk_t>& chunks, const PlaybackOptions& options, Playback* playback);
+
+		//! next_frame
+		//! interpretes chunks until the next frame is complete
+		//! passing the same frame again only copies the dirty area, so it must still hold the previous frame
+		//! param[in,out] playback: playback as initialized by open_playback
+		//! param[out] frame: receives the composed frame, its buffer is reused
+		//! returns PlaybackStatus::Frame if a frame was produced
+		PlaybackStatus next_frame(Playback* playback, Frame* frame);
+
+		//! get_writable_image
+		//! returns the image buffer of the object for modification, copying it first if it is shared
+		//! with other (fully cloned) objects. nullptr if the object has no image
+		ImageBuffer* get_writable_image(Object* object);
+
+		//-------------------------------------------------------------------------
+		//! seek index
+		//-- a keyframe is the interpreter state between two frames. its object store shares the image
+		//-- buffers with the playback, which copies them before modifying them (see get_writable_image),
+		//-- so only the canvas is stored per keyframe
+
+		// the state of a keyframe is a playback without canvas; chunks, options and header are the playback's
+		using Keyframe	= common::Keyframe<Playback>;
+		using SeekIndex = common::SeekIndex<Playback>;
+
+		//! init_seekindex
+		//! prepares an empty index for the playback
+		//! param[in] playback: playback as initialized by open_playback
+		//! param[in] options: snapshot intervals and memory limit
+		//! param[out] index: index to initialize
+		void init_seekindex(const Playback& playback, const common::SeekIndexOptions& options, SeekIndex* index);
+
+		//! update_seekindex
+		//! records a keyframe if one is due, to be called after next_frame, e.g. during the first playback
+		//! param[in,out] index: index as initialized by init_seekindex
+		//! param[in] playback: playback the index was initialized for
+		void update_seekindex(SeekIndex* index, const Playback& playback);
+
+		//! build_seekindex
+		//! indexes the animation in a pass of its own
+		//! param[in] chunks: chunks as read by xng::read_chunks, starting with MHDR
+		//! param[in] options: decoding options of the playbacks that will use the index
+		//! param[in] seekOptions: snapshot intervals and memory limit
+		//! param[in] maxTime: seconds to index, as MNG animations may loop forever. indexing also ends
+		//!  where the animation stalls (see common::max_stalled_frames)
+		//! param[out] index: the index
+		//! returns 0 on success
+		int build_seekindex(const std::vector<chunk_t>& chunks, const PlaybackOptions& options, const common::SeekIndexOptions& seekOptions, double maxTime, SeekIndex* index);
+
+		//! seek
+		//! restores the last keyframe before time and plays up to the frame shown at time
+		//! param[in,out] playback: playback the index was recorded for
+		//! param[in] index: the index, may be empty (seeking then plays from the start)
+		//! param[in] time: seconds from the start
+		//! param[out] frame: receives the frame shown at time, with the whole canvas as dirty area
+		//! returns PlaybackStatus::Frame on success, End if time is past the animation or the animation
+		//!  stalls before it (see common::max_stalled_frames)
+		PlaybackStatus seek(Playback* playback, const SeekIndex& index, double time, Frame* frame);
+
+		//! write_seekindex
+		//! serializes the index, to be stored next to the animation
+		void write_seekindex(const SeekIndex& index, std::vector<uint8_t>* out);
+
+		//! read_seekindex
+		//! reads a serialized index
+		//! param[in] data, size: serialized index
+		//! param[in] playback: playback the index is going to be used with
+		//! param[out] index: the index
+		//! returns 0 on success, -1 for corrupt data or an index recorded for other chunks
+		int read_seekindex(const uint8_t* data, size_t size, const Playback& playback, SeekIndex* index);
+
+	}	// namespace mng
+
+	using MNGFrame = mng::Frame;
+}	// namespace xng
+
+
+#endif	// XNG_MNG_H_INC
@@ -0,0 +1,667 @@
+#include "xng_optimizer.h"
+
+#include "xng/common/xng_stats.h"
+#include "xng/png/xng_png.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+namespace xng
+{
+	namespace optimizer
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! chunk layout
+
+		//! a chunk of the input, spliced from there as is
+		struct ChunkSpan
+		{
+			chunkid_t	   id;
+			const uint8_t* begin;	// length field
+			const uint8_t* data;
+			uint32_t	   length;
+			size_t		   frame;	// index into DecoderInfo::frames for fcTL/IDAT/fdAT, SIZE_MAX otherwise
+		};
+
+		//! what is written for one of DecoderInfo::frames
+		struct FramePlan
+		{
+			size_t			  firstData  = SIZE_MAX;	// chunk index of the first IDAT/fdAT
+			size_t			  dataChunks = 0;
+			bool			  hasIDAT	 = false;
+			png::FrameControl control;	// fcTL as written
+
+			bool		isControlChanged = false;
+			bool		isDropped		 = false;	// merged into the frame before, or stripped with the animation
+			bool		isMerged		 = false;
+			bool		isCropped		 = false;
+			png::Region crop;	// area of the frame kept when cropped, in frame pixels
+			bool		isRecompressed = false;
+
+			std::vector<uint8_t> payload;	// new image data, empty: the one read
+			int					 error = 0;
+		};
+
+		inline bool is_chunk(const chunkid_t& id, const char* type)
+		{
+			return memcmp(id.type, type, sizeof(chunkid_t)) == 0;
+		}
+
+		//! collects the chunks passed by xng_iterate_chunks, up to IEND
+		int add_chunkspan(const xng_chunk_t* chunk, void* context)
+		{
+			std::vector<ChunkSpan>* chunks = static_cast<std::vector<ChunkSpan>*>(context);
+			ChunkSpan				span;
+			span.id._raw = chunk->id._raw;
+			span.begin	 = chunk->data - chunkheader_size;
+			span.data	 = chunk->data;
+			span.length	 = chunk->length;
+			span.frame	 = SIZE_MAX;
+			chunks->push_back(span);
+			return is_chunk(span.id, "IEND") ? 1 : 0;
+		}
+
+		//! splits the data into chunks, up to IEND
+		int scan_chunks(const uint8_t* data, size_t size, std::vector<ChunkSpan>* chunks)
+		{
+			xng_iterate_chunks(data, size, add_chunkspan, chunks);
+			if (chunks->empty() || !is_chunk(chunks->front().id, "IHDR") || !is_chunk(chunks->back().id, "IEND"))
+			{
+				// truncated
+				return -1;
+			}
+			return 0;
+		}
+
+		//! assigns the fcTL/IDAT/fdAT chunks to frames the way read_decoderinfo does, and reads the chunks
+		//! the optimizer needs into info. the image data stays a view into the input
+		int group_frames(std::vector<ChunkSpan>* chunks, std::vector<FramePlan>* frames, png::DecoderInfo* info)
+		{
+			static const char* const imageTypes[] = {"IHDR", "PLTE", "tRNS", "acTL", "fcTL", "IDAT", "fdAT", "IEND"};
+
+			chunk_t copy;	// none of the image types is kept as a view, so the copies can share it
+			for (size_t i = 0; i < chunks->size(); ++i)
+			{
+				ChunkSpan& chunk = (*chunks)[i];
+				if (is_chunk(chunk.id, "fcTL"))
+				{
+					frames->emplace_back();
+					chunk.frame = frames->size() - 1;
+				}
+				else if (is_chunk(chunk.id, "IDAT"))
+				{
+					if (frames->empty())
+					{
+						frames->emplace_back();
+					}
+					else if (frames->size() > 1)
+					{
+						return -1;
+					}
+					chunk.frame				= 0;
+					frames->front().hasIDAT = true;
+				}
+				else if (is_chunk(chunk.id, "fdAT"))
+				{
+					if (frames->empty())
+					{
+						return -1;
+					}
+					chunk.frame = frames->size() - 1;
+				}
+
+				if (chunk.frame != SIZE_MAX && !is_chunk(chunk.id, "fcTL"))
+				{
+					FramePlan& plan = (*frames)[chunk.frame];
+					if (plan.dataChunks++ == 0)
+					{
+						plan.firstData = i;
+					}
+				}
+
+				if (std::any_of(std::begin(imageTypes), std::end(imageTypes), [&chunk](const char* type) { return is_chunk(chunk.id, type); }))
+				{
+					xng_chunk_t view;
+					view.id._raw = chunk.id._raw;
+					view.length	 = chunk.length;
+					view.crc	 = read_uint32_t(chunk.data + chunk.length, nullptr);
+					view.data	 = chunk.data;
+					if (png::read_decoderinfo_chunk(view, info, &copy) != 0)
+					{
+						return -1;
+					}
+				}
+			}
+			return 0;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! frame analysis
+
+		//! finds the part of the frame that changes the canvas, false if it changes nothing
+		//! pixels blended over are unchanged only if transparent, or opaque and equal, so the result
+		//! doesn't depend on the blending arithmetic of the decoder
+		bool find_dirty_rect(const png::FrameControl& control, const std::pmr::vector<uint8_t>& source, const std::pmr::vector<uint8_t>& before, uint32_t canvasWidth, png::Region* dirty)
+		{
+			uint32_t left = control.width, top = control.height, right = 0, bottom = 0;
+			for (uint32_t y = 0; y < control.height; ++y)
+			{
+				const uint8_t* sourceRow = &source[size_t(y) * control.width * 4];
+				const uint8_t* beforeRow = &before[((size_t(control.y_offset) + y) * canvasWidth + control.x_offset) * 4];
+				for (uint32_t x = 0; x < control.width; ++x)
+				{
+					const uint8_t* pixel	   = sourceRow + size_t(x) * 4;
+					const bool	   isEqual	   = memcmp(pixel, beforeRow + size_t(x) * 4, 4) == 0;
+					const bool	   isUnchanged = control.blend_op == png::AnimationFrameBlendOperation::Source
+											 ? isEqual
+											 : pixel[3] == 0 || (pixel[3] == 0xFF && isEqual);
+					if (!isUnchanged)
+					{
+						left   = std::min(left, x);
+						top	   = std::min(top, y);
+						right  = std::max(right, x + 1);
+						bottom = std::max(bottom, y + 1);
+					}
+				}
+			}
+
+			if (right == 0)
+			{
+				return false;
+			}
+			*dirty = {left, top, right - left, bottom - top};
+			return true;
+		}
+
+		//! adds the delay of frame to the delay of control, false if the sum doesn't fit the fraction
+		bool add_delay(png::FrameControl* control, const png::FrameControl& frame)
+		{
+			const uint64_t den		= control->delay_den == 0 ? 100 : control->delay_den;
+			const uint64_t frameDen = frame.delay_den == 0 ? 100 : frame.delay_den;
+			uint64_t	   sumNum	= control->delay_num * frameDen + frame.delay_num * den;
+			uint64_t	   sumDen	= den * frameDen;
+			const uint64_t divisor	= std::gcd(sumNum, sumDen);
+			sumNum /= divisor;
+			sumDen /= divisor;
+			if (sumNum > UINT16_MAX || sumDen > UINT16_MAX)
+			{
+				return false;
+			}
+
+			control->delay_num = uint16_t(sumNum);
+			control->delay_den = uint16_t(sumDen);
+			return true;
+		}
+
+		//! plays the animation, merging frames that don't change the canvas into the frame shown before
+		//! and cropping the others to the part they change
+		int plan_frames(const png::DecoderInfo& info, const OptimizeOptions& options, std::vector<FramePlan>* frames)
+		{
+			png::DecodeOptions decodeOptions;
+			decodeOptions.inflatefunc		  = options.inflatefunc;
+			decodeOptions.inflatefuncSettings = options.inflatefuncSettings;
+
+			png::Playback playback;
+			if (png::open_playback(info, decodeOptions, &playback) != 0)
+			{
+				return -1;
+			}
+
+			// cropping rewrites the image data
+			const bool				  isCroppable = options.deflatefunc && uint8_t(info.interlaceMethod) == 0;
+			size_t					  shown		  = SIZE_MAX;	// last frame not merged
+			std::pmr::vector<uint8_t> before;
+			png::Frame				  frame;
+			for (size_t i = 0; i < info.frames.size(); ++i)
+			{
+				const png::FrameControl& control = info.frames[i].frameControl;
+				if (!control.isDefined)
+				{
+					continue;
+				}
+
+				before = playback.canvas;
+				if (png::next_frame(&playback, &frame) != png::PlaybackStatus::Frame)
+				{
+					return -1;
+				}
+
+				// the first frame disposes APNG_DISPOSE_OP_PREVIOUS to the background, and clearing the
+				// background depends on the whole frame area
+				if (shown == SIZE_MAX || control.dispose_op == png::AnimationFrameDisposeOperation::Background)
+				{
+					shown = i;
+					continue;
+				}
+
+				FramePlan&	plan = (*frames)[i];
+				FramePlan&	shownPlan = (*frames)[shown];
+				png::Region dirty;
+				const bool	isDirty = find_dirty_rect(control, playback.subframe, before, info.width, &dirty);
+				if (!isDirty && shownPlan.control.dispose_op == png::AnimationFrameDisposeOperation::None
+					&& add_delay(&shownPlan.control, control))
+				{
+					// the canvas stays as shown before for the time of both frames
+					shownPlan.isControlChanged = true;
+					plan.isDropped			   = true;
+					plan.isMerged			   = true;
+					continue;
+				}
+
+				shown = i;
+				if (!isDirty)
+				{
+					dirty = {0, 0, 1, 1};
+				}
+				if (isCroppable && (dirty.width < control.width || dirty.height < control.height))
+				{
+					plan.isCropped = true;
+					plan.crop	   = dirty;
+				}
+			}
+			return 0;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! image data
+
+		inline size_t bits_per_pixel(const png::DecoderInfo& info)
+		{
+			switch (info.colorType)
+			{
+				case png::ColorType::RGB:
+					return size_t(info.bitdepth) * 3;
+				case png::ColorType::GREY_ALPHA:
+					return size_t(info.bitdepth) * 2;
+				case png::ColorType::RGBA:
+					return size_t(info.bitdepth) * 4;
+				default:
+					return info.bitdepth;
+			}
+		}
+
+		//! copies width pixels starting at pixel x of the scanline, packed pixels bit by bit
+		void copy_pixels(const uint8_t* scanline, uint32_t x, uint32_t width, size_t bitsPerPixel, uint8_t* out)
+		{
+			if (bitsPerPixel >= 8)
+			{
+				memcpy(out, scanline + size_t(x) * bitsPerPixel / 8, size_t(width) * bitsPerPixel / 8);
+				return;
+			}
+
+			memset(out, 0, (size_t(width) * bitsPerPixel + 7) / 8);
+			for (size_t bit = 0; bit < size_t(width) * bitsPerPixel; ++bit)
+			{
+				const size_t sourceBit = size_t(x) * bitsPerPixel + bit;
+				if (scanline[sourceBit >> 3] & (0x80 >> (sourceBit & 7)))
+				{
+					out[bit >> 3] |= uint8_t(0x80 >> (bit & 7));
+				}
+			}
+		}
+
+		//! filters the scanline with the filter type giving the smallest sum of absolute differences
+		//! palette and low bitdepth images compress better unfiltered
+		void filter_row(const uint8_t* recon, const uint8_t* precon, size_t bytewidth, size_t length, bool isUnfiltered, uint8_t* out, std::vector<uint8_t>& candidate)
+		{
+			out[0] = 0;
+			memcpy(out + 1, recon, length);
+			if (isUnfiltered)
+			{
+				return;
+			}
+
+			size_t bestSum = SIZE_MAX;
+			for (uint8_t filterType = 0; filterType < 5; ++filterType)
+			{
+				common::filter_scanline(candidate.data(), recon, precon, bytewidth, filterType, length);
+				size_t sum = 0;
+				for (size_t i = 0; i < length; ++i)
+				{
+					sum += size_t(std::abs(int(int8_t(candidate[i]))));
+				}
+				if (sum < bestSum)
+				{
+					bestSum = sum;
+					out[0]	= filterType;
+					memcpy(out + 1, candidate.data(), length);
+				}
+			}
+		}
+
+		//! rewrites the image data of the frame for its crop rectangle, refiltered
+		int crop_frame(const png::DecoderInfo& info, const png::ImageFrameData& frameData, const OptimizeOptions& options, FramePlan* plan)
+		{
+			const png::FrameControl& control	  = frameData.frameControl;
+			const png::Region&		 crop		  = plan->crop;
+			const size_t			 bitsPerPixel = bits_per_pixel(info);
+			const size_t			 bytewidth	  = std::max<size_t>(1, bitsPerPixel / 8);
+			const size_t			 stride		  = (size_t(control.width) * bitsPerPixel + 7) / 8;
+			const size_t			 cropStride	  = (size_t(crop.width) * bitsPerPixel + 7) / 8;
+			const bool				 isUnfiltered = info.colorType == png::ColorType::PALETTE || info.bitdepth < 8;
+
+			std::vector<uint8_t>   joined;
+			const common::ByteSpan compressed = common::join_spans(frameData.compressedData, &joined);
+			std::vector<uint8_t>   imagedata((stride + 1) * control.height);
+			if (common::inflate(compressed.data, compressed.size, options.inflatefunc, options.inflatefuncSettings, &imagedata) != 0
+				|| imagedata.size() < (stride + 1) * control.height)
+			{
+				return -1;
+			}
+
+			std::vector<uint8_t> zeroes(stride, 0);
+			std::vector<uint8_t> row(cropStride);
+			std::vector<uint8_t> previousRow(cropStride, 0);
+			std::vector<uint8_t> candidate(cropStride);
+			std::vector<uint8_t> filtered((cropStride + 1) * crop.height);
+			XNG_STAGE_TOTAL(unfilterTotal, Unfilter);
+			for (uint32_t y = 0; y < crop.y + crop.height; ++y)
+			{
+				uint8_t* scanline = &imagedata[y * (stride + 1)];
+				{
+					XNG_STAGE_SECTION(unfilterTotal, stride);
+					if (common::unfilter_scanline(scanline + 1, y == 0 ? zeroes.data() : scanline - stride, bytewidth, scanline[0], stride) != 0)
+					{
+						return -1;
+					}
+				}
+				if (y < crop.y)
+				{
+					continue;
+				}
+
+				copy_pixels(scanline + 1, crop.x, crop.width, bitsPerPixel, row.data());
+				filter_row(row.data(), previousRow.data(), bytewidth, cropStride, isUnfiltered, &filtered[(y - crop.y) * (cropStride + 1)], candidate);
+				row.swap(previousRow);
+			}
+
+			plan->payload = common::deflate(filtered, options.deflatefunc, options.deflatefuncSettings);
+			return plan->payload.empty() ? -1 : 0;
+		}
+
+		//! recompresses the image data of the frame, kept if smaller
+		int recompress_frame(const png::ImageFrameData& frameData, const OptimizeOptions& options, FramePlan* plan)
+		{
+			std::vector<uint8_t>   joined;
+			const common::ByteSpan compressedData = common::join_spans(frameData.compressedData, &joined);
+			std::vector<uint8_t>   imagedata;
+			if (common::inflate(compressedData.data, compressedData.size, options.inflatefunc, options.inflatefuncSettings, &imagedata) != 0
+				|| imagedata.empty())
+			{
+				return -1;
+			}
+
+			std::vector<uint8_t> compressed = common::deflate(imagedata, options.deflatefunc, options.deflatefuncSettings);
+			if (compressed.empty())
+			{
+				return -1;
+			}
+			if (compressed.size() < compressedData.size)
+			{
+				plan->payload.swap(compressed);
+				plan->isRecompressed = true;
+			}
+			return 0;
+		}
+
+		//! crops or recompresses a frame, a task of its own
+		void encode_frame(const png::DecoderInfo& info, const png::ImageFrameData& frameData, const OptimizeOptions& options, FramePlan* plan)
+		{
+			if (plan->isCropped)
+			{
+				plan->error = crop_frame(info, frameData, options, plan);
+				if (plan->error != 0)
+				{
+					return;
+				}
+				if (plan->payload.size() < common::spans_size(frameData.compressedData))
+				{
+					plan->control.x_offset += plan->crop.x;
+					plan->control.y_offset += plan->crop.y;
+					plan->control.width			= plan->crop.width;
+					plan->control.height		= plan->crop.height;
+					plan->isControlChanged		= true;
+					return;
+				}
+
+				plan->isCropped = false;
+				plan->payload.clear();
+			}
+
+			plan->error = recompress_frame(frameData, options, plan);
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! writing
+
+		//! starts a chunk of the type, reusing the data buffer of chunk
+		inline void reset_chunk(chunk_t* chunk, const char* type)
+		{
+			memcpy(chunk->id.type, type, sizeof(chunk->id.type));
+			chunk->data.clear();
+		}
+
+		//! appends the chunk, computing its length and crc
+		void append_chunk(std::vector<uint8_t>* out, chunk_t* chunk)
+		{
+			chunk->length		  = uint32_t(chunk->data.size());
+			chunk->crc			  = 0;
+			const size_t position = out->size();
+			out->resize(position + chunkheader_size + chunk->length + sizeof(uint32_t));
+			write_chunk(*chunk, out->data() + position, nullptr);
+
+			// crc of type and data
+			const uint8_t* crcdata = out->data() + position + sizeof(uint32_t);
+			chunk->crc			   = compute_crc32(crcdata, sizeof(chunkid_t) + chunk->length);
+			write_uint32_t(chunk->crc, out->data() + out->size() - sizeof(uint32_t), nullptr);
+		}
+
+		void append_frame_control(std::vector<uint8_t>* out, chunk_t* chunk, const png::FrameControl& control, uint32_t sequence)
+		{
+			reset_chunk(chunk, "fcTL");
+			chunk->data.resize(26);
+			uint8_t* data_iter = chunk->data.data();
+			write_uint32_t(sequence, data_iter, &data_iter);
+			write_uint32_t(control.width, data_iter, &data_iter);
+			write_uint32_t(control.height, data_iter, &data_iter);
+			write_uint32_t(control.x_offset, data_iter, &data_iter);
+			write_uint32_t(control.y_offset, data_iter, &data_iter);
+			write_uint16_t(control.delay_num, data_iter, &data_iter);
+			write_uint16_t(control.delay_den, data_iter, &data_iter);
+			write_uint8_t(uint8_t(control.dispose_op), data_iter, &data_iter);
+			write_uint8_t(uint8_t(control.blend_op), data_iter, &data_iter);
+			append_chunk(out, chunk);
+		}
+
+		//! appends the image data of a frame as IDAT, or fdAT numbered from *sequence on
+		void append_image_data(std::vector<uint8_t>* out, chunk_t* chunk, bool isIDAT, const std::pmr::vector<common::ByteSpan>& payload, uint32_t* sequence, OptimizeStats* stats)
+		{
+			static const size_t maxLength = 0x7FFFFFFF;
+
+			size_t span	  = 0;
+			size_t offset = 0;
+			do
+			{
+				reset_chunk(chunk, isIDAT ? "IDAT" : "fdAT");
+				if (!isIDAT)
+				{
+					chunk->data.resize(sizeof(uint32_t));
+					write_uint32_t((*sequence)++, chunk->data.data(), nullptr);
+				}
+
+				// the pieces of the payload, split where a chunk is full
+				while (span < payload.size() && chunk->data.size() < maxLength)
+				{
+					const common::ByteSpan& piece = payload[span];
+					const size_t			size  = std::min(piece.size - offset, maxLength - chunk->data.size());
+					chunk->data.insert(chunk->data.end(), piece.data + offset, piece.data + offset + size);
+					offset += size;
+					if (offset == piece.size)
+					{
+						++span;
+						offset = 0;
+					}
+				}
+
+				append_chunk(out, chunk);
+				++stats->writtenChunks;
+			} while (span < payload.size());
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! optimize
+
+		int optimize(const uint8_t* data, size_t size, const OptimizeOptions& options, common::ThreadPool* pool, std::vector<uint8_t>* out, OptimizeStats* stats)
+		{
+			assert(data && out);
+			OptimizeStats localStats;
+			if (!stats)
+			{
+				stats = &localStats;
+			}
+			*stats = OptimizeStats();
+
+			std::vector<ChunkSpan> chunks;
+			std::vector<FramePlan> frames;
+			png::DecoderInfo	   info;
+			if (scan_chunks(data, size, &chunks) != 0 || group_frames(&chunks, &frames, &info) != 0
+				|| info.frames.size() != frames.size())
+			{
+				return -1;
+			}
+
+			const bool isAnimated	  = info.animationControl.isDefined && (options.keepChunks & XNG_CHUNK_ANIMATION);
+			size_t	   animatedFrames = 0;
+			for (size_t i = 0; i < frames.size(); ++i)
+			{
+				frames[i].control	= info.frames[i].frameControl;
+				frames[i].isDropped = !isAnimated && !frames[i].hasIDAT;
+				animatedFrames += info.frames[i].frameControl.isDefined ? 1 : 0;
+			}
+
+			if (options.optimizeFrames && isAnimated && info.bitdepth <= 8 && animatedFrames > 1
+				&& plan_frames(info, options, &frames) != 0)
+			{
+				return -1;
+			}
+
+			// crop and recompress the frames in parallel
+			common::TaskGroup group;
+			for (size_t i = 0; i < frames.size(); ++i)
+			{
+				FramePlan& plan = frames[i];
+				if (plan.isDropped || !options.deflatefunc)
+				{
+					continue;
+				}
+
+				const png::ImageFrameData& frameData = info.frames[i];
+				if (pool)
+				{
+					pool->submit(&group, [&info, &frameData, &options, &plan]() { encode_frame(info, frameData, options, &plan); });
+				}
+				else
+				{
+					encode_frame(info, frameData, options, &plan);
+				}
+			}
+			if (pool)
+			{
+				pool->wait(&group);
+			}
+
+			// chunks that aren't safe to copy depend on the image data
+			bool isImageChanged = false;
+			for (auto& plan : frames)
+			{
+				if (plan.error != 0)
+				{
+					return -1;
+				}
+				isImageChanged |= plan.isMerged || !plan.payload.empty() || plan.dataChunks > 1;
+				stats->mergedFrames += plan.isMerged ? 1 : 0;
+				stats->croppedFrames += plan.isCropped ? 1 : 0;
+				stats->recompressedFrames += plan.isRecompressed ? 1 : 0;
+			}
+
+			out->clear();
+			out->reserve(size);
+			chunk_t	 written;	// chunk written last, its buffer is reused
+			uint32_t sequence = 0;
+			for (size_t i = 0; i < chunks.size(); ++i)
+			{
+				const ChunkSpan& chunk = chunks[i];
+				xng_chunkid_t	 id;
+				id._raw				  = chunk.id._raw;
+				const uint32_t filter = xng_get_chunk_filter(id);
+				if ((filter != XNG_CHUNK_CRITICAL && (options.keepChunks & filter) == 0)
+					|| (filter == XNG_CHUNK_OTHER && (chunk.id.type[3] & 0x20) == 0 && isImageChanged))
+				{
+					++stats->droppedChunks;
+					continue;
+				}
+
+				const FramePlan* plan = chunk.frame == SIZE_MAX ? nullptr : &frames[chunk.frame];
+				if (plan && plan->isDropped)
+				{
+					++stats->droppedChunks;
+				}
+				else if (is_chunk(chunk.id, "acTL") && stats->mergedFrames > 0)
+				{
+					reset_chunk(&written, "acTL");
+					written.data.resize(8);
+					uint8_t* control_iter = written.data.data();
+					write_uint32_t(info.animationControl.num_frames - stats->mergedFrames, control_iter, &control_iter);
+					write_uint32_t(info.animationControl.num_loops, control_iter, &control_iter);
+					append_chunk(out, &written);
+					++stats->writtenChunks;
+				}
+				else if (plan && is_chunk(chunk.id, "fcTL"))
+				{
+					if (plan->isControlChanged || plan->control.sequence_number != sequence)
+					{
+						append_frame_control(out, &written, plan->control, sequence);
+						++stats->writtenChunks;
+					}
+					else
+					{
+						out->insert(out->end(), chunk.begin, chunk.data + chunk.length + sizeof(uint32_t));
+						++stats->splicedChunks;
+					}
+					++sequence;
+				}
+				else if (plan && i != plan->firstData)
+				{
+					// merged into the first chunk of the frame
+					++stats->droppedChunks;
+				}
+				else if (plan)
+				{
+					const bool isIDAT = is_chunk(chunk.id, "IDAT");
+					if (!plan->payload.empty() || plan->dataChunks > 1
+						|| (!isIDAT && read_uint32_t(chunk.data, nullptr) != sequence))
+					{
+						const std::pmr::vector<common::ByteSpan> rewritten = {{plan->payload.data(), plan->payload.size()}};
+						append_image_data(out, &written, isIDAT, plan->payload.empty() ? info.frames[chunk.frame].compressedData : rewritten, &sequence, stats);
+					}
+					else
+					{
+						out->insert(out->end(), chunk.begin, chunk.data + chunk.length + sizeof(uint32_t));
+						++stats->splicedChunks;
+						sequence += isIDAT ? 0 : 1;
+					}
+				}
+				else
+				{
+					out->insert(out->end(), chunk.begin, chunk.data + chunk.length + sizeof(uint32_t));
+					++stats->splicedChunks;
+				}
+			}
+			return 0;
+		}
+
+	}	// namespace optimizer
+}	// namespace xng
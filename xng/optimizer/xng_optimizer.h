@@ -0,0 +1,66 @@
+#ifndef XNG_OPTIMIZER_H_INC
+#define XNG_OPTIMIZER_H_INC
+
+#include "xng/xng.h"
+#include "xng/common/xng_common.h"
+#include "xng/common/xng_pool.h"
+
+#include <cctype>
+#include <vector>
+
+namespace xng
+{
+	namespace optimizer
+	{
+		//-------------------------------------------------------------------------
+		//! lossless PNG/APNG optimizer
+		//-- chunks that aren't changed are spliced from the input byte for byte, CRC included. only the
+		//-- image data is rewritten: the IDAT/fdAT chunks of every frame are merged, and recompressed
+		//-- (frames in parallel) where that makes them smaller. APNG frames that don't change the
+		//-- output are merged into the frame before, frames changing only part of their area are cropped
+
+		struct OptimizeOptions
+		{
+			// xng_chunk_filter_t groups kept, critical chunks are always kept. ancillary chunks unknown to
+			// the optimizer that aren't safe to copy are dropped once the image data changed
+			uint32_t keepChunks = XNG_CHUNK_ANIMATION | XNG_CHUNK_TRANSPARENCY | XNG_CHUNK_COLOR;
+
+			// recompresses the image data (e.g. wrapping zlib at its highest level). nullptr: the chunks of
+			// every frame are merged only, and frames aren't cropped
+			common::deflatefunc_t deflatefunc		   = nullptr;
+			void*				  deflatefuncSettings = nullptr;
+
+			// inflate function (e.g. wrapping zlib), nullptr for the built-in one
+			common::inflatefunc_t inflatefunc		   = nullptr;
+			void*				  inflatefuncSettings = nullptr;
+
+			// merges and crops APNG frames. images with 16 bit samples are left as they are
+			bool optimizeFrames = true;
+		};
+
+		struct OptimizeStats
+		{
+			uint32_t splicedChunks		= 0;	// copied byte for byte
+			uint32_t writtenChunks		= 0;	// new or rewritten
+			uint32_t droppedChunks		= 0;	// stripped, or merged into others
+			uint32_t recompressedFrames = 0;
+			uint32_t mergedFrames		= 0;
+			uint32_t croppedFrames		= 0;
+		};
+
+		//! optimize
+		//! rewrites a PNG or APNG losslessly, smaller
+		//! param[in] data: chunks, as for xng::read_chunks (after the PNG signature)
+		//! param[in] size: size of data
+		//! param[in] options: chunks to keep, (de)compression functions
+		//! param[in] pool: recompresses the frames in parallel, nullptr for the calling thread
+		//! param[out] out: optimized chunks, without the signature. replaced
+		//! param[out] stats: what was done, may be nullptr
+		//! returns 0 on success
+		int optimize(const uint8_t* data, size_t size, const OptimizeOptions& options, common::ThreadPool* pool, std::vector<uint8_t>* out, OptimizeStats* stats = nullptr);
+
+	}	// namespace optimizer
+}	// namespace xng
+
+
+#endif	// XNG_OPTIMIZER_H_INC
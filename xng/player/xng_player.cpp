@@ -0,0 +1,248 @@
+#include "xng_player.h"
+
+#include <algorithm>
+#include <cassert>
+#include <system_error>
+
+namespace xng
+{
+	namespace player
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! decoding thread
+
+		//! decodes the next frame into the slot, starting the next play of APNGs with loops
+		PlayerStatus decode_next(Player& p, PlayerFrame* slot)
+		{
+			if (p.isMNG)
+			{
+				// the slot buffer doesn't hold the previous frame, so the whole canvas is copied
+				p.mng.lastFrame = nullptr;
+
+				mng::Frame frame;
+				frame.imagedata.swap(slot->imagedata);
+				const double			  timestamp = p.mng.time;
+				const mng::PlaybackStatus status	= mng::next_frame(&p.mng, &frame);
+				frame.imagedata.swap(slot->imagedata);
+				if (status != mng::PlaybackStatus::Frame)
+				{
+					return status == mng::PlaybackStatus::End ? PlayerStatus::End : PlayerStatus::Error;
+				}
+				slot->timestamp = timestamp;
+				slot->duration	= frame.duration;
+			}
+			else
+			{
+				png::Frame frame;
+				for (;;)
+				{
+					frame.imagedata.swap(slot->imagedata);
+					const double			  timestamp = p.playStart + p.png.time;
+					const png::PlaybackStatus status	= png::next_frame(&p.png, &frame);
+					frame.imagedata.swap(slot->imagedata);
+					if (status == png::PlaybackStatus::Frame)
+					{
+						slot->timestamp = timestamp;
+						slot->duration	= frame.duration;
+						break;
+					}
+					if (status == png::PlaybackStatus::Error)
+					{
+						return PlayerStatus::Error;
+					}
+
+					// plays without any time passing would loop forever
+					if (p.playsLeft == 1 || !(p.png.time > 0.0))
+					{
+						return PlayerStatus::End;
+					}
+					if (p.playsLeft > 1)
+					{
+						--p.playsLeft;
+					}
+					p.playStart += p.png.time;
+					if (png::open_playback(*p.png.info, p.png.options, &p.png) != 0)
+					{
+						return PlayerStatus::Error;
+					}
+				}
+			}
+
+			slot->index = p.frameCount++;
+			return PlayerStatus::Frame;
+		}
+
+		void run_decoder(Player* player)
+		{
+			Player&		 p		  = *player;
+			const size_t capacity = p.ring.size();
+			for (;;)
+			{
+				// read before the conditions, so a wake-up between them isn't missed
+				const uint32_t signal = p.signal.load(std::memory_order_acquire);
+				if (p.isStopping.load(std::memory_order_acquire))
+				{
+					return;
+				}
+
+				const uint64_t tail = p.tail.load(std::memory_order_relaxed);
+				if (tail - p.head.load(std::memory_order_acquire) >= p.lookAhead.load(std::memory_order_relaxed))
+				{
+					p.signal.wait(signal, std::memory_order_acquire);
+					continue;
+				}
+
+				const PlayerStatus status = decode_next(p, &p.ring[tail % capacity]);
+				if (status != PlayerStatus::Frame)
+				{
+					p.decoderStatus.store(int8_t(status), std::memory_order_release);
+					return;
+				}
+				p.tail.store(tail + 1, std::memory_order_release);
+			}
+		}
+
+		inline void wake_decoder(Player& p)
+		{
+			p.signal.fetch_add(1, std::memory_order_release);
+			p.signal.notify_one();
+		}
+
+		//! sizes the ring and starts the decoding thread, once the source is open
+		int start_player(Player& p, const PlayerOptions& options)
+		{
+			const size_t capacity = std::min(size_t(options.maxLookAhead), options.memoryBudget / p.frameSize);
+			if (capacity < 2)
+			{
+				return -1;
+			}
+
+			p.options	 = options;
+			p.frameCount = 0;
+			p.ring.clear();
+			p.ring.resize(capacity);
+			p.head.store(0, std::memory_order_relaxed);
+			p.tail.store(0, std::memory_order_relaxed);
+			p.lookAhead.store(uint32_t(std::clamp(size_t(options.minLookAhead), size_t(2), capacity)), std::memory_order_relaxed);
+			p.decoderStatus.store(int8_t(PlayerStatus::Frame), std::memory_order_relaxed);
+			p.isStopping.store(false, std::memory_order_relaxed);
+			p.underruns = 0;
+			try
+			{
+				p.thread = std::thread(run_decoder, &p);
+			}
+			catch (const std::system_error&)
+			{
+				return -1;
+			}
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! player
+
+		Player::~Player()
+		{
+			close_player(this);
+		}
+
+		int open_player(const png::DecoderInfo& info, const png::DecodeOptions& decodeOptions, const PlayerOptions& options, Player* player)
+		{
+			assert(player);
+			Player& p = *player;
+			close_player(&p);
+			if (png::open_playback(info, decodeOptions, &p.png) != 0)
+			{
+				return -1;
+			}
+
+			p.isMNG		= false;
+			p.playsLeft = info.animationControl.num_loops;
+			p.playStart = 0.0;
+			p.frameSize = size_t(p.png.targetWidth) * p.png.targetHeight * 4;
+			return start_player(p, options);
+		}
+
+		int open_player(const std::vector<chunk_t>& chunks, const mng::PlaybackOptions& playbackOptions, const PlayerOptions& options, Player* player)
+		{
+			assert(player);
+			Player& p = *player;
+			close_player(&p);
+			if (mng::open_playback(chunks, playbackOptions, &p.mng) != 0)
+			{
+				return -1;
+			}
+
+			p.isMNG		= true;
+			p.playsLeft = 1;	// loops are part of the MNG
+			p.playStart = 0.0;
+			p.frameSize = size_t(p.mng.header.frameWidth) * p.mng.header.frameHeight * 4;
+			return start_player(p, options);
+		}
+
+		PlayerStatus present_frame(Player* player, double time, const PlayerFrame** frame)
+		{
+			assert(player && frame);
+			Player&		 p		  = *player;
+			const size_t capacity = p.ring.size();
+			*frame				  = nullptr;
+
+			// the decoding thread publishes its last frame before its status
+			const PlayerStatus decoderStatus = PlayerStatus(p.decoderStatus.load(std::memory_order_acquire));
+			const uint64_t	   tail			 = p.tail.load(std::memory_order_acquire);
+			uint64_t		   head			 = p.head.load(std::memory_order_relaxed);
+			if (head == tail)
+			{
+				// nothing decoded yet
+				return decoderStatus != PlayerStatus::Frame ? decoderStatus : PlayerStatus::Underrun;
+			}
+
+			// release the frames up to the last one due at time
+			const uint64_t presented = head;
+			while (head + 1 < tail && p.ring[(head + 1) % capacity].timestamp <= time)
+			{
+				++head;
+			}
+			if (head != presented)
+			{
+				p.head.store(head, std::memory_order_release);
+				wake_decoder(p);
+			}
+
+			const PlayerFrame& shown = p.ring[head % capacity];
+			*frame					 = &shown;
+			if (head + 1 < tail || time < shown.timestamp + shown.duration)
+			{
+				return PlayerStatus::Frame;
+			}
+			if (decoderStatus != PlayerStatus::Frame)
+			{
+				return decoderStatus;
+			}
+
+			// the next frame is due but not decoded: decode further ahead
+			++p.underruns;
+			const uint32_t lookAhead = p.lookAhead.load(std::memory_order_relaxed);
+			if (lookAhead < capacity)
+			{
+				p.lookAhead.store(uint32_t(std::min(size_t(lookAhead) * 2, capacity)), std::memory_order_relaxed);
+				wake_decoder(p);
+			}
+			return PlayerStatus::Underrun;
+		}
+
+		void close_player(Player* player)
+		{
+			assert(player);
+			Player& p = *player;
+			if (p.thread.joinable())
+			{
+				p.isStopping.store(true, std::memory_order_release);
+				wake_decoder(p);
+				p.thread.join();
+			}
+		}
+
+	}	// namespace player
+}	// namespace xng
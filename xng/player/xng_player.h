@@ -0,0 +1,117 @@
+#ifndef XNG_PLAYER_H_INC
+#define XNG_PLAYER_H_INC
+
+#include "xng/xng.h"
+#include "xng/mng/xng_mng.h"
+#include "xng/png/xng_png.h"
+
+#include <atomic>
+#include <cctype>
+#include <thread>
+#include <vector>
+
+namespace xng
+{
+	namespace player
+	{
+		//-------------------------------------------------------------------------
+		//! prefetching player
+		//-- a background thread decodes the frames of an APNG or MNG ahead into a ring of frame buffers,
+		//-- so the presenting thread never waits for the decoder. the ring is a single-producer,
+		//-- single-consumer queue: the slots are handed over through the head and tail counters only
+
+		struct PlayerFrame
+		{
+			uint64_t			 index;		 // frames decoded before, over all plays
+			double				 timestamp;	 // presentation time, seconds from the start
+			float				 duration;	 // seconds
+			std::vector<uint8_t> imagedata;	 // rgba8
+		};
+
+		struct PlayerOptions
+		{
+			// frame buffers of the ring in bytes, at least two frames. the decoder state is not included
+			size_t memoryBudget = size_t(64) << 20;
+
+			// frames decoded ahead of the presented one. starts at minLookAhead and doubles whenever
+			// a frame wasn't decoded when it was due, up to what the memory budget and maxLookAhead allow
+			uint32_t minLookAhead = 2;
+			uint32_t maxLookAhead = 64;
+		};
+
+		enum class PlayerStatus : int8_t
+		{
+			Error = -1,	// corrupt data, the frames before it were presented
+			Frame = 0,	// frame to show
+			Underrun,	// the due frame isn't decoded yet, frame (if any) is the one still shown
+			End			// no more frames, frame is the last one
+		};
+
+		struct Player
+		{
+			// source, used by the decoding thread only while it runs
+			bool		  isMNG;
+			png::Playback png;
+			mng::Playback mng;
+			uint32_t	  playsLeft;	// APNG num_loops, 0: endless
+			double		  playStart;	// timestamp of the first frame of the current play
+			uint64_t	  frameCount;
+
+			PlayerOptions			 options;
+			size_t					 frameSize;	// bytes per frame
+			std::vector<PlayerFrame> ring;
+
+			// [head, tail) are decoded, head is the frame presented last and never overwritten
+			std::atomic<uint64_t> head{0};
+			std::atomic<uint64_t> tail{0};
+			std::atomic<uint32_t> lookAhead{0};
+			std::atomic<int8_t>	  decoderStatus{int8_t(PlayerStatus::Frame)};	// End or Error when the thread is done
+			std::atomic<bool>	  isStopping{false};
+			std::atomic<uint32_t> signal{0};	// bumped to wake the decoding thread
+
+			// presenting thread
+			uint64_t underruns;	// due frames that weren't decoded in time
+
+			std::thread thread;
+
+			Player() = default;
+			Player(const Player&) = delete;
+			Player& operator=(const Player&) = delete;
+			~Player();
+		};
+
+		//! open_player
+		//! starts decoding an animated PNG in the background
+		//! param[in] info: decoder info as filled by png::read_decoderinfo, with acTL. must outlive the player
+		//! param[in] decodeOptions: as for png::open_playback
+		//! param[in] options: ring size and look-ahead
+		//! param[out] player: player to start, closed first if running
+		//! returns 0 on success
+		int open_player(const png::DecoderInfo& info, const png::DecodeOptions& decodeOptions, const PlayerOptions& options, Player* player);
+
+		//! open_player
+		//! starts decoding an MNG in the background
+		//! param[in] chunks: chunks as read by xng::read_chunks, starting with MHDR. must outlive the player
+		//! param[in] playbackOptions: as for mng::open_playback
+		//! param[in] options: ring size and look-ahead
+		//! param[out] player: player to start, closed first if running
+		//! returns 0 on success
+		int open_player(const std::vector<chunk_t>& chunks, const mng::PlaybackOptions& playbackOptions, const PlayerOptions& options, Player* player);
+
+		//! present_frame
+		//! returns the frame to show at time, releasing the frames before it to the decoder. never blocks
+		//! param[in,out] player: player as started by open_player
+		//! param[in] time: seconds since the start of the presentation, not decreasing between calls
+		//! param[out] frame: the frame to show, valid until the next call. nullptr before the first frame is decoded
+		//! returns PlayerStatus::Frame if the frame is the one due at time
+		PlayerStatus present_frame(Player* player, double time, const PlayerFrame** frame);
+
+		//! close_player
+		//! stops the decoding thread
+		void close_player(Player* player);
+
+	}	// namespace player
+}	// namespace xng
+
+
+#endif	// XNG_PLAYER_H_INC
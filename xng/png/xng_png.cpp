@@ -0,0 +1,2776 @@
+#include "xng_png.h"
+#include "xng/common/xng_color.h"
+#include "xng/common/xng_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace xng
+{
+	namespace png
+	{
+		///////////////////////////////////////////////////////////////////////////
+		//! chunk data helpers
+
+		inline DecoderInfo* as_decoderinfo(void* target)
+		{
+			assert(target);
+			return static_cast<DecoderInfo*>(target);
+		}
+
+		//! reads a 0-terminated keyword (1-79 characters)
+		//! returns the offset right after the terminator, 0 if the keyword is invalid
+		inline size_t read_keyword(const std::pmr::vector<uint8_t>& data, size_t offset, char* keyword)
+		{
+			size_t length = 0;
+			while (offset + length < data.size() && length < 79 && data[offset + length] != 0)
+			{
+				++length;
+			}
+
+			if (length == 0 || offset + length >= data.size() || data[offset + length] != 0)
+			{
+				return 0;
+			}
+
+			memcpy(keyword, data.data() + offset, length);
+			keyword[length] = 0;
+			return offset + length + 1;
+		}
+
+		//! reads a 0-terminated string
+		//! returns the offset right after the terminator, 0 if no terminator was found
+		inline size_t read_string(const std::pmr::vector<uint8_t>& data, size_t offset, std::pmr::string* str)
+		{
+			auto itEnd = std::find(data.begin() + offset, data.end(), 0);
+			if (itEnd == data.end())
+			{
+				return 0;
+			}
+
+			str->assign(data.begin() + offset, itEnd);
+			return size_t(itEnd - data.begin()) + 1;
+		}
+
+		//! view into the chunk data from offset to its end
+		inline LazyInflatedData make_lazy(const std::pmr::vector<uint8_t>& data, size_t offset)
+		{
+			LazyInflatedData lazy;
+			lazy.compressed		= data.data() + offset;
+			lazy.compressedSize = data.size() - offset;
+			return lazy;
+		}
+
+		inline uint32_t channel_count(ColorType colorType)
+		{
+			switch (colorType)
+			{
+				case ColorType::GREY:
+				case ColorType::PALETTE:
+					return 1;
+				case ColorType::GREY_ALPHA:
+					return 2;
+				case ColorType::RGB:
+					return 3;
+				case ColorType::RGBA:
+					return 4;
+			}
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! chunk handlers
+
+		int handle_IHDR(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 13)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter = chunk->data.data();
+			info->width				 = read_uint32_t(data_iter, &data_iter);
+			info->height			 = read_uint32_t(data_iter, &data_iter);
+			info->bitdepth			 = read_uint8_t(data_iter, &data_iter);
+			info->colorType			 = ColorType(read_uint8_t(data_iter, &data_iter));
+			info->compressionMethod  = CompressionMethod(read_uint8_t(data_iter, &data_iter));
+			info->filterMethod		 = FilterMethod(read_uint8_t(data_iter, &data_iter));
+			info->interlaceMethod	= InterlaceMethod(read_uint8_t(data_iter, &data_iter));
+
+			if (info->width == 0 || info->height == 0 || !is_valid_bitdepth(info->colorType, info->bitdepth)
+				|| uint8_t(info->interlaceMethod) > 1)
+			{
+				return -1;
+			}
+
+			return 0;
+		}
+
+		int handle_PLTE(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() % 3 != 0 || chunk->data.size() > 256 * 3)
+			{
+				return -1;
+			}
+
+			info->palette.colors.resize(chunk->data.size() / 3);
+			for (size_t i = 0; i < info->palette.colors.size(); ++i)
+			{
+				const uint8_t* rgb		 = chunk->data.data() + i * 3;
+				info->palette.colors[i] = (uint32_t(rgb[0]) << 24) | (uint32_t(rgb[1]) << 16) | (uint32_t(rgb[2]) << 8) | 0xFF;
+			}
+
+			return 0;
+		}
+
+		int handle_tRNS(const chunk_t* chunk, void* target)
+		{
+			auto		   info		 = as_decoderinfo(target);
+			const uint8_t* data_iter = chunk->data.data();
+
+			switch (info->colorType)
+			{
+				case ColorType::PALETTE:
+					if (chunk->data.size() > info->palette.colors.size())
+					{
+						return -1;
+					}
+					info->transparency.alphas.assign(chunk->data.begin(), chunk->data.end());
+					for (size_t i = 0; i < chunk->data.size(); ++i)
+					{
+						info->palette.colors[i] = (info->palette.colors[i] & 0xFFFFFF00) | chunk->data[i];
+					}
+					break;
+				case ColorType::GREY:
+					if (chunk->data.size() != 2)
+					{
+						return -1;
+					}
+					info->transparency.alphas = {read_uint16_t(data_iter, &data_iter)};
+					break;
+				case ColorType::RGB:
+					if (chunk->data.size() != 6)
+					{
+						return -1;
+					}
+					info->transparency.alphas.resize(3);
+					for (auto& alpha : info->transparency.alphas)
+					{
+						alpha = read_uint16_t(data_iter, &data_iter);
+					}
+					break;
+				default:
+					// not allowed for color types with alpha channel
+					return -1;
+			}
+
+			info->transparency.isDefined = true;
+			return 0;
+		}
+
+		int handle_gAMA(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 4)
+			{
+				return -1;
+			}
+
+			info->gamma.value	 = read_uint32_t(chunk->data.data(), nullptr);
+			info->gamma.isDefined = true;
+			return 0;
+		}
+
+		int handle_cHRM(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 32)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter  = chunk->data.data();
+			info->chroma.whitePoint_x = read_uint32_t(data_iter, &data_iter);
+			info->chroma.whitePoint_y = read_uint32_t(data_iter, &data_iter);
+			info->chroma.red_x		  = read_uint32_t(data_iter, &data_iter);
+			info->chroma.red_y		  = read_uint32_t(data_iter, &data_iter);
+			info->chroma.green_x	  = read_uint32_t(data_iter, &data_iter);
+			info->chroma.green_y	  = read_uint32_t(data_iter, &data_iter);
+			info->chroma.blue_x		  = read_uint32_t(data_iter, &data_iter);
+			info->chroma.blue_y		  = read_uint32_t(data_iter, &data_iter);
+			info->chroma.isDefined	= true;
+			return 0;
+		}
+
+		int handle_sRGB(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 1)
+			{
+				return -1;
+			}
+
+			info->srgb.intent	= RenderingIntent(chunk->data[0]);
+			info->srgb.isDefined = true;
+			return 0;
+		}
+
+		int handle_iCCP(const chunk_t* chunk, void* target)
+		{
+			auto   info   = as_decoderinfo(target);
+			size_t offset = read_keyword(chunk->data, 0, info->iccProfile.name);
+			if (offset == 0 || offset >= chunk->data.size())
+			{
+				return -1;
+			}
+
+			info->iccProfile.compressionMethod = CompressionMethod(chunk->data[offset]);
+			info->iccProfile.profile		   = make_lazy(chunk->data, offset + 1);
+			info->iccProfile.isDefined = true;
+			return 0;
+		}
+
+		int handle_tEXt(const chunk_t* chunk, void* target)
+		{
+			auto		info = as_decoderinfo(target);
+			TextualData text(info->texts.get_allocator().resource());
+			size_t		offset = read_keyword(chunk->data, 0, text.keyword);
+			if (offset == 0)
+			{
+				return -1;
+			}
+
+			text.text.assign(chunk->data.begin() + offset, chunk->data.end());
+			text.isDefined = true;
+			info->texts.push_back(std::move(text));
+			return 0;
+		}
+
+		int handle_zTXt(const chunk_t* chunk, void* target)
+		{
+			auto				  info = as_decoderinfo(target);
+			CompressedTextualData text(info->compressedTexts.get_allocator().resource());
+			size_t				  offset = read_keyword(chunk->data, 0, text.keyword);
+			if (offset == 0 || offset >= chunk->data.size())
+			{
+				return -1;
+			}
+
+			text.compressionMethod = CompressionMethod(chunk->data[offset]);
+			text.compressedText	= make_lazy(chunk->data, offset + 1);
+			text.isDefined = true;
+			info->compressedTexts.push_back(std::move(text));
+			return 0;
+		}
+
+		int handle_iTXt(const chunk_t* chunk, void* target)
+		{
+			auto					 info = as_decoderinfo(target);
+			InternationalTextualData text(info->internationalTexts.get_allocator().resource());
+			size_t					 offset = read_keyword(chunk->data, 0, text.keyword);
+			if (offset == 0 || offset + 2 > chunk->data.size())
+			{
+				return -1;
+			}
+
+			text.isCompressed	  = chunk->data[offset];
+			text.compressionMethod = CompressionMethod(chunk->data[offset + 1]);
+
+			offset = read_string(chunk->data, offset + 2, &text.language);
+			if (offset == 0)
+			{
+				return -1;
+			}
+
+			offset = read_string(chunk->data, offset, &text.translatedKeyword);
+			if (offset == 0)
+			{
+				return -1;
+			}
+
+			if (text.isCompressed)
+			{
+				text.compressedText = make_lazy(chunk->data, offset);
+			}
+			else
+			{
+				text.text.assign(chunk->data.begin() + offset, chunk->data.end());
+			}
+
+			text.isDefined = true;
+			info->internationalTexts.push_back(std::move(text));
+			return 0;
+		}
+
+		int handle_bKGD(const chunk_t* chunk, void* target)
+		{
+			auto		   info		 = as_decoderinfo(target);
+			const uint8_t* data_iter = chunk->data.data();
+
+			switch (info->colorType)
+			{
+				case ColorType::PALETTE:
+					if (chunk->data.size() != 1)
+					{
+						return -1;
+					}
+					info->backgroundColor.values = {chunk->data[0]};
+					break;
+				case ColorType::GREY:
+				case ColorType::GREY_ALPHA:
+					if (chunk->data.size() != 2)
+					{
+						return -1;
+					}
+					info->backgroundColor.values = {read_uint16_t(data_iter, &data_iter)};
+					break;
+				case ColorType::RGB:
+				case ColorType::RGBA:
+					if (chunk->data.size() != 6)
+					{
+						return -1;
+					}
+					info->backgroundColor.values.resize(3);
+					for (auto& value : info->backgroundColor.values)
+					{
+						value = read_uint16_t(data_iter, &data_iter);
+					}
+					break;
+			}
+
+			info->backgroundColor.isDefined = true;
+			return 0;
+		}
+
+		int handle_pHYs(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 9)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter				= chunk->data.data();
+			info->physicalDimensions.ppu_x	 = read_uint32_t(data_iter, &data_iter);
+			info->physicalDimensions.ppu_y	 = read_uint32_t(data_iter, &data_iter);
+			info->physicalDimensions.isMetric  = read_uint8_t(data_iter, &data_iter);
+			info->physicalDimensions.isDefined = true;
+			return 0;
+		}
+
+		int handle_sBIT(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.empty() || chunk->data.size() > 4)
+			{
+				return -1;
+			}
+
+			info->significantBits.depths.assign(chunk->data.begin(), chunk->data.end());
+			info->significantBits.isDefined = true;
+			return 0;
+		}
+
+		int handle_sPLT(const chunk_t* chunk, void* target)
+		{
+			auto			 info = as_decoderinfo(target);
+			SuggestedPalette palette(info->suggestedPalettes.get_allocator().resource());
+			size_t			 offset = read_keyword(chunk->data, 0, palette.name);
+			if (offset == 0 || offset >= chunk->data.size())
+			{
+				return -1;
+			}
+
+			palette.sampleDepth		= chunk->data[offset++];
+			const size_t entrySize = palette.sampleDepth == 16 ? 10 : 6;
+			if ((palette.sampleDepth != 8 && palette.sampleDepth != 16) || (chunk->data.size() - offset) % entrySize != 0)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter = chunk->data.data() + offset;
+			palette.entries.resize((chunk->data.size() - offset) / entrySize);
+			for (auto& entry : palette.entries)
+			{
+				if (palette.sampleDepth == 16)
+				{
+					entry.r = read_uint16_t(data_iter, &data_iter);
+					entry.g = read_uint16_t(data_iter, &data_iter);
+					entry.b = read_uint16_t(data_iter, &data_iter);
+					entry.a = read_uint16_t(data_iter, &data_iter);
+				}
+				else
+				{
+					entry.r = read_uint8_t(data_iter, &data_iter);
+					entry.g = read_uint8_t(data_iter, &data_iter);
+					entry.b = read_uint8_t(data_iter, &data_iter);
+					entry.a = read_uint8_t(data_iter, &data_iter);
+				}
+				entry.frequency = read_uint16_t(data_iter, &data_iter);
+			}
+
+			palette.isDefined = true;
+			info->suggestedPalettes.push_back(std::move(palette));
+			return 0;
+		}
+
+		int handle_hIST(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() % 2 != 0 || chunk->data.size() / 2 > 256)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter = chunk->data.data();
+			info->histogram.entries.resize(chunk->data.size() / 2);
+			for (size_t i = 0; i < info->histogram.entries.size(); ++i)
+			{
+				info->histogram.entries[i].colorIndex = uint8_t(i);
+				info->histogram.entries[i].frequency  = read_uint16_t(data_iter, &data_iter);
+			}
+
+			info->histogram.isDefined = true;
+			return 0;
+		}
+
+		int handle_tIME(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 7)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter			 = chunk->data.data();
+			info->lastModificationTime.year   = read_uint16_t(data_iter, &data_iter);
+			info->lastModificationTime.month  = read_uint8_t(data_iter, &data_iter);
+			info->lastModificationTime.day	= read_uint8_t(data_iter, &data_iter);
+			info->lastModificationTime.hour   = read_uint8_t(data_iter, &data_iter);
+			info->lastModificationTime.minute = read_uint8_t(data_iter, &data_iter);
+			info->lastModificationTime.second = read_uint8_t(data_iter, &data_iter);
+			return 0;
+		}
+
+		int handle_acTL(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 8)
+			{
+				return -1;
+			}
+
+			const uint8_t* data_iter			 = chunk->data.data();
+			info->animationControl.num_frames = read_uint32_t(data_iter, &data_iter);
+			info->animationControl.num_loops  = read_uint32_t(data_iter, &data_iter);
+			info->animationControl.isDefined  = true;
+			return 0;
+		}
+
+		int handle_fcTL(const chunk_t* chunk, void* target)
+		{
+			auto info = as_decoderinfo(target);
+			if (chunk->data.size() != 26)
+			{
+				return -1;
+			}
+
+			ImageFrameData frame(info->frames.get_allocator().resource());
+			FrameControl&  control   = frame.frameControl;
+			const uint8_t* data_iter = chunk->data.data();
+			control.sequence_number  = read_uint32_t(data_iter, &data_iter);
+			control.width			 = read_uint32_t(data_iter, &data_iter);
+			control.height			 = read_uint32_t(data_iter, &data_iter);
+			control.x_offset		 = read_uint32_t(data_iter, &data_iter);
+			control.y_offset		 = read_uint32_t(data_iter, &data_iter);
+			control.delay_num		 = read_uint16_t(data_iter, &data_iter);
+			control.delay_den		 = read_uint16_t(data_iter, &data_iter);
+			control.dispose_op		 = AnimationFrameDisposeOperation(read_uint8_t(data_iter, &data_iter));
+			control.blend_op		 = AnimationFrameBlendOperation(read_uint8_t(data_iter, &data_iter));
+			control.isDefined		 = true;
+			frame.sequence_number	= control.sequence_number;
+
+			if (control.width == 0 || control.height == 0)
+			{
+				return -1;
+			}
+
+			info->frames.push_back(std::move(frame));
+			return 0;
+		}
+
+		//! adds the payload of an IDAT chunk, as a view
+		int add_IDAT(DecoderInfo* info, common::ByteSpan data)
+		{
+			// IDAT belongs to the preceding fcTL if any, else it's the (non-animated) default image
+			if (info->frames.empty())
+			{
+				info->frames.emplace_back(info->frames.get_allocator().resource());
+				info->frames.back().sequence_number = 0;
+			}
+			else if (info->frames.size() > 1)
+			{
+				// IDAT after fdAT frames
+				return -1;
+			}
+
+			if (data.size > 0)
+			{
+				info->frames.back().compressedData.push_back(data);
+			}
+			return 0;
+		}
+
+		//! adds the payload of an fdAT chunk, as a view
+		//! param[in] data: chunk data, starting with the sequence number
+		int add_fdAT(DecoderInfo* info, common::ByteSpan data)
+		{
+			if (data.size < sizeof(uint32_t) || info->frames.empty() || !info->frames.back().frameControl.isDefined)
+			{
+				return -1;
+			}
+
+			// skip sequence number
+			if (data.size > sizeof(uint32_t))
+			{
+				info->frames.back().compressedData.push_back({data.data + sizeof(uint32_t), data.size - sizeof(uint32_t)});
+			}
+			return 0;
+		}
+
+		int handle_IDAT(const chunk_t* chunk, void* target)
+		{
+			return add_IDAT(as_decoderinfo(target), {chunk->data.data(), chunk->data.size()});
+		}
+
+		int handle_fdAT(const chunk_t* chunk, void* target)
+		{
+			return add_fdAT(as_decoderinfo(target), {chunk->data.data(), chunk->data.size()});
+		}
+
+		int handle_IEND(const chunk_t*, void*)
+		{
+			return 0;
+		}
+
+		int handle_skipped(const chunk_t*, void*)
+		{
+			return 0;
+		}
+
+		inline const chunkhandlerstate_t& png_chunkhandlers(const ReadOptions& options)
+		{
+			static const chunkhandlerstate_t state = {{
+			  chunkhandler_t{{.type = {'I', 'H', 'D', 'R'}}, handle_IHDR},
+			  chunkhandler_t{{.type = {'P', 'L', 'T', 'E'}}, handle_PLTE},
+			  chunkhandler_t{{.type = {'t', 'R', 'N', 'S'}}, handle_tRNS},
+			  chunkhandler_t{{.type = {'g', 'A', 'M', 'A'}}, handle_gAMA},
+			  chunkhandler_t{{.type = {'c', 'H', 'R', 'M'}}, handle_cHRM},
+			  chunkhandler_t{{.type = {'s', 'R', 'G', 'B'}}, handle_sRGB},
+			  chunkhandler_t{{.type = {'i', 'C', 'C', 'P'}}, handle_iCCP},
+			  chunkhandler_t{{.type = {'t', 'E', 'X', 't'}}, handle_tEXt},
+			  chunkhandler_t{{.type = {'z', 'T', 'X', 't'}}, handle_zTXt},
+			  chunkhandler_t{{.type = {'i', 'T', 'X', 't'}}, handle_iTXt},
+			  chunkhandler_t{{.type = {'b', 'K', 'G', 'D'}}, handle_bKGD},
+			  chunkhandler_t{{.type = {'p', 'H', 'Y', 's'}}, handle_pHYs},
+			  chunkhandler_t{{.type = {'s', 'B', 'I', 'T'}}, handle_sBIT},
+			  chunkhandler_t{{.type = {'s', 'P', 'L', 'T'}}, handle_sPLT},
+			  chunkhandler_t{{.type = {'h', 'I', 'S', 'T'}}, handle_hIST},
+			  chunkhandler_t{{.type = {'t', 'I', 'M', 'E'}}, handle_tIME},
+			  chunkhandler_t{{.type = {'a', 'c', 'T', 'L'}}, handle_acTL},
+			  chunkhandler_t{{.type = {'f', 'c', 'T', 'L'}}, handle_fcTL},
+			  chunkhandler_t{{.type = {'I', 'D', 'A', 'T'}}, handle_IDAT},
+			  chunkhandler_t{{.type = {'f', 'd', 'A', 'T'}}, handle_fdAT},
+			  chunkhandler_t{{.type = {'I', 'E', 'N', 'D'}}, handle_IEND},
+			}};
+
+			// same handlers, with the textual data ones replaced
+			static const chunkhandlerstate_t stateWithoutText = [] {
+				chunkhandlerstate_t result = state;
+				for (auto& handler : result.handlers)
+				{
+					if (handler.func == handle_tEXt || handler.func == handle_zTXt || handler.func == handle_iTXt)
+					{
+						handler.func = handle_skipped;
+					}
+				}
+				return result;
+			}();
+
+			return options.readTextualData ? state : stateWithoutText;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! read_decoderinfo
+
+		int read_decoderinfo(const std::vector<chunk_t>& chunks, DecoderInfo* info, const ReadOptions& options)
+		{
+			return read_decoderinfo(chunks.data(), chunks.size(), info, options);
+		}
+
+		int read_decoderinfo(const chunk_t* chunks, size_t count, DecoderInfo* info, const ReadOptions& options)
+		{
+			assert(info);
+			// IHDR must come first
+			if (count == 0 || memcmp(chunks[0].id.type, "IHDR", sizeof(chunkid_t)) != 0)
+			{
+				return -1;
+			}
+
+			return handle_chunks(chunks, count, png_chunkhandlers(options), info);
+		}
+
+		int read_decoderinfo_chunk(const xng_chunk_t& chunk, DecoderInfo* info, chunk_t* copy, const ReadOptions& options)
+		{
+			assert(info && copy);
+			if (memcmp(chunk.id.type, "IDAT", sizeof(chunk.id.type)) == 0)
+			{
+				return add_IDAT(info, {chunk.data, chunk.length});
+			}
+			if (memcmp(chunk.id.type, "fdAT", sizeof(chunk.id.type)) == 0)
+			{
+				return add_fdAT(info, {chunk.data, chunk.length});
+			}
+
+			copy->id._raw = chunk.id._raw;
+			copy->length  = chunk.length;
+			copy->crc	  = chunk.crc;
+			copy->data.assign(chunk.data, chunk.data + chunk.length);
+			return handle_chunk(*copy, png_chunkhandlers(options), info);
+		}
+
+		void reset_decoderinfo(DecoderInfo* info)
+		{
+			assert(info);
+			info->width				= 0;
+			info->height			= 0;
+			info->bitdepth			= 0;
+			info->colorType			= ColorType();
+			info->compressionMethod = CompressionMethod();
+			info->filterMethod		= FilterMethod();
+			info->interlaceMethod	= InterlaceMethod();
+
+			info->palette.colors.clear();
+			info->transparency.isDefined = false;
+			info->transparency.alphas.clear();
+			info->gamma = Gamma();
+			info->chroma = Chroma();
+			info->srgb = SRGB();
+			info->iccProfile.isDefined = false;
+			info->iccProfile.profile.compressed		= nullptr;
+			info->iccProfile.profile.compressedSize = 0;
+			info->iccProfile.profile.isInflated		= false;
+			info->iccProfile.profile.inflated.clear();
+			info->texts.clear();
+			info->compressedTexts.clear();
+			info->internationalTexts.clear();
+			info->backgroundColor.isDefined = false;
+			info->backgroundColor.values.clear();
+			info->physicalDimensions = PhysicalDimensions();
+			info->significantBits.isDefined = false;
+			info->significantBits.depths.clear();
+			info->suggestedPalettes.clear();
+			info->histogram.isDefined = false;
+			info->histogram.entries.clear();
+			info->lastModificationTime = ModificationTime();
+			info->animationControl	   = AnimationControl();
+			info->frames.clear();
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+		//! lazily inflated chunk data
+
+		int get_text(const CompressedTextualData& text, common::inflatefunc_t inflatefunc, void* settings, std::string* out, size_t maxSize)
+		{
+			assert(out);
+			const std::pmr::vector<uint8_t>* inflated = nullptr;
+			if (text.compressionMethod != CompressionMethod::Deflate
+				|| !(inflated = common::inflate(text.compressedText, inflatefunc, settings, maxSize)))
+			{
+				return -1;
+			}
+
+			out->assign(inflated->begin(), inflated->end());
+			return 0;
+		}
+
+		int get_text(const InternationalTextualData& text, common::inflatefunc_t inflatefunc, void* settings, std::string* out, size_t maxSize)
+		{
+			assert(out);
+			if (!text.isCompressed)
+			{
+				out->assign(text.text.begin(), text.text.end());
+				return 0;
+			}
+
+			const std::pmr::vector<uint8_t>* inflated = nullptr;
+			if (text.compressionMethod != CompressionMethod::Deflate
+				|| !(inflated = common::inflate(text.compressedText, inflatefunc, settings, maxSize)))
+			{
+				return -1;
+			}
+
+			out->assign(inflated->begin(), inflated->end());
+			return 0;
+		}
+
+		const std::pmr::vector<uint8_t>* get_profile(const ICCProfile& profile, common::inflatefunc_t inflatefunc, void* settings, size_t maxSize)
+		{
+			if (profile.compressionMethod != CompressionMethod::Deflate)
+			{
+				return nullptr;
+			}
+			return common::inflate(profile.profile, inflatefunc, settings, maxSize);
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! color conversion
+
+		struct ImageLayout
+		{
+			uint32_t  width;
+			uint32_t  height;
+			uint8_t   bitdepth;
+			ColorType colorType;
+			size_t	bitsPerPixel;
+		};
+
+		inline size_t scanline_size(uint32_t width, size_t bitsPerPixel)
+		{
+			return (size_t(width) * bitsPerPixel + 7) / 8;
+		}
+
+		//! deflate expands its input by 1032:1 at most (258 bytes for a 2-bit length/distance pair)
+		static const size_t max_inflate_ratio = 1032;
+
+		//! sample of a sub-byte grey/palette pixel, index in pixels
+		inline uint8_t read_packed_sample(const uint8_t* scanline, size_t index, uint8_t bitdepth)
+		{
+			const size_t bitpos = index * bitdepth;
+			return uint8_t((scanline[bitpos >> 3] >> (8 - bitdepth - (bitpos & 7))) & ((1u << bitdepth) - 1));
+		}
+
+		//! 16 bit sample, reduced to its high byte for 8 bit output
+		template <typename Sample>
+		inline Sample read_sample16(const uint8_t* p);
+
+		template <>
+		inline uint8_t read_sample16<uint8_t>(const uint8_t* p)
+		{
+			return p[0];
+		}
+
+		template <>
+		inline uint16_t read_sample16<uint16_t>(const uint8_t* p)
+		{
+			return uint16_t(p[0] << 8 | p[1]);
+		}
+
+		//! converts pixels [first, last) of a reconstructed scanline to rgba
+		//! samples are 8 bit, except for 16 bit images converted with Sample = uint16_t
+		//! sink(index, r, g, b, a) gets called once per pixel
+		template <typename Sample, typename Sink>
+		void convert_pixels(const ImageLayout& layout, const DecoderInfo& info, const uint8_t* scanline, uint32_t first, uint32_t last, Sink&& sink)
+		{
+			const bool		hasKey   = info.transparency.isDefined && !info.transparency.alphas.empty();
+			const uint16_t* key	  = hasKey ? info.transparency.alphas.data() : nullptr;
+			const Sample	opaque   = Sample(layout.bitdepth == 16 ? ~Sample(0) : 255);
+			const Sample	keyAlpha = Sample(0);
+
+			switch (layout.colorType)
+			{
+				case ColorType::GREY:
+					if (layout.bitdepth == 16)
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t* p = scanline + i * 2;
+							const Sample   v = read_sample16<Sample>(p);
+							sink(i, v, v, v, hasKey && uint16_t(p[0] << 8 | p[1]) == key[0] ? keyAlpha : opaque);
+						}
+					}
+					else if (layout.bitdepth == 8)
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const Sample v = scanline[i];
+							sink(i, v, v, v, hasKey && v == key[0] ? keyAlpha : opaque);
+						}
+					}
+					else
+					{
+						const uint8_t scale = uint8_t(255 / ((1u << layout.bitdepth) - 1));
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t s = read_packed_sample(scanline, i, layout.bitdepth);
+							const Sample  v = Sample(s * scale);
+							sink(i, v, v, v, hasKey && s == key[0] ? keyAlpha : opaque);
+						}
+					}
+					break;
+
+				case ColorType::RGB:
+					if (layout.bitdepth == 16)
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t* p	   = scanline + i * 6;
+							const bool	 isKey = hasKey && uint16_t(p[0] << 8 | p[1]) == key[0]
+												 && uint16_t(p[2] << 8 | p[3]) == key[1]
+												 && uint16_t(p[4] << 8 | p[5]) == key[2];
+							sink(i, read_sample16<Sample>(p), read_sample16<Sample>(p + 2), read_sample16<Sample>(p + 4), isKey ? keyAlpha : opaque);
+						}
+					}
+					else
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t* p	   = scanline + i * 3;
+							const bool	 isKey = hasKey && p[0] == key[0] && p[1] == key[1] && p[2] == key[2];
+							sink(i, Sample(p[0]), Sample(p[1]), Sample(p[2]), isKey ? keyAlpha : opaque);
+						}
+					}
+					break;
+
+				case ColorType::PALETTE:
+				{
+					const auto&	colors	 = info.palette.colors;
+					const uint32_t colorCount = uint32_t(colors.size());
+					for (uint32_t i = first; i < last; ++i)
+					{
+						const uint8_t  index = layout.bitdepth == 8 ? scanline[i] : read_packed_sample(scanline, i, layout.bitdepth);
+						const uint32_t color = index < colorCount ? colors[index] : 0x000000FF;
+						sink(i, Sample(uint8_t(color >> 24)), Sample(uint8_t(color >> 16)), Sample(uint8_t(color >> 8)), Sample(uint8_t(color)));
+					}
+					break;
+				}
+
+				case ColorType::GREY_ALPHA:
+					if (layout.bitdepth == 16)
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t* p = scanline + i * 4;
+							const Sample   v = read_sample16<Sample>(p);
+							sink(i, v, v, v, read_sample16<Sample>(p + 2));
+						}
+					}
+					else
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t* p = scanline + i * 2;
+							sink(i, Sample(p[0]), Sample(p[0]), Sample(p[0]), Sample(p[1]));
+						}
+					}
+					break;
+
+				case ColorType::RGBA:
+					if (layout.bitdepth == 16)
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t* p = scanline + i * 8;
+							sink(i, read_sample16<Sample>(p), read_sample16<Sample>(p + 2), read_sample16<Sample>(p + 4), read_sample16<Sample>(p + 6));
+						}
+					}
+					else
+					{
+						for (uint32_t i = first; i < last; ++i)
+						{
+							const uint8_t* p = scanline + i * 4;
+							sink(i, Sample(p[0]), Sample(p[1]), Sample(p[2]), Sample(p[3]));
+						}
+					}
+					break;
+			}
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! box filter downsampling
+		//-- sums are alpha-premultiplied so transparent pixels don't bleed their color
+
+		struct BoxAccumulator
+		{
+			uint32_t					width = 0;
+			std::pmr::vector<uint64_t>* sums;	// r*a, g*a, b*a, a, count per pixel
+
+			void reset(uint32_t accumulatorWidth, uint32_t accumulatorRows)
+			{
+				width = accumulatorWidth;
+				sums->assign(size_t(accumulatorWidth) * accumulatorRows * 5, 0);
+			}
+
+			void add(size_t index, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+			{
+				uint64_t* sum = &(*sums)[index * 5];
+				sum[0] += uint32_t(r) * a;
+				sum[1] += uint32_t(g) * a;
+				sum[2] += uint32_t(b) * a;
+				sum[3] += a;
+				sum[4] += 1;
+			}
+
+			//! writes accumulator row to rgba8 and clears it
+			void flush(uint32_t row, uint8_t* rgba)
+			{
+				uint64_t* sum = &(*sums)[size_t(row) * width * 5];
+				for (uint32_t x = 0; x < width; ++x, sum += 5, rgba += 4)
+				{
+					if (sum[3] == 0)
+					{
+						rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0;
+					}
+					else
+					{
+						rgba[0] = uint8_t((sum[0] + sum[3] / 2) / sum[3]);
+						rgba[1] = uint8_t((sum[1] + sum[3] / 2) / sum[3]);
+						rgba[2] = uint8_t((sum[2] + sum[3] / 2) / sum[3]);
+						rgba[3] = uint8_t((sum[3] + sum[4] / 2) / sum[4]);
+					}
+					std::fill(sum, sum + 5, 0);
+				}
+			}
+		};
+
+		//! same for linear float samples
+		struct LinearBoxAccumulator
+		{
+			uint32_t				  width = 0;
+			std::pmr::vector<double>* sums;	// r*a, g*a, b*a, a, count per pixel
+
+			void reset(uint32_t accumulatorWidth, uint32_t accumulatorRows)
+			{
+				width = accumulatorWidth;
+				sums->assign(size_t(accumulatorWidth) * accumulatorRows * 5, 0.0);
+			}
+
+			void add(size_t index, float r, float g, float b, float a)
+			{
+				double* sum = &(*sums)[index * 5];
+				sum[0] += r * a;
+				sum[1] += g * a;
+				sum[2] += b * a;
+				sum[3] += a;
+				sum[4] += 1.0;
+			}
+
+			//! writes accumulator row to linear rgba and clears it
+			void flush(uint32_t row, float* rgba)
+			{
+				double* sum = &(*sums)[size_t(row) * width * 5];
+				for (uint32_t x = 0; x < width; ++x, sum += 5, rgba += 4)
+				{
+					if (sum[3] <= 0.0)
+					{
+						rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+					}
+					else
+					{
+						rgba[0] = float(sum[0] / sum[3]);
+						rgba[1] = float(sum[1] / sum[3]);
+						rgba[2] = float(sum[2] / sum[3]);
+						rgba[3] = float(sum[3] / sum[4]);
+					}
+					std::fill(sum, sum + 5, 0.0);
+				}
+			}
+		};
+
+		inline BoxAccumulator make_accumulator(uint8_t*, DecoderScratch& scratch)
+		{
+			BoxAccumulator accumulator;
+			accumulator.sums = &scratch.sums;
+			return accumulator;
+		}
+
+		inline LinearBoxAccumulator make_accumulator(float*, DecoderScratch& scratch)
+		{
+			LinearBoxAccumulator accumulator;
+			accumulator.sums = &scratch.linearSums;
+			return accumulator;
+		}
+
+		//! maps region-relative source columns/rows to output columns/rows
+		inline void make_box_map(uint32_t sourceSize, uint32_t targetSize, std::pmr::vector<uint32_t>* map)
+		{
+			map->resize(sourceSize);
+			for (uint32_t i = 0; i < sourceSize; ++i)
+			{
+				(*map)[i] = uint32_t(uint64_t(i) * targetSize / sourceSize);
+			}
+		}
+
+		//! downsamples a rgba image, the target rows are targetStride bytes apart
+		template <typename Channel>
+		void box_filter(const Channel* source, uint32_t sourceWidth, uint32_t sourceHeight, Channel* target, uint32_t targetWidth, uint32_t targetHeight, size_t targetStride, DecoderScratch& scratch)
+		{
+			auto accumulator = make_accumulator(target, scratch);
+			accumulator.reset(targetWidth, 1);
+			make_box_map(sourceWidth, targetWidth, &scratch.columns);
+
+			for (uint32_t y = 0; y < sourceHeight; ++y)
+			{
+				const Channel* p = source + size_t(y) * sourceWidth * 4;
+				for (uint32_t x = 0; x < sourceWidth; ++x, p += 4)
+				{
+					accumulator.add(scratch.columns[x], p[0], p[1], p[2], p[3]);
+				}
+
+				const uint32_t row = uint32_t(uint64_t(y) * targetHeight / sourceHeight);
+				if (y + 1 == sourceHeight || uint32_t(uint64_t(y + 1) * targetHeight / sourceHeight) != row)
+				{
+					accumulator.flush(0, reinterpret_cast<Channel*>(reinterpret_cast<uint8_t*>(target) + size_t(row) * targetStride));
+				}
+			}
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! pixel writers
+		//-- receive converted pixels from decode_imagedata, either row by row (begin_row/store/end_row)
+		//-- or through box filtering (reset_accumulator/add/flush)
+
+		//! rgba8 output
+		struct Rgba8Writer
+		{
+			typedef uint8_t sample_t;
+
+			uint8_t*	   output;
+			size_t		   stride;
+			uint32_t	   width;
+			uint8_t*	   row;
+			size_t		   step;
+			BoxAccumulator accumulator;
+
+			Rgba8Writer(uint8_t* output, size_t stride, uint32_t width, const common::ColorTransform&, DecoderScratch& scratch)
+			  : output(output)
+			  , stride(stride)
+			  , width(width)
+			  , accumulator(make_accumulator(output, scratch))
+			{
+			}
+
+			void begin_row(uint32_t y, uint32_t x, uint32_t xstep)
+			{
+				row  = output + y * stride + size_t(x) * 4;
+				step = size_t(xstep) * 4;
+			}
+
+			void store(uint32_t k, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+			{
+				uint8_t* rgba = row + k * step;
+				rgba[0]		  = r;
+				rgba[1]		  = g;
+				rgba[2]		  = b;
+				rgba[3]		  = a;
+			}
+
+			void end_row(uint32_t)
+			{
+			}
+
+			void reset_accumulator(uint32_t rows)
+			{
+				accumulator.reset(width, rows);
+			}
+
+			void add(size_t index, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+			{
+				accumulator.add(index, r, g, b, a);
+			}
+
+			void flush(uint32_t slot, uint32_t y)
+			{
+				accumulator.flush(slot, output + y * stride);
+			}
+		};
+
+		inline void write_linear(const float* rgba, size_t count, float* target, size_t step)
+		{
+			for (size_t i = 0; i < count; ++i, rgba += 4, target += step)
+			{
+				memcpy(target, rgba, 4 * sizeof(float));
+			}
+		}
+
+		inline void write_linear(const float* rgba, size_t count, uint16_t* target, size_t step)
+		{
+			if (step == 4)
+			{
+				common::float_to_half(rgba, target, count * 4);
+				return;
+			}
+
+			for (size_t i = 0; i < count; ++i, rgba += 4, target += step)
+			{
+				common::float_to_half(rgba, target, 4);
+			}
+		}
+
+		//! linear fp32 (Channel = float) or fp16 (Channel = uint16_t) output
+		//! samples go through the transfer LUT right away, the chromaticity matrix is applied per row,
+		//! or after box filtering as it commutes with averaging
+		template <typename Channel>
+		struct LinearWriter
+		{
+			typedef uint16_t sample_t;
+
+			const common::ColorTransform& transform;
+			uint8_t*					  output;
+			size_t						  stride;
+			uint32_t					  width;
+			Channel*					  row;
+			size_t						  step;
+			std::pmr::vector<float>&	  rowbuffer;
+			LinearBoxAccumulator		  accumulator;
+
+			LinearWriter(uint8_t* output, size_t stride, uint32_t width, const common::ColorTransform& transform, DecoderScratch& scratch)
+			  : transform(transform)
+			  , output(output)
+			  , stride(stride)
+			  , width(width)
+			  , rowbuffer(scratch.rowbuffer)
+			{
+				accumulator.sums = &scratch.linearSums;
+				rowbuffer.resize(size_t(width) * 4);
+			}
+
+			void begin_row(uint32_t y, uint32_t x, uint32_t xstep)
+			{
+				row  = reinterpret_cast<Channel*>(output + y * stride) + size_t(x) * 4;
+				step = size_t(xstep) * 4;
+			}
+
+			void store(uint32_t k, uint16_t r, uint16_t g, uint16_t b, uint16_t a)
+			{
+				const float* lut  = transform.lut.data();
+				float*		 rgba = &rowbuffer[size_t(k) * 4];
+				rgba[0]			  = lut[r];
+				rgba[1]			  = lut[g];
+				rgba[2]			  = lut[b];
+				rgba[3]			  = a * transform.alphaScale;
+			}
+
+			void end_row(uint32_t count)
+			{
+				common::apply_colortransform_matrix(transform, rowbuffer.data(), count);
+				write_linear(rowbuffer.data(), count, row, step);
+			}
+
+			void reset_accumulator(uint32_t rows)
+			{
+				accumulator.reset(width, rows);
+			}
+
+			void add(size_t index, uint16_t r, uint16_t g, uint16_t b, uint16_t a)
+			{
+				const float* lut = transform.lut.data();
+				accumulator.add(index, lut[r], lut[g], lut[b], a * transform.alphaScale);
+			}
+
+			void flush(uint32_t slot, uint32_t y)
+			{
+				accumulator.flush(slot, rowbuffer.data());
+				common::apply_colortransform_matrix(transform, rowbuffer.data(), width);
+				write_linear(rowbuffer.data(), width, reinterpret_cast<Channel*>(output + y * stride), 4);
+			}
+		};
+
+		//! writer type by output channel type
+		template <typename Channel>
+		struct WriterFor
+		{
+			typedef LinearWriter<Channel> type;
+		};
+
+		template <>
+		struct WriterFor<uint8_t>
+		{
+			typedef Rgba8Writer type;
+		};
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! image data decoding
+
+		struct Pass
+		{
+			uint32_t x;
+			uint32_t y;
+			uint32_t xstep;
+			uint32_t ystep;
+		};
+
+		static const Pass adam7_passes[7] = {
+		  {0, 0, 8, 8},
+		  {4, 0, 8, 8},
+		  {0, 4, 4, 8},
+		  {2, 0, 4, 4},
+		  {0, 2, 2, 4},
+		  {1, 0, 2, 2},
+		  {0, 1, 1, 2},
+		};
+		static const Pass single_pass = {0, 0, 1, 1};
+
+		//! number of Adam7 passes needed for a given decimation factor
+		//! passes 1, 1-3 and 1-5 give a full 8x8, 4x4 and 2x2 sampling grid
+		inline uint32_t adam7_pass_count(uint32_t decimation)
+		{
+			if (decimation >= 8)
+			{
+				return 1;
+			}
+			else if (decimation >= 4)
+			{
+				return 3;
+			}
+			else if (decimation >= 2)
+			{
+				return 5;
+			}
+			return 7;
+		}
+
+		inline uint32_t pass_size(uint32_t size, uint32_t start, uint32_t step)
+		{
+			return size > start ? (size - start + step - 1) / step : 0;
+		}
+
+		//! first pass pixel index at or after image coordinate pos
+		inline uint32_t pass_index(uint32_t pos, uint32_t start, uint32_t step)
+		{
+			return pos > start ? (pos - start + step - 1) / step : 0;
+		}
+
+		//! hands out filter byte + scanline pairs in order, either from the completely inflated image data
+		//! or drained from an inflate stream into two alternating windows, the previous scanline staying
+		//! valid for unfiltering
+		struct ScanlineReader
+		{
+			common::InflateStream*	   stream;	// nullptr: data is the inflated image data
+			std::pmr::vector<uint8_t>* data;
+			size_t					   offset;
+			size_t					   windowSize;	// streaming: largest filter byte + scanline
+			bool					   isSecondWindow;
+
+			//! returns the next size bytes, nullptr if the image data is corrupt or too short
+			uint8_t* next(size_t size)
+			{
+				if (!stream)
+				{
+					if (size > data->size() - offset)
+					{
+						return nullptr;
+					}
+					uint8_t* line = data->data() + offset;
+					offset += size;
+					return line;
+				}
+
+				assert(size <= windowSize);
+				uint8_t* line  = data->data() + (isSecondWindow ? windowSize : 0);
+				isSecondWindow = !isSecondWindow;
+				return stream->read(line, size) ? line : nullptr;
+			}
+
+			//! skips size bytes, e.g. the rest of a pass below the region
+			bool skip(size_t size)
+			{
+				if (!stream)
+				{
+					if (size > data->size() - offset)
+					{
+						return false;
+					}
+					offset += size;
+					return true;
+				}
+
+				while (size > 0)
+				{
+					const size_t part = std::min(size, data->size());
+					if (!stream->read(data->data(), part))
+					{
+						return false;
+					}
+					size -= part;
+				}
+				return true;
+			}
+		};
+
+		//! decodes the image data, only converting the given region
+		//! the writer receives targetWidth x targetHeight pixels
+		template <typename Writer>
+		int decode_imagedata(ScanlineReader&	reader,
+							 const ImageLayout&	layout,
+							 bool					interlaced,
+							 const DecoderInfo&	info,
+							 const Region&		   region,
+							 uint32_t			   targetWidth,
+							 uint32_t			   targetHeight,
+							 Writer&				 writer,
+							 DecoderScratch&		 scratch)
+		{
+			typedef typename Writer::sample_t sample_t;
+			assert(region.width > 0 && region.height > 0);
+			assert(targetWidth <= region.width && targetHeight <= region.height);
+
+			const bool	 isScaled   = targetWidth != region.width || targetHeight != region.height;
+			const uint32_t decimation = std::min(region.width / targetWidth, region.height / targetHeight);
+			const Pass*	passes	 = interlaced ? adam7_passes : &single_pass;
+			const uint32_t passCount  = interlaced ? (isScaled ? adam7_pass_count(decimation) : 7) : 1;
+			const size_t   bytewidth  = std::max<size_t>(1, layout.bitsPerPixel / 8);
+
+			const std::pmr::vector<uint32_t>& columns = scratch.columns;
+			const std::pmr::vector<uint32_t>& rows	   = scratch.rows;
+			if (isScaled)
+			{
+				make_box_map(region.width, targetWidth, &scratch.columns);
+				make_box_map(region.height, targetHeight, &scratch.rows);
+				// non-interlaced images complete output rows in order, interlaced ones only after the last pass
+				writer.reset_accumulator(interlaced ? targetHeight : 1);
+			}
+
+			scratch.zeroes.assign(scanline_size(layout.width, layout.bitsPerPixel), 0);
+
+			// one span per stage for the image, not per scanline. inflate is only timed here when streaming
+			XNG_STAGE_TOTAL(inflateTotal, Inflate);
+			XNG_STAGE_TOTAL(unfilterTotal, Unfilter);
+			XNG_STAGE_TOTAL(conversionTotal, ColorConversion);
+
+			for (uint32_t p = 0; p < passCount; ++p)
+			{
+				const Pass&	pass		 = passes[p];
+				const uint32_t passWidth	= pass_size(layout.width, pass.x, pass.xstep);
+				const uint32_t passHeight   = pass_size(layout.height, pass.y, pass.ystep);
+				const size_t   linesize		= scanline_size(passWidth, layout.bitsPerPixel);
+				const uint32_t first		= std::min(pass_index(region.x, pass.x, pass.xstep), passWidth);
+				const uint32_t last			= std::min(pass_index(region.x + region.width, pass.x, pass.xstep), passWidth);
+				const uint8_t* precon		= scratch.zeroes.data();
+
+				if (passWidth == 0 || passHeight == 0)
+				{
+					continue;
+				}
+
+				for (uint32_t r = 0; r < passHeight; ++r)
+				{
+					const uint32_t y = pass.y + r * pass.ystep;
+					if (y >= region.y + region.height)
+					{
+						// below the region, the rest of the pass is only needed to get to the next one
+						const size_t rest = (linesize + 1) * (passHeight - r);
+						XNG_STAGE_SECTION(inflateTotal, reader.stream && p + 1 < passCount ? rest : 0);
+						if (p + 1 < passCount && !reader.skip(rest))
+						{
+							return -1;
+						}
+						break;
+					}
+
+					uint8_t* scanline = nullptr;
+					{
+						XNG_STAGE_SECTION(inflateTotal, reader.stream ? linesize + 1 : 0);
+						scanline = reader.next(linesize + 1);
+					}
+					if (!scanline)
+					{
+						return -1;
+					}
+
+					uint8_t* recon = scanline + 1;
+					{
+						XNG_STAGE_SECTION(unfilterTotal, linesize);
+						if (common::unfilter_scanline(recon, precon, bytewidth, scanline[0], linesize) != 0)
+						{
+							return -1;
+						}
+					}
+					precon = recon;
+
+					if (y < region.y || first >= last)
+					{
+						// outside the region, only unfiltered for the following scanlines
+						continue;
+					}
+
+					XNG_STAGE_SECTION(conversionTotal, linesize);
+					const uint32_t ry = y - region.y;
+					if (!isScaled)
+					{
+						writer.begin_row(ry, pass.x + first * pass.xstep - region.x, pass.xstep);
+						convert_pixels<sample_t>(layout, info, recon, first, last, [&](uint32_t i, sample_t cr, sample_t cg, sample_t cb, sample_t ca) {
+							writer.store(i - first, cr, cg, cb, ca);
+						});
+						writer.end_row(last - first);
+						continue;
+					}
+
+					const size_t accumulatorRow = interlaced ? size_t(rows[ry]) * targetWidth : 0;
+					convert_pixels<sample_t>(layout, info, recon, first, last, [&](uint32_t i, sample_t cr, sample_t cg, sample_t cb, sample_t ca) {
+						writer.add(accumulatorRow + columns[pass.x + i * pass.xstep - region.x], cr, cg, cb, ca);
+					});
+
+					if (!interlaced && (ry + 1 == region.height || rows[ry + 1] != rows[ry]))
+					{
+						writer.flush(0, rows[ry]);
+					}
+				}
+			}
+
+			if (isScaled && interlaced)
+			{
+				XNG_STAGE_SECTION(conversionTotal, 0);
+				for (uint32_t row = 0; row < targetHeight; ++row)
+				{
+					writer.flush(row, row);
+				}
+			}
+
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! color management
+		//-- iCCP profiles are not evaluated, the sRGB/gAMA/cHRM chunks that writers are
+		//-- advised to add alongside are used instead; untagged images are assumed to be sRGB
+
+		inline bool is_same_chroma(const Chroma& a, const Chroma& b)
+		{
+			return a.isDefined == b.isDefined && a.whitePoint_x == b.whitePoint_x && a.whitePoint_y == b.whitePoint_y
+				   && a.red_x == b.red_x && a.red_y == b.red_y && a.green_x == b.green_x && a.green_y == b.green_y
+				   && a.blue_x == b.blue_x && a.blue_y == b.blue_y;
+		}
+
+		//! returns the transform for the image, built once and kept in scratch while the color chunks don't change
+		inline const common::ColorTransform& get_colortransform(const DecoderInfo& info, DecoderScratch& scratch)
+		{
+			// sub-byte and palette samples are expanded to 8 bit
+			const uint8_t bitdepth = info.colorType == ColorType::PALETTE ? 8 : info.bitdepth;
+			if (scratch.hasTransform && scratch.transformBitdepth == bitdepth
+				&& scratch.transformSRGB.isDefined == info.srgb.isDefined
+				&& scratch.transformGamma.isDefined == info.gamma.isDefined
+				&& (!info.gamma.isDefined || scratch.transformGamma.value == info.gamma.value)
+				&& is_same_chroma(scratch.transformChroma, info.chroma))
+			{
+				return scratch.transform;
+			}
+
+			common::Chromaticities chromaticities;
+			const bool			   hasChromaticities = !info.srgb.isDefined && info.chroma.isDefined;
+			if (hasChromaticities)
+			{
+				chromaticities = {
+				  info.chroma.whitePoint_x / 100000.0f,
+				  info.chroma.whitePoint_y / 100000.0f,
+				  info.chroma.red_x / 100000.0f,
+				  info.chroma.red_y / 100000.0f,
+				  info.chroma.green_x / 100000.0f,
+				  info.chroma.green_y / 100000.0f,
+				  info.chroma.blue_x / 100000.0f,
+				  info.chroma.blue_y / 100000.0f,
+				};
+			}
+
+			if (info.srgb.isDefined || !info.gamma.isDefined || info.gamma.value == 0)
+			{
+				common::build_colortransform(&scratch.transform, bitdepth, common::TransferFunction::SRGB, 0.0f, hasChromaticities ? &chromaticities : nullptr);
+			}
+			else
+			{
+				common::build_colortransform(&scratch.transform, bitdepth, common::TransferFunction::Gamma, info.gamma.value / 100000.0f, hasChromaticities ? &chromaticities : nullptr);
+			}
+
+			scratch.hasTransform	  = true;
+			scratch.transformBitdepth = bitdepth;
+			scratch.transformSRGB	 = info.srgb;
+			scratch.transformGamma	= info.gamma;
+			scratch.transformChroma   = info.chroma;
+			return scratch.transform;
+		}
+
+		inline size_t bytes_per_pixel(PixelFormat format)
+		{
+			switch (format)
+			{
+				case PixelFormat::RGBA8:
+					return 4;
+				case PixelFormat::RGBA32F:
+					return 4 * sizeof(float);
+				case PixelFormat::RGBA16F:
+					return 4 * sizeof(uint16_t);
+			}
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! APNG composition
+
+		inline bool intersect(const Region& a, const Region& b, Region* result)
+		{
+			const uint32_t x0 = std::max(a.x, b.x);
+			const uint32_t y0 = std::max(a.y, b.y);
+			const uint32_t x1 = std::min(a.x + a.width, b.x + b.width);
+			const uint32_t y1 = std::min(a.y + a.height, b.y + b.height);
+			if (x0 >= x1 || y0 >= y1)
+			{
+				return false;
+			}
+
+			*result = {x0, y0, x1 - x0, y1 - y0};
+			return true;
+		}
+
+		//! composes rgba8 source over target (APNG_BLEND_OP_OVER)
+		inline void blend_over(uint8_t* target, const uint8_t* source)
+		{
+			const uint32_t sa = source[3];
+			if (sa == 255)
+			{
+				memcpy(target, source, 4);
+				return;
+			}
+			if (sa == 0)
+			{
+				return;
+			}
+
+			// out_a = sa + da * (1 - sa), out_c = (sc * sa + dc * da * (1 - sa)) / out_a
+			const uint32_t da	= target[3] * (255 - sa) / 255;
+			const uint32_t outa = sa + da;
+			for (int c = 0; c < 3; ++c)
+			{
+				target[c] = uint8_t((source[c] * sa + target[c] * da + outa / 2) / outa);
+			}
+			target[3] = uint8_t(outa);
+		}
+
+		//! same for linear rgba
+		inline void blend_over(float* target, const float* source)
+		{
+			const float sa = source[3];
+			if (sa >= 1.0f)
+			{
+				memcpy(target, source, 4 * sizeof(float));
+				return;
+			}
+			if (sa <= 0.0f)
+			{
+				return;
+			}
+
+			const float da	= target[3] * (1.0f - sa);
+			const float outa = sa + da;
+			for (int c = 0; c < 3; ++c)
+			{
+				target[c] = (source[c] * sa + target[c] * da) / outa;
+			}
+			target[3] = outa;
+		}
+
+		inline float frame_duration(const FrameControl& control)
+		{
+			// a denominator of 0 is to be treated as 100
+			return float(control.delay_num) / float(control.delay_den == 0 ? 100 : control.delay_den);
+		}
+
+		//! copies the composed canvas to the frame in the requested format
+		inline void emit_frame(const std::pmr::vector<uint8_t>& canvas, PixelFormat, Frame* frame)
+		{
+			frame->imagedata.assign(canvas.begin(), canvas.end());
+		}
+
+		inline void emit_frame(const std::pmr::vector<float>& canvas, PixelFormat format, Frame* frame)
+		{
+			frame->imagedata.resize(canvas.size() / 4 * bytes_per_pixel(format));
+			if (format == PixelFormat::RGBA16F)
+			{
+				common::float_to_half(canvas.data(), reinterpret_cast<uint16_t*>(frame->imagedata.data()), canvas.size());
+			}
+			else
+			{
+				memcpy(frame->imagedata.data(), canvas.data(), canvas.size() * sizeof(float));
+			}
+		}
+
+		//! decodes the image data into dst, Channel being uint8_t, float or uint16_t (half)
+		template <typename Channel>
+		int decode_image(ScanlineReader&			   reader,
+						 const ImageLayout&			  layout,
+						 bool						  interlaced,
+						 const DecoderInfo&			  info,
+						 const Region&				  region,
+						 uint32_t					  targetWidth,
+						 uint32_t					  targetHeight,
+						 const common::ColorTransform& transform,
+						 uint8_t*					  dst,
+						 size_t						  stride,
+						 DecoderScratch&			   scratch)
+		{
+			typename WriterFor<Channel>::type writer(dst, stride, targetWidth, transform, scratch);
+			return decode_imagedata(reader, layout, interlaced, info, region, targetWidth, targetHeight, writer, scratch);
+		}
+
+		//! size of the inflated image data
+		inline size_t imagedata_size(const ImageLayout& layout, bool interlaced)
+		{
+			if (!interlaced)
+			{
+				return (scanline_size(layout.width, layout.bitsPerPixel) + 1) * layout.height;
+			}
+
+			size_t size = 0;
+			for (auto& pass : adam7_passes)
+			{
+				const uint32_t passWidth  = pass_size(layout.width, pass.x, pass.xstep);
+				const uint32_t passHeight = pass_size(layout.height, pass.y, pass.ystep);
+				if (passWidth != 0 && passHeight != 0)
+				{
+					size += (scanline_size(passWidth, layout.bitsPerPixel) + 1) * passHeight;
+				}
+			}
+			return size;
+		}
+
+		//! prepares reading the scanlines of the frame data: inflate streams are fed the compressed data
+		//! and drained scanline by scanline, one-shot inflate functions inflate everything into
+		//! scratch.imagedata, sized from IHDR, in place if they support it (the built-in one does)
+		inline int read_imagedata(const ImageFrameData& frameData,
+								  const ImageLayout&	layout,
+								  bool					interlaced,
+								  const DecodeOptions&  options,
+								  DecoderScratch&		scratch,
+								  ScanlineReader*		reader)
+		{
+			*reader = {nullptr, &scratch.imagedata, 0, 0, false};
+			if (!options.inflatestream)
+			{
+				const common::ByteSpan compressed = common::join_spans(frameData.compressedData, &scratch.compressed);
+				common::resize_buffer(&scratch.imagedata, imagedata_size(layout, interlaced));
+				return common::inflate(compressed.data, compressed.size, options.inflatefunc, options.inflatefuncSettings, &scratch.imagedata);
+			}
+
+			if (scratch.stream.reset(options.inflatestream, options.inflatestreamSettings) != 0)
+			{
+				return -1;
+			}
+			for (const common::ByteSpan& span : frameData.compressedData)
+			{
+				if (scratch.stream.feed(span.data, span.size) != 0)
+				{
+					return -1;
+				}
+			}
+
+			// the first pass (or the image) has the widest scanlines
+			reader->stream	 = &scratch.stream;
+			reader->windowSize = scanline_size(layout.width, layout.bitsPerPixel) + 1;
+			common::resize_buffer(&scratch.imagedata, 2 * reader->windowSize);
+			return 0;
+		}
+
+		//! what happens to the canvas once a composed frame was emitted
+		struct FrameDisposal
+		{
+			AnimationFrameDisposeOperation op;
+			bool						   isVisible;
+			Region						   visibleRect;	// part of the frame inside the region
+		};
+
+		//! composes one animation frame onto the region sized canvas, Channel as in compose_frames
+		template <typename Channel>
+		int compose_frame(const DecoderInfo&			 info,
+						  const DecodeOptions&			 options,
+						  const ImageLayout&			 layout,
+						  const Region&					 region,
+						  const ImageFrameData&			 frameData,
+						  bool							 isFirst,
+						  const common::ColorTransform& transform,
+						  DecoderScratch&				 scratch,
+						  std::pmr::vector<Channel>&	 canvas,
+						  std::pmr::vector<Channel>&	 previous,
+						  std::pmr::vector<Channel>&	 subframe,
+						  FrameDisposal*				 disposal)
+		{
+			const FrameControl& control	   = frameData.frameControl;
+			const bool			interlaced = uint8_t(info.interlaceMethod) == 1;
+			const Region		image	   = {0, 0, info.width, info.height};
+			const Region		frameRect  = {control.x_offset, control.y_offset, control.width, control.height};
+			Region				checkRect;
+			if (!intersect(frameRect, image, &checkRect) || checkRect.width != frameRect.width
+				|| checkRect.height != frameRect.height)
+			{
+				return -1;
+			}
+
+			disposal->op = control.dispose_op;
+			if (isFirst && disposal->op == AnimationFrameDisposeOperation::Previous)
+			{
+				disposal->op = AnimationFrameDisposeOperation::Background;
+			}
+
+			const Region& visibleRect = disposal->visibleRect;
+			disposal->isVisible		  = intersect(frameRect, region, &disposal->visibleRect);
+			if (disposal->op == AnimationFrameDisposeOperation::Previous)
+			{
+				previous = canvas;
+			}
+
+			if (!disposal->isVisible)
+			{
+				return 0;
+			}
+
+			const ImageLayout frameLayout = {control.width, control.height, layout.bitdepth, layout.colorType, layout.bitsPerPixel};
+			const Region	  frameRegion = {visibleRect.x - frameRect.x, visibleRect.y - frameRect.y, visibleRect.width, visibleRect.height};
+			const size_t	  frameStride = size_t(visibleRect.width) * 4 * sizeof(Channel);
+
+			ScanlineReader reader;
+			int			   err = read_imagedata(frameData, frameLayout, interlaced, options, scratch, &reader);
+			if (err != 0)
+			{
+				return err;
+			}
+
+			common::resize_buffer(&subframe, size_t(visibleRect.width) * visibleRect.height * 4);
+			err = decode_image<Channel>(reader, frameLayout, interlaced, info, frameRegion, visibleRect.width, visibleRect.height, transform, reinterpret_cast<uint8_t*>(subframe.data()), frameStride, scratch);
+			if (err != 0)
+			{
+				return err;
+			}
+
+			XNG_STAGE(Composition, subframe.size() * sizeof(Channel));
+			for (uint32_t y = 0; y < visibleRect.height; ++y)
+			{
+				const Channel* source = &subframe[size_t(y) * visibleRect.width * 4];
+				Channel*	   target = &canvas[((size_t(visibleRect.y - region.y) + y) * region.width + (visibleRect.x - region.x)) * 4];
+				if (control.blend_op == AnimationFrameBlendOperation::Source)
+				{
+					memcpy(target, source, size_t(visibleRect.width) * 4 * sizeof(Channel));
+				}
+				else
+				{
+					for (uint32_t x = 0; x < visibleRect.width; ++x)
+					{
+						blend_over(target + x * 4, source + x * 4);
+					}
+				}
+			}
+			return 0;
+		}
+
+		//! applies the dispose operation of the emitted frame
+		template <typename Channel>
+		void dispose_frame(const FrameDisposal& disposal, const Region& region, std::pmr::vector<Channel>& canvas, std::pmr::vector<Channel>& previous)
+		{
+			XNG_STAGE(Composition, 0);
+			const Region& visibleRect = disposal.visibleRect;
+			if (disposal.op == AnimationFrameDisposeOperation::Background && disposal.isVisible)
+			{
+				for (uint32_t y = 0; y < visibleRect.height; ++y)
+				{
+					Channel* target = &canvas[((size_t(visibleRect.y - region.y) + y) * region.width + (visibleRect.x - region.x)) * 4];
+					std::fill(target, target + size_t(visibleRect.width) * 4, Channel(0));
+				}
+			}
+			else if (disposal.op == AnimationFrameDisposeOperation::Previous)
+			{
+				canvas.swap(previous);
+			}
+		}
+
+		//! composes the animation frames on a region sized canvas at full resolution,
+		//! downscaling each composed frame. Channel is uint8_t for rgba8, float for linear output
+		template <typename Channel>
+		int compose_frames(const DecoderInfo&			 info,
+						   const DecodeOptions&			 options,
+						   const ImageLayout&			 layout,
+						   const Region&				 region,
+						   uint32_t						 targetWidth,
+						   uint32_t						 targetHeight,
+						   const common::ColorTransform& transform,
+						   DecoderScratch&				 scratch,
+						   Document*					 document)
+		{
+			std::pmr::memory_resource* resource = scratch.imagedata.get_allocator().resource();
+			const bool				   isScaled = targetWidth != region.width || targetHeight != region.height;
+			std::pmr::vector<Channel>  canvas(size_t(region.width) * region.height * 4, Channel(0), resource);
+			std::pmr::vector<Channel>  previous(resource);
+			std::pmr::vector<Channel>  subframe(resource);
+			std::pmr::vector<Channel>  scaled(isScaled ? size_t(targetWidth) * targetHeight * 4 : 0, resource);
+			bool					   isFirst = true;
+			XNG_COUNT_ALLOCATION((canvas.size() + scaled.size()) * sizeof(Channel));
+
+			for (auto& frameData : info.frames)
+			{
+				if (!frameData.frameControl.isDefined)
+				{
+					// default image not part of the animation
+					continue;
+				}
+
+				FrameDisposal disposal;
+				int			  err = compose_frame<Channel>(info, options, layout, region, frameData, isFirst, transform, scratch, canvas, previous, subframe, &disposal);
+				if (err != 0)
+				{
+					return err;
+				}
+				isFirst = false;
+
+				Frame frame;
+				frame.duration = frame_duration(frameData.frameControl);
+				if (isScaled)
+				{
+					XNG_STAGE(Composition, scaled.size() * sizeof(Channel));
+					box_filter(canvas.data(), region.width, region.height, scaled.data(), targetWidth, targetHeight, size_t(targetWidth) * 4 * sizeof(Channel), scratch);
+					emit_frame(scaled, options.format, &frame);
+				}
+				else
+				{
+					XNG_STAGE(Composition, canvas.size() * sizeof(Channel));
+					emit_frame(canvas, options.format, &frame);
+				}
+				XNG_COUNT_ALLOCATION(frame.imagedata.size());
+				document->frames.push_back(std::move(frame));
+
+				dispose_frame(disposal, region, canvas, previous);
+			}
+
+			return document->frames.empty() ? -1 : 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! output size
+
+		//! validates the image and resolves region and output size of the options
+		inline int resolve_output(const DecoderInfo& info, const DecodeOptions& options, ImageLayout* layout, Region* region, uint32_t* targetWidth, uint32_t* targetHeight)
+		{
+			if (info.width == 0 || info.height == 0 || info.frames.empty() || bytes_per_pixel(options.format) == 0)
+			{
+				return -1;
+			}
+
+			*layout = {
+			  info.width,
+			  info.height,
+			  info.bitdepth,
+			  info.colorType,
+			  size_t(channel_count(info.colorType)) * info.bitdepth,
+			};
+			if (layout->bitsPerPixel == 0 || (info.colorType == ColorType::PALETTE && info.palette.colors.empty()))
+			{
+				return -1;
+			}
+
+			// image data too short for the image size is corrupt: rejected before the buffers for the claimed
+			// size are allocated. even interlaced, the image data holds at least the non-interlaced scanlines
+			const size_t maxImagedataSize = common::spans_size(info.frames.front().compressedData) * max_inflate_ratio;
+			if (info.height > maxImagedataSize / (scanline_size(info.width, layout->bitsPerPixel) + 1))
+			{
+				return -1;
+			}
+
+			*region = options.region;
+			if (region->x >= info.width || region->y >= info.height)
+			{
+				return -1;
+			}
+			region->width  = region->width == 0 ? info.width - region->x : std::min(region->width, info.width - region->x);
+			region->height = region->height == 0 ? info.height - region->y : std::min(region->height, info.height - region->y);
+
+			*targetWidth  = options.targetWidth == 0 ? region->width : std::min(options.targetWidth, region->width);
+			*targetHeight = options.targetHeight == 0 ? region->height : std::min(options.targetHeight, region->height);
+			return 0;
+		}
+
+		int get_output_size(const DecoderInfo& info, const DecodeOptions& options, uint32_t* width, uint32_t* height)
+		{
+			ImageLayout layout;
+			Region		region;
+			uint32_t	targetWidth;
+			uint32_t	targetHeight;
+			int			err = resolve_output(info, options, &layout, &region, &targetWidth, &targetHeight);
+			if (err != 0)
+			{
+				return err;
+			}
+
+			if (width)
+			{
+				*width = targetWidth;
+			}
+			if (height)
+			{
+				*height = targetHeight;
+			}
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! decode_into
+
+		int decode_into(const DecoderInfo& info, const DecodeOptions& options, uint8_t* dst, size_t stride, DecoderScratch* scratch)
+		{
+			assert(dst);
+
+			ImageLayout layout;
+			Region		region;
+			uint32_t	targetWidth;
+			uint32_t	targetHeight;
+			int			err = resolve_output(info, options, &layout, &region, &targetWidth, &targetHeight);
+			if (err != 0 || !dst)
+			{
+				return -1;
+			}
+
+			const size_t channelSize = bytes_per_pixel(options.format) / 4;
+			if (stride < targetWidth * bytes_per_pixel(options.format) || stride % channelSize != 0
+				|| reinterpret_cast<uintptr_t>(dst) % channelSize != 0)
+			{
+				return -1;
+			}
+
+			DecoderScratch localScratch;
+			DecoderScratch& buffers	= scratch ? *scratch : localScratch;
+			const bool		interlaced = uint8_t(info.interlaceMethod) == 1;
+
+			// the IDAT image comes first, whether it's part of the animation or not
+			ScanlineReader reader;
+			err = read_imagedata(info.frames.front(), layout, interlaced, options, buffers, &reader);
+			if (err != 0)
+			{
+				return err;
+			}
+
+			switch (options.format)
+			{
+				case PixelFormat::RGBA8:
+				{
+					const common::ColorTransform& transform = buffers.transform;
+					return decode_image<uint8_t>(reader, layout, interlaced, info, region, targetWidth, targetHeight, transform, dst, stride, buffers);
+				}
+				case PixelFormat::RGBA32F:
+				{
+					const common::ColorTransform& transform = get_colortransform(info, buffers);
+					return decode_image<float>(reader, layout, interlaced, info, region, targetWidth, targetHeight, transform, dst, stride, buffers);
+				}
+				case PixelFormat::RGBA16F:
+				{
+					const common::ColorTransform& transform = get_colortransform(info, buffers);
+					return decode_image<uint16_t>(reader, layout, interlaced, info, region, targetWidth, targetHeight, transform, dst, stride, buffers);
+				}
+			}
+
+			return -1;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! decode
+
+		int decode(const DecoderInfo& info, const DecodeOptions& options, Document* document, DecoderScratch* scratch)
+		{
+			assert(document);
+
+			ImageLayout layout;
+			Region		region;
+			uint32_t	targetWidth;
+			uint32_t	targetHeight;
+			int			err = resolve_output(info, options, &layout, &region, &targetWidth, &targetHeight);
+			if (err != 0)
+			{
+				return -1;
+			}
+
+			document->width  = targetWidth;
+			document->height = targetHeight;
+			document->frames.clear();
+
+			DecoderScratch	localScratch;
+			DecoderScratch& buffers = scratch ? *scratch : localScratch;
+
+			// animated: compose first, scale afterwards
+			if (info.animationControl.isDefined)
+			{
+				if (options.format == PixelFormat::RGBA8)
+				{
+					return compose_frames<uint8_t>(info, options, layout, region, targetWidth, targetHeight, buffers.transform, buffers, document);
+				}
+				return compose_frames<float>(info, options, layout, region, targetWidth, targetHeight, get_colortransform(info, buffers), buffers, document);
+			}
+
+			// non-animated: decode straight into the output frame
+			const size_t stride = size_t(targetWidth) * bytes_per_pixel(options.format);
+
+			Frame frame;
+			frame.duration = 0.0f;
+			frame.imagedata.resize(stride * targetHeight);
+			XNG_COUNT_ALLOCATION(frame.imagedata.size());
+			err = decode_into(info, options, frame.imagedata.data(), stride, &buffers);
+			if (err != 0)
+			{
+				return err;
+			}
+
+			document->frames.push_back(std::move(frame));
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! playback
+
+		int open_playback(const DecoderInfo& info, const DecodeOptions& options, Playback* playback)
+		{
+			assert(playback);
+			Playback&	p = *playback;
+			ImageLayout layout;
+			if (resolve_output(info, options, &layout, &p.region, &p.targetWidth, &p.targetHeight) != 0
+				|| options.format != PixelFormat::RGBA8 || !info.animationControl.isDefined)
+			{
+				return -1;
+			}
+
+			p.info				= &info;
+			p.options			= options;
+			p.next				= 0;
+			p.frameIndex		= 0;
+			p.time				= 0.0;
+			p.bytesRead			= 0;
+			p.canvas.assign(size_t(p.region.width) * p.region.height * 4, 0);
+			p.previous.clear();
+			return 0;
+		}
+
+		PlaybackStatus next_frame(Playback* playback, Frame* frame)
+		{
+			assert(playback && frame);
+			const size_t stride = size_t(playback->targetWidth) * 4;
+			common::resize_buffer(&frame->imagedata, stride * playback->targetHeight);
+			return next_frame(playback, frame->imagedata.data(), stride, &frame->duration);
+		}
+
+		PlaybackStatus next_frame(Playback* playback, uint8_t* dst, size_t stride, float* duration)
+		{
+			assert(playback && dst && duration);
+			Playback&		   p	  = *playback;
+			const DecoderInfo& info	  = *p.info;
+
+			// the default image may not be part of the animation
+			while (p.next < info.frames.size() && !info.frames[p.next].frameControl.isDefined)
+			{
+				++p.next;
+			}
+			if (p.next >= info.frames.size())
+			{
+				return PlaybackStatus::End;
+			}
+
+			const ImageFrameData& frameData = info.frames[p.next];
+			ImageLayout			  layout;
+			Region				  region;
+			uint32_t			  targetWidth;
+			uint32_t			  targetHeight;
+			FrameDisposal		  disposal;
+			if (resolve_output(info, p.options, &layout, &region, &targetWidth, &targetHeight) != 0
+				|| compose_frame<uint8_t>(info, p.options, layout, p.region, frameData, p.frameIndex == 0, p.scratch.transform, p.scratch, p.canvas, p.previous, p.subframe, &disposal) != 0)
+			{
+				return PlaybackStatus::Error;
+			}
+
+			*duration = frame_duration(frameData.frameControl);
+			if (p.targetWidth != p.region.width || p.targetHeight != p.region.height)
+			{
+				XNG_STAGE(Composition, size_t(p.targetWidth) * p.targetHeight * 4);
+				box_filter(p.canvas.data(), p.region.width, p.region.height, dst, p.targetWidth, p.targetHeight, stride, p.scratch);
+			}
+			else
+			{
+				XNG_STAGE(Composition, p.canvas.size());
+				const size_t rowSize = size_t(p.region.width) * 4;
+				for (uint32_t y = 0; y < p.region.height; ++y)
+				{
+					memcpy(dst + y * stride, &p.canvas[y * rowSize], rowSize);
+				}
+			}
+			dispose_frame(disposal, p.region, p.canvas, p.previous);
+
+			++p.next;
+			++p.frameIndex;
+			p.time += *duration;
+			p.bytesRead += common::spans_size(frameData.compressedData);
+			return PlaybackStatus::Frame;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! seek index
+
+		static const uint8_t seekindex_signature[4] = {'a', 'S', 'E', 'K'};
+
+		//! identifies the frames and the region, so an index isn't used with another image
+		inline uint32_t fingerprint_of(const Playback& playback)
+		{
+			std::vector<uint8_t> description;
+			common::ByteWriter	 writer{&description};
+			writer.write_uint32(playback.region.x);
+			writer.write_uint32(playback.region.y);
+			writer.write_uint32(playback.region.width);
+			writer.write_uint32(playback.region.height);
+			for (auto& frameData : playback.info->frames)
+			{
+				const FrameControl& control = frameData.frameControl;
+				writer.write_uint64(common::spans_size(frameData.compressedData));
+				writer.write_uint8(control.isDefined);
+				writer.write_uint32(control.width);
+				writer.write_uint32(control.height);
+				writer.write_uint32(control.x_offset);
+				writer.write_uint32(control.y_offset);
+				writer.write_uint16(control.delay_num);
+				writer.write_uint16(control.delay_den);
+				writer.write_uint8(uint8_t(control.dispose_op));
+				writer.write_uint8(uint8_t(control.blend_op));
+			}
+			return compute_crc32(description.data(), description.size());
+		}
+
+		void init_seekindex(const Playback& playback, const common::SeekIndexOptions& options, SeekIndex* index)
+		{
+			common::init_seekindex(options, fingerprint_of(playback), index);
+		}
+
+		inline size_t memory_of(const SeekIndex& index)
+		{
+			size_t usage = 0;
+			for (auto& keyframe : index.keyframes)
+			{
+				usage += keyframe.canvas.size();
+			}
+			return usage;
+		}
+
+		void update_seekindex(SeekIndex* index, const Playback& playback)
+		{
+			assert(index);
+			if (common::is_keyframe_due(*index, playback.frameIndex, playback.time, playback.bytesRead))
+			{
+				Keyframe keyframe{playback.next, playback.frameIndex, playback.time, playback.bytesRead, {}};
+				common::add_keyframe(index, std::move(keyframe), playback.canvas.data(), playback.canvas.size(), memory_of);
+			}
+		}
+
+		int build_seekindex(const DecoderInfo& info, const DecodeOptions& options, const common::SeekIndexOptions& seekOptions, SeekIndex* index)
+		{
+			Playback playback;
+			if (open_playback(info, options, &playback) != 0)
+			{
+				return -1;
+			}
+
+			init_seekindex(playback, seekOptions, index);
+			Frame		   frame;
+			PlaybackStatus status;
+			while ((status = next_frame(&playback, &frame)) == PlaybackStatus::Frame)
+			{
+				update_seekindex(index, playback);
+			}
+			return status == PlaybackStatus::End ? 0 : -1;
+		}
+
+		inline int restart_playback(Playback* playback)
+		{
+			return open_playback(*playback->info, playback->options, playback);
+		}
+
+		inline void restore_keyframe(const Keyframe& keyframe, Playback* playback)
+		{
+			playback->next		 = keyframe.state;
+			playback->frameIndex = keyframe.frameIndex;
+			playback->time		 = keyframe.time;
+			playback->bytesRead	 = keyframe.bytesRead;
+		}
+
+		PlaybackStatus seek(Playback* playback, const SeekIndex& index, double time, Frame* frame)
+		{
+			assert(playback && frame);
+			if (!index.keyframes.empty() && index.fingerprint != fingerprint_of(*playback))
+			{
+				return PlaybackStatus::Error;
+			}
+			return common::seek(playback, index, time, frame, restart_playback, restore_keyframe, next_frame);
+		}
+
+		void write_seekindex(const SeekIndex& index, std::vector<uint8_t>* out)
+		{
+			common::write_seekindex_header(seekindex_signature, index, out);
+			common::ByteWriter writer{out};
+			writer.write_uint64(index.keyframes.size());
+			for (auto& keyframe : index.keyframes)
+			{
+				writer.write_uint64(keyframe.state);
+				writer.write_uint64(keyframe.frameIndex);
+				writer.write_double(keyframe.time);
+				writer.write_uint64(keyframe.bytesRead);
+				writer.write_bytes(keyframe.canvas);
+			}
+		}
+
+		int read_seekindex(const uint8_t* data, size_t size, const Playback& playback, SeekIndex* index)
+		{
+			assert((data || size == 0) && index);
+
+			// parsed into a copy, so index is left as it is on failure
+			SeekIndex		   result;
+			common::ByteReader reader{data, data + size};
+			if (!common::read_seekindex_header(seekindex_signature, fingerprint_of(playback), &reader, &result))
+			{
+				return -1;
+			}
+
+			const uint64_t count = reader.read_uint64();
+			for (uint64_t i = 0; i < count && reader.isValid; ++i)
+			{
+				Keyframe keyframe;
+				keyframe.state		= size_t(reader.read_uint64());
+				keyframe.frameIndex = reader.read_uint64();
+				keyframe.time		= reader.read_double();
+				keyframe.bytesRead	= reader.read_uint64();
+				reader.read_bytes(&keyframe.canvas);
+				if (keyframe.state > playback.info->frames.size()
+					|| (!result.keyframes.empty() && !(keyframe.time >= result.keyframes.back().time)))
+				{
+					return -1;
+				}
+				result.keyframes.push_back(std::move(keyframe));
+			}
+			if (!reader.isValid || reader.data_iter != reader.end)
+			{
+				return -1;
+			}
+			result.memoryUsage = memory_of(result);
+			*index			   = std::move(result);
+			return 0;
+		}
+
+
+		///////////////////////////////////////////////////////////////////////////
+		//! batch decoding
+
+		//! checks the CRCs, in tasks of about taskSize bytes of chunk data if there's more
+		bool check_crcs(const std::vector<chunk_t>& chunks, size_t taskSize, common::ThreadPool* pool)
+		{
+			std::atomic<bool>			 isValid{true};
+			const common::TaskStatsHooks statHooks = common::capture_statshooks();
+			std::mutex					 statsMutex;
+			common::DecodeStats			 stats;	// of all tasks
+			common::TaskGroup			 group;
+			for (size_t first = 0, last; first < chunks.size(); first = last)
+			{
+				size_t size = 0;
+				for (last = first; last < chunks.size() && (last == first || size < taskSize); ++last)
+				{
+					size += chunks[last].data.size();
+				}
+				if (first == 0 && last == chunks.size())
+				{
+					// small file
+					return check_chunks(chunks);
+				}
+
+				pool->submit(&group, [&chunks, &isValid, &statHooks, &statsMutex, &stats, first, last] {
+					common::DecodeStats taskStats;
+					{
+						common::TaskStatsScope scope(statHooks, &taskStats);
+						for (size_t i = first; i < last && isValid.load(std::memory_order_relaxed); ++i)
+						{
+							if (!check_chunk(chunks[i]))
+							{
+								isValid.store(false, std::memory_order_relaxed);
+							}
+						}
+					}
+					std::lock_guard<std::mutex> lock(statsMutex);
+					common::add_stats(&stats, taskStats);
+				});
+			}
+			pool->wait(&group);
+			if (common::StatsScope* scope = common::current_statsscope())
+			{
+				common::add_stats(scope->stats, stats);
+			}
+			return isValid.load();
+		}
+
+		size_t scratch_size(const DecoderScratch& scratch)
+		{
+			return scratch.compressed.capacity() + scratch.imagedata.capacity() + scratch.zeroes.capacity()
+				   + (scratch.columns.capacity() + scratch.rows.capacity()) * sizeof(uint32_t) + scratch.sums.capacity() * sizeof(uint64_t)
+				   + scratch.linearSums.capacity() * sizeof(double) + (scratch.rowbuffer.capacity() + scratch.transform.lut.capacity()) * sizeof(float);
+		}
+
+		std::unique_ptr<DecoderScratch> take_scratch(ScratchCache* cache)
+		{
+			if (cache)
+			{
+				std::lock_guard<std::mutex> lock(cache->mutex);
+				if (!cache->scratches.empty())
+				{
+					std::unique_ptr<DecoderScratch> scratch = std::move(cache->scratches.back());
+					cache->scratches.pop_back();
+					return scratch;
+				}
+			}
+			return std::make_unique<DecoderScratch>();
+		}
+
+		void return_scratch(ScratchCache* cache, std::unique_ptr<DecoderScratch> scratch)
+		{
+			assert(scratch);
+			if (cache && scratch_size(*scratch) <= cache->maxSize)
+			{
+				std::lock_guard<std::mutex> lock(cache->mutex);
+				cache->scratches.push_back(std::move(scratch));
+			}
+		}
+
+		//! decodes a file of a batch on the calling thread
+		void decode_file(common::ByteSpan file, const BatchOptions& options, common::ThreadPool* pool, ScratchCache* cache, BatchResult* result)
+		{
+			result->error = -1;
+			const std::vector<chunk_t> chunks = read_chunks(file.data, file.size);
+			if (chunks.empty() || (options.checkCRC && !check_crcs(chunks, options.crcTaskSize, pool)))
+			{
+				return;
+			}
+
+			DecoderInfo info;
+			if (read_decoderinfo(chunks, &info, options.read) != 0)
+			{
+				return;
+			}
+
+			// taken after the CRC tasks, the files decoded while waiting for them have put theirs back
+			std::unique_ptr<DecoderScratch> scratch = take_scratch(cache);
+			result->error							= decode(info, options.decode, &result->document, scratch.get());
+			return_scratch(cache, std::move(scratch));
+		}
+
+		int decode_many(const std::vector<common::ByteSpan>& files, const BatchOptions& options, common::ThreadPool* pool, std::vector<BatchResult>* results)
+		{
+			assert(pool && results);
+			results->clear();
+			results->resize(files.size());
+
+			ScratchCache				 batchCache;
+			ScratchCache*				 cache	   = options.scratchCache ? options.scratchCache : &batchCache;
+			const common::TaskStatsHooks statHooks = common::capture_statshooks();
+			common::TaskGroup			 group;
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				BatchResult* result = &(*results)[i];
+				pool->submit(&group, [file = files[i], &options, pool, cache, &statHooks, result] {
+					common::TaskStatsScope scope(statHooks, &result->stats);
+					try
+					{
+						decode_file(file, options, pool, cache, result);
+					}
+					catch (...)
+					{
+						// e.g. std::bad_alloc for the image size of a corrupt header
+						result->error = -1;
+					}
+				});
+			}
+			pool->wait(&group);
+			if (common::StatsScope* scope = common::current_statsscope())
+			{
+				for (auto& result : *results)
+				{
+					common::add_stats(scope->stats, result.stats);
+				}
+			}
+
+			return std::all_of(results->begin(), results->end(), [](const BatchResult& result) { return result.error == 0; }) ? 0 : -1;
+		}
+
+		std::future<BatchResult> submit_decode(common::ByteSpan file, const BatchOptions& options, common::ThreadPool* pool, batchcallback_t callback, void* context)
+		{
+			assert(pool);
+			auto					 promise = std::make_shared<std::promise<BatchResult>>();
+			std::future<BatchResult> future	 = promise->get_future();
+			pool->submit([file, options, pool, callback, context, promise, statHooks = common::capture_statshooks()] {
+				try
+				{
+					BatchResult result;
+					{
+						common::TaskStatsScope scope(statHooks, &result.stats);
+						decode_file(file, options, pool, options.scratchCache, &result);
+					}
+					if (callback)
+					{
+						callback(context, result);
+					}
+					promise->set_value(std::move(result));
+				}
+				catch (...)
+				{
+					promise->set_exception(std::current_exception());
+				}
+			});
+			return future;
+		}
+
+		///////////////////////////////////////////////////////////////////////////
+
+	}	// namespace png
+}	// namespace xng
+
+
+///////////////////////////////////////////////////////////////////////////////
+//! C decoding interface
+
+//! memory resource of the decoder buffers, served by the allocator hooks
+struct xng_allocator_resource_t : std::pmr::memory_resource
+{
+	xng_allocator_t allocator;
+
+	explicit xng_allocator_resource_t(const xng_allocator_t& hooks)
+	  : allocator(hooks)
+	{
+	}
+
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		// the hooks align for any type
+		void* memory = alignment <= alignof(std::max_align_t) ? allocator.alloc(allocator.context, std::max<size_t>(bytes, 1)) : nullptr;
+		if (!memory)
+		{
+			throw std::bad_alloc();
+		}
+		return memory;
+	}
+
+	void do_deallocate(void* ptr, size_t, size_t) override
+	{
+		allocator.free(allocator.context, ptr);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+struct xng_png_decoder_t
+{
+	xng_inflate_func_t					inflatefunc;
+	void*								settings;
+	xng_allocator_resource_t			resource;	// before the buffers allocating from it
+	uint32_t							chunkFilter;
+	std::pmr::vector<xng::chunk_t>		chunks;		// copies of the chunks besides the image data, the first chunkCount are the read ones
+	size_t								chunkCount;
+	xng::png::DecoderInfo				info;
+	xng::png::DecoderScratch			scratch;
+	bool								hasInfo;
+	xng::png::Playback					playback;
+	bool								hasPlayback;
+
+	xng_png_decoder_t(const xng_png_decoder_desc_t& desc, const xng_allocator_t& allocator)
+	  : inflatefunc(desc.inflatefunc)
+	  , settings(desc.settings)
+	  , resource(allocator)
+	  , chunkFilter(desc.chunk_filter | XNG_CHUNK_CRITICAL)
+	  , chunks(&resource)
+	  , chunkCount(0)
+	  , info(&resource)
+	  , scratch(&resource)
+	  , hasInfo(false)
+	  , playback(&resource)
+	  , hasPlayback(false)
+	{
+	}
+};
+
+//! state of xng_png_read_info while iterating the chunks
+struct xng_png_chunk_reader_t
+{
+	xng_png_decoder_t*			decoder;
+	xng::png::ReadOptions		options;
+	size_t						count;
+	int							error;
+};
+
+static void* default_alloc(void*, size_t size)
+{
+	return malloc(size);
+}
+
+static void default_free(void*, void* ptr)
+{
+	free(ptr);
+}
+
+//! interpretes the chunk into the decoder info, the chunks besides the image data are copied into
+//! the next slot of the decoder
+static int read_info_chunk(const xng_chunk_t* chunk, void* context)
+{
+	xng_png_chunk_reader_t* reader	= static_cast<xng_png_chunk_reader_t*>(context);
+	xng_png_decoder_t*		decoder = reader->decoder;
+	try
+	{
+		// IHDR must come first
+		if (reader->count++ == 0 && memcmp(chunk->id.type, "IHDR", sizeof(chunk->id.type)) != 0)
+		{
+			reader->error = -1;
+			return reader->error;
+		}
+
+		if (decoder->chunkCount == decoder->chunks.size())
+		{
+			decoder->chunks.push_back({{}, 0, 0, std::pmr::vector<uint8_t>(&decoder->resource)});
+		}
+		reader->error = xng::png::read_decoderinfo_chunk(*chunk, &decoder->info, &decoder->chunks[decoder->chunkCount], reader->options);
+
+		// slots of image data chunks stay unused
+		const bool isImageData = memcmp(chunk->id.type, "IDAT", sizeof(chunk->id.type)) == 0 || memcmp(chunk->id.type, "fdAT", sizeof(chunk->id.type)) == 0;
+		decoder->chunkCount += isImageData ? 0 : 1;
+	}
+	catch (...)
+	{
+		reader->error = -1;
+	}
+	return reader->error;
+}
+
+//! options of the C region and output size
+static inline xng::png::DecodeOptions make_options(const xng_png_decoder_t* decoder, const xng_region_t* region, uint32_t target_width, uint32_t target_height)
+{
+	xng::png::DecodeOptions options;
+	if (region)
+	{
+		options.region = {region->x, region->y, region->width, region->height};
+	}
+	options.targetWidth			= target_width;
+	options.targetHeight		= target_height;
+	options.inflatefunc			= decoder->inflatefunc;
+	options.inflatefuncSettings = decoder->settings;
+	return options;
+}
+
+xng_png_decoder_t* xng_png_create_decoder(xng_inflate_func_t inflatefunc, void* settings)
+{
+	xng_png_decoder_desc_t desc = {inflatefunc, settings, nullptr, XNG_CHUNK_ALL};
+	return xng_png_create_decoder_with(&desc);
+}
+
+xng_png_decoder_t* xng_png_create_decoder_with(const xng_png_decoder_desc_t* desc)
+{
+	assert(desc);
+	const xng_allocator_t allocator = desc->allocator ? *desc->allocator : xng_allocator_t{default_alloc, default_free, nullptr};
+	assert(allocator.alloc && allocator.free);
+
+	void* memory = allocator.alloc(allocator.context, sizeof(xng_png_decoder_t));
+	if (!memory)
+	{
+		return nullptr;
+	}
+
+	try
+	{
+		return new (memory) xng_png_decoder_t(*desc, allocator);
+	}
+	catch (...)
+	{
+		allocator.free(allocator.context, memory);
+		return nullptr;
+	}
+}
+
+void xng_png_destroy_decoder(xng_png_decoder_t* decoder)
+{
+	if (!decoder)
+	{
+		return;
+	}
+
+	const xng_allocator_t allocator = decoder->resource.allocator;
+	decoder->~xng_png_decoder_t();
+	allocator.free(allocator.context, decoder);
+}
+
+int xng_png_read_info(xng_png_decoder_t* decoder, const uint8_t* data, size_t length, uint32_t* width, uint32_t* height)
+{
+	assert(decoder);
+	assert(data || length == 0);
+
+	try
+	{
+		decoder->hasInfo	 = false;
+		decoder->hasPlayback = false;
+		xng::png::reset_decoderinfo(&decoder->info);
+		decoder->chunkCount	 = 0;
+
+		xng_png_chunk_reader_t reader = {decoder, {}, 0, 0};
+		reader.options.readTextualData = (decoder->chunkFilter & XNG_CHUNK_TEXT) != 0;
+		xng_iterate_chunks_filtered(data, length, decoder->chunkFilter, read_info_chunk, &reader);
+		if (reader.error != 0 || reader.count == 0)
+		{
+			return -1;
+		}
+	}
+	catch (...)
+	{
+		return -1;
+	}
+
+	decoder->hasInfo = true;
+	if (width)
+	{
+		*width = decoder->info.width;
+	}
+	if (height)
+	{
+		*height = decoder->info.height;
+	}
+	return 0;
+}
+
+int xng_png_get_output_size(xng_png_decoder_t*	decoder,
+							const xng_region_t* region,
+							uint32_t			target_width,
+							uint32_t			target_height,
+							uint32_t*			width,
+							uint32_t*			height)
+{
+	assert(decoder && width && height);
+	if (!decoder->hasInfo)
+	{
+		return -1;
+	}
+
+	try
+	{
+		return xng::png::get_output_size(decoder->info, make_options(decoder, region, target_width, target_height), width, height);
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+uint32_t xng_png_get_frame_count(xng_png_decoder_t* decoder)
+{
+	assert(decoder);
+	if (!decoder->hasInfo || !decoder->info.animationControl.isDefined)
+	{
+		return 0;
+	}
+	return uint32_t(std::count_if(decoder->info.frames.begin(), decoder->info.frames.end(), [](auto& frameData) {
+		return frameData.frameControl.isDefined;
+	}));
+}
+
+int xng_png_decode_into(xng_png_decoder_t*  decoder,
+						const xng_region_t* region,
+						uint32_t			target_width,
+						uint32_t			target_height,
+						xng_pixel_format_t  format,
+						uint8_t*			dst,
+						size_t				stride)
+{
+	assert(decoder);
+	if (!decoder->hasInfo)
+	{
+		return -1;
+	}
+
+	xng::png::DecodeOptions options = make_options(decoder, region, target_width, target_height);
+	switch (format)
+	{
+		case XNG_PIXEL_FORMAT_RGBA8: options.format = xng::png::PixelFormat::RGBA8; break;
+		case XNG_PIXEL_FORMAT_RGBA32F: options.format = xng::png::PixelFormat::RGBA32F; break;
+		case XNG_PIXEL_FORMAT_RGBA16F: options.format = xng::png::PixelFormat::RGBA16F; break;
+		default: return -1;
+	}
+
+	try
+	{
+		return xng::png::decode_into(decoder->info, options, dst, stride, &decoder->scratch);
+	}
+	catch (...)
+	{
+		// e.g. std::bad_alloc from the allocator hooks
+		return -1;
+	}
+}
+
+int xng_png_open_playback(xng_png_decoder_t* decoder, const xng_region_t* region, uint32_t target_width, uint32_t target_height)
+{
+	assert(decoder);
+	decoder->hasPlayback = false;
+	try
+	{
+		if (!decoder->hasInfo || xng::png::open_playback(decoder->info, make_options(decoder, region, target_width, target_height), &decoder->playback) != 0)
+		{
+			return -1;
+		}
+	}
+	catch (...)
+	{
+		return -1;
+	}
+
+	decoder->hasPlayback = true;
+	return 0;
+}
+
+int xng_png_next_frame(xng_png_decoder_t* decoder, uint8_t* dst, size_t stride, float* duration)
+{
+	assert(decoder);
+	xng::png::Playback& p = decoder->playback;
+	if (!decoder->hasPlayback || !dst || stride < size_t(p.targetWidth) * 4)
+	{
+		return -1;
+	}
+
+	float frameDuration;
+	try
+	{
+		switch (xng::png::next_frame(&p, dst, stride, &frameDuration))
+		{
+			case xng::png::PlaybackStatus::Frame: break;
+			case xng::png::PlaybackStatus::End: return 1;
+			default: return -1;
+		}
+	}
+	catch (...)
+	{
+		// the canvas may be half composed
+		decoder->hasPlayback = false;
+		return -1;
+	}
+
+	if (duration)
+	{
+		*duration = frameDuration;
+	}
+	return 0;
+}
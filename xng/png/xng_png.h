@@ -2,9 +2,16 @@
 #define XNG_PNG_H_INC
 
 #include "xng/xng.h"
+#include "xng/common/xng_color.h"
 #include "xng/common/xng_common.h"
+#include "xng/common/xng_pool.h"
+#include "xng/common/xng_seek.h"
+#include "xng/common/xng_stats.h"
 
 #include <cctype>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -15,6 +22,7 @@ namespace xng
 		//-------------------------------------------------------------------------
 		//! imports
 		using common::_Optional;
+		using common::LazyInflatedData;
 
 		//-------------------------------------------------------------------------
 		//! enums used in intermediate structures
@@ -28,9 +36,26 @@ namespace xng
 			RGBA	   = 6	 // RGB with alpha: 8,16 bit
 		};
 
-		enum class CompressionMethod : uint8_t
+		//! whether the bit depth is allowed for the color type (false for unknown color types)
+		inline bool is_valid_bitdepth(ColorType colorType, uint8_t bitdepth)
 		{
+			switch (colorType)
+			{
+				case ColorType::GREY:
+					return bitdepth == 1 || bitdepth == 2 || bitdepth == 4 || bitdepth == 8 || bitdepth == 16;
+				case ColorType::PALETTE:
+					return bitdepth == 1 || bitdepth == 2 || bitdepth == 4 || bitdepth == 8;
+				case ColorType::RGB:
+				case ColorType::GREY_ALPHA:
+				case ColorType::RGBA:
+					return bitdepth == 8 || bitdepth == 16;
+			}
+			return false;
+		}
 
+		enum class CompressionMethod : uint8_t
+		{
+			Deflate = 0,	// zlib stream, the only method defined
 		};
 
 		enum class FilterMethod : uint8_t
@@ -71,12 +96,22 @@ namespace xng
 		{
 			// RGB0: alpha is set to 0xFF when first reading PLTE chunk
 			// for RGBA: requires OR-ing with Transparency.alphas
-			std::vector<uint32_t> colors;
+			std::pmr::vector<uint32_t> colors;
+
+			explicit Palette(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : colors(resource)
+			{
+			}
 		};
 
 		struct Transparency : _Optional
 		{
-			std::vector<uint16_t> alphas;
+			std::pmr::vector<uint16_t> alphas;
+
+			explicit Transparency(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : alphas(resource)
+			{
+			}
 		};
 
 		struct Gamma : _Optional
@@ -104,21 +139,36 @@ namespace xng
 		struct ICCProfile : _Optional
 		{
 			char				 name[80];	// 79 + '0'
-			CompressionMethod	compressionMethod;
-			std::vector<uint8_t> profile;	// compressed
+			CompressionMethod compressionMethod;
+			LazyInflatedData  profile;	// view into the chunk data, see get_profile
+
+			explicit ICCProfile(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : profile(resource)
+			{
+			}
 		};
 
 		struct TextualData : _Optional
 		{
-			char		keyword[80];	// 79 + '0'
-			std::string text;
+			char			 keyword[80];	// 79 + '0'
+			std::pmr::string text;
+
+			explicit TextualData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : text(resource)
+			{
+			}
 		};
 
 		struct CompressedTextualData : _Optional
 		{
 			char				 keyword[80];	// 79 + '0'
-			CompressionMethod	compressionMethod;
-			std::vector<uint8_t> compressedText;
+			CompressionMethod compressionMethod;
+			LazyInflatedData  compressedText;	// view into the chunk data, see get_text
+
+			explicit CompressedTextualData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : compressedText(resource)
+			{
+			}
 		};
 
 		struct InternationalTextualData : _Optional
@@ -126,18 +176,31 @@ namespace xng
 			char			  keyword[80];	// 79 + '0'
 			uint8_t			  isCompressed;
 			CompressionMethod compressionMethod;
-			std::string		  language;
+			std::pmr::string  language;
 
-			std::string translatedKeyword;
+			std::pmr::string translatedKeyword;
 
-			// text set depending on isCompressed
-			std::vector<uint8_t> compressedText;
-			std::string			 text;
+			// text set depending on isCompressed, see get_text
+			LazyInflatedData compressedText;	// view into the chunk data
+			std::pmr::string text;
+
+			explicit InternationalTextualData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : language(resource)
+			  , translatedKeyword(resource)
+			  , compressedText(resource)
+			  , text(resource)
+			{
+			}
 		};
 
 		struct BackgroundColor : _Optional
 		{
-			std::vector<uint16_t> values;
+			std::pmr::vector<uint16_t> values;
+
+			explicit BackgroundColor(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : values(resource)
+			{
+			}
 		};
 
 		struct PhysicalDimensions : _Optional
@@ -149,7 +212,12 @@ namespace xng
 
 		struct SignificantBits : _Optional
 		{
-			std::vector<uint8_t> depths;
+			std::pmr::vector<uint8_t> depths;
+
+			explicit SignificantBits(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : depths(resource)
+			{
+			}
 		};
 
 		struct SuggestedPaletteEntry
@@ -163,20 +231,30 @@ namespace xng
 
 		struct SuggestedPalette : _Optional
 		{
-			char							   name[80];
-			uint8_t							   sampleDepth;
-			std::vector<SuggestedPaletteEntry> entries;
+			char									name[80];
+			uint8_t									sampleDepth;
+			std::pmr::vector<SuggestedPaletteEntry> entries;
+
+			explicit SuggestedPalette(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : entries(resource)
+			{
+			}
 		};
 
 		struct HistogramEntry
 		{
-			uint8_t colorIndex;
-			uint8_t frequency;
+			uint8_t  colorIndex;
+			uint16_t frequency;
 		};
 
 		struct PaletteHistogram : _Optional
 		{
-			std::vector<HistogramEntry> entries;
+			std::pmr::vector<HistogramEntry> entries;
+
+			explicit PaletteHistogram(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : entries(resource)
+			{
+			}
 		};
 
 		struct ModificationTime
@@ -193,10 +271,10 @@ namespace xng
 		struct AnimationControl : _Optional
 		{
 			uint32_t num_frames;
-			unit32_t num_loops;
+			uint32_t num_loops;
 		};
 
-		struct FrameControl	// mandatory for fdAT
+		struct FrameControl : _Optional	// mandatory for fdAT
 		{
 			uint32_t			  sequence_number;	// Sequence number of the animation chunk, starting from 0
 			uint32_t			  width;			  // Width of the following frame
@@ -212,7 +290,15 @@ namespace xng
 		struct ImageFrameData
 		{
 			uint32_t			 sequence_number;	// not used for single images
-			std::vector<uint8_t> imagedata;			 // uncompressed imagedata
+			FrameControl		 frameControl;		 // fcTL preceding the data, undefined for non-animated IDAT
+			std::pmr::vector<common::ByteSpan> compressedData;	// IDAT/fdAT payloads, views into the chunk data
+			std::pmr::vector<uint8_t>		   imagedata;		// uncompressed imagedata
+
+			explicit ImageFrameData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : compressedData(resource)
+			  , imagedata(resource)
+			{
+			}
 		};
 
 		//-------------------------------------------------------------------------
@@ -248,13 +334,13 @@ namespace xng
 			ICCProfile iccProfile;
 
 			// tEXt
-			std::vector<TextualData> texts;
+			std::pmr::vector<TextualData> texts;
 
 			// zTXt
-			std::vector<CompressedTextualData> compressedTexts;
+			std::pmr::vector<CompressedTextualData> compressedTexts;
 
 			// iTXt
-			std::vector<InternationalTextualData> internationalTexts;
+			std::pmr::vector<InternationalTextualData> internationalTexts;
 
 			// bKGD
 			BackgroundColor backgroundColor;
@@ -262,11 +348,14 @@ namespace xng
 			// pHYS
 			PhysicalDimensions physicalDimensions;
 
+			// sBIT
+			SignificantBits significantBits;
+
 			// sPLT
-			std::vector<SuggestedPalette> suggestedPalettes;
+			std::pmr::vector<SuggestedPalette> suggestedPalettes;
 
 			// hIST
-			Histogram histogram;
+			PaletteHistogram histogram;
 
 			// tIME
 			ModificationTime lastModificationTime;
@@ -275,7 +364,36 @@ namespace xng
 			AnimationControl animationControl;
 
 			// IDAT and fdAT
-			std::vector<ImageFrameData> frames;
+			std::pmr::vector<ImageFrameData> frames;
+
+			//! the containers, and the elements added while reading chunks, allocate from the resource
+			explicit DecoderInfo(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : width(0)
+			  , height(0)
+			  , bitdepth(0)
+			  , colorType()
+			  , compressionMethod()
+			  , filterMethod()
+			  , interlaceMethod()
+			  , palette(resource)
+			  , transparency(resource)
+			  , gamma()
+			  , chroma()
+			  , srgb()
+			  , iccProfile(resource)
+			  , texts(resource)
+			  , compressedTexts(resource)
+			  , internationalTexts(resource)
+			  , backgroundColor(resource)
+			  , physicalDimensions()
+			  , significantBits(resource)
+			  , suggestedPalettes(resource)
+			  , histogram(resource)
+			  , lastModificationTime()
+			  , animationControl()
+			  , frames(resource)
+			{
+			}
 		};
 
 		//-------------------------------------------------------------------------
@@ -284,7 +402,7 @@ namespace xng
 		struct Frame
 		{
 			float				 duration;	 // seconds
-			std::vector<uint8_t> imagedata;	// rgba image data, i.e. interpreted
+			std::vector<uint8_t> imagedata;	// rgba image data, i.e. interpreted. see PixelFormat
 		};
 
 		struct Document
@@ -296,6 +414,349 @@ namespace xng
 			std::vector<Frame> frames;
 		};
 
+		//-------------------------------------------------------------------------
+		//! decoding
+
+		struct Region
+		{
+			uint32_t x;
+			uint32_t y;
+			uint32_t width;		// 0: up to the right border of the image
+			uint32_t height;	// 0: up to the bottom border of the image
+		};
+
+		enum class PixelFormat : uint8_t
+		{
+			RGBA8 = 0,	// 8 bit per channel, as stored
+			RGBA32F,	// linear light float, sRGB primaries, color corrected from gAMA/cHRM/sRGB
+			RGBA16F,	// same as RGBA32F in half floats
+		};
+
+		struct DecodeOptions
+		{
+			// source rectangle to decode, in image pixels. default: whole image
+			Region region = {0, 0, 0, 0};
+
+			// size of the output frames, 0: size of the region
+			// only downscaling is supported (box filter), larger sizes are clamped to the region size
+			uint32_t targetWidth  = 0;
+			uint32_t targetHeight = 0;
+
+			// format of Frame::imagedata
+			PixelFormat format = PixelFormat::RGBA8;
+
+			// zlib stream decompression for IDAT/fdAT. streams decode scanline by scanline, keeping two
+			// scanlines in memory (e.g. common::builtin_inflatestream); one-shot functions inflate the whole
+			// image data first. inflatestream takes precedence, if neither is set the built-in inflate
+			// decodes straight into a buffer of the exact image data size
+			const common::inflatestream_t* inflatestream		 = nullptr;
+			void*						   inflatestreamSettings = nullptr;
+			common::inflatefunc_t		   inflatefunc			 = nullptr;
+			void*						   inflatefuncSettings   = nullptr;
+		};
+
+		struct ReadOptions
+		{
+			// false: tEXt, zTXt and iTXt chunks are skipped entirely
+			bool readTextualData = true;
+		};
+
+		//! read_decoderinfo
+		//! interpretes the chunks into the intermediate container
+		//! image data (IDAT, fdAT) and compressed payloads (zTXt, iTXt, iCCP) are kept as views into
+		//! the chunk data, so the chunks must outlive the decoder info
+		//! param[in] chunks: chunks as read by xng::read_chunks
+		//! param[out] info: decoder info to fill
+		//! param[in] options: chunks to skip
+		//! returns 0 on success
+		int read_decoderinfo(const std::vector<chunk_t>& chunks, DecoderInfo* info, const ReadOptions& options = ReadOptions());
+
+		//! read_decoderinfo
+		//! same for count chunks starting at chunks, e.g. an image embedded in a MNG
+		int read_decoderinfo(const chunk_t* chunks, size_t count, DecoderInfo* info, const ReadOptions& options = ReadOptions());
+
+		//! read_decoderinfo_chunk
+		//! interpretes one chunk in caller memory (e.g. passed by xng_iterate_chunks), for reading the chunks
+		//! one at a time. the image data (IDAT, fdAT) is kept as a view into the caller's data; other chunks
+		//! are copied into copy first, so copy must outlive the decoder info as well if it holds zTXt, iTXt
+		//! or iCCP. IHDR must be the first chunk read
+		//! param[in] chunk: the chunk
+		//! param[out] info: decoder info to fill
+		//! param[out] copy: receives the chunk unless it's image data, its buffer and memory resource are reused
+		//! param[in] options: chunks to skip
+		//! returns 0 on success
+		int read_decoderinfo_chunk(const xng_chunk_t& chunk, DecoderInfo* info, chunk_t* copy, const ReadOptions& options = ReadOptions());
+
+		//! reset_decoderinfo
+		//! returns the decoder info to its constructed state for reading another image, the containers
+		//! are cleared and keep their capacity and memory resource
+		void reset_decoderinfo(DecoderInfo* info);
+
+		//! largest text and ICC profile get_text and get_profile inflate by default
+		static const size_t max_inflated_chunk_size = size_t(16) << 20;
+
+		//! get_text
+		//! reads the text of a zTXt/iTXt chunk, inflating it on first success (see common::inflate)
+		//! param[in] text: the chunk as read by read_decoderinfo
+		//! param[in] inflatefunc: inflate function (e.g. wrapping zlib), nullptr for the built-in one
+		//! param[in] settings: settings for inflate function
+		//! param[out] out: receives the text
+		//! param[in] maxSize: largest inflated text accepted
+		//! returns 0 on success, -1 for an unknown compression method, corrupt data or a text over maxSize
+		int get_text(const CompressedTextualData& text, common::inflatefunc_t inflatefunc, void* settings, std::string* out, size_t maxSize = max_inflated_chunk_size);
+		int get_text(const InternationalTextualData& text, common::inflatefunc_t inflatefunc, void* settings, std::string* out, size_t maxSize = max_inflated_chunk_size);
+
+		//! get_profile
+		//! returns the ICC profile of the iCCP chunk, inflating it on first success (see common::inflate)
+		//! returns nullptr for an unknown compression method, corrupt data or a profile over maxSize
+		const std::pmr::vector<uint8_t>* get_profile(const ICCProfile& profile, common::inflatefunc_t inflatefunc, void* settings, size_t maxSize = max_inflated_chunk_size);
+
+		//! reusable decoding buffers
+		//! keep one per thread, repeated decodes of same-sized images then don't allocate. the buffers
+		//! come from the memory resource (e.g. the allocator of the C interface)
+		struct DecoderScratch
+		{
+			std::pmr::vector<uint8_t>  compressed;	// image data of several chunks, joined for one-shot inflate functions
+			std::pmr::vector<uint8_t>  imagedata;	// inflated image data, or the scanline windows when streaming
+			std::pmr::vector<uint8_t>  zeroes;		// scanline preceding the first one
+			std::pmr::vector<uint32_t> columns;		// box filter column map
+			std::pmr::vector<uint32_t> rows;		// box filter row map
+			std::pmr::vector<uint64_t> sums;		// box filter sums, rgba8
+			std::pmr::vector<double>   linearSums;	// box filter sums, linear
+			std::pmr::vector<float>	   rowbuffer;	// linear scanline
+			common::InflateStream	   stream;		// kept to reuse its buffers
+
+			// color transform of the last linear decode, rebuilt when the color chunks differ
+			common::ColorTransform transform;
+			bool				   hasTransform = false;
+			uint8_t				   transformBitdepth;
+			SRGB				   transformSRGB;
+			Gamma				   transformGamma;
+			Chroma				   transformChroma;
+
+			explicit DecoderScratch(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : compressed(resource)
+			  , imagedata(resource)
+			  , zeroes(resource)
+			  , columns(resource)
+			  , rows(resource)
+			  , sums(resource)
+			  , linearSums(resource)
+			  , rowbuffer(resource)
+			{
+			}
+		};
+
+		//! decode
+		//! decodes the image data to rgba frames
+		//! rows outside the requested region are unfiltered, but neither converted nor stored;
+		//! downscaling is fused into the color conversion, and interlaced images only decode
+		//! the Adam7 passes needed for the requested scale
+		//! param[in] info: decoder info as filled by read_decoderinfo
+		//! param[in] options: region, output size and inflate function
+		//! param[out] document: decoded document. width/height are the output size
+		//! param[in,out] scratch: reusable buffers, nullptr for temporary ones
+		//! returns 0 on success
+		int decode(const DecoderInfo& info, const DecodeOptions& options, Document* document, DecoderScratch* scratch = nullptr);
+
+		//! decode_into
+		//! decodes the (default) image into caller memory, the same way as decode
+		//! for APNG, this is the IDAT image, i.e. what non-animated decoders display
+		//! param[in] info: decoder info as filled by read_decoderinfo
+		//! param[in] options: region, output size, output format and inflate function
+		//! param[out] dst: output pixels, aligned to the channel size of options.format
+		//! param[in] stride: distance between rows in bytes, aligned to the channel size
+		//! param[in,out] scratch: reusable buffers, nullptr for temporary ones
+		//! returns 0 on success
+		int decode_into(const DecoderInfo& info, const DecodeOptions& options, uint8_t* dst, size_t stride, DecoderScratch* scratch = nullptr);
+
+		//! get_output_size
+		//! resolves the region and output size of options for the image
+		//! returns 0 on success
+		int get_output_size(const DecoderInfo& info, const DecodeOptions& options, uint32_t* width, uint32_t* height);
+
+		//-------------------------------------------------------------------------
+		//! playback
+		//-- APNG frames composed one at a time, instead of all of them at once by decode
+
+		using PlaybackStatus = common::PlaybackStatus;
+
+		struct Playback
+		{
+			const DecoderInfo* info;
+			DecodeOptions	   options;
+			Region			   region;	// resolved from options
+			uint32_t		   targetWidth;
+			uint32_t		   targetHeight;
+
+			size_t	 next;		   // index of the next frame in info->frames
+			uint64_t frameIndex;   // frames produced so far
+			double	 time;		   // start of the next frame, seconds
+			uint64_t bytesRead;	   // compressed image data decoded so far
+
+			std::pmr::vector<uint8_t> canvas;		// rgba8, region sized, the state between frames
+			std::pmr::vector<uint8_t> previous;		// canvas saved for APNG_DISPOSE_OP_PREVIOUS
+			std::pmr::vector<uint8_t> subframe;
+			DecoderScratch			  scratch;
+
+			//! param[in] resource: memory of the buffers
+			explicit Playback(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			  : canvas(resource)
+			  , previous(resource)
+			  , subframe(resource)
+			  , scratch(resource)
+			{
+			}
+		};
+
+		//! open_playback
+		//! prepares composing the frames of an animated PNG
+		//! param[in] info: decoder info as filled by read_decoderinfo, with acTL. must outlive the playback
+		//! param[in] options: region, output size and inflate function. the format must be rgba8
+		//! param[out] playback: playback to initialize
+		//! returns 0 on success
+		int open_playback(const DecoderInfo& info, const DecodeOptions& options, Playback* playback);
+
+		//! next_frame
+		//! composes the next frame
+		//! param[in,out] playback: playback as initialized by open_playback
+		//! param[out] frame: receives the frame, its buffer is reused
+		//! returns PlaybackStatus::Frame if a frame was produced
+		PlaybackStatus next_frame(Playback* playback, Frame* frame);
+
+		//! next_frame
+		//! composes the next frame into caller memory
+		//! param[in,out] playback: playback as initialized by open_playback
+		//! param[out] dst: rgba8 output pixels of the output size
+		//! param[in] stride: distance between rows in bytes
+		//! param[out] duration: receives the duration of the frame in seconds
+		//! returns PlaybackStatus::Frame if a frame was produced
+		PlaybackStatus next_frame(Playback* playback, uint8_t* dst, size_t stride, float* duration);
+
+		//-------------------------------------------------------------------------
+		//! seek index
+		//-- the canvas between two frames is all the state of an APNG, so keyframes are compressed canvases
+
+		// the state of a keyframe is the index of the next frame in info->frames
+		using Keyframe	= common::Keyframe<size_t>;
+		using SeekIndex = common::SeekIndex<size_t>;
+
+		//! init_seekindex
+		//! prepares an empty index for the playback of the image
+		//! param[in] playback: playback as initialized by open_playback
+		//! param[in] options: snapshot intervals and memory limit
+		//! param[out] index: index to initialize
+		void init_seekindex(const Playback& playback, const common::SeekIndexOptions& options, SeekIndex* index);
+
+		//! update_seekindex
+		//! records a keyframe if one is due, to be called after next_frame, e.g. during the first playback
+		//! param[in,out] index: index as initialized by init_seekindex
+		//! param[in] playback: playback the index was initialized for
+		void update_seekindex(SeekIndex* index, const Playback& playback);
+
+		//! build_seekindex
+		//! indexes the whole animation in a pass of its own
+		//! param[in] info: decoder info as filled by read_decoderinfo
+		//! param[in] options: decoding options of the playbacks that will use the index
+		//! param[in] seekOptions: snapshot intervals and memory limit
+		//! param[out] index: the index
+		//! returns 0 on success
+		int build_seekindex(const DecoderInfo& info, const DecodeOptions& options, const common::SeekIndexOptions& seekOptions, SeekIndex* index);
+
+		//! seek
+		//! restores the last keyframe before time and plays up to the frame shown at time
+		//! param[in,out] playback: playback the index was recorded for
+		//! param[in] index: the index, may be empty (seeking then plays from the start)
+		//! param[in] time: seconds from the start
+		//! param[out] frame: receives the frame shown at time
+		//! returns PlaybackStatus::Frame on success, End if time is past the animation or the animation
+		//!  stalls before it (see common::max_stalled_frames)
+		PlaybackStatus seek(Playback* playback, const SeekIndex& index, double time, Frame* frame);
+
+		//! write_seekindex
+		//! serializes the index, to be stored next to the image
+		void write_seekindex(const SeekIndex& index, std::vector<uint8_t>* out);
+
+		//! read_seekindex
+		//! reads a serialized index
+		//! param[in] data, size: serialized index
+		//! param[in] playback: playback the index is going to be used with
+		//! param[out] index: the index
+		//! returns 0 on success, -1 for corrupt data or an index recorded for other frames or another region
+		int read_seekindex(const uint8_t* data, size_t size, const Playback& playback, SeekIndex* index);
+
+		//-------------------------------------------------------------------------
+		//! batch decoding
+		//-- files are decoded as tasks of a common::ThreadPool. the tasks reuse scratch buffers and inflate
+		//-- state through a ScratchCache, taking one per file. the tasks collect stats on behalf of the
+		//-- StatsScope of the submitting thread, if any (see common::TaskStatsScope)
+
+		//! scratch buffers shared by the files of batches: a file takes one while it decodes, a new one if
+		//! all are taken. a scratch left holding more than maxSize bytes is released after the file instead
+		//! of being put back, so one large image doesn't keep its buffers for the files that follow
+		struct ScratchCache
+		{
+			std::mutex									 mutex;
+			std::vector<std::unique_ptr<DecoderScratch>> scratches;	// not taken
+			size_t										 maxSize = size_t(64) << 20;
+		};
+
+		//! returns the bytes the buffers of the scratch hold, not counting the inflate stream state
+		size_t scratch_size(const DecoderScratch& scratch);
+
+		//! takes a scratch of the cache, a new one if there is none left or cache is nullptr
+		std::unique_ptr<DecoderScratch> take_scratch(ScratchCache* cache);
+
+		//! puts a scratch back into the cache, releases it if it holds more than cache->maxSize bytes or
+		//! cache is nullptr
+		void return_scratch(ScratchCache* cache, std::unique_ptr<DecoderScratch> scratch);
+
+		struct BatchOptions
+		{
+			ReadOptions	  read;
+			DecodeOptions decode;
+			bool		  checkCRC = true;
+
+			// chunk data per CRC task: the chunks of larger files are checked in parallel
+			size_t crcTaskSize = size_t(1) << 20;
+
+			// scratch buffers to reuse, e.g. by successive batches. nullptr: decode_many uses a cache of
+			// its own for the batch, submit_decode a scratch per file
+			ScratchCache* scratchCache = nullptr;
+		};
+
+		struct BatchResult
+		{
+			int					error;	// 0 on success
+			Document			document;
+			common::DecodeStats stats;	// of the file, if the submitting thread had a StatsScope
+		};
+
+		//! called on the decoding thread when a file is done
+		typedef void (*batchcallback_t)(void* context, const BatchResult& result);
+
+		//! decode_many
+		//! decodes the files on the pool, the calling thread helps until all are done. the stats of the
+		//! files are added to the StatsScope of the calling thread
+		//! param[in] files: the chunks of the files (after the PNG signature)
+		//! param[in] options: options of all files
+		//! param[in,out] pool: pool to run the decoding on
+		//! param[out] results: one per file, in the order of files
+		//! returns 0 if all files were decoded
+		int decode_many(const std::vector<common::ByteSpan>& files, const BatchOptions& options, common::ThreadPool* pool, std::vector<BatchResult>* results);
+
+		//! submit_decode
+		//! queues the decoding of a file on the pool. spans are forwarded to the hooks of the StatsScope of
+		//! the calling thread, which must outlive the decoding; the counters are left in the result
+		//! param[in] file: the chunks of the file (after the PNG signature), must stay valid until it's decoded
+		//! param[in] options: decoding options
+		//! param[in,out] pool: pool to run the decoding on
+		//! param[in] callback: called with the result before the future is ready, may be nullptr
+		//! param[in] context: passed to callback
+		//! returns the future result. it holds the exception if decoding threw (e.g. std::bad_alloc), the
+		//!  callback isn't called then
+		std::future<BatchResult> submit_decode(common::ByteSpan file, const BatchOptions& options, common::ThreadPool* pool, batchcallback_t callback = nullptr, void* context = nullptr);
+
 	}	// namespace png
 
 	using PNGFrame	= png::Frame;
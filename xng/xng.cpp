@@ -1,8 +1,11 @@
 #include "xng.h"
+#include "xng/common/xng_stats.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <vector>
 
 // cheap endianess swapping
@@ -157,8 +160,12 @@ namespace xng
 
 		chunk.length = read_uint32_t(filedata_iter, &filedata_iter);
 		chunk.id	 = read_chunkid_t(filedata_iter, &filedata_iter);
-		chunk.data   = std::vector<uint8_t>(filedata_iter, filedata_iter + chunk.length);
+		chunk.data.assign(filedata_iter, filedata_iter + chunk.length);
 		filedata_iter += chunk.length;
+		if (chunk.length > 0)
+		{
+			XNG_COUNT_ALLOCATION(chunk.length);
+		}
 
 		chunk.crc = read_uint32_t(filedata_iter, &filedata_iter);
 
@@ -178,11 +185,19 @@ namespace xng
 		const uint8_t*		 filedata_iter = filedata;
 		size_t				 sum_read	  = 0;
 		std::vector<chunk_t> chunks;
+		XNG_STAGE(ChunkParsing, filedata_size);
 		chunks.reserve(filedata_size / (chunkheader_size + sizeof(uint32_t)));
+		XNG_COUNT_ALLOCATION(chunks.capacity() * sizeof(chunk_t));
 
 		// files can have padding (e.g. after IEND). TODO: handle falsely created chunks
-		while (sum_read < filedata_size)
+		while (filedata_size - sum_read >= chunkheader_size + sizeof(uint32_t))
 		{
+			// a truncated chunk ends the data
+			if (read_uint32_t(filedata_iter, nullptr) > filedata_size - sum_read - chunkheader_size - sizeof(uint32_t))
+			{
+				break;
+			}
+
 			auto chunk = read_chunk(filedata_iter, &filedata_iter);
 
 			if (chunk.id.type[0] == 0 && chunk.id.type[1] == 0 && chunk.id.type[2] == 0 && chunk.id.type[3] == 0)
@@ -190,13 +205,106 @@ namespace xng
 				break;
 			}
 
-			sum_read += chunk.length;
+			sum_read += chunkheader_size + chunk.length + sizeof(chunk.crc);
+			XNG_COUNT_CHUNK(chunk.id, chunk.length);
 			chunks.push_back(std::move(chunk));
 		}
 
 		return chunks;
 	}
 
+
+	///////////////////////////////////////////////////////////////////////////
+	//! functions to write to file data (internally handling endianess)
+
+	size_t write_int8_t(int8_t val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		return write_uint8_t(uint8_t(val), filedata, next_filedata);
+	}
+
+	size_t write_uint8_t(uint8_t val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		filedata[0] = val;
+		if (next_filedata)
+		{
+			*next_filedata = filedata + sizeof(val);
+		}
+
+		return sizeof(val);
+	}
+
+	size_t write_int16_t(int16_t val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		return write_uint16_t(uint16_t(val), filedata, next_filedata);
+	}
+
+	size_t write_uint16_t(uint16_t val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		filedata[0] = uint8_t(val >> 8);
+		filedata[1] = uint8_t(val);
+		if (next_filedata)
+		{
+			*next_filedata = filedata + sizeof(val);
+		}
+
+		return sizeof(val);
+	}
+
+	size_t write_int32_t(int32_t val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		return write_uint32_t(uint32_t(val), filedata, next_filedata);
+	}
+
+	size_t write_uint32_t(uint32_t val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		filedata[0] = uint8_t(val >> 24);
+		filedata[1] = uint8_t(val >> 16);
+		filedata[2] = uint8_t(val >> 8);
+		filedata[3] = uint8_t(val);
+		if (next_filedata)
+		{
+			*next_filedata = filedata + sizeof(val);
+		}
+
+		return sizeof(val);
+	}
+
+	size_t write_chunkid_t(const chunkid_t& val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		memcpy(filedata, val.type, sizeof(val.type));
+		if (next_filedata)
+		{
+			*next_filedata = filedata + sizeof(val);
+		}
+
+		return sizeof(val);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	//! write a chunk to filedata
+
+	size_t write_chunk(const chunk_t& val, uint8_t* filedata, uint8_t** next_filedata)
+	{
+		assert(val.data.size() == val.length);
+		uint8_t* filedata_iter = filedata;
+
+		write_uint32_t(val.length, filedata_iter, &filedata_iter);
+		write_chunkid_t(val.id, filedata_iter, &filedata_iter);
+		if (val.length > 0)
+		{
+			memcpy(filedata_iter, val.data.data(), val.length);
+			filedata_iter += val.length;
+		}
+		write_uint32_t(val.crc, filedata_iter, &filedata_iter);
+
+		if (next_filedata)
+		{
+			*next_filedata = filedata_iter;
+		}
+
+		return size_t(filedata_iter - filedata);
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	//! check_chunk
 
@@ -208,8 +316,10 @@ namespace xng
 			return false;
 		}
 
+		XNG_STAGE(CRC, chunk.data.size() + sizeof(uint32_t));
 		std::vector<uint8_t> chunkdata;
 		chunkdata.reserve(chunk.data.size() + sizeof(uint32_t));
+		XNG_COUNT_ALLOCATION(chunkdata.capacity());
 
 		chunkdata.push_back(chunk.id.type[0]);
 		chunkdata.push_back(chunk.id.type[1]);
@@ -271,12 +381,16 @@ namespace xng
 	}
 
 	int handle_chunks(const std::vector<chunk_t>& chunks, const chunkhandlerstate_t& state, void* target)
+	{
+		return handle_chunks(chunks.data(), chunks.size(), state, target);
+	}
+
+	int handle_chunks(const chunk_t* chunks, size_t count, const chunkhandlerstate_t& state, void* target)
 	{
 		int err = 0;
-		for (auto& chunk : chunks)
+		for (size_t i = 0; i < count; ++i)
 		{
-			err = handle_chunk(chunk, state, target);
-			assert(err == 0);
+			err = handle_chunk(chunks[i], state, target);
 			if (err != 0)
 			{
 				return err;
@@ -363,17 +477,59 @@ xng_chunk_t xng_get_next_chunk(const uint8_t* data, const uint8_t** next_data)
 	return chunk;
 }
 
+uint32_t xng_get_chunk_filter(xng_chunkid_t id)
+{
+	static const struct
+	{
+		char	 type[5];
+		uint32_t filter;
+	} groups[] = {
+	  {"acTL", XNG_CHUNK_ANIMATION},	{"fcTL", XNG_CHUNK_ANIMATION}, {"fdAT", XNG_CHUNK_ANIMATION},
+	  {"tRNS", XNG_CHUNK_TRANSPARENCY}, {"gAMA", XNG_CHUNK_COLOR},	   {"cHRM", XNG_CHUNK_COLOR},
+	  {"sRGB", XNG_CHUNK_COLOR},		{"iCCP", XNG_CHUNK_COLOR},	   {"sBIT", XNG_CHUNK_COLOR},
+	  {"tEXt", XNG_CHUNK_TEXT},			{"zTXt", XNG_CHUNK_TEXT},	   {"iTXt", XNG_CHUNK_TEXT},
+	  {"bKGD", XNG_CHUNK_METADATA},		{"pHYs", XNG_CHUNK_METADATA},  {"sPLT", XNG_CHUNK_METADATA},
+	  {"hIST", XNG_CHUNK_METADATA},		{"tIME", XNG_CHUNK_METADATA},
+	};
+
+	for (auto& group : groups)
+	{
+		if (memcmp(id.type, group.type, sizeof(id.type)) == 0)
+		{
+			return group.filter;
+		}
+	}
+
+	// bit 5 of the first byte: ancillary
+	return (id.type[0] & 0x20) ? XNG_CHUNK_OTHER : XNG_CHUNK_CRITICAL;
+}
+
 size_t xng_iterate_chunks(const uint8_t* data, size_t length, xng_chunk_iteration_func_t xng_chunk_iterator, void* context)
+{
+	return xng_iterate_chunks_filtered(data, length, XNG_CHUNK_ALL, xng_chunk_iterator, context);
+}
+
+size_t xng_iterate_chunks_filtered(const uint8_t* data, size_t length, uint32_t filter_mask, xng_chunk_iteration_func_t xng_chunk_iterator, void* context)
 {
 	size_t iter_length = 0;
 	size_t	chunk_count = 0;
 	const uint8_t* data_iter   = data;
+	XNG_STAGE_TOTAL(parsing, ChunkParsing);	// not timing the iterator
 
-	assert(length >= xng_chunkheader_min_size);
-
-	while(iter_length < length)
+	while(length - iter_length >= xng_chunkheader_min_size)
 	{
-		xng_chunk_t chunk = xng_get_next_chunk(data_iter, &data_iter);
+		// a truncated chunk ends the data
+		const uint32_t chunk_length = xng::read_uint32_t(data_iter, nullptr);
+		if (chunk_length > length - iter_length - xng_chunkheader_min_size)
+		{
+			break;
+		}
+
+		xng_chunk_t chunk;
+		{
+			XNG_STAGE_SECTION(parsing, xng_chunkheader_min_size + chunk_length);
+			chunk = xng_get_next_chunk(data_iter, &data_iter);
+		}
 
 		if (chunk.id.type[0] == 0 && chunk.id.type[1] == 0 && chunk.id.type[2] == 0 && chunk.id.type[3] == 0)
 		{
@@ -381,11 +537,16 @@ size_t xng_iterate_chunks(const uint8_t* data, size_t length, xng_chunk_iteratio
 		}
 
 		iter_length += xng_chunkheader_min_size + chunk.length;
+		XNG_COUNT_CHUNK(xng::read_chunkid_t(chunk.data - sizeof(uint32_t), nullptr), chunk.length);
+		if ((xng_get_chunk_filter(chunk.id) & filter_mask) == 0)
+		{
+			continue;
+		}
 		++chunk_count;
 
-		if(xng_chunk_iterator)
+		if(xng_chunk_iterator && xng_chunk_iterator(&chunk, context) != 0)
 		{
-			xng_chunk_iterator(&chunk, context);
+			break;
 		}
 	}
 
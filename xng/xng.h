@@ -1,8 +1,15 @@
 #ifndef XNG_H_INC
 #define XNG_H_INC
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
 #include <cctype>
+#include <memory_resource>
 #include <vector>
+#endif //__cplusplus
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,19 +35,132 @@ typedef struct xng_chunk_t
 	const uint8_t* 		data;
 } xng_chunk_t;
 
+// chunk groups, for filtering the chunks passed on
+typedef enum xng_chunk_filter_t
+{
+	XNG_CHUNK_CRITICAL	   = 1 << 0,	// IHDR, PLTE, IDAT, IEND and other chunks with the critical bit (e.g. MNG's)
+	XNG_CHUNK_ANIMATION	   = 1 << 1,	// acTL, fcTL, fdAT
+	XNG_CHUNK_TRANSPARENCY = 1 << 2,	// tRNS
+	XNG_CHUNK_COLOR		   = 1 << 3,	// gAMA, cHRM, sRGB, iCCP, sBIT
+	XNG_CHUNK_TEXT		   = 1 << 4,	// tEXt, zTXt, iTXt
+	XNG_CHUNK_METADATA	   = 1 << 5,	// bKGD, pHYs, sPLT, hIST, tIME
+	XNG_CHUNK_OTHER		   = 1 << 6,	// all other ancillary chunks
+	XNG_CHUNK_ALL		   = 0x7F
+} xng_chunk_filter_t;
+
+// group of the chunk type, one of xng_chunk_filter_t
+uint32_t xng_get_chunk_filter(xng_chunkid_t id);
+
+// the iterator returns 0 to continue, anything else stops the iteration after the chunk
 typedef int (*xng_chunk_iteration_func_t)(const xng_chunk_t* chunk, void* context);
+
+// passes the chunks of data (after the signature) to the iterator, up to a truncated chunk
+// returns the number of chunks passed, including the one the iterator stopped at
 size_t xng_iterate_chunks(const uint8_t* data, size_t length, xng_chunk_iteration_func_t xng_chunk_iterator, void* context);
+
+// as xng_iterate_chunks, passing only the chunks of the groups in filter_mask (xng_chunk_filter_t flags)
+size_t xng_iterate_chunks_filtered(const uint8_t* data, size_t length, uint32_t filter_mask, xng_chunk_iteration_func_t xng_chunk_iterator, void* context);
+
 xng_chunk_t xng_get_next_chunk(const uint8_t* data, const uint8_t** next_data);
 
+// memory of the C interface objects, e.g. the arena of an embedding runtime
+// alloc returns NULL on failure, the memory is aligned for any type. the functions using it then
+// fail (returning -1 or NULL), no C++ exception leaves the C interface
+typedef struct xng_allocator_t
+{
+	void* (*alloc)(void* context, size_t size);
+	void (*free)(void* context, void* ptr);
+	void* context;
+} xng_allocator_t;
+
 typedef uint32_t (*xng_crc32_computation_func_t)(const uint8_t* data, size_t length);
 bool xng_check_chunk_crc(const xng_chunk_t* chunk, xng_crc32_computation_func_t crc32);
 
+// C decoding interface, implemented by the PNG decoder (xng/png)
+
+typedef enum xng_pixel_format_t
+{
+	XNG_PIXEL_FORMAT_RGBA8 = 0,
+	XNG_PIXEL_FORMAT_RGBA32F,
+	XNG_PIXEL_FORMAT_RGBA16F,
+} xng_pixel_format_t;
+
+typedef struct xng_region_t
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;		// 0: up to the right border of the image
+	uint32_t height;	// 0: up to the bottom border of the image
+} xng_region_t;
+
+// see xng::common::inflatefunc_t
+typedef int (*xng_inflate_func_t)(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, void* settings);
+
+// decoder keeping its buffers between decodes, so decoding similar images doesn't allocate again
+// inflatefunc may be NULL for the built-in inflate
+typedef struct xng_png_decoder_t xng_png_decoder_t;
+
+typedef struct xng_png_decoder_desc_t
+{
+	xng_inflate_func_t	   inflatefunc;	// NULL for the built-in inflate
+	void*				   settings;		// passed to inflatefunc
+	const xng_allocator_t* allocator;		// memory of the decoder object and its image buffers, NULL for malloc/free. copied
+	uint32_t			   chunk_filter;	// xng_chunk_filter_t groups read, critical chunks are always read
+} xng_png_decoder_desc_t;
+
+xng_png_decoder_t* xng_png_create_decoder(xng_inflate_func_t inflatefunc, void* settings);
+// returns NULL if the allocator fails
+xng_png_decoder_t* xng_png_create_decoder_with(const xng_png_decoder_desc_t* desc);
+void xng_png_destroy_decoder(xng_png_decoder_t* decoder);
+
+// reads the chunks of data (after the PNG signature) passing the chunk filter. the image data (IDAT,
+// fdAT) isn't copied, data must stay valid until the next xng_png_read_info or the decoder is destroyed;
+// the other chunks are copied into the decoder, reusing the buffers of the previous image. skipping
+// XNG_CHUNK_ANIMATION decodes the default image of animated PNGs
+// returns 0 on success, width/height (may be NULL) receive the image size
+int xng_png_read_info(xng_png_decoder_t* decoder, const uint8_t* data, size_t length, uint32_t* width, uint32_t* height);
+
+// size of the image decoded for region and target size, as passed to xng_png_decode_into
+// returns 0 on success
+int xng_png_get_output_size(xng_png_decoder_t*	decoder,
+							const xng_region_t* region,
+							uint32_t			target_width,
+							uint32_t			target_height,
+							uint32_t*			width,
+							uint32_t*			height);
+
+// number of frames of the animation, 0 for still images (or if animation chunks were filtered)
+uint32_t xng_png_get_frame_count(xng_png_decoder_t* decoder);
+
+// decodes the image read by xng_png_read_info into dst, rows are stride bytes apart
+// region may be NULL for the whole image, target_width/target_height 0 for the region size
+// dst and stride must be aligned to the channel size
+int xng_png_decode_into(xng_png_decoder_t* decoder,
+						const xng_region_t* region,
+						uint32_t			target_width,
+						uint32_t			target_height,
+						xng_pixel_format_t  format,
+						uint8_t*			dst,
+						size_t				stride);
+
+// starts composing the frames of the animation read by xng_png_read_info, rgba8
+// region and target size as for xng_png_decode_into
+int xng_png_open_playback(xng_png_decoder_t* decoder, const xng_region_t* region, uint32_t target_width, uint32_t target_height);
+
+// composes the next frame into dst, rows are stride bytes apart, duration (may be NULL) receives its
+// duration in seconds
+// returns 0 for a frame, 1 after the last one, -1 on error
+int xng_png_next_frame(xng_png_decoder_t* decoder, uint8_t* dst, size_t stride, float* duration);
+
 
 #ifdef __cplusplus
 }
 #endif //__cplusplus
 
 
+// C++ interface
+
+#ifdef __cplusplus
 namespace xng
 {
 	//-------------------------------------------------------------------------
@@ -57,10 +177,10 @@ namespace xng
 	struct chunk_t
 	{
 		// png/mng/jng: length, type, data, crc
-		chunkid_t			 id;
-		uint32_t			 length;
-		uint32_t			 crc;
-		std::vector<uint8_t> data;	// for C: use uint8_t*
+		chunkid_t				  id;
+		uint32_t				  length;
+		uint32_t				  crc;
+		std::pmr::vector<uint8_t> data;	// for C: use uint8_t*
 	};
 
 	//-------------------------------------------------------------------------
@@ -98,7 +218,7 @@ namespace xng
 	//!  *next_filedata = filedata + chunkheader_size + chunk.length + sizeof(chunk.crc)
 	chunk_t read_chunk(const uint8_t* filedata, const uint8_t** next_filedata);
 
-	//! read all chunks from filedata
+	//! read all chunks from filedata, up to the first truncated one
 	std::vector<chunk_t> read_chunks(const uint8_t* filedata, size_t filedata_size);
 
 	//-------------------------------------------------------------------------
@@ -113,11 +233,12 @@ namespace xng
 	size_t write_int32_t(int32_t val, uint8_t* filedata, uint8_t** next_filedata);
 	size_t write_uint32_t(uint32_t val, uint8_t* filedata, uint8_t** next_filedata);
 
-	//! read a chunkid from filedata
+	//! write a chunkid to filedata
 	//!  *next_filedata = filedata + sizeof(chunkid_t) //the latter being 4 bytes
 	size_t write_chunkid_t(const chunkid_t& val, uint8_t* filedata, uint8_t** next_filedata);
 
-	//! read a chunk from filedata
+	//! write a chunk to filedata, with the crc of the chunk as is. filedata must hold
+	//! chunkheader_size + chunk.length + sizeof(chunk.crc) bytes
 	//!  *next_filedata = filedata + chunkheader_size + chunk.length + sizeof(chunk.crc)
 	size_t write_chunk(const chunk_t& val, uint8_t* filedata, uint8_t** next_filedata);
 
@@ -145,8 +266,10 @@ namespace xng
 
 	int handle_chunk(const chunk_t& chunk, const chunkhandlerstate_t& state, void* target);
 	int handle_chunks(const std::vector<chunk_t>& chunks, const chunkhandlerstate_t& state, void* target);
+	int handle_chunks(const chunk_t* chunks, size_t count, const chunkhandlerstate_t& state, void* target);
 
 	//-------------------------------------------------------------------------
 }	// namespace xng
+#endif //__cplusplus
 
 #endif	// XNG_H_INC
\ No newline at end of file